@@ -39,14 +39,21 @@ if command -v update-desktop-database &> /dev/null; then
 fi
 
 # Optionally remove system rules
-if [ -f "$SYSTEM_RULES" ]; then
+if [ -f "$SYSTEM_RULES" ] || compgen -G "/etc/udev/rules.d/99-udevme-*.rules" > /dev/null; then
     echo ""
-    echo "System rules file found: $SYSTEM_RULES"
+    echo "System rules found in /etc/udev/rules.d"
     read -p "Remove system udev rules? [y/N] " -n 1 -r
     echo
     if [[ $REPLY =~ ^[Yy]$ ]]; then
         sudo rm -f "$SYSTEM_RULES"
         echo "Removed: $SYSTEM_RULES"
+        # Per-rule shards of the sharded layout
+        sudo rm -f /etc/udev/rules.d/99-udevme-*.rules
+        if compgen -G "/etc/udev/hwdb.d/99-udevme*.hwdb" > /dev/null; then
+            sudo rm -f /etc/udev/hwdb.d/99-udevme*.hwdb
+            echo "Removed: udevme hwdb files"
+            sudo systemd-hwdb update
+        fi
         echo "Reloading udev rules..."
         sudo udevadm control --reload-rules
         sudo udevadm trigger
@@ -0,0 +1,226 @@
+#include "AccessProbe.h"
+#include <QFile>
+#include <QtConcurrent>
+#include <QtEndian>
+
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+namespace udevme {
+
+namespace {
+
+// On-disk format of system.posix_acl_access (linux/posix_acl_xattr.h)
+constexpr quint32 kAclXattrVersion = 2;
+constexpr int kAclHeaderSize = 4;
+constexpr int kAclEntrySize = 8;    // u16 tag, u16 perm, u32 id
+
+enum AclTag : quint16 {
+    AclUserObj = 0x01,
+    AclUser = 0x02,
+    AclGroupObj = 0x04,
+    AclGroup = 0x08,
+    AclMask = 0x10,
+    AclOther = 0x20
+};
+
+constexpr uint kRead = 4;
+constexpr uint kWrite = 2;
+
+constexpr char kAclXattr[] = "system.posix_acl_access";
+
+bool inGroups(gid_t gid, const QVector<gid_t>& groups) {
+    return std::find(groups.cbegin(), groups.cend(), gid) != groups.cend();
+}
+
+QVector<gid_t> processGroups() {
+    QVector<gid_t> groups;
+    int n = ::getgroups(0, nullptr);
+    if (n > 0) {
+        groups.resize(n);
+        n = ::getgroups(n, groups.data());
+        groups.resize(qMax(n, 0));
+    }
+    groups.append(::getegid());
+    return groups;
+}
+
+// The ACL xattr as stored, sized first: one with many named entries is
+// far larger than a fixed buffer. Empty if there is none.
+QByteArray readAclXattr(const char* path) {
+    for (;;) {
+        const ssize_t size = ::getxattr(path, kAclXattr, nullptr, 0);
+        if (size <= 0) return QByteArray();
+        QByteArray value(qsizetype(size), Qt::Uninitialized);
+        const ssize_t len = ::getxattr(path, kAclXattr, value.data(), size_t(value.size()));
+        if (len >= 0) {
+            value.truncate(qsizetype(len));
+            return value;
+        }
+        // Grown since it was sized: size it again
+        if (errno != ERANGE) return QByteArray();
+    }
+}
+
+// Plain owner/group/other evaluation for nodes without an ACL
+uint modePermissions(uint mode, uid_t owner, gid_t group) {
+    if (::geteuid() == owner) return (mode >> 6) & 7;
+    if (inGroups(group, processGroups())) return (mode >> 3) & 7;
+    return mode & 7;
+}
+
+} // namespace
+
+uint AccessProbe::aclPermissions(const QByteArray& xattr, uid_t owner, gid_t group, uint requested) {
+    const char* data = xattr.constData();
+    if (xattr.size() < kAclHeaderSize || qFromLittleEndian<quint32>(data) != kAclXattrVersion) {
+        return 0;
+    }
+    const int count = (xattr.size() - kAclHeaderSize) / kAclEntrySize;
+
+    const uid_t uid = ::geteuid();
+    uint userObj = 0;
+    uint other = 0;
+    uint mask = 7;
+    bool hasMask = false;
+    int namedUser = -1;
+    QVector<uint> groupEntries;     // every matching group entry, unmasked
+
+    // One pass collecting what the access check algorithm needs
+    const QVector<gid_t> groups = processGroups();
+    for (int i = 0; i < count; ++i) {
+        const char* entry = data + kAclHeaderSize + i * kAclEntrySize;
+        const quint16 tag = qFromLittleEndian<quint16>(entry);
+        const uint perm = qFromLittleEndian<quint16>(entry + 2) & 7;
+        const quint32 id = qFromLittleEndian<quint32>(entry + 4);
+
+        switch (tag) {
+            case AclUserObj: userObj = perm; break;
+            case AclUser: if (id == uid) namedUser = int(perm); break;
+            case AclGroupObj:
+                if (inGroups(group, groups)) groupEntries.append(perm);
+                break;
+            case AclGroup:
+                if (inGroups(gid_t(id), groups)) groupEntries.append(perm);
+                break;
+            case AclMask: mask = perm; hasMask = true; break;
+            case AclOther: other = perm; break;
+        }
+    }
+
+    // POSIX.1e order: owner, named user, groups, other. Group entries are
+    // not combined: r from one and w from another doesn't open read-write.
+    if (uid == owner) return userObj;
+    const uint groupMask = hasMask ? mask : 7;
+    if (namedUser >= 0) return uint(namedUser) & groupMask;
+    if (!groupEntries.isEmpty()) {
+        uint best = 0;
+        for (uint perm : std::as_const(groupEntries)) {
+            const uint granted = perm & groupMask;
+            if ((granted & requested) == requested) return granted;
+            if (qPopulationCount(granted & requested) > qPopulationCount(best & requested)) best = granted;
+        }
+        return best;
+    }
+    return other;
+}
+
+AccessProbe::Result AccessProbe::probe(const QString& node, bool tryOpen) {
+    Result r;
+    r.node = node;
+
+    const QByteArray path = QFile::encodeName(node);
+    struct stat st;
+    if (::stat(path.constData(), &st) != 0) return r;
+
+    r.exists = true;
+    r.mode = st.st_mode & 07777;
+    r.owner = st.st_uid;
+    r.group = st.st_gid;
+
+    uint perms = 0;
+    if (::geteuid() == 0) {
+        perms = kRead | kWrite;
+    } else {
+        // uaccess grants go through the ACL; a minimal ACL isn't stored
+        const QByteArray acl = readAclXattr(path.constData());
+        if (acl.size() > kAclHeaderSize) {
+            r.hasAcl = true;
+            perms = aclPermissions(acl, r.owner, r.group);
+        } else {
+            perms = modePermissions(r.mode, r.owner, r.group);
+        }
+    }
+    r.readable = perms & kRead;
+    r.writable = perms & kWrite;
+
+    // Only worth confirming when the bits say yes; the open is what a
+    // browser would do, so LSMs and read-only mounts show up here
+    if (tryOpen && r.readable && r.writable) {
+        r.openChecked = true;
+        int fd = ::open(path.constData(), O_RDWR | O_NONBLOCK | O_CLOEXEC | O_NOCTTY);
+        if (fd >= 0) {
+            r.openSucceeded = true;
+            ::close(fd);
+        }
+    }
+
+    return r;
+}
+
+QFuture<AccessProbe::Result> AccessProbe::probeNodes(const QStringList& nodes, bool tryOpen) {
+    // getxattr and open can block on a busy device; don't serialize them,
+    // and keep them off the caller's thread
+    return QtConcurrent::mapped(nodes, [tryOpen](const QString& node) {
+        return probe(node, tryOpen);
+    });
+}
+
+QStringList AccessProbe::unprobedNodes(const QVector<DeviceInfo>& devices) const {
+    QStringList nodes;
+    for (const auto& dev : devices) {
+        for (const QString& node : dev.hidrawNodes) {
+            if (!m_results.contains(node)) nodes.append(node);
+        }
+    }
+    nodes.removeDuplicates();
+    return nodes;
+}
+
+void AccessProbe::addResults(const QList<Result>& results) {
+    for (const Result& r : results) {
+        m_results.insert(r.node, r);
+    }
+}
+
+void AccessProbe::forget(const QVector<DeviceInfo>& devices) {
+    for (const auto& dev : devices) {
+        for (const QString& node : dev.hidrawNodes) {
+            m_results.remove(node);
+        }
+    }
+}
+
+void AccessProbe::clear() {
+    m_results.clear();
+}
+
+const AccessProbe::Result* AccessProbe::result(const QString& node) const {
+    auto it = m_results.constFind(node);
+    return it != m_results.cend() ? &it.value() : nullptr;
+}
+
+bool AccessProbe::isAccessible(const DeviceInfo& device) const {
+    if (device.hidrawNodes.isEmpty()) return false;
+    for (const QString& node : device.hidrawNodes) {
+        const Result* r = result(node);
+        if (!r || !r->accessible()) return false;
+    }
+    return true;
+}
+
+} // namespace udevme
@@ -0,0 +1,69 @@
+#ifndef ACCESSPROBE_H
+#define ACCESSPROBE_H
+
+#include <QFuture>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include "Types.h"
+
+#include <sys/types.h>
+
+namespace udevme {
+
+// Works out whether the current user can already read and write a hidraw
+// node, e.g. through another vendor's rule or a uaccess ACL, so the user
+// isn't asked to apply a rule that changes nothing.
+class AccessProbe {
+public:
+    struct Result {
+        QString node;
+        bool exists = false;
+        uint mode = 0;              // permission bits
+        uid_t owner = 0;
+        gid_t group = 0;
+        bool hasAcl = false;        // extended ACL entries present
+        bool readable = false;      // by mode bits and ACL
+        bool writable = false;
+        bool openChecked = false;   // a non-blocking open was attempted
+        bool openSucceeded = false;
+
+        bool accessible() const {
+            return readable && writable && (!openChecked || openSucceeded);
+        }
+    };
+
+    // Probes one node. With tryOpen, a node that looks accessible is also
+    // opened O_RDWR|O_NONBLOCK to catch anything stat/ACL can't see.
+    static Result probe(const QString& node, bool tryOpen = false);
+
+    // Evaluates a system.posix_acl_access xattr value for the current
+    // process credentials; returns the granted rwx bits (4/2/1). In the
+    // group class one matching entry has to grant all of 'requested'
+    // (rw by default), as the kernel checks it; otherwise the bits of the
+    // entry that grants the most of it.
+    static uint aclPermissions(const QByteArray& xattr, uid_t owner, gid_t group, uint requested = 6);
+
+    // Probes the nodes in parallel on the global thread pool
+    static QFuture<Result> probeNodes(const QStringList& nodes, bool tryOpen = false);
+
+    // Results are kept per node until forgotten, so a hotplug batch only
+    // probes the nodes it added
+    QStringList unprobedNodes(const QVector<DeviceInfo>& devices) const;
+    void addResults(const QList<Result>& results);
+    void forget(const QVector<DeviceInfo>& devices);
+    void clear();
+
+    const Result* result(const QString& node) const;
+
+    // True if the device has hidraw nodes and all of them are accessible
+    bool isAccessible(const DeviceInfo& device) const;
+
+private:
+    QHash<QString, Result> m_results;
+};
+
+} // namespace udevme
+
+#endif // ACCESSPROBE_H
@@ -1,10 +1,13 @@
 #include "AppScanner.h"
+#include "BatchFileReader.h"
+#include "TextScan.h"
 #include <QDir>
 #include <QFile>
-#include <QTextStream>
 #include <QStandardPaths>
 #include <QDebug>
 
+#include <fcntl.h>
+
 namespace udevme {
 
 const QStringList AppScanner::s_browserDesktopIds = {
@@ -49,22 +52,29 @@ QStringList AppScanner::getDesktopDirs() const {
 }
 
 AppInfo AppScanner::parseDesktopFile(const QString& path) {
-    AppInfo app;
     QFile file(path);
     
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        return app;
+    if (!file.open(QIODevice::ReadOnly)) {
+        return AppInfo();
     }
     
-    QFileInfo fi(path);
-    app.desktopId = fi.fileName();
+    QByteArray content = file.readAll();
+    file.close();
+    
+    return parseDesktopEntry(QFileInfo(path).fileName(), content);
+}
+
+AppInfo AppScanner::parseDesktopEntry(const QString& desktopId, const QByteArray& content) const {
+    AppInfo app;
+    app.desktopId = desktopId;
     
-    QTextStream in(&file);
     bool inDesktopEntry = false;
     
-    while (!in.atEnd()) {
-        QString line = in.readLine().trimmed();
-        
+    // Keys are ASCII, so lines are split on the raw bytes and only the
+    // values we keep are decoded
+    qsizetype pos = 0;
+    QByteArrayView line;
+    while (TextScan::nextLine(content, pos, line)) {
         if (line.startsWith('[')) {
             inDesktopEntry = (line == "[Desktop Entry]");
             continue;
@@ -72,28 +82,28 @@ AppInfo AppScanner::parseDesktopFile(const QString& path) {
         
         if (!inDesktopEntry) continue;
         
-        int eq = line.indexOf('=');
+        const qsizetype eq = TextScan::indexOf(line, '=');
         if (eq <= 0) continue;
         
-        QString key = line.left(eq).trimmed();
-        QString value = line.mid(eq + 1).trimmed();
+        const QByteArrayView key = line.first(eq).trimmed();
+        const QByteArrayView rawValue = line.sliced(eq + 1);
+        auto value = [rawValue] { return QString::fromUtf8(rawValue).trimmed(); };
         
         if (key == "Name" && app.name.isEmpty()) {
-            app.name = value;
+            app.name = value();
         } else if (key == "Exec") {
-            app.exec = value;
+            app.exec = value();
         } else if (key == "Icon") {
-            app.icon = value;
+            app.icon = value();
         } else if (key == "GenericName" && app.genericName.isEmpty()) {
-            app.genericName = value;
-        } else if (key == "Type" && value != "Application") {
+            app.genericName = value();
+        } else if (key == "Type" && value() != "Application") {
             return AppInfo(); // Not an application
-        } else if (key == "NoDisplay" && value.toLower() == "true") {
+        } else if (key == "NoDisplay" && value().toLower() == "true") {
             return AppInfo(); // Hidden app
         }
     }
     
-    file.close();
     return app;
 }
 
@@ -103,18 +113,30 @@ QVector<AppInfo> AppScanner::scanApplications() {
     QVector<AppInfo> apps;
     QSet<QString> seenIds;
     
+    // Collect every candidate first so all files are read in one batch
+    QStringList desktopIds;
+    QVector<BatchFileReader::Request> requests;
+    
     for (const QString& dirPath : getDesktopDirs()) {
         QDir dir(dirPath);
         if (!dir.exists()) continue;
         
         for (const QString& entry : dir.entryList({"*.desktop"}, QDir::Files)) {
-            if (seenIds.contains(entry)) continue;
-            
-            AppInfo app = parseDesktopFile(dir.filePath(entry));
-            if (!app.name.isEmpty() && !app.exec.isEmpty()) {
-                apps.append(app);
-                seenIds.insert(entry);
-            }
+            desktopIds << entry;
+            requests.append(BatchFileReader::Request{QFile::encodeName(dir.filePath(entry)), QByteArray(), false});
+        }
+    }
+    
+    BatchFileReader::readAll(AT_FDCWD, requests);
+    
+    // Earlier directories win, as long as their entry is a usable app
+    for (int i = 0; i < requests.size(); ++i) {
+        if (!requests[i].ok || seenIds.contains(desktopIds[i])) continue;
+        
+        AppInfo app = parseDesktopEntry(desktopIds[i], requests[i].data);
+        if (!app.name.isEmpty() && !app.exec.isEmpty()) {
+            apps.append(app);
+            seenIds.insert(desktopIds[i]);
         }
     }
     
@@ -21,6 +21,7 @@ signals:
 
 private:
     AppInfo parseDesktopFile(const QString& path);
+    AppInfo parseDesktopEntry(const QString& desktopId, const QByteArray& content) const;
     QStringList getDesktopDirs() const;
     
     static const QStringList s_browserDesktopIds;
@@ -0,0 +1,88 @@
+#include "Arena.h"
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace udevme {
+
+Arena::Arena(qsizetype blockSize)
+    : m_blockSize(qMax<qsizetype>(blockSize, 256)) {
+}
+
+Arena::~Arena() {
+    clear();
+}
+
+Arena::Arena(Arena&& other) noexcept
+    : m_blocks(std::exchange(other.m_blocks, nullptr)),
+      m_cursor(std::exchange(other.m_cursor, nullptr)),
+      m_end(std::exchange(other.m_end, nullptr)),
+      m_blockSize(other.m_blockSize),
+      m_bytesUsed(std::exchange(other.m_bytesUsed, 0)),
+      m_blockCount(std::exchange(other.m_blockCount, 0)) {
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+    if (this != &other) {
+        clear();
+        m_blocks = std::exchange(other.m_blocks, nullptr);
+        m_cursor = std::exchange(other.m_cursor, nullptr);
+        m_end = std::exchange(other.m_end, nullptr);
+        m_blockSize = other.m_blockSize;
+        m_bytesUsed = std::exchange(other.m_bytesUsed, 0);
+        m_blockCount = std::exchange(other.m_blockCount, 0);
+    }
+    return *this;
+}
+
+void Arena::clear() {
+    Block* block = m_blocks;
+    while (block) {
+        Block* next = block->next;
+        std::free(block);
+        block = next;
+    }
+    m_blocks = nullptr;
+    m_cursor = m_end = nullptr;
+    m_bytesUsed = 0;
+    m_blockCount = 0;
+}
+
+void Arena::addBlock(qsizetype minimum) {
+    // Oversized requests get a block of their own
+    const qsizetype size = qMax(m_blockSize, minimum + qsizetype(alignof(std::max_align_t)));
+    void* memory = std::malloc(sizeof(Block) + size_t(size));
+    Q_CHECK_PTR(memory);
+
+    Block* block = static_cast<Block*>(memory);
+    block->next = m_blocks;
+    m_blocks = block;
+    m_cursor = reinterpret_cast<char*>(block + 1);
+    m_end = m_cursor + size;
+    ++m_blockCount;
+}
+
+void* Arena::allocate(qsizetype size, qsizetype align) {
+    auto aligned = [&] {
+        const quintptr p = reinterpret_cast<quintptr>(m_cursor);
+        return reinterpret_cast<char*>((p + quintptr(align) - 1) & ~(quintptr(align) - 1));
+    };
+
+    char* p = m_cursor ? aligned() : nullptr;
+    if (!p || p + size > m_end) {
+        addBlock(size + align);
+        p = aligned();
+    }
+    m_cursor = p + size;
+    m_bytesUsed += size;
+    return p;
+}
+
+QStringView Arena::copy(QStringView text) {
+    if (text.isEmpty()) return QStringView();
+    QChar* data = allocateArray<QChar>(text.size());
+    std::memcpy(data, text.data(), size_t(text.size()) * sizeof(QChar));
+    return QStringView(data, text.size());
+}
+
+} // namespace udevme
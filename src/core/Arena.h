@@ -0,0 +1,59 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <QStringView>
+#include <cstddef>
+#include <type_traits>
+
+namespace udevme {
+
+// Bump allocator for data that lives and dies together, like the AST of
+// one rules file. Allocations are carved out of large blocks and only
+// released all at once, so only trivially destructible types belong here.
+class Arena {
+public:
+    static constexpr qsizetype DefaultBlockSize = 64 * 1024;
+
+    explicit Arena(qsizetype blockSize = DefaultBlockSize);
+    ~Arena();
+
+    Arena(Arena&& other) noexcept;
+    Arena& operator=(Arena&& other) noexcept;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(qsizetype size, qsizetype align = alignof(std::max_align_t));
+
+    template <typename T>
+    T* allocateArray(qsizetype count) {
+        static_assert(std::is_trivially_destructible_v<T>, "Arena never runs destructors");
+        return static_cast<T*>(allocate(qsizetype(sizeof(T)) * count, alignof(T)));
+    }
+
+    // Copy of text that lives as long as the arena
+    QStringView copy(QStringView text);
+
+    // Frees every block
+    void clear();
+
+    int blockCount() const { return m_blockCount; }
+    qsizetype bytesUsed() const { return m_bytesUsed; }
+
+private:
+    struct Block {
+        Block* next;
+    };
+
+    void addBlock(qsizetype minimum);
+
+    Block* m_blocks = nullptr;
+    char* m_cursor = nullptr;
+    char* m_end = nullptr;
+    qsizetype m_blockSize;
+    qsizetype m_bytesUsed = 0;
+    int m_blockCount = 0;
+};
+
+} // namespace udevme
+
+#endif // ARENA_H
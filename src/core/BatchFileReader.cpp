@@ -0,0 +1,255 @@
+#include "BatchFileReader.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+
+#ifdef UDEVME_HAVE_IO_URING
+#include <liburing.h>
+#endif
+
+namespace udevme {
+
+namespace {
+
+#ifdef UDEVME_HAVE_IO_URING
+// Files per submission round; also the ring size
+constexpr unsigned kQueueDepth = 256;
+
+// Result of a slot whose sqe hasn't completed yet
+constexpr int kPending = INT_MIN;
+
+// User data of the cancel sqe, which has no slot
+constexpr quintptr kCancelTag = ~quintptr(0);
+
+// Submits everything queued and collects `count` completions into
+// results[slot], where slot is the sqe user data.
+bool completeAll(io_uring* ring, int count, QVector<int>& results) {
+    if (count == 0) return true;
+    
+    if (io_uring_submit_and_wait(ring, static_cast<unsigned>(count)) < 0) {
+        return false;
+    }
+    
+    for (int seen = 0; seen < count; ++seen) {
+        io_uring_cqe* cqe = nullptr;
+        if (io_uring_wait_cqe(ring, &cqe) < 0) return false;
+        results[static_cast<int>(reinterpret_cast<quintptr>(io_uring_cqe_get_data(cqe)))] = cqe->res;
+        io_uring_cqe_seen(ring, cqe);
+    }
+    return true;
+}
+
+// After completeAll() failed: cancels whatever is still in flight and
+// reaps until no slot of the first `count` is kPending, so the kernel is
+// done with every fd and buffer before they are closed or freed. False if
+// the ring stopped answering and some may still be in use.
+bool cancelAll(io_uring* ring, int count, QVector<int>& results) {
+    int outstanding = static_cast<int>(std::count(results.cbegin(), results.cbegin() + count, kPending));
+    int cancels = 0;
+#ifdef IORING_ASYNC_CANCEL_ANY
+    // Kernels before 5.19 fail the cancel itself; the requests then run to
+    // completion, which for sysfs and desktop files doesn't take long
+    io_uring_sqe* sqe = io_uring_get_sqe(ring);
+    if (!sqe) {
+        io_uring_submit(ring);
+        sqe = io_uring_get_sqe(ring);
+    }
+    if (sqe) {
+        io_uring_prep_cancel(sqe, nullptr, IORING_ASYNC_CANCEL_ANY);
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(kCancelTag));
+        cancels = 1;
+    }
+#endif
+    
+    while (outstanding > 0 || cancels > 0) {
+        // Anything the failed submit left queued goes in now, or it would never complete
+        if (io_uring_sq_ready(ring) > 0) {
+            const int err = io_uring_submit(ring);
+            if (err < 0 && err != -EINTR && err != -EAGAIN && err != -EBUSY) return false;
+        }
+        io_uring_cqe* cqe = nullptr;
+        const int err = io_uring_wait_cqe(ring, &cqe);
+        if (err == -EINTR || err == -EAGAIN) continue;
+        if (err < 0) return false;
+        
+        const quintptr tag = reinterpret_cast<quintptr>(io_uring_cqe_get_data(cqe));
+        if (tag == kCancelTag) {
+            --cancels;
+        } else if (results[static_cast<int>(tag)] == kPending) {
+            results[static_cast<int>(tag)] = cqe->res;
+            --outstanding;
+        }
+        io_uring_cqe_seen(ring, cqe);
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+bool BatchFileReader::isIoUringAvailable() {
+#ifdef UDEVME_HAVE_IO_URING
+    static const bool available = [] {
+        io_uring_probe* probe = io_uring_get_probe();
+        if (!probe) return false;
+        bool ok = io_uring_opcode_supported(probe, IORING_OP_OPENAT) &&
+                  io_uring_opcode_supported(probe, IORING_OP_READ) &&
+                  io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+        io_uring_free_probe(probe);
+        return ok;
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+void BatchFileReader::readAll(int dirFd, QVector<Request>& requests, qsizetype maxSize, Mode mode) {
+    if (requests.isEmpty()) return;
+    
+    if (mode == Mode::Auto && isIoUringAvailable() &&
+        readAllIoUring(dirFd, requests, maxSize)) {
+        return;
+    }
+    
+    readAllSync(dirFd, requests, maxSize);
+}
+
+void BatchFileReader::readRemainder(int fd, Request& request) {
+    // Positional reads: an io_uring read at offset 0 doesn't move the file position
+    char chunk[16384];
+    for (;;) {
+        ssize_t n = ::pread(fd, chunk, sizeof(chunk), request.data.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        request.data.append(chunk, n);
+    }
+}
+
+void BatchFileReader::readAllSync(int dirFd, QVector<Request>& requests, qsizetype maxSize) {
+    QByteArray scratch(maxSize, Qt::Uninitialized);
+    
+    for (Request& r : requests) {
+        r.ok = false;
+        r.data.clear();
+        
+        int fd = ::openat(dirFd, r.path.constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        
+        ssize_t n = ::read(fd, scratch.data(), scratch.size());
+        if (n >= 0) {
+            r.data = QByteArray(scratch.constData(), n);
+            if (n == scratch.size()) readRemainder(fd, r);
+            r.ok = true;
+        }
+        ::close(fd);
+    }
+}
+
+bool BatchFileReader::readAllIoUring(int dirFd, QVector<Request>& requests, qsizetype maxSize) {
+#ifdef UDEVME_HAVE_IO_URING
+    io_uring ring;
+    if (io_uring_queue_init(kQueueDepth, &ring, 0) < 0) return false;
+    
+    // One read buffer per slot, reused for every round
+    QByteArray slab(qsizetype(kQueueDepth) * maxSize, Qt::Uninitialized);
+    QVector<int> fds(kQueueDepth);
+    QVector<int> results(kQueueDepth);
+    bool ok = true;
+    bool settled = true;    // the kernel is done with every fd and slot
+    
+    for (qsizetype base = 0; ok && base < requests.size(); base += kQueueDepth) {
+        const int count = static_cast<int>(qMin<qsizetype>(kQueueDepth, requests.size() - base));
+        
+        // Round 1: open every file of this batch
+        fds.fill(kPending);
+        for (int i = 0; i < count; ++i) {
+            io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_openat(sqe, dirFd, requests[base + i].path.constData(), O_RDONLY | O_CLOEXEC, 0);
+            io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(quintptr(i)));
+        }
+        ok = completeAll(&ring, count, fds);
+        if (!ok) {
+            // Opens still in flight would leak their fds, and completed ones hold theirs
+            settled = cancelAll(&ring, count, fds);
+            for (int i = 0; settled && i < count; ++i) {
+                if (fds[i] >= 0) ::close(fds[i]);
+            }
+            break;
+        }
+        
+        // Round 2: read each opened file into its slab slot
+        int pending = 0;
+        results.fill(-1);
+        for (int i = 0; i < count; ++i) {
+            if (fds[i] < 0) continue;
+            io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_read(sqe, fds[i], slab.data() + i * maxSize, static_cast<unsigned>(maxSize), 0);
+            io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(quintptr(i)));
+            results[i] = kPending;
+            ++pending;
+        }
+        ok = completeAll(&ring, pending, results);
+        if (!ok) {
+            // No read may still target an fd or slot once they are released
+            settled = cancelAll(&ring, count, results);
+            for (int i = 0; settled && i < count; ++i) {
+                if (fds[i] >= 0) ::close(fds[i]);
+            }
+            break;
+        }
+        
+        for (int i = 0; i < count; ++i) {
+            Request& r = requests[base + i];
+            r.ok = false;
+            r.data.clear();
+            if (fds[i] < 0 || results[i] < 0) continue;
+            
+            r.data = QByteArray(slab.constData() + i * maxSize, results[i]);
+            if (results[i] == maxSize) readRemainder(fds[i], r);
+            r.ok = true;
+        }
+        
+        // Round 3: close
+        pending = 0;
+        results.fill(-1);
+        for (int i = 0; i < count; ++i) {
+            if (fds[i] < 0) continue;
+            io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_close(sqe, fds[i]);
+            io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(quintptr(i)));
+            results[i] = kPending;
+            ++pending;
+        }
+        ok = completeAll(&ring, pending, results);
+        if (!ok) {
+            // A cancelled close never ran; one that ran must not be repeated
+            settled = cancelAll(&ring, count, results);
+            for (int i = 0; settled && i < count; ++i) {
+                if (results[i] == -ECANCELED) ::close(fds[i]);
+            }
+        }
+    }
+    
+    io_uring_queue_exit(&ring);
+    
+    if (!settled) {
+        // The kernel may still write into the slab after the ring is gone,
+        // so it is never freed; its fds stay open for the same reason
+        static_cast<void>(new QByteArray(std::move(slab)));
+    }
+    
+    // A failed submission leaves requests half-filled; the caller redoes them synchronously
+    return ok;
+#else
+    Q_UNUSED(dirFd);
+    Q_UNUSED(requests);
+    Q_UNUSED(maxSize);
+    return false;
+#endif
+}
+
+} // namespace udevme
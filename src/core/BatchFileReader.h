@@ -0,0 +1,42 @@
+#ifndef BATCHFILEREADER_H
+#define BATCHFILEREADER_H
+
+#include <QByteArray>
+#include <QVector>
+
+namespace udevme {
+
+// Reads many small files in one pass. With io_uring (liburing, kernel 5.6+)
+// all opens, reads and closes of a batch are submitted together; otherwise
+// it falls back to plain openat/read/close.
+class BatchFileReader {
+public:
+    enum class Mode {
+        Auto,       // io_uring when available, synchronous otherwise
+        Sync        // always synchronous (benchmarks, debugging)
+    };
+
+    struct Request {
+        QByteArray path;    // relative to the directory fd, or absolute
+        QByteArray data;    // file contents on success
+        bool ok = false;
+    };
+
+    // Fills data/ok for every request. Files larger than maxSize are
+    // completed with synchronous reads.
+    static void readAll(int dirFd, QVector<Request>& requests,
+                        qsizetype maxSize = 16 * 1024, Mode mode = Mode::Auto);
+
+    // True when built with liburing and the running kernel supports the
+    // opcodes we need
+    static bool isIoUringAvailable();
+
+private:
+    static void readAllSync(int dirFd, QVector<Request>& requests, qsizetype maxSize);
+    static bool readAllIoUring(int dirFd, QVector<Request>& requests, qsizetype maxSize);
+    static void readRemainder(int fd, Request& request);
+};
+
+} // namespace udevme
+
+#endif // BATCHFILEREADER_H
@@ -0,0 +1,496 @@
+#include "ConfigCbor.h"
+#include <QCborStreamReader>
+#include <QCborStreamWriter>
+#include <QFile>
+
+namespace udevme {
+
+namespace {
+
+// Map keys; new ones may be added, old ones never reused
+enum ConfigKey : quint64 { ConfigVersion, ConfigRules, ConfigSync };
+enum RuleKey : quint64 { RuleId, RuleDevices, RuleApps, RulePermission, RuleTypeFlags, RuleEnabled,
+                         RuleCreated, RuleUpdated };
+enum DeviceKey : quint64 { DeviceVid, DevicePid, DeviceName, DeviceManufacturer, DeviceBus, DeviceFlags };
+enum AppKey : quint64 { AppDesktopId, AppName, AppExec, AppIcon };
+enum SyncKey : quint64 { SyncHashAtLoad, SyncSyncedAt, SyncAppliedAt, SyncHashAfterApply, SyncFileHashes,
+                         SyncFileStamps };
+
+enum : quint64 {
+    FlagHidraw = 0x01,
+    FlagUsb = 0x02
+};
+
+enum : quint64 {
+    TypeHidraw = 0x01,
+    TypeUsb = 0x02,
+    TypeUaccess = 0x04,
+    TypeSeat = 0x08
+};
+
+// vid/pid are stored as integers when that loses nothing: four lowercase
+// hex digits, as sysfs reports them. Anything else stays a string.
+bool packHexId(const QString& id, quint64& value) {
+    if (id.size() != 4) return false;
+    value = 0;
+    for (QChar c : id) {
+        const char16_t u = c.unicode();
+        if (u >= '0' && u <= '9') value = value << 4 | (u - '0');
+        else if (u >= 'a' && u <= 'f') value = value << 4 | (u - 'a' + 10);
+        else return false;
+    }
+    return true;
+}
+
+void writeHexId(QCborStreamWriter& w, const QString& id) {
+    quint64 value;
+    if (packHexId(id, value)) {
+        w.append(value);
+    } else {
+        w.append(id);
+    }
+}
+
+void writeStringMap(QCborStreamWriter& w, const QMap<QString, QString>& map) {
+    w.startMap(map.size());
+    for (auto it = map.cbegin(); it != map.cend(); ++it) {
+        w.append(it.key());
+        w.append(it.value());
+    }
+    w.endMap();
+}
+
+void writeDevice(QCborStreamWriter& w, const DeviceInfo& d) {
+    w.startMap(d.bus.isEmpty() ? 5 : 6);
+    w.append(quint64(DeviceVid));
+    writeHexId(w, d.vendorId);
+    w.append(quint64(DevicePid));
+    writeHexId(w, d.productId);
+    w.append(quint64(DeviceName));
+    w.append(d.name);
+    w.append(quint64(DeviceManufacturer));
+    w.append(d.manufacturer);
+    if (!d.bus.isEmpty()) {
+        w.append(quint64(DeviceBus));
+        w.append(d.bus);
+    }
+    w.append(quint64(DeviceFlags));
+    w.append(quint64((d.hasHidraw ? FlagHidraw : 0) | (d.hasUsb ? FlagUsb : 0)));
+    w.endMap();
+}
+
+void writeApp(QCborStreamWriter& w, const AppInfo& a) {
+    w.startMap(4);
+    w.append(quint64(AppDesktopId));
+    w.append(a.desktopId);
+    w.append(quint64(AppName));
+    w.append(a.name);
+    w.append(quint64(AppExec));
+    w.append(a.exec);
+    w.append(quint64(AppIcon));
+    w.append(a.icon);
+    w.endMap();
+}
+
+void writeRule(QCborStreamWriter& w, const UdevRule& r) {
+    w.startMap(8);
+    w.append(quint64(RuleId));
+    w.append(r.id.toRfc4122());
+    w.append(quint64(RuleDevices));
+    w.startArray(r.devices.size());
+    for (const auto& d : r.devices) writeDevice(w, d);
+    w.endArray();
+    w.append(quint64(RuleApps));
+    w.startArray(r.applications.size());
+    for (const auto& a : r.applications) writeApp(w, a);
+    w.endArray();
+    w.append(quint64(RulePermission));
+    w.append(quint64(r.permissionLevel));
+    w.append(quint64(RuleTypeFlags));
+    w.append(quint64((r.ruleTypes.hidraw ? TypeHidraw : 0) | (r.ruleTypes.usb ? TypeUsb : 0) |
+                     (r.ruleTypes.uaccess ? TypeUaccess : 0) | (r.ruleTypes.seat ? TypeSeat : 0)));
+    w.append(quint64(RuleEnabled));
+    w.append(r.enabled);
+    w.append(quint64(RuleCreated));
+    w.append(r.createdAt.toSecsSinceEpoch());
+    w.append(quint64(RuleUpdated));
+    w.append(r.updatedAt.toSecsSinceEpoch());
+    w.endMap();
+}
+
+void writeSync(QCborStreamWriter& w, const SyncInfo& s) {
+    w.startMap(4 + (s.lastSyncedFromRulesAt.isValid() ? 1 : 0) + (s.lastAppliedAt.isValid() ? 1 : 0));
+    w.append(quint64(SyncHashAtLoad));
+    w.append(s.rulesFileHashAtLoad);
+    if (s.lastSyncedFromRulesAt.isValid()) {
+        w.append(quint64(SyncSyncedAt));
+        w.append(s.lastSyncedFromRulesAt.toSecsSinceEpoch());
+    }
+    if (s.lastAppliedAt.isValid()) {
+        w.append(quint64(SyncAppliedAt));
+        w.append(s.lastAppliedAt.toSecsSinceEpoch());
+    }
+    w.append(quint64(SyncHashAfterApply));
+    w.append(s.rulesFileHashAfterApply);
+    w.append(quint64(SyncFileHashes));
+    writeStringMap(w, s.fileHashes);
+    w.append(quint64(SyncFileStamps));
+    writeStringMap(w, s.fileStamps);
+    w.endMap();
+}
+
+// Pull decoder over the config layout. The first value of the wrong type
+// marks the data malformed; every loop stops there.
+class Decoder {
+public:
+    explicit Decoder(QByteArrayView data) : m_reader(data.data(), data.size()) {}
+
+    bool config(QVector<UdevRule>& rules, SyncInfo& syncInfo, QString* error);
+    bool single(UdevRule& r) {
+        r = rule();
+        return ok();
+    }
+    bool single(SyncInfo& s) {
+        s = sync();
+        return ok();
+    }
+
+private:
+    bool ok() { return !m_malformed && m_reader.lastError() == QCborError::NoError; }
+    bool fail() {
+        m_malformed = true;
+        return false;
+    }
+
+    template <typename F> bool map(F&& field);
+    template <typename F> bool array(F&& item);
+
+    QString text();
+    QByteArray bytes();
+    quint64 unsignedInt();
+    qint64 integer();
+    bool boolean();
+    QString hexId();
+    QDateTime time() { return QDateTime::fromSecsSinceEpoch(integer()); }
+    QMap<QString, QString> stringMap();
+
+    DeviceInfo device();
+    AppInfo app();
+    UdevRule rule();
+    SyncInfo sync();
+
+    QCborStreamReader m_reader;
+    bool m_malformed = false;
+};
+
+template <typename F>
+bool Decoder::map(F&& field) {
+    if (!m_reader.isMap() || !m_reader.enterContainer()) return fail();
+    while (ok() && m_reader.hasNext()) {
+        if (!m_reader.isUnsignedInteger()) return fail();
+        const quint64 key = m_reader.toUnsignedInteger();
+        m_reader.next();
+        // Unknown keys are from a newer writer; skip their values
+        if (!field(key)) m_reader.next();
+    }
+    return ok() && m_reader.leaveContainer();
+}
+
+template <typename F>
+bool Decoder::array(F&& item) {
+    if (!m_reader.isArray()) return fail();
+    const qsizetype length = m_reader.isLengthKnown() ? qsizetype(m_reader.length()) : 0;
+    if (!m_reader.enterContainer()) return fail();
+    while (ok() && m_reader.hasNext()) item(length);
+    return ok() && m_reader.leaveContainer();
+}
+
+QString Decoder::text() {
+    if (!m_reader.isString()) {
+        fail();
+        return QString();
+    }
+    QString s;
+    auto chunk = m_reader.readString();
+    while (chunk.status == QCborStreamReader::Ok) {
+        s += chunk.data;
+        chunk = m_reader.readString();
+    }
+    if (chunk.status == QCborStreamReader::Error) fail();
+    return s;
+}
+
+QByteArray Decoder::bytes() {
+    if (!m_reader.isByteArray()) {
+        fail();
+        return QByteArray();
+    }
+    QByteArray b;
+    auto chunk = m_reader.readByteArray();
+    while (chunk.status == QCborStreamReader::Ok) {
+        b += chunk.data;
+        chunk = m_reader.readByteArray();
+    }
+    if (chunk.status == QCborStreamReader::Error) fail();
+    return b;
+}
+
+quint64 Decoder::unsignedInt() {
+    if (!m_reader.isUnsignedInteger()) {
+        fail();
+        return 0;
+    }
+    const quint64 value = m_reader.toUnsignedInteger();
+    m_reader.next();
+    return value;
+}
+
+qint64 Decoder::integer() {
+    if (!m_reader.isInteger()) {
+        fail();
+        return 0;
+    }
+    const qint64 value = m_reader.toInteger();
+    m_reader.next();
+    return value;
+}
+
+bool Decoder::boolean() {
+    if (!m_reader.isBool()) {
+        fail();
+        return false;
+    }
+    const bool value = m_reader.toBool();
+    m_reader.next();
+    return value;
+}
+
+QString Decoder::hexId() {
+    if (m_reader.isString()) return text();
+    return QString("%1").arg(unsignedInt(), 4, 16, QLatin1Char('0'));
+}
+
+QMap<QString, QString> Decoder::stringMap() {
+    QMap<QString, QString> result;
+    if (!m_reader.isMap() || !m_reader.enterContainer()) {
+        fail();
+        return result;
+    }
+    while (ok() && m_reader.hasNext()) {
+        const QString key = text();
+        result.insert(key, text());
+    }
+    if (ok()) m_reader.leaveContainer();
+    return result;
+}
+
+DeviceInfo Decoder::device() {
+    DeviceInfo d;
+    map([&](quint64 key) {
+        switch (key) {
+            case DeviceVid: d.vendorId = hexId(); return true;
+            case DevicePid: d.productId = hexId(); return true;
+            case DeviceName: d.name = text(); return true;
+            case DeviceManufacturer: d.manufacturer = text(); return true;
+            case DeviceBus: d.bus = text(); return true;
+            case DeviceFlags: {
+                const quint64 flags = unsignedInt();
+                d.hasHidraw = flags & FlagHidraw;
+                d.hasUsb = flags & FlagUsb;
+                return true;
+            }
+        }
+        return false;
+    });
+    return d;
+}
+
+AppInfo Decoder::app() {
+    AppInfo a;
+    map([&](quint64 key) {
+        switch (key) {
+            case AppDesktopId: a.desktopId = text(); return true;
+            case AppName: a.name = text(); return true;
+            case AppExec: a.exec = text(); return true;
+            case AppIcon: a.icon = text(); return true;
+        }
+        return false;
+    });
+    return a;
+}
+
+UdevRule Decoder::rule() {
+    UdevRule r;
+    bool hasUpdated = false;
+    map([&](quint64 key) {
+        switch (key) {
+            case RuleId: {
+                const QUuid id = QUuid::fromRfc4122(bytes());
+                if (!id.isNull()) r.id = id;
+                return true;
+            }
+            case RuleDevices:
+                array([&](qsizetype length) {
+                    if (r.devices.isEmpty()) r.devices.reserve(length);
+                    r.devices.append(device());
+                });
+                return true;
+            case RuleApps:
+                array([&](qsizetype length) {
+                    if (r.applications.isEmpty()) r.applications.reserve(length);
+                    r.applications.append(app());
+                });
+                return true;
+            case RulePermission: {
+                const quint64 level = unsignedInt();
+                r.permissionLevel = level <= quint64(PermissionLevel::Open) ? PermissionLevel(level)
+                                                                             : PermissionLevel::Safe;
+                return true;
+            }
+            case RuleTypeFlags: {
+                const quint64 types = unsignedInt();
+                r.ruleTypes.hidraw = types & TypeHidraw;
+                r.ruleTypes.usb = types & TypeUsb;
+                r.ruleTypes.uaccess = types & TypeUaccess;
+                r.ruleTypes.seat = types & TypeSeat;
+                return true;
+            }
+            case RuleEnabled: r.enabled = boolean(); return true;
+            case RuleCreated: r.createdAt = time(); return true;
+            case RuleUpdated:
+                r.updatedAt = time();
+                hasUpdated = true;
+                return true;
+        }
+        return false;
+    });
+    // As fromJson(): a rule without one is as old as it was created
+    if (!hasUpdated) r.updatedAt = r.createdAt;
+    return r;
+}
+
+SyncInfo Decoder::sync() {
+    SyncInfo s;
+    map([&](quint64 key) {
+        switch (key) {
+            case SyncHashAtLoad: s.rulesFileHashAtLoad = text(); return true;
+            case SyncSyncedAt: s.lastSyncedFromRulesAt = time(); return true;
+            case SyncAppliedAt: s.lastAppliedAt = time(); return true;
+            case SyncHashAfterApply: s.rulesFileHashAfterApply = text(); return true;
+            case SyncFileHashes: s.fileHashes = stringMap(); return true;
+            case SyncFileStamps: s.fileStamps = stringMap(); return true;
+        }
+        return false;
+    });
+    return s;
+}
+
+bool Decoder::config(QVector<UdevRule>& rules, SyncInfo& syncInfo, QString* error) {
+    auto failed = [&](const QString& why) {
+        if (error) *error = why;
+        return false;
+    };
+
+    if (!m_reader.isTag() || m_reader.toTag() != QCborTag(QCborKnownTags::Signature)) {
+        return failed("Not a udevme CBOR config");
+    }
+    m_reader.next();
+
+    quint64 version = 0;
+    QVector<UdevRule> decoded;
+    SyncInfo decodedSync;
+    map([&](quint64 key) {
+        switch (key) {
+            case ConfigVersion:
+                version = unsignedInt();
+                // Layout changes a reader can't skip bump the version
+                if (version > quint64(ConfigCbor::Version)) fail();
+                return true;
+            case ConfigRules:
+                array([&](qsizetype length) {
+                    if (decoded.isEmpty()) decoded.reserve(length);
+                    decoded.append(rule());
+                });
+                return true;
+            case ConfigSync: decodedSync = sync(); return true;
+        }
+        return false;
+    });
+
+    if (version > quint64(ConfigCbor::Version)) {
+        return failed(QString("Config version %1 is newer than this udevme supports").arg(version));
+    }
+    if (!ok()) {
+        const QString why = m_reader.lastError() != QCborError::NoError ? m_reader.lastError().toString()
+                                                                        : QString("unexpected value type");
+        return failed(QString("Malformed CBOR config at byte %1: %2").arg(m_reader.currentOffset()).arg(why));
+    }
+    rules = std::move(decoded);
+    syncInfo = decodedSync;
+    return true;
+}
+
+} // namespace
+
+QByteArray ConfigCbor::write(const QVector<UdevRule>& rules, const SyncInfo& syncInfo) {
+    QByteArray out;
+    QCborStreamWriter w(&out);
+    w.append(QCborKnownTags::Signature);
+    w.startMap(3);
+    w.append(quint64(ConfigVersion));
+    w.append(quint64(Version));
+    w.append(quint64(ConfigRules));
+    w.startArray(rules.size());
+    for (const auto& rule : rules) writeRule(w, rule);
+    w.endArray();
+    w.append(quint64(ConfigSync));
+    writeSync(w, syncInfo);
+    w.endMap();
+    return out;
+}
+
+bool ConfigCbor::read(QByteArrayView data, QVector<UdevRule>& rules, SyncInfo& syncInfo, QString* error) {
+    return Decoder(data).config(rules, syncInfo, error);
+}
+
+QByteArray ConfigCbor::writeRule(const UdevRule& rule) {
+    QByteArray out;
+    QCborStreamWriter w(&out);
+    udevme::writeRule(w, rule);
+    return out;
+}
+
+bool ConfigCbor::readRule(QByteArrayView data, UdevRule& rule) {
+    return Decoder(data).single(rule);
+}
+
+QByteArray ConfigCbor::writeSyncInfo(const SyncInfo& syncInfo) {
+    QByteArray out;
+    QCborStreamWriter w(&out);
+    writeSync(w, syncInfo);
+    return out;
+}
+
+bool ConfigCbor::readSyncInfo(QByteArrayView data, SyncInfo& syncInfo) {
+    return Decoder(data).single(syncInfo);
+}
+
+bool ConfigCbor::readFile(const QString& path, QVector<UdevRule>& rules, SyncInfo& syncInfo, QString* error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = "Cannot open config file: " + path;
+        return false;
+    }
+
+    const qint64 size = file.size();
+    if (uchar* data = size > 0 ? file.map(0, size) : nullptr) {
+        const bool ok = read(QByteArrayView(data, size), rules, syncInfo, error);
+        file.unmap(data);
+        return ok;
+    }
+    // Filesystems that can't map; also an empty file, which fails to parse
+    const QByteArray bytes = file.readAll();
+    return read(bytes, rules, syncInfo, error);
+}
+
+} // namespace udevme
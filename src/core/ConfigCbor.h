@@ -0,0 +1,38 @@
+#ifndef CONFIGCBOR_H
+#define CONFIGCBOR_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+#include <QVector>
+#include "Types.h"
+
+namespace udevme {
+
+// The config as CBOR, for udevme.cbor. Maps use small integer keys, ids
+// are 16-byte strings, vid:pid integers and timestamps epoch seconds, so
+// nothing goes through a DOM or string formatting. Notes are not stored,
+// as in udevme.json. Reading streams straight from the buffer; readFile()
+// maps the file so the decode never copies it.
+class ConfigCbor {
+public:
+    static constexpr int Version = 1;
+
+    static QByteArray write(const QVector<UdevRule>& rules, const SyncInfo& syncInfo);
+
+    // False, and why, if the data isn't a config this version can read
+    static bool read(QByteArrayView data, QVector<UdevRule>& rules, SyncInfo& syncInfo,
+                     QString* error = nullptr);
+    static bool readFile(const QString& path, QVector<UdevRule>& rules, SyncInfo& syncInfo,
+                         QString* error = nullptr);
+
+    // Single rules and sync info in the same encoding, for ConfigJournal
+    static QByteArray writeRule(const UdevRule& rule);
+    static bool readRule(QByteArrayView data, UdevRule& rule);
+    static QByteArray writeSyncInfo(const SyncInfo& syncInfo);
+    static bool readSyncInfo(QByteArrayView data, SyncInfo& syncInfo);
+};
+
+} // namespace udevme
+
+#endif // CONFIGCBOR_H
@@ -0,0 +1,282 @@
+#include "ConfigJournal.h"
+#include "ConfigCbor.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <QtEndian>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <optional>
+#include <unistd.h>
+
+namespace udevme {
+
+namespace {
+
+// File header: magic, then the SHA-1 of the snapshot the records apply to
+constexpr char kMagic[] = "UDMJRN01";
+constexpr int kMagicSize = 8;
+constexpr int kDigestSize = 20;
+constexpr int kHeaderSize = kMagicSize + kDigestSize;
+
+// Record: u32 payload size, u16 CRC-16 of payload, payload (op byte, body)
+constexpr int kRecordHeaderSize = 6;
+
+constexpr int kIdSize = 16;
+
+template <typename T>
+void put(QByteArray& out, T value) {
+    char buf[sizeof(T)];
+    qToLittleEndian(value, buf);
+    out.append(buf, sizeof(T));
+}
+
+// Applies records to a rule list. Removed rules stay as holes until
+// finish(), so a long journal replays in linear time.
+class Replay {
+public:
+    explicit Replay(QVector<UdevRule>& rules) : m_rules(rules), m_removed(rules.size(), false) {
+        reindex();
+    }
+
+    void put(UdevRule&& rule) {
+        auto it = m_index.constFind(rule.id);
+        if (it != m_index.constEnd() && !m_removed[it.value()]) {
+            m_rules[it.value()] = std::move(rule);
+            return;
+        }
+        m_index.insert(rule.id, m_rules.size());
+        m_rules.append(std::move(rule));
+        m_removed.append(false);
+    }
+
+    void remove(const QUuid& id) {
+        auto it = m_index.constFind(id);
+        if (it != m_index.constEnd()) m_removed[it.value()] = true;
+    }
+
+    void order(QByteArrayView ids) {
+        QHash<QUuid, int> position;
+        for (qsizetype i = 0; i + kIdSize <= ids.size(); i += kIdSize) {
+            position.insert(QUuid::fromRfc4122(ids.sliced(i, kIdSize)), int(i / kIdSize));
+        }
+        finish();
+        std::stable_sort(m_rules.begin(), m_rules.end(), [&position](const UdevRule& a, const UdevRule& b) {
+            return position.value(a.id, INT_MAX) < position.value(b.id, INT_MAX);
+        });
+        reindex();
+    }
+
+    void finish() {
+        qsizetype kept = 0;
+        for (qsizetype i = 0; i < m_rules.size(); ++i) {
+            if (m_removed[i]) continue;
+            if (kept != i) m_rules[kept] = std::move(m_rules[i]);
+            ++kept;
+        }
+        m_rules.resize(kept);
+        m_removed.fill(false, kept);
+    }
+
+private:
+    void reindex() {
+        m_index.clear();
+        m_index.reserve(m_rules.size());
+        for (qsizetype i = 0; i < m_rules.size(); ++i) {
+            m_index.insert(m_rules[i].id, i);
+        }
+    }
+
+    QVector<UdevRule>& m_rules;
+    QVector<bool> m_removed;
+    QHash<QUuid, qsizetype> m_index;
+};
+
+QByteArray idList(const QVector<UdevRule>& rules) {
+    QByteArray ids;
+    ids.reserve(rules.size() * kIdSize);
+    for (const auto& rule : rules) ids += rule.id.toRfc4122();
+    return ids;
+}
+
+} // namespace
+
+ConfigJournal::ConfigJournal(const QString& path) : m_path(path) {}
+
+QByteArray ConfigJournal::snapshotDigest(QByteArrayView snapshot) {
+    return QCryptographicHash::hash(snapshot, QCryptographicHash::Sha1);
+}
+
+QByteArray ConfigJournal::encode(Op op, const QByteArray& body) {
+    QByteArray payload;
+    payload.reserve(1 + body.size());
+    payload.append(char(op));
+    payload.append(body);
+
+    QByteArray record;
+    record.reserve(kRecordHeaderSize + payload.size());
+    put<quint32>(record, quint32(payload.size()));
+    put<quint16>(record, qChecksum(payload));
+    record.append(payload);
+    return record;
+}
+
+bool ConfigJournal::load(QByteArrayView digest, QVector<UdevRule>* rules, SyncInfo* syncInfo) {
+    m_digest = digest.toByteArray();
+    m_end = 0;
+    m_records = 0;
+
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly)) return true;
+
+    // A torn header has no records; the next append starts the file over
+    const qint64 size = file.size();
+    if (size < kHeaderSize) return true;
+
+    const uchar* map = file.map(0, size);
+    QByteArray copy;
+    const char* data = reinterpret_cast<const char*>(map);
+    if (!data) {
+        copy = file.readAll();
+        data = copy.constData();
+    }
+
+    const bool ours = memcmp(data, kMagic, kMagicSize) == 0;
+    const bool current = ours && m_digest == QByteArrayView(data + kMagicSize, kDigestSize);
+    if (current) {
+        std::optional<Replay> replay;
+        if (rules) replay.emplace(*rules);
+
+        qint64 pos = kHeaderSize;
+        while (pos + kRecordHeaderSize <= size) {
+            const quint32 payloadSize = qFromLittleEndian<quint32>(data + pos);
+            const quint16 crc = qFromLittleEndian<quint16>(data + pos + 4);
+            const char* payload = data + pos + kRecordHeaderSize;
+            if (payloadSize < 1 || pos + kRecordHeaderSize + payloadSize > size) break;
+            if (qChecksum(QByteArrayView(payload, payloadSize)) != crc) break;
+
+            const QByteArrayView body(payload + 1, payloadSize - 1);
+            bool valid = true;
+            switch (Op(payload[0])) {
+                case Op::Put: {
+                    UdevRule rule;
+                    valid = ConfigCbor::readRule(body, rule);
+                    if (valid && replay) replay->put(std::move(rule));
+                    break;
+                }
+                case Op::Remove:
+                    valid = body.size() == kIdSize;
+                    if (valid && replay) replay->remove(QUuid::fromRfc4122(body));
+                    break;
+                case Op::Order:
+                    valid = body.size() % kIdSize == 0;
+                    if (valid && replay) replay->order(body);
+                    break;
+                case Op::Sync: {
+                    SyncInfo sync;
+                    valid = ConfigCbor::readSyncInfo(body, sync);
+                    if (valid && syncInfo) *syncInfo = sync;
+                    break;
+                }
+                default:
+                    valid = false;
+            }
+            if (!valid) break;
+
+            ++m_records;
+            pos += kRecordHeaderSize + payloadSize;
+        }
+        if (replay) replay->finish();
+        m_end = pos;
+    }
+
+    if (map) file.unmap(const_cast<uchar*>(map));
+    return ours;
+}
+
+bool ConfigJournal::append(const QVector<UdevRule>& from, const SyncInfo& fromSync,
+                           const QVector<UdevRule>& to, const SyncInfo& toSync, bool* written) {
+    if (written) *written = false;
+    if (m_digest.isEmpty()) return false;
+
+    QHash<QUuid, const UdevRule*> before;
+    before.reserve(from.size());
+    for (const auto& rule : from) before.insert(rule.id, &rule);
+
+    QByteArray pending;
+    int records = 0;
+
+    // Rules as they'll be once these records are replayed, for the order check
+    QVector<QUuid> replayed;
+    QSet<QUuid> kept;
+    for (const auto& rule : to) {
+        kept.insert(rule.id);
+        const UdevRule* old = before.value(rule.id);
+        const QByteArray encoded = ConfigCbor::writeRule(rule);
+        if (old && ConfigCbor::writeRule(*old) == encoded) continue;
+        pending += encode(Op::Put, encoded);
+        ++records;
+    }
+    for (const auto& rule : from) {
+        if (kept.contains(rule.id)) {
+            replayed.append(rule.id);
+        } else {
+            pending += encode(Op::Remove, rule.id.toRfc4122());
+            ++records;
+        }
+    }
+    for (const auto& rule : to) {
+        if (!before.contains(rule.id)) replayed.append(rule.id);
+    }
+
+    bool sameOrder = replayed.size() == to.size();
+    for (qsizetype i = 0; sameOrder && i < to.size(); ++i) {
+        sameOrder = replayed[i] == to[i].id;
+    }
+    if (!sameOrder) {
+        pending += encode(Op::Order, idList(to));
+        ++records;
+    }
+
+    const QByteArray sync = ConfigCbor::writeSyncInfo(toSync);
+    if (sync != ConfigCbor::writeSyncInfo(fromSync)) {
+        pending += encode(Op::Sync, sync);
+        ++records;
+    }
+
+    if (pending.isEmpty()) return true;
+
+    QDir().mkpath(QFileInfo(m_path).path());
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadWrite)) return false;
+
+    // A stale or foreign file is replaced; a torn tail is cut off so the
+    // records start on a boundary
+    if (m_end == 0) {
+        QByteArray header(kMagic, kMagicSize);
+        header += m_digest;
+        pending.prepend(header);
+    }
+    if (file.size() != m_end && !file.resize(m_end)) return false;
+    if (!file.seek(m_end) || file.write(pending) != pending.size() || !file.flush()) return false;
+    if (::fdatasync(file.handle()) != 0) return false;
+
+    m_end += pending.size();
+    m_records += records;
+    if (written) *written = true;
+    return true;
+}
+
+bool ConfigJournal::reset(QByteArrayView digest) {
+    m_digest = digest.toByteArray();
+    m_end = 0;
+    m_records = 0;
+    return !QFile::exists(m_path) || QFile::remove(m_path);
+}
+
+} // namespace udevme
@@ -0,0 +1,66 @@
+#ifndef CONFIGJOURNAL_H
+#define CONFIGJOURNAL_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+#include <QVector>
+#include "Types.h"
+
+namespace udevme {
+
+// Rule changes made since the config snapshot (udevme.json or .cbor) was
+// written, so a save appends what changed instead of rewriting every rule.
+//
+// Framed and checksummed like the device inventory's log. The header holds
+// a digest of the snapshot the records apply to: once the snapshot is
+// rewritten, a journal left behind by a crash no longer matches and is
+// ignored. Each record sets the whole state of one rule, the rule order or
+// the sync info; notes stay in notes.json.
+class ConfigJournal {
+public:
+    enum class Op : quint8 {
+        Put = 1,        // a rule added or changed, in ConfigCbor's encoding
+        Remove = 2,     // a rule id
+        Order = 3,      // every rule id, in order
+        Sync = 4        // the sync info
+    };
+
+    explicit ConfigJournal(const QString& path);
+
+    static QByteArray snapshotDigest(QByteArrayView snapshot);
+
+    // Reads the records written against this snapshot and, if given,
+    // applies them to its rules and sync info. A missing or stale journal
+    // has no records; a torn last record (crash during append) ends it.
+    // Never writes.
+    bool load(QByteArrayView digest, QVector<UdevRule>* rules = nullptr, SyncInfo* syncInfo = nullptr);
+
+    // Appends the records that turn 'from' into 'to'; 'written' is false
+    // when they're the same. Starts a new journal for the digest given to
+    // load() or reset() if the file holds another one.
+    bool append(const QVector<UdevRule>& from, const SyncInfo& fromSync,
+                const QVector<UdevRule>& to, const SyncInfo& toSync, bool* written = nullptr);
+
+    // After a new snapshot: drops the file and follows that snapshot
+    bool reset(QByteArrayView digest);
+
+    int recordCount() const { return m_records; }
+    // Folding into a new snapshot is due once the records outnumber the
+    // rules by more than kCompactSlack
+    bool needsCompaction(int ruleCount) const { return m_records > ruleCount + kCompactSlack; }
+
+private:
+    static constexpr int kCompactSlack = 64;
+
+    static QByteArray encode(Op op, const QByteArray& body);
+
+    QString m_path;
+    QByteArray m_digest;
+    qint64 m_end = 0;       // end of the last good record; 0 if the file isn't ours
+    int m_records = 0;
+};
+
+} // namespace udevme
+
+#endif // CONFIGJOURNAL_H
@@ -0,0 +1,204 @@
+#include "ConfigSession.h"
+#include "FileHash.h"
+#include <QFile>
+#include <QTimer>
+
+namespace udevme {
+
+namespace {
+
+QByteArray readAll(const QString& path) {
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+} // namespace
+
+ConfigSession::ConfigSession(QObject* parent)
+    : QObject(parent)
+    , m_timer(new QTimer(this))
+    , m_stampTimer(new QTimer(this))
+{
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(FlushDelayMs);
+    connect(m_timer, &QTimer::timeout, this, [this] {
+        QString error;
+        if (!flush(&error)) emit flushFailed(error);
+    });
+    
+    // Just past the racy window of files written right before
+    m_stampTimer->setSingleShot(true);
+    m_stampTimer->setInterval(int(FileHash::RacyNs / 1000000) + 100);
+    connect(m_stampTimer, &QTimer::timeout, this, &ConfigSession::stampFiles);
+}
+
+ConfigSession::~ConfigSession() {
+    // Whatever is old enough by now still gets its stamp
+    if (m_stampTimer->isActive()) stampFiles();
+    flush();
+}
+
+ConfigStore::LoadResult ConfigSession::load() {
+    // Pending changes go out before the files are read back
+    m_stampTimer->stop();
+    flush();
+    ConfigStore::LoadResult result = ConfigStore::load();
+    m_configOnDisk = readAll(ConfigStore::configPath(m_format));
+    m_notesOnDisk = readAll(ConfigStore::getNotesPath());
+    m_journal.load(ConfigJournal::snapshotDigest(m_configOnDisk));
+    m_configDirty = m_notesDirty = false;
+    m_hasBaseline = false;
+    if (!result.success) return result;
+
+    m_rules = result.rules;
+    m_syncInfo = result.syncInfo;
+    m_hasConfig = true;
+
+    // Rules read from the system replace the config, and drop the notes of
+    // rules that are gone; unchanged ones serialize to the same bytes
+    if (result.loadedFromSystem) {
+        m_configDirty = m_journal.recordCount() > 0
+            || ConfigStore::serializeConfig(m_rules, m_syncInfo, m_format) != m_configOnDisk;
+        m_notesDirty = ConfigStore::serializeNotes(ConfigStore::notesOf(m_rules)) != m_notesOnDisk;
+    }
+    const ConfigFormat other = m_format == ConfigFormat::Cbor ? ConfigFormat::Json : ConfigFormat::Cbor;
+    if (QFile::exists(ConfigStore::configPath(other))) m_configDirty = true;
+
+    // What was loaded is what the files hold, unless a rewrite is queued
+    if (!m_configDirty) {
+        m_savedRules = m_rules;
+        m_savedSync = m_syncInfo;
+        m_hasBaseline = true;
+    }
+    if (isDirty()) schedule();
+    return result;
+}
+
+void ConfigSession::setFormat(ConfigFormat format) {
+    if (format == m_format) return;
+    m_format = format;
+    m_configOnDisk = readAll(ConfigStore::configPath(m_format));
+    m_hasBaseline = false;
+    // Before load() there is nothing to convert; load() picks the file up
+    if (!m_hasConfig) return;
+    m_configDirty = true;
+    schedule();
+}
+
+void ConfigSession::setRules(const QVector<UdevRule>& rules) {
+    m_rules = rules;
+    m_hasConfig = true;
+    m_configDirty = m_notesDirty = true;
+    schedule();
+}
+
+void ConfigSession::setSyncInfo(const SyncInfo& syncInfo) {
+    m_syncInfo = syncInfo;
+    m_configDirty = true;
+    schedule();
+}
+
+void ConfigSession::save(const QVector<UdevRule>& rules, const SyncInfo& syncInfo) {
+    m_rules = rules;
+    m_syncInfo = syncInfo;
+    m_hasConfig = true;
+    m_configDirty = m_notesDirty = true;
+    schedule();
+}
+
+void ConfigSession::stampFilesLater() {
+    m_stampTimer->start();
+}
+
+void ConfigSession::stampFiles() {
+    m_stampTimer->stop();
+    
+    // Stat, hash, stat: a stamp vouches for the bytes the hash was taken of
+    QMap<QString, QString> stamps;
+    for (auto it = m_syncInfo.fileHashes.cbegin(); it != m_syncInfo.fileHashes.cend(); ++it) {
+        const QString stamp = ConfigStore::fileStamp(it.key());
+        const bool same = !stamp.isEmpty() && FileHash::sha256(it.key()) == it.value()
+            && ConfigStore::fileStamp(it.key()) == stamp;
+        stamps.insert(it.key(), same ? stamp : QString());
+    }
+    if (stamps == m_syncInfo.fileStamps) return;
+    
+    SyncInfo syncInfo = m_syncInfo;
+    syncInfo.fileStamps = stamps;
+    setSyncInfo(syncInfo);
+}
+
+void ConfigSession::setFlushDelay(int msec) {
+    m_timer->setInterval(msec);
+}
+
+void ConfigSession::setStampDelay(int msec) {
+    m_stampTimer->setInterval(msec);
+}
+
+void ConfigSession::schedule() {
+    // Restarting coalesces a burst of changes into one write
+    m_timer->start();
+}
+
+bool ConfigSession::flush(QString* error) {
+    m_timer->stop();
+    if (!isDirty()) return true;
+    ConfigStore::ensureInstallDir();
+
+    // Notes first, then the config they belong to
+    if (m_notesDirty) {
+        if (!flushFile(ConfigStore::getNotesPath(), ConfigStore::serializeNotes(ConfigStore::notesOf(m_rules)),
+                       m_notesOnDisk, error)) {
+            return false;
+        }
+        m_notesDirty = false;
+    }
+    if (m_configDirty) {
+        if (!flushConfig(error)) return false;
+        m_configDirty = false;
+    }
+    return true;
+}
+
+bool ConfigSession::flushConfig(QString* error) {
+    if (m_hasBaseline && !m_configOnDisk.isEmpty() && !m_journal.needsCompaction(m_rules.size())) {
+        bool written = false;
+        if (!m_journal.append(m_savedRules, m_savedSync, m_rules, m_syncInfo, &written)) {
+            if (error) *error = "Cannot write " + ConfigStore::getJournalPath();
+            return false;
+        }
+        if (written) ++m_writes;
+    } else {
+        // A new snapshot, then the journal goes: a crash in between leaves
+        // a journal for the old snapshot, which load ignores
+        if (!flushFile(ConfigStore::configPath(m_format), ConfigStore::serializeConfig(m_rules, m_syncInfo, m_format),
+                       m_configOnDisk, error)) {
+            return false;
+        }
+        ConfigStore::removeOtherConfig(m_format);
+        if (!m_journal.reset(ConfigJournal::snapshotDigest(m_configOnDisk))) {
+            if (error) *error = "Cannot remove " + ConfigStore::getJournalPath();
+            return false;
+        }
+    }
+    m_savedRules = m_rules;
+    m_savedSync = m_syncInfo;
+    m_hasBaseline = true;
+    return true;
+}
+
+bool ConfigSession::flushFile(const QString& path, const QByteArray& bytes, QByteArray& onDisk, QString* error) {
+    if (bytes == onDisk) return true;
+
+    bool written = false;
+    if (!ConfigStore::writeFileIfChanged(path, bytes, &written)) {
+        if (error) *error = "Cannot write " + path;
+        return false;
+    }
+    if (written) ++m_writes;
+    onDisk = bytes;
+    return true;
+}
+
+} // namespace udevme
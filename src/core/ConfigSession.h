@@ -0,0 +1,94 @@
+#ifndef CONFIGSESSION_H
+#define CONFIGSESSION_H
+
+#include <QObject>
+#include <QByteArray>
+#include "ConfigJournal.h"
+#include "ConfigStore.h"
+
+class QTimer;
+
+namespace udevme {
+
+// The config and notes while the app runs. Changes are held in memory and
+// written a short while after the last one (or on flush()/destruction);
+// a file is only written when its serialized bytes differ from what is on
+// disk, so an idle start and quit writes nothing. Changed rules are
+// appended to the config journal and folded into a new snapshot once it
+// grows. MainWindow saves the rules after each Apply, so edits that were
+// never applied aren't kept.
+class ConfigSession : public QObject {
+    Q_OBJECT
+public:
+    static constexpr int FlushDelayMs = 500;
+
+    explicit ConfigSession(QObject* parent = nullptr);
+    ~ConfigSession() override;
+
+    // ConfigStore::load(), remembering what the files held. A config that
+    // no longer matches the system rules, or is in the other format, is
+    // queued for rewriting.
+    ConfigStore::LoadResult load();
+
+    // The format flushes write; changing it after load() converts the file
+    ConfigFormat format() const { return m_format; }
+    void setFormat(ConfigFormat format);
+
+    const QVector<UdevRule>& rules() const { return m_rules; }
+    const SyncInfo& syncInfo() const { return m_syncInfo; }
+
+    void setRules(const QVector<UdevRule>& rules);
+    void setSyncInfo(const SyncInfo& syncInfo);
+    void save(const QVector<UdevRule>& rules, const SyncInfo& syncInfo);
+
+    // Files just written by an Apply are too recent to stamp (see
+    // ConfigStore::fileStamp()). This stamps syncInfo().fileHashes' files
+    // once that has passed, each only if it still holds the hashed bytes,
+    // so the next start can take the fast path.
+    void stampFilesLater();
+
+    bool isDirty() const { return m_configDirty || m_notesDirty; }
+
+    // Writes pending changes now; false (and why) if a file couldn't be written
+    bool flush(QString* error = nullptr);
+
+    void setFlushDelay(int msec);
+    void setStampDelay(int msec);
+    // Files actually written since construction
+    int writeCount() const { return m_writes; }
+
+signals:
+    void flushFailed(const QString& error);
+
+private:
+    void schedule();
+    void stampFiles();
+    bool flushConfig(QString* error);
+    bool flushFile(const QString& path, const QByteArray& bytes, QByteArray& onDisk, QString* error);
+
+    QVector<UdevRule> m_rules;
+    SyncInfo m_syncInfo;
+    ConfigFormat m_format = ConfigFormat::Json;
+    bool m_hasConfig = false;      // loaded or given rules, so a format change converts
+    bool m_configDirty = false;
+    bool m_notesDirty = false;
+
+    // What the files hold as far as we know; equal bytes skip the write
+    QByteArray m_configOnDisk;
+    QByteArray m_notesOnDisk;
+
+    // The snapshot plus journal hold m_savedRules/m_savedSync; without a
+    // baseline the next flush writes a whole snapshot
+    ConfigJournal m_journal{ConfigStore::getJournalPath()};
+    QVector<UdevRule> m_savedRules;
+    SyncInfo m_savedSync;
+    bool m_hasBaseline = false;
+
+    QTimer* m_timer;
+    QTimer* m_stampTimer;
+    int m_writes = 0;
+};
+
+} // namespace udevme
+
+#endif // CONFIGSESSION_H
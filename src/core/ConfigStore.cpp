@@ -1,14 +1,77 @@
 #include "ConfigStore.h"
+#include "ConfigCbor.h"
+#include "ConfigJournal.h"
+#include "RuleGenerator.h"
 #include "RuleParser.h"
+#include "DeviceInventory.h"
+#include "FileHash.h"
+#include "UsbIds.h"
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QJsonDocument>
 #include <QJsonArray>
+#include <QSaveFile>
 #include <QStandardPaths>
 #include <QSet>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <climits>
 
 namespace udevme {
 
+namespace {
+
+// Unchanged files (by stat) keep their hash from the last call, so load,
+// planApply and verifyApply read each file once between changes
+QMap<QString, QString> hashFiles(const QStringList& paths) {
+    const QList<QString> hashes = QtConcurrent::blockingMapped(paths, &FileHash::sha256);
+    QMap<QString, QString> result;
+    for (qsizetype i = 0; i < paths.size(); ++i) {
+        result.insert(paths[i], hashes[i]);
+    }
+    return result;
+}
+
+// Rules of the last load by block checksum, per file, so a reload after
+// an edit only parses the blocks that changed
+QHash<QString, RuleParser::BlockCache>& blockCaches() {
+    static QHash<QString, RuleParser::BlockCache> caches;
+    return caches;
+}
+
+struct ParsedFile {
+    QString path;
+    RuleParser::StreamResult stream;
+    QVector<UdevRule> rules;
+};
+
+QString& systemRootStorage() {
+    static QString root;
+    return root;
+}
+
+bool writeFile(const QString& path, const QString& content) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        return false;
+    }
+    file.write(content.toUtf8());
+    file.close();
+    return true;
+}
+
+} // namespace
+
+void ConfigStore::setSystemRoot(const QString& root) {
+    systemRootStorage() = root;
+}
+
+QString ConfigStore::systemRoot() {
+    return systemRootStorage();
+}
+
 QString ConfigStore::getInstallDir() {
     return QDir::homePath() + "/.local/bin/udevme";
 }
@@ -17,6 +80,18 @@ QString ConfigStore::getConfigPath() {
     return getInstallDir() + "/udevme.json";
 }
 
+QString ConfigStore::getBinaryConfigPath() {
+    return getInstallDir() + "/udevme.cbor";
+}
+
+QString ConfigStore::getJournalPath() {
+    return getInstallDir() + "/udevme.journal";
+}
+
+QString ConfigStore::configPath(ConfigFormat format) {
+    return format == ConfigFormat::Cbor ? getBinaryConfigPath() : getConfigPath();
+}
+
 QString ConfigStore::getNotesPath() {
     return getInstallDir() + "/notes.json";
 }
@@ -26,7 +101,47 @@ QString ConfigStore::getStagedRulesPath() {
 }
 
 QString ConfigStore::getSystemRulesPath() {
-    return "/etc/udev/rules.d/99-udevme.rules";
+    return systemRoot() + "/etc/udev/rules.d/99-udevme.rules";
+}
+
+QString ConfigStore::getStagedHwdbPath() {
+    return getInstallDir() + "/99-udevme.hwdb";
+}
+
+QString ConfigStore::getSystemHwdbPath() {
+    return systemRoot() + "/etc/udev/hwdb.d/99-udevme.hwdb";
+}
+
+QString ConfigStore::getStagedShardDir() {
+    return getInstallDir() + "/shards";
+}
+
+QString ConfigStore::shardPath(const UdevRule& rule, RuleOutput output) {
+    // Shards sit next to the single file they replace
+    const bool hwdb = output == RuleOutput::Hwdb;
+    const QString dir = QFileInfo(hwdb ? getSystemHwdbPath() : getSystemRulesPath()).path();
+    return dir + "/" + ShardPrefix + rule.id.toString(QUuid::WithoutBraces) + (hwdb ? ".hwdb" : ".rules");
+}
+
+QStringList ConfigStore::systemShardPaths() {
+    QStringList paths;
+    for (const QString& single : { getSystemRulesPath(), getSystemHwdbPath() }) {
+        const QFileInfo info(single);
+        QDir dir = info.dir();
+        const QString pattern = QLatin1String(ShardPrefix) + "*." + info.suffix();
+        for (const QString& name : dir.entryList({ pattern }, QDir::Files, QDir::Name)) {
+            paths << dir.filePath(name);
+        }
+    }
+    return paths;
+}
+
+QString ConfigStore::getInventoryPath() {
+    return getInstallDir() + "/devices.inv";
+}
+
+QString ConfigStore::getSettingsPath() {
+    return getInstallDir() + "/settings.json";
 }
 
 bool ConfigStore::ensureInstallDir() {
@@ -41,23 +156,61 @@ bool ConfigStore::systemRulesExist() {
     return QFile::exists(getSystemRulesPath());
 }
 
-QString ConfigStore::readSystemRules() {
-    QFile file(getSystemRulesPath());
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        return QString();
+bool ConfigStore::systemHwdbExists() {
+    return QFile::exists(getSystemHwdbPath());
+}
+
+QStringList ConfigStore::systemFilePaths() {
+    QStringList paths;
+    if (systemRulesExist()) paths << getSystemRulesPath();
+    if (systemHwdbExists()) paths << getSystemHwdbPath();
+    return paths + systemShardPaths();
+}
+
+QMap<QString, QString> ConfigStore::computeSystemFileHashes() {
+    return hashFiles(systemFilePaths());
+}
+
+QString ConfigStore::fileStamp(const QString& path) {
+    // A file just written could change again without the stamp moving
+    FileHash::Stat st;
+    if (!FileHash::stat(path, st) || FileHash::isRacy(st)) return QString();
+    return QString("%1:%2:%3:%4:%5").arg(st.device).arg(st.inode).arg(st.size).arg(st.mtimeNs).arg(st.ctimeNs);
+}
+
+QMap<QString, QString> ConfigStore::computeFileStamps(const QStringList& paths) {
+    QMap<QString, QString> stamps;
+    for (const QString& path : paths) {
+        stamps.insert(path, fileStamp(path));
     }
-    QString content = QString::fromUtf8(file.readAll());
-    file.close();
-    return content;
+    return stamps;
 }
 
-QString ConfigStore::computeSystemRulesHash() {
-    QString content = readSystemRules();
-    if (content.isEmpty()) return QString();
-    return RuleParser::computeHash(content);
+QString ConfigStore::combineFileHashes(const QMap<QString, QString>& hashes) {
+    // A lone rules file keeps the hash older configs stored for it
+    if (hashes.size() == 1) return hashes.first();
+    QString all;
+    for (auto it = hashes.cbegin(); it != hashes.cend(); ++it) {
+        all += it.key() + " " + it.value() + "\n";
+    }
+    return all.isEmpty() ? QString() : RuleParser::computeHash(all);
 }
 
 // Notes management
+AppSettings ConfigStore::loadSettings() {
+    QFile file(getSettingsPath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return AppSettings();
+    }
+    return AppSettings::fromJson(QJsonDocument::fromJson(file.readAll()).object());
+}
+
+bool ConfigStore::saveSettings(const AppSettings& settings) {
+    ensureInstallDir();
+    
+    return writeFileIfChanged(getSettingsPath(), QJsonDocument(settings.toJson()).toJson(QJsonDocument::Indented));
+}
+
 QMap<QString, QString> ConfigStore::loadNotes() {
     QMap<QString, QString> notes;
     
@@ -77,76 +230,47 @@ QMap<QString, QString> ConfigStore::loadNotes() {
     return notes;
 }
 
-bool ConfigStore::saveNotes(const QMap<QString, QString>& notes) {
-    ensureInstallDir();
-    
+QByteArray ConfigStore::serializeNotes(const QMap<QString, QString>& notes) {
     QJsonObject root;
     for (auto it = notes.begin(); it != notes.end(); ++it) {
         if (!it.value().isEmpty()) {
             root[it.key()] = it.value();
         }
     }
-    
-    QJsonDocument doc(root);
-    
-    QFile file(getNotesPath());
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        return false;
-    }
-    
-    file.write(doc.toJson(QJsonDocument::Indented));
-    file.close();
-    return true;
-}
-
-bool ConfigStore::saveNote(const QString& ruleId, const QString& note) {
-    QMap<QString, QString> notes = loadNotes();
-    if (note.isEmpty()) {
-        notes.remove(ruleId);
-    } else {
-        notes[ruleId] = note;
-    }
-    return saveNotes(notes);
+    return QJsonDocument(root).toJson(QJsonDocument::Indented);
 }
 
-QString ConfigStore::getNote(const QString& ruleId) {
-    QMap<QString, QString> notes = loadNotes();
-    return notes.value(ruleId);
+bool ConfigStore::saveNotes(const QMap<QString, QString>& notes) {
+    ensureInstallDir();
+    return writeFileIfChanged(getNotesPath(), serializeNotes(notes));
 }
 
-bool ConfigStore::deleteNote(const QString& ruleId) {
-    QMap<QString, QString> notes = loadNotes();
-    if (notes.contains(ruleId)) {
-        notes.remove(ruleId);
-        return saveNotes(notes);
+QMap<QString, QString> ConfigStore::notesOf(const QVector<UdevRule>& rules) {
+    // Only current rules' notes, so deleted rules leave none behind
+    QMap<QString, QString> notes;
+    for (const auto& rule : rules) {
+        if (!rule.notes.isEmpty()) {
+            notes[rule.id.toString(QUuid::WithoutBraces)] = rule.notes;
+        }
     }
-    return true;
+    return notes;
 }
 
-void ConfigStore::cleanupOrphanedNotes(const QVector<UdevRule>& currentRules) {
-    QMap<QString, QString> notes = loadNotes();
-    if (notes.isEmpty()) return;
-    
-    // Build set of current rule IDs
-    QSet<QString> ruleIds;
-    for (const auto& rule : currentRules) {
-        ruleIds.insert(rule.id.toString(QUuid::WithoutBraces));
-    }
-    
-    // Remove notes for rules that no longer exist
-    QStringList toRemove;
-    for (auto it = notes.begin(); it != notes.end(); ++it) {
-        if (!ruleIds.contains(it.key())) {
-            toRemove.append(it.key());
-        }
+bool ConfigStore::writeFileIfChanged(const QString& path, const QByteArray& bytes, bool* written) {
+    if (written) *written = false;
+    QFile current(path);
+    if (current.open(QIODevice::ReadOnly) && current.size() == bytes.size() && current.readAll() == bytes) {
+        return true;
     }
+    current.close();
     
-    if (!toRemove.isEmpty()) {
-        for (const QString& id : toRemove) {
-            notes.remove(id);
-        }
-        saveNotes(notes);
+    // Written aside and renamed over, so a crash never leaves half a file
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(bytes) != bytes.size() || !file.commit()) {
+        return false;
     }
+    if (written) *written = true;
+    return true;
 }
 
 ConfigStore::LoadResult ConfigStore::load() {
@@ -158,19 +282,124 @@ ConfigStore::LoadResult ConfigStore::load() {
     // Load notes first
     QMap<QString, QString> notes = loadNotes();
     
-    // Check if system rules exist - they are source of truth
-    if (systemRulesExist()) {
-        QString systemContent = readSystemRules();
-        QString systemHash = RuleParser::computeHash(systemContent);
+    // System rules are the source of truth: the rules file, the hwdb file
+    // and any shards, parsed in parallel
+    const QStringList paths = systemFilePaths();
+    const bool sharded = std::any_of(paths.cbegin(), paths.cend(), [](const QString& path) {
+        return QFileInfo(path).fileName().startsWith(QLatin1String(ShardPrefix));
+    });
+    
+    if (!paths.isEmpty()) {
+        // Saved config, for the rule order and the hashes it was saved with
+        StoredConfig stored = readConfig();
+        const SyncInfo& saved = stored.syncInfo;
         
-        // Parse system rules
-        auto parseResult = RuleParser::parseRulesFile(systemContent);
+        // Files the config was saved against need no parse: the config
+        // already holds their rules
+        const QMap<QString, QString> stamps = computeFileStamps(paths);
+        auto loadCached = [&]() {
+            result.rules = std::move(stored.rules);
+            prepareRules(result.rules, notes);
+            result.syncInfo = saved;
+            result.syncInfo.fileStamps = stamps;
+            result.loadedFromSystem = true;
+            result.fromCache = true;
+            return result;
+        };
+        if (stored.ok && !saved.fileStamps.isEmpty() && saved.fileStamps == stamps
+            && !stamps.values().contains(QString())) {
+            return loadCached();
+        }
+        
+        // Each file keeps its own block cache; all exist before the parses
+        // start, so the threads only read the table
+        QHash<QString, RuleParser::BlockCache>& caches = blockCaches();
+        QHash<QString, RuleParser::BlockCache> current;
+        for (const QString& path : std::as_const(paths)) {
+            current.insert(path, caches.take(path));
+        }
+        caches = std::move(current);
+        
+        QHash<QString, RuleParser::BlockCache*> cacheFor;
+        for (auto it = caches.begin(); it != caches.end(); ++it) {
+            cacheFor.insert(it.key(), &it.value());
+        }
+        
+        // Parse each file as it streams in; none is ever held whole
+        const QList<ParsedFile> parsed = QtConcurrent::blockingMapped(paths, [&cacheFor](const QString& path) {
+            ParsedFile file;
+            file.path = path;
+            file.stream = RuleParser::parseRulesStream(path, [&file](UdevRule&& rule) {
+                file.rules.append(std::move(rule));
+                return true;
+            }, cacheFor.value(path));
+            return file;
+        });
+        
+        QVector<UdevRule> systemRules;
+        QStringList warnings;
+        QMap<QString, QString> fileHashes;
+        bool ok = true;
+        for (const ParsedFile& file : parsed) {
+            // The rules file unreadable means falling back to the config
+            if (!file.stream.success && file.path == getSystemRulesPath()) ok = false;
+            
+            const QString prefix = file.path == getSystemRulesPath()
+                ? QString() : QFileInfo(file.path).fileName() + ": ";
+            for (const QString& w : file.stream.warnings) {
+                warnings << prefix + w;
+            }
+            if (!file.stream.success) continue;
+            fileHashes.insert(file.path, file.stream.hash);
+            systemRules += file.rules;
+        }
+        
+        // Stamps differ but the bytes don't (touched, reinstalled, or
+        // stamped too soon after an Apply): the stream hashed them as it
+        // parsed, so nothing is read twice
+        if (ok && stored.ok && fileHashes == saved.fileHashes) {
+            return loadCached();
+        }
         
-        if (parseResult.success) {
-            result.rules = parseResult.rules;
+        if (ok) {
+            // Shards come back in file name order, so put the rules back in
+            // the order they were saved in; rules not saved go last
+            if (sharded) {
+                QHash<QUuid, int> savedOrder;
+                for (int i = 0; i < stored.rules.size(); ++i) {
+                    savedOrder.insert(stored.rules[i].id, i);
+                }
+                std::stable_sort(systemRules.begin(), systemRules.end(),
+                                 [&savedOrder](const UdevRule& a, const UdevRule& b) {
+                    return savedOrder.value(a.id, INT_MAX) < savedOrder.value(b.id, INT_MAX);
+                });
+            }
+            
+            // The rules file has no timestamps; keep the saved ones
+            QHash<QUuid, const UdevRule*> savedById;
+            for (const UdevRule& savedRule : std::as_const(stored.rules)) {
+                savedById.insert(savedRule.id, &savedRule);
+            }
+            for (auto& rule : systemRules) {
+                const UdevRule* savedRule = savedById.value(rule.id);
+                if (!savedRule) continue;
+                rule.createdAt = savedRule->createdAt;
+                rule.updatedAt = savedRule->updatedAt;
+            }
+            
+            const QString systemHash = combineFileHashes(fileHashes);
+            result.rules = std::move(systemRules);
             result.loadedFromSystem = true;
-            result.syncInfo.rulesFileHashAtLoad = systemHash;
-            result.syncInfo.lastSyncedFromRulesAt = QDateTime::currentDateTime();
+            resolveDeviceNames(result.rules);
+            if (saved.rulesFileHashAtLoad == systemHash) {
+                // Nothing changed since; the config stays as it is
+                result.syncInfo = saved;
+            } else {
+                result.syncInfo.rulesFileHashAtLoad = systemHash;
+                result.syncInfo.lastSyncedFromRulesAt = QDateTime::currentDateTime();
+            }
+            result.syncInfo.fileHashes = fileHashes;
+            result.syncInfo.fileStamps = stamps;
             
             // Apply notes to rules
             for (auto& rule : result.rules) {
@@ -181,23 +410,22 @@ ConfigStore::LoadResult ConfigStore::load() {
             }
             
             // Check if we have a config file with different hash
-            QFile configFile(getConfigPath());
-            if (configFile.exists() && configFile.open(QIODevice::ReadOnly)) {
-                QJsonDocument doc = QJsonDocument::fromJson(configFile.readAll());
-                configFile.close();
-                
-                QJsonObject root = doc.object();
-                QString savedHash = root["sync_info"].toObject()["rules_file_hash_at_load"].toString();
-                
-                if (!savedHash.isEmpty() && savedHash != systemHash) {
-                    result.warning = "System rules differ from saved config; loaded system rules.";
+            if (!saved.rulesFileHashAtLoad.isEmpty() && saved.rulesFileHashAtLoad != systemHash) {
+                // Configs from before per-file hashes can't say which
+                QStringList changed;
+                for (auto it = fileHashes.cbegin(); it != fileHashes.cend(); ++it) {
+                    if (saved.fileHashes.contains(it.key()) && saved.fileHashes.value(it.key()) != it.value()) {
+                        changed << QFileInfo(it.key()).fileName();
+                    }
                 }
+                result.warning = changed.isEmpty()
+                    ? "System rules differ from saved config; loaded system rules."
+                    : "System rules differ from saved config (" + changed.join(", ") + "); loaded system rules.";
             }
             
-            // Update config to match system rules
-            saveConfig(result.rules, result.syncInfo);
-            
-            for (const QString& w : parseResult.warnings) {
+            // Writing the config to match is up to the caller, see
+            // ConfigSession
+            for (const QString& w : std::as_const(warnings)) {
                 if (!result.warning.isEmpty()) result.warning += "\n";
                 result.warning += w;
             }
@@ -207,70 +435,114 @@ ConfigStore::LoadResult ConfigStore::load() {
     }
     
     // No system rules, try loading from config
-    QFile configFile(getConfigPath());
-    if (!configFile.exists()) {
+    StoredConfig stored = readConfig();
+    if (!stored.exists) {
         // Fresh start
         result.rules.clear();
         result.syncInfo = SyncInfo();
         return result;
     }
     
-    if (!configFile.open(QIODevice::ReadOnly)) {
+    if (!stored.ok) {
         result.success = false;
-        result.error = "Cannot open config file: " + getConfigPath();
+        result.error = stored.error;
         return result;
     }
     
-    QByteArray data = configFile.readAll();
-    configFile.close();
+    result.rules = std::move(stored.rules);
+    prepareRules(result.rules, notes);
+    result.syncInfo = stored.syncInfo;
     
-    QJsonParseError parseError;
-    QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
-    
-    if (parseError.error != QJsonParseError::NoError) {
-        result.success = false;
-        result.error = "JSON parse error: " + parseError.errorString();
-        return result;
+    return result;
+}
+
+ConfigStore::StoredConfig ConfigStore::readConfig() {
+    StoredConfig stored;
+    
+    // After a format switch the old file may linger if the app died before
+    // removing it; the newer one is current
+    const QFileInfo json(getConfigPath());
+    const QFileInfo cbor(getBinaryConfigPath());
+    if (!json.exists() && !cbor.exists()) return stored;
+    stored.exists = true;
+    
+    const bool binary = cbor.exists() && (!json.exists() || cbor.lastModified() >= json.lastModified());
+    QFile configFile(binary ? cbor.filePath() : json.filePath());
+    if (!configFile.open(QIODevice::ReadOnly)) {
+        stored.error = "Cannot open config file: " + configFile.fileName();
+        return stored;
     }
     
-    QJsonObject root = doc.object();
+    // Mapped: CBOR decodes from it directly, and the snapshot's digest for
+    // the journal comes from the same bytes
+    const qint64 size = configFile.size();
+    uchar* map = size > 0 ? configFile.map(0, size) : nullptr;
+    const QByteArray data = map ? QByteArray::fromRawData(reinterpret_cast<const char*>(map), size)
+                                : configFile.readAll();
     
-    // Load rules
-    QJsonArray rulesArray = root["rules"].toArray();
-    for (const QJsonValue& v : rulesArray) {
-        result.rules.append(UdevRule::fromJson(v.toObject()));
-    }
-    
-    // Apply notes to rules
-    for (auto& rule : result.rules) {
-        QString ruleId = rule.id.toString(QUuid::WithoutBraces);
-        if (notes.contains(ruleId)) {
-            rule.notes = notes[ruleId];
+    if (binary) {
+        stored.ok = ConfigCbor::read(data, stored.rules, stored.syncInfo, &stored.error);
+    } else {
+        QJsonParseError parseError;
+        const QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
+        if (parseError.error != QJsonParseError::NoError) {
+            stored.error = "JSON parse error: " + parseError.errorString();
+        } else {
+            const QJsonObject root = doc.object();
+            const QJsonArray rulesArray = root["rules"].toArray();
+            stored.rules.reserve(rulesArray.size());
+            for (const QJsonValue& v : rulesArray) {
+                stored.rules.append(UdevRule::fromJson(v.toObject()));
+            }
+            stored.syncInfo = SyncInfo::fromJson(root["sync_info"].toObject());
+            stored.ok = true;
         }
     }
     
-    // Load sync info
-    result.syncInfo = SyncInfo::fromJson(root["sync_info"].toObject());
+    // Changes saved since the snapshot was written
+    if (stored.ok) {
+        ConfigJournal journal(getJournalPath());
+        journal.load(ConfigJournal::snapshotDigest(data), &stored.rules, &stored.syncInfo);
+    }
     
-    return result;
+    if (map) configFile.unmap(map);
+    return stored;
 }
 
-bool ConfigStore::saveConfig(const QVector<UdevRule>& rules, const SyncInfo& syncInfo) {
-    ensureInstallDir();
+void ConfigStore::prepareRules(QVector<UdevRule>& rules, const QMap<QString, QString>& notes) {
+    resolveDeviceNames(rules);
     
-    // Save notes separately
-    QMap<QString, QString> notes;
-    for (const auto& rule : rules) {
-        if (!rule.notes.isEmpty()) {
-            notes[rule.id.toString(QUuid::WithoutBraces)] = rule.notes;
+    // Apply notes to rules
+    for (auto& rule : rules) {
+        auto it = notes.constFind(rule.id.toString(QUuid::WithoutBraces));
+        if (it != notes.constEnd()) {
+            rule.notes = it.value();
         }
     }
-    saveNotes(notes);
-    
-    // Cleanup orphaned notes
-    cleanupOrphanedNotes(rules);
+}
+
+void ConfigStore::resolveDeviceNames(QVector<UdevRule>& rules) {
+    // Names we've seen the device report win over the generic usb.ids ones
+    DeviceInventory inventory(getInventoryPath());
+    inventory.load();
+    const UsbIds& usbIds = UsbIds::instance();
+    
+    for (auto& rule : rules) {
+        for (auto& dev : rule.devices) {
+            if (!dev.name.isEmpty() && !dev.manufacturer.isEmpty()) continue;
+            if (const DeviceInventory::Entry* entry = inventory.find(dev)) {
+                if (dev.name.isEmpty()) dev.name = entry->device.name;
+                if (dev.manufacturer.isEmpty()) dev.manufacturer = entry->device.manufacturer;
+            }
+            if (dev.bus.isEmpty()) usbIds.resolve(dev);
+        }
+    }
+}
+
+QByteArray ConfigStore::serializeConfig(const QVector<UdevRule>& rules, const SyncInfo& syncInfo,
+                                        ConfigFormat format) {
+    if (format == ConfigFormat::Cbor) return ConfigCbor::write(rules, syncInfo);
     
-    // Save config (without notes in rule JSON - they're stored separately now)
     QJsonObject root;
     root["schema_version"] = SCHEMA_VERSION;
     
@@ -283,29 +555,91 @@ bool ConfigStore::saveConfig(const QVector<UdevRule>& rules, const SyncInfo& syn
     root["rules"] = rulesArray;
     root["sync_info"] = syncInfo.toJson();
     
-    QJsonDocument doc(root);
-    
-    QFile file(getConfigPath());
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        return false;
-    }
-    
-    file.write(doc.toJson(QJsonDocument::Indented));
-    file.close();
-    return true;
+    return QJsonDocument(root).toJson(QJsonDocument::Indented);
+}
+
+void ConfigStore::removeOtherConfig(ConfigFormat kept) {
+    QFile::remove(configPath(kept == ConfigFormat::Cbor ? ConfigFormat::Json : ConfigFormat::Cbor));
 }
 
 bool ConfigStore::saveStagedRules(const QString& content) {
     ensureInstallDir();
+    return writeFile(getStagedRulesPath(), content);
+}
+
+ConfigStore::ApplyPlan ConfigStore::planApply(const QVector<UdevRule>& rules, const AppSettings& settings) {
+    const bool sharded = settings.ruleLayout == RuleLayout::Sharded;
+    const bool hwdb = settings.ruleOutput == RuleOutput::Hwdb;
+    
+    // System path -> content of every udevme file once applied. With
+    // hwdb output the rules file doesn't depend on the rules, so only the
+    // hwdb side gets sharded.
+    QMap<QString, QString> files;
+    if (!sharded || hwdb) {
+        const QString hwdbFiles = sharded ? QString(ShardPrefix) + "*.hwdb"
+                                          : QFileInfo(getSystemHwdbPath()).fileName();
+        files.insert(getSystemRulesPath(),
+                     RuleGenerator::generateRulesFile(rules, settings.ruleOutput, hwdbFiles));
+    }
+    if (sharded) {
+        for (const UdevRule& rule : rules) {
+            if (!rule.enabled || rule.devices.isEmpty()) continue;
+            files.insert(shardPath(rule, settings.ruleOutput),
+                         hwdb ? RuleGenerator::generateHwdbFile({ rule })
+                              : RuleGenerator::generateRulesFile({ rule }, settings.ruleOutput));
+        }
+    } else if (hwdb) {
+        files.insert(getSystemHwdbPath(), RuleGenerator::generateHwdbFile(rules));
+    }
     
-    QFile file(getStagedRulesPath());
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
-        return false;
+    ApplyPlan plan;
+    const QMap<QString, QString> system = computeSystemFileHashes();
+    for (auto it = files.cbegin(); it != files.cend(); ++it) {
+        const QString hash = RuleParser::computeHash(it.value());
+        plan.expected.insert(it.key(), hash);
+        if (sharded && system.value(it.key()) == hash) continue;
+        
+        const QFileInfo info(it.key());
+        const QString stagedDir = info.fileName().startsWith(QLatin1String(ShardPrefix))
+            ? getStagedShardDir() : getInstallDir();
+        plan.write.append({ stagedDir + "/" + info.fileName(), it.key(), it.value() });
+        if (info.suffix() == "hwdb") plan.updateHwdb = true;
     }
+    for (auto it = system.cbegin(); it != system.cend(); ++it) {
+        if (files.contains(it.key())) continue;
+        plan.remove << it.key();
+        if (QFileInfo(it.key()).suffix() == "hwdb") plan.updateHwdb = true;
+    }
+    return plan;
+}
+
+bool ConfigStore::stageApply(const ApplyPlan& plan, QString* error) {
+    ensureInstallDir();
     
-    file.write(content.toUtf8());
-    file.close();
+    // Shards of earlier applies would only pile up
+    QDir shardDir(getStagedShardDir());
+    shardDir.removeRecursively();
+    shardDir.mkpath(".");
+    
+    for (const ApplyPlan::File& file : plan.write) {
+        if (!writeFile(file.stagedPath, file.content)) {
+            if (error) *error = "Cannot write " + file.stagedPath;
+            return false;
+        }
+    }
     return true;
 }
 
+QStringList ConfigStore::verifyApply(const ApplyPlan& plan) {
+    const QMap<QString, QString> system = computeSystemFileHashes();
+    QStringList mismatched;
+    for (auto it = plan.expected.cbegin(); it != plan.expected.cend(); ++it) {
+        if (system.value(it.key()) != it.value()) mismatched << it.key();
+    }
+    for (auto it = system.cbegin(); it != system.cend(); ++it) {
+        if (!plan.expected.contains(it.key())) mismatched << it.key();
+    }
+    return mismatched;
+}
+
 } // namespace udevme
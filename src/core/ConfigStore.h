@@ -12,39 +12,120 @@ class ConfigStore {
 public:
     static QString getInstallDir();
     static QString getConfigPath();
+    static QString getBinaryConfigPath();
+    static QString getJournalPath();
+    static QString configPath(ConfigFormat format);
     static QString getNotesPath();
     static QString getStagedRulesPath();
     static QString getSystemRulesPath();
+    static QString getStagedHwdbPath();
+    static QString getSystemHwdbPath();
+    static QString getStagedShardDir();
+    static QString getInventoryPath();
+    static QString getSettingsPath();
+
+    // Prefixed to the /etc/udev paths; tests point it at a temporary tree
+    static void setSystemRoot(const QString& root);
+    static QString systemRoot();
     
     struct LoadResult {
         QVector<UdevRule> rules;
         SyncInfo syncInfo;
         bool loadedFromSystem = false;
+        bool fromCache = false;     // system files unchanged; rules read from the config
         bool success = false;
         QString error;
         QString warning;
     };
     
+    // Reads the system rules, or the config without them; writes nothing
     static LoadResult load();
-    static bool saveConfig(const QVector<UdevRule>& rules, const SyncInfo& syncInfo);
+    // Json is also the export format
+    static QByteArray serializeConfig(const QVector<UdevRule>& rules, const SyncInfo& syncInfo,
+                                      ConfigFormat format = ConfigFormat::Json);
+    static void removeOtherConfig(ConfigFormat kept);
     static bool saveStagedRules(const QString& content);
     
-    // Notes management (stored separately from rules)
+    // What an Apply writes and removes. The single layout rewrites its
+    // files every time; the sharded one only the shards that differ from
+    // the system's copy.
+    struct ApplyPlan {
+        struct File {
+            QString stagedPath;
+            QString systemPath;
+            QString content;
+        };
+        QVector<File> write;
+        QStringList remove;                 // system paths
+        QMap<QString, QString> expected;    // every udevme file afterwards -> hash
+        bool updateHwdb = false;            // a .hwdb file is written or removed
+        
+        bool isEmpty() const { return write.isEmpty() && remove.isEmpty(); }
+    };
+    
+    static ApplyPlan planApply(const QVector<UdevRule>& rules, const AppSettings& settings);
+    static bool stageApply(const ApplyPlan& plan, QString* error = nullptr);
+    // Names the files that don't hold what the plan expects; empty if all do
+    static QStringList verifyApply(const ApplyPlan& plan);
+    
+    static AppSettings loadSettings();
+    static bool saveSettings(const AppSettings& settings);
+    
+    // Notes management (stored separately from rules); ConfigSession
+    // keeps them in memory while the app runs
     static QMap<QString, QString> loadNotes();
     static bool saveNotes(const QMap<QString, QString>& notes);
-    static bool saveNote(const QString& ruleId, const QString& note);
-    static QString getNote(const QString& ruleId);
-    static bool deleteNote(const QString& ruleId);
-    static void cleanupOrphanedNotes(const QVector<UdevRule>& currentRules);
+    static QByteArray serializeNotes(const QMap<QString, QString>& notes);
+    static QMap<QString, QString> notesOf(const QVector<UdevRule>& rules);
+    
+    // Replaces the file atomically unless it already holds exactly these
+    // bytes; 'written' tells which
+    static bool writeFileIfChanged(const QString& path, const QByteArray& bytes, bool* written = nullptr);
     
-    static QString readSystemRules();
-    static QString computeSystemRulesHash();
     static bool systemRulesExist();
+    static bool systemHwdbExists();
+    
+    // Every udevme file udev loads: the rules and hwdb files and the
+    // shards, as system path -> SHA-256 of its bytes (FileHash::sha256()).
+    // Shards are hashed in parallel; files whose stat() is unchanged since
+    // the last call keep their hash (see FileHash).
+    static QMap<QString, QString> computeSystemFileHashes();
+    // "dev:inode:size:mtime:ctime", cheap enough to check every file on each
+    // start; empty if the file can't be stat'ed or changed too recently to
+    // be told apart (FileHash::isRacy()), and an empty stamp never matches
+    static QString fileStamp(const QString& path);
+    static QMap<QString, QString> computeFileStamps(const QStringList& paths);
+    // One hash for a set of files; a lone file's own hash
+    static QString combineFileHashes(const QMap<QString, QString>& hashes);
     
     static bool ensureInstallDir();
     
 private:
     static constexpr int SCHEMA_VERSION = 1;
+    
+    // Shard file names: the prefix, the rule's id, .rules or .hwdb
+    static constexpr char ShardPrefix[] = "99-udevme-";
+    static QStringList systemShardPaths();
+    // The rules file, the hwdb file and the shards that exist
+    static QStringList systemFilePaths();
+    static QString shardPath(const UdevRule& rule, RuleOutput output);
+    
+    // Fills in names the rules file doesn't carry from the device
+    // inventory, then usb.ids
+    static void resolveDeviceNames(QVector<UdevRule>& rules);
+    
+    // The saved config from udevme.json or udevme.cbor with the journal
+    // replayed onto it, without notes
+    struct StoredConfig {
+        bool exists = false;
+        bool ok = false;
+        QString error;
+        QVector<UdevRule> rules;
+        SyncInfo syncInfo;
+    };
+    static StoredConfig readConfig();
+    // Device names and notes for rules read from the config
+    static void prepareRules(QVector<UdevRule>& rules, const QMap<QString, QString>& notes);
 };
 
 } // namespace udevme
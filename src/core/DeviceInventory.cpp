@@ -0,0 +1,263 @@
+#include "DeviceInventory.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+namespace udevme {
+
+namespace {
+
+// File header; bump the digits on incompatible record changes
+constexpr char kMagic[] = "UDMINV01";
+constexpr int kMagicSize = 8;
+
+// Record: u16 payload size, u16 CRC-16 of payload, payload
+constexpr int kRecordHeaderSize = 4;
+
+enum : quint8 {
+    FlagHidraw = 0x01,
+    FlagUsb = 0x02
+};
+
+template <typename T>
+void put(QByteArray& out, T value) {
+    char buf[sizeof(T)];
+    qToLittleEndian(value, buf);
+    out.append(buf, sizeof(T));
+}
+
+void putString(QByteArray& out, const QString& value) {
+    QByteArray utf8 = value.toUtf8().left(0xffff);
+    put<quint16>(out, static_cast<quint16>(utf8.size()));
+    out.append(utf8);
+}
+
+// Bounds-checked reader over one record payload
+class Reader {
+public:
+    Reader(const char* data, qsizetype size) : m_data(data), m_size(size) {}
+
+    template <typename T>
+    bool get(T* value) {
+        if (m_pos + qsizetype(sizeof(T)) > m_size) return false;
+        *value = qFromLittleEndian<T>(m_data + m_pos);
+        m_pos += sizeof(T);
+        return true;
+    }
+
+    bool getString(QString* value) {
+        quint16 len = 0;
+        if (!get(&len) || m_pos + len > m_size) return false;
+        *value = QString::fromUtf8(m_data + m_pos, len);
+        m_pos += len;
+        return true;
+    }
+
+private:
+    const char* m_data;
+    qsizetype m_size;
+    qsizetype m_pos = 0;
+};
+
+QString hexId(uint id) {
+    return QString("%1").arg(id, 4, 16, QLatin1Char('0'));
+}
+
+bool decode(const char* data, qsizetype size, DeviceInventory::Entry* entry) {
+    Reader r(data, size);
+    quint8 bus = 0;
+    quint8 flags = 0;
+    quint16 vid = 0;
+    quint16 pid = 0;
+    qint64 lastSeen = 0;
+
+    if (!r.get(&bus) || !r.get(&flags) || !r.get(&vid) || !r.get(&pid) || !r.get(&lastSeen) ||
+        !r.getString(&entry->device.name) || !r.getString(&entry->device.manufacturer)) {
+        return false;
+    }
+
+    entry->device.vendorId = hexId(vid);
+    entry->device.productId = hexId(pid);
+    entry->device.bus = hidBusName(bus);
+    entry->device.hasHidraw = flags & FlagHidraw;
+    entry->device.hasUsb = flags & FlagUsb;
+    entry->lastSeen = QDateTime::fromMSecsSinceEpoch(lastSeen, Qt::UTC);
+    return true;
+}
+
+bool sameStrings(const DeviceInfo& a, const DeviceInfo& b) {
+    return a.name == b.name && a.manufacturer == b.manufacturer &&
+           a.hasHidraw == b.hasHidraw && a.hasUsb == b.hasUsb;
+}
+
+} // namespace
+
+DeviceInventory::DeviceInventory(const QString& path) : m_path(path) {}
+
+quint64 DeviceInventory::key(const DeviceInfo& device) {
+    return device.deviceKey();
+}
+
+QByteArray DeviceInventory::encode(const Entry& entry) {
+    const DeviceInfo& dev = entry.device;
+    quint8 flags = (dev.hasHidraw ? FlagHidraw : 0) | (dev.hasUsb ? FlagUsb : 0);
+
+    QByteArray payload;
+    payload.reserve(16 + dev.name.size() + dev.manufacturer.size());
+    put<quint8>(payload, static_cast<quint8>(hidBusNumber(dev.bus)));
+    put<quint8>(payload, flags);
+    put<quint16>(payload, static_cast<quint16>(dev.vendorId.toUInt(nullptr, 16)));
+    put<quint16>(payload, static_cast<quint16>(dev.productId.toUInt(nullptr, 16)));
+    put<qint64>(payload, entry.lastSeen.toMSecsSinceEpoch());
+    putString(payload, dev.name);
+    putString(payload, dev.manufacturer);
+
+    QByteArray record;
+    record.reserve(kRecordHeaderSize + payload.size());
+    put<quint16>(record, static_cast<quint16>(payload.size()));
+    put<quint16>(record, qChecksum(payload));
+    record.append(payload);
+    return record;
+}
+
+bool DeviceInventory::load() {
+    m_entries.clear();
+    m_records = 0;
+
+    QFile file(m_path);
+    if (!file.exists()) return true;
+    if (!file.open(QIODevice::ReadWrite)) return false;
+
+    const qint64 size = file.size();
+    if (size < kMagicSize) {
+        // Torn header: nothing of value was written yet
+        return file.resize(0);
+    }
+
+    char magic[kMagicSize];
+    if (file.read(magic, kMagicSize) != kMagicSize) return false;
+    if (memcmp(magic, kMagic, kMagicSize) != 0) {
+        // Not ours, or from a version with other records: set aside, so
+        // appends start a new log instead of following something unreadable
+        file.close();
+        const QString aside = m_path + ".bad";
+        QFile::remove(aside);
+        return QFile::rename(m_path, aside) || QFile::resize(m_path, 0);
+    }
+
+    const uchar* map = file.map(0, size);
+    QByteArray copy;
+    const char* data = reinterpret_cast<const char*>(map);
+    if (!data) {
+        file.seek(0);
+        copy = file.readAll();
+        data = copy.constData();
+    }
+
+    qint64 pos = kMagicSize;
+    while (pos + kRecordHeaderSize <= size) {
+        quint16 payloadSize = qFromLittleEndian<quint16>(data + pos);
+        quint16 crc = qFromLittleEndian<quint16>(data + pos + 2);
+        const char* payload = data + pos + kRecordHeaderSize;
+        if (pos + kRecordHeaderSize + payloadSize > size) break;
+        if (qChecksum(QByteArrayView(payload, payloadSize)) != crc) break;
+
+        Entry entry;
+        if (!decode(payload, payloadSize, &entry)) break;
+
+        // Later records win
+        m_entries.insert(key(entry.device), entry);
+        ++m_records;
+        pos += kRecordHeaderSize + payloadSize;
+    }
+
+    if (map) file.unmap(const_cast<uchar*>(map));
+
+    // Drop a partial record so the next append starts on a boundary
+    if (pos < size) return file.resize(pos);
+    return true;
+}
+
+bool DeviceInventory::record(const QVector<DeviceInfo>& devices, const QDateTime& seenAt) {
+    QByteArray pending;
+
+    for (const DeviceInfo& dev : devices) {
+        if (dev.vendorId.isEmpty() || dev.productId.isEmpty()) continue;
+
+        Entry updated;
+        updated.device = dev;
+        updated.device.sysPath.clear();
+        updated.device.hidrawNodes.clear();
+        updated.lastSeen = seenAt;
+
+        auto it = m_entries.find(key(dev));
+        if (it != m_entries.end()) {
+            // Backends without string descriptors shouldn't erase known names
+            if (updated.device.name.isEmpty()) updated.device.name = it->device.name;
+            if (updated.device.manufacturer.isEmpty()) updated.device.manufacturer = it->device.manufacturer;
+
+            if (sameStrings(it->device, updated.device) &&
+                it->lastSeen.secsTo(seenAt) < kTouchIntervalSecs) {
+                continue;
+            }
+            *it = updated;
+        } else {
+            m_entries.insert(key(dev), updated);
+        }
+
+        pending += encode(updated);
+        ++m_records;
+    }
+
+    if (pending.isEmpty()) return true;
+
+    if (m_records > 2 * m_entries.size() + kCompactSlack) {
+        return compact();
+    }
+
+    QDir().mkpath(QFileInfo(m_path).path());
+    QFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) return false;
+    if (file.size() == 0) file.write(kMagic, kMagicSize);
+    return file.write(pending) == pending.size();
+}
+
+const DeviceInventory::Entry* DeviceInventory::find(const DeviceInfo& device) const {
+    auto it = m_entries.constFind(key(device));
+    return it != m_entries.cend() ? &it.value() : nullptr;
+}
+
+QVector<DeviceInventory::Entry> DeviceInventory::seenSince(const QDateTime& since) const {
+    QVector<Entry> list;
+    for (const Entry& entry : m_entries) {
+        if (entry.lastSeen >= since) list.append(entry);
+    }
+    std::sort(list.begin(), list.end(), [](const Entry& a, const Entry& b) {
+        if (a.lastSeen != b.lastSeen) return a.lastSeen > b.lastSeen;
+        return a.device.vidPid() < b.device.vidPid();
+    });
+    return list;
+}
+
+bool DeviceInventory::compact() {
+    QDir().mkpath(QFileInfo(m_path).path());
+
+    QSaveFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    file.write(kMagic, kMagicSize);
+    for (const Entry& entry : m_entries) {
+        file.write(encode(entry));
+    }
+    if (!file.commit()) return false;
+
+    m_records = m_entries.size();
+    return true;
+}
+
+} // namespace udevme
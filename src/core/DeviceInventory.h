@@ -0,0 +1,65 @@
+#ifndef DEVICEINVENTORY_H
+#define DEVICEINVENTORY_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QDateTime>
+#include "Types.h"
+
+namespace udevme {
+
+// Every device the scanner has ever reported, with its strings and when it
+// was last seen. Lets rules loaded from the rules file (which only carry
+// vid:pid) show product names, and lists unplugged devices without a scan.
+//
+// On disk it is an append-only log of small binary records; a device that
+// changes or is seen again after kTouchIntervalSecs appends one record, and
+// the log is rewritten once stale records outnumber live ones.
+class DeviceInventory {
+public:
+    struct Entry {
+        DeviceInfo device;      // sysPath is not stored
+        QDateTime lastSeen;
+    };
+
+    explicit DeviceInventory(const QString& path);
+
+    // Reads the log. A missing file is an empty inventory; a torn last
+    // record (crash during append) is dropped and truncated away, and a
+    // file without our header is renamed to <path>.bad.
+    bool load();
+
+    // Records devices seen at seenAt; only changes reach the disk. Names
+    // are kept as the devices reported them, so pass devices scanned
+    // without usb.ids resolution (see DeviceScanner::setNameResolution()).
+    bool record(const QVector<DeviceInfo>& devices,
+                const QDateTime& seenAt = QDateTime::currentDateTimeUtc());
+
+    // O(1) lookup by vid:pid and bus; nullptr for unknown devices
+    const Entry* find(const DeviceInfo& device) const;
+
+    // Entries seen at or after since, most recent first
+    QVector<Entry> seenSince(const QDateTime& since) const;
+
+    int size() const { return m_entries.size(); }
+    int recordCount() const { return m_records; }
+
+    // Rewrites the log with one record per device
+    bool compact();
+
+private:
+    static constexpr qint64 kTouchIntervalSecs = 60 * 60;
+    static constexpr int kCompactSlack = 64;
+
+    static quint64 key(const DeviceInfo& device);
+    static QByteArray encode(const Entry& entry);
+
+    QString m_path;
+    QHash<quint64, Entry> m_entries;
+    int m_records = 0;
+};
+
+} // namespace udevme
+
+#endif // DEVICEINVENTORY_H
@@ -1,19 +1,190 @@
 #include "DeviceScanner.h"
+#include "BatchFileReader.h"
+#include "TextScan.h"
+#include "UsbIds.h"
 #include <QDir>
 #include <QFile>
 #include <QProcess>
 #include <QRegularExpression>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QSet>
+#include <QStandardPaths>
 #include <QDebug>
 
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
 namespace udevme {
 
+namespace {
+
+// Hotplug events arriving within this window are delivered as one batch
+constexpr int kCoalesceIntervalMs = 200;
+
+// Receive buffer for the uevent socket, so a hotplug storm (a hub with a
+// dozen devices) fits before the event loop gets to it
+constexpr int kUeventBufferSize = 4 * 1024 * 1024;
+
+// One entry per bus and vid:pid; the same model on USB and Bluetooth stays
+QVector<DeviceInfo> uniqueByDeviceKey(const QVector<DeviceInfo>& devices) {
+    QVector<DeviceInfo> unique;
+    QSet<quint64> seen;
+    for (const auto& d : devices) {
+        const quint64 key = d.deviceKey();
+        if (!seen.contains(key) && !d.vendorId.isEmpty() && !d.productId.isEmpty()) {
+            seen.insert(key);
+            unique.append(d);
+        }
+    }
+    return unique;
+}
+
+// Extracts vid/pid from a NUL-terminated usb uevent. Returns false for
+// interfaces and anything without a PRODUCT=vid/pid/bcd line.
+bool parseUsbUevent(const char* data, uint* vendorId, uint* productId) {
+    bool isUsbDevice = false;
+    bool hasProduct = false;
+    
+    for (const char* line = data; line && *line;) {
+        const char* eol = strchr(line, '\n');
+        
+        if (strncmp(line, "DEVTYPE=usb_device", 18) == 0 &&
+            (line[18] == '\n' || line[18] == '\0')) {
+            isUsbDevice = true;
+        } else if (strncmp(line, "PRODUCT=", 8) == 0) {
+            char* next = nullptr;
+            *vendorId = static_cast<uint>(strtoul(line + 8, &next, 16));
+            if (*next == '/') {
+                *productId = static_cast<uint>(strtoul(next + 1, &next, 16));
+                hasProduct = (*next == '/');
+            }
+        }
+        
+        line = eol ? eol + 1 : nullptr;
+    }
+    
+    return isUsbDevice && hasProduct;
+}
+
+// Extracts bus/vid/pid from HID_ID=bbbb:vvvvvvvv:pppppppp and the HID_NAME
+// of a NUL-terminated HID device uevent.
+bool parseHidUevent(const char* data, uint* bus, uint* vendorId, uint* productId, QString* name) {
+    bool hasId = false;
+    
+    for (const char* line = data; line && *line;) {
+        const char* eol = strchr(line, '\n');
+        
+        if (strncmp(line, "HID_ID=", 7) == 0) {
+            char* next = nullptr;
+            *bus = static_cast<uint>(strtoul(line + 7, &next, 16));
+            if (*next == ':') {
+                *vendorId = static_cast<uint>(strtoul(next + 1, &next, 16)) & 0xffff;
+                if (*next == ':') {
+                    *productId = static_cast<uint>(strtoul(next + 1, &next, 16)) & 0xffff;
+                    hasId = true;
+                }
+            }
+        } else if (strncmp(line, "HID_NAME=", 9) == 0) {
+            qsizetype len = eol ? eol - (line + 9) : qsizetype(strlen(line + 9));
+            *name = QString::fromUtf8(line + 9, len).trimmed();
+        }
+        
+        line = eol ? eol + 1 : nullptr;
+    }
+    
+    return hasId;
+}
+
+// Bus number from a HID device kernel name like "0005:046D:B01A.0003"
+uint hidBusFromKernelName(const QString& name) {
+    bool ok = false;
+    uint bus = name.left(4).toUInt(&ok, 16);
+    return ok ? bus : 0;
+}
+
+// Decodes udev's \xHH escaping used by the *_ENC properties
+QString decodeUdevString(const char* data, qsizetype len) {
+    QByteArray out;
+    out.reserve(len);
+    for (qsizetype i = 0; i < len; ++i) {
+        if (data[i] == '\\' && i + 3 < len && data[i + 1] == 'x') {
+            char hex[3] = { data[i + 2], data[i + 3], '\0' };
+            char* end = nullptr;
+            long value = strtol(hex, &end, 16);
+            if (end == hex + 2) {
+                out.append(static_cast<char>(value));
+                i += 3;
+                continue;
+            }
+        }
+        out.append(data[i]);
+    }
+    return QString::fromUtf8(out).trimmed();
+}
+
+// Parses the E: properties of a NUL-terminated /run/udev/data entry. Only
+// the handful of keys we use are turned into strings.
+DeviceInfo parseUdevDbEntry(const char* data) {
+    DeviceInfo dev;
+    QString model, modelFromDb, vendor, vendorFromDb;
+    
+    for (const char* line = data; line && *line;) {
+        const char* eol = strchr(line, '\n');
+        const char* end = eol ? eol : line + strlen(line);
+        
+        if (line[0] == 'E' && line[1] == ':') {
+            const char* key = line + 2;
+            const char* eq = static_cast<const char*>(memchr(key, '=', end - key));
+            if (eq) {
+                const char* value = eq + 1;
+                qsizetype valueLen = end - value;
+                auto keyIs = [key, eq](const char* name) {
+                    size_t len = strlen(name);
+                    return size_t(eq - key) == len && memcmp(key, name, len) == 0;
+                };
+                
+                if (keyIs("ID_VENDOR_ID")) dev.vendorId = QString::fromLatin1(value, valueLen);
+                else if (keyIs("ID_MODEL_ID")) dev.productId = QString::fromLatin1(value, valueLen);
+                else if (keyIs("ID_MODEL_ENC")) model = decodeUdevString(value, valueLen);
+                else if (keyIs("ID_VENDOR_ENC")) vendor = decodeUdevString(value, valueLen);
+                else if (keyIs("ID_MODEL_FROM_DATABASE")) modelFromDb = QString::fromUtf8(value, valueLen);
+                else if (keyIs("ID_VENDOR_FROM_DATABASE")) vendorFromDb = QString::fromUtf8(value, valueLen);
+            }
+        }
+        
+        line = eol ? eol + 1 : nullptr;
+    }
+    
+    // usb_id falls back to the hex IDs when the device has no strings;
+    // prefer the hwdb names in that case
+    dev.name = (model.isEmpty() || model == dev.productId) ? modelFromDb : model;
+    dev.manufacturer = (vendor.isEmpty() || vendor == dev.vendorId) ? vendorFromDb : vendor;
+    return dev;
+}
+
+QString hexId(uint id) {
+    return QString("%1").arg(id, 4, 16, QLatin1Char('0'));
+}
+
+} // namespace
+
 DeviceScanner::DeviceScanner(QObject* parent) : QObject(parent) {}
 
+DeviceScanner::~DeviceScanner() {
+    stopMonitoring();
+}
+
 bool DeviceScanner::commandExists(const QString& cmd) const {
-    QProcess proc;
-    proc.start("which", {cmd});
-    proc.waitForFinished(3000);
-    return proc.exitCode() == 0;
+    // PATH lookup in-process; no need to fork `which`
+    return !QStandardPaths::findExecutable(cmd).isEmpty();
 }
 
 bool DeviceScanner::isUdevadmAvailable() const {
@@ -35,77 +206,262 @@ QVector<DeviceInfo> DeviceScanner::scanDevices() {
     emit scanProgress("Scanning USB devices...");
     
     QVector<DeviceInfo> devices;
+    m_stats = ScanStats();
     
     // Primary: scan /sys/bus/usb/devices
-    devices = scanViaSys();
+    devices = scanUsbBus();
     
     // Enrich with hidraw info
     enrichWithHidrawInfo(devices);
     
-    // Remove duplicates by vid:pid
-    QVector<DeviceInfo> unique;
-    QSet<QString> seen;
-    for (const auto& d : devices) {
-        QString key = d.vidPid();
-        if (!seen.contains(key) && !d.vendorId.isEmpty() && !d.productId.isEmpty()) {
-            seen.insert(key);
-            unique.append(d);
-        }
+    // Remove duplicates by bus and vid:pid
+    QVector<DeviceInfo> unique = uniqueByDeviceKey(devices);
+    for (DeviceInfo& dev : unique) {
+        resolveNames(dev);
     }
     
     emit scanComplete(unique);
     return unique;
 }
 
+void DeviceScanner::resolveNames(DeviceInfo& device) const {
+    // usb.ids only covers USB-IF vendor IDs; Bluetooth IDs may be SIG-assigned
+    if (m_resolveNames && device.bus.isEmpty()) {
+        UsbIds::instance().resolve(device);
+    }
+}
+
+QVector<DeviceInfo> DeviceScanner::scanUsbBus() {
+    switch (m_backend) {
+        case Backend::Sysfs: return scanViaSys();
+        case Backend::SysfsUevent: return scanViaSysUevent();
+        case Backend::UdevDatabase: return scanViaUdevDatabase();
+        case Backend::Udevadm: return scanViaUdevadm();
+    }
+    return scanViaSysUevent();
+}
+
+DeviceInfo DeviceScanner::readUsbDevice(const QString& path) {
+    DeviceInfo dev;
+    
+    // Read vendor and product IDs
+    QFile vidFile(path + "/idVendor");
+    QFile pidFile(path + "/idProduct");
+    
+    m_stats.statCalls += 2;
+    if (!vidFile.exists() || !pidFile.exists()) return dev;
+    
+    if (vidFile.open(QIODevice::ReadOnly)) {
+        ++m_stats.filesOpened;
+        ++m_stats.readCalls;
+        dev.vendorId = QString::fromUtf8(vidFile.readAll()).trimmed();
+        vidFile.close();
+    }
+    
+    if (pidFile.open(QIODevice::ReadOnly)) {
+        ++m_stats.filesOpened;
+        ++m_stats.readCalls;
+        dev.productId = QString::fromUtf8(pidFile.readAll()).trimmed();
+        pidFile.close();
+    }
+    
+    // Skip root hubs and empty IDs
+    if (dev.vendorId.isEmpty() || dev.productId.isEmpty() ||
+        dev.vendorId == "1d6b") { // Linux Foundation root hub
+        return DeviceInfo();
+    }
+    
+    // Read product name
+    QFile prodFile(path + "/product");
+    if (prodFile.open(QIODevice::ReadOnly)) {
+        ++m_stats.filesOpened;
+        ++m_stats.readCalls;
+        dev.name = QString::fromUtf8(prodFile.readAll()).trimmed();
+        prodFile.close();
+    }
+    
+    // Read manufacturer
+    QFile mfgFile(path + "/manufacturer");
+    if (mfgFile.open(QIODevice::ReadOnly)) {
+        ++m_stats.filesOpened;
+        ++m_stats.readCalls;
+        dev.manufacturer = QString::fromUtf8(mfgFile.readAll()).trimmed();
+        mfgFile.close();
+    }
+    
+    dev.sysPath = path;
+    dev.hasUsb = true;
+    
+    return dev;
+}
+
 QVector<DeviceInfo> DeviceScanner::scanViaSys() {
     QVector<DeviceInfo> devices;
-    QDir usbDir("/sys/bus/usb/devices");
+    QDir usbDir(m_sysfsRoot + "/bus/usb/devices");
     
     for (const QString& entry : usbDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
-        QString path = usbDir.filePath(entry);
-        
-        // Read vendor and product IDs
-        QFile vidFile(path + "/idVendor");
-        QFile pidFile(path + "/idProduct");
-        
-        if (!vidFile.exists() || !pidFile.exists()) continue;
+        ++m_stats.devicesVisited;
+        DeviceInfo dev = readUsbDevice(usbDir.filePath(entry));
+        if (!dev.vendorId.isEmpty()) {
+            devices.append(dev);
+        }
+    }
+    
+    return devices;
+}
+
+qsizetype DeviceScanner::readInto(int dirFd, const char* name, QByteArray& buffer) {
+    int fd = ::openat(dirFd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ++m_stats.filesOpened;
+    
+    // sysfs hands back a whole attribute (at most one page) in a single read
+    ssize_t n = ::read(fd, buffer.data(), buffer.size() - 1);
+    ++m_stats.readCalls;
+    ::close(fd);
+    
+    if (n < 0) return -1;
+    buffer[n] = '\0';
+    return n;
+}
+
+void DeviceScanner::countBatch(const QVector<BatchFileReader::Request>& requests) {
+    for (const auto& r : requests) {
+        if (!r.ok) continue;
+        ++m_stats.filesOpened;
+        ++m_stats.readCalls;
+    }
+}
+
+QVector<DeviceInfo> DeviceScanner::scanViaSysUevent() {
+    QVector<DeviceInfo> devices;
+    const QString busPath = m_sysfsRoot + "/bus/usb/devices";
+    
+    int busFd = ::open(QFile::encodeName(busPath).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (busFd < 0) return devices;
+    
+    DIR* dir = ::fdopendir(busFd);
+    if (!dir) {
+        ::close(busFd);
+        return devices;
+    }
+    
+    // Sort like QDir does so both backends return devices in the same order
+    QVector<QByteArray> entries;
+    while (dirent* ent = ::readdir(dir)) {
+        if (ent->d_name[0] != '.') entries.append(QByteArray(ent->d_name));
+    }
+    std::sort(entries.begin(), entries.end());
+    m_stats.devicesVisited += entries.size();
+    
+    // Pass 1: one uevent per device, all read relative to the bus dirfd in one batch
+    QVector<BatchFileReader::Request> uevents(entries.size());
+    for (int i = 0; i < entries.size(); ++i) {
+        uevents[i].path = entries[i] + "/uevent";
+    }
+    BatchFileReader::readAll(busFd, uevents, 4096);
+    countBatch(uevents);
+    
+    QHash<quint32, int> firstByVidPid;
+    QVector<int> sameAs;                            // per device: first device with same vid:pid
+    QVector<BatchFileReader::Request> strings;      // product + manufacturer, first of each vid:pid only
+    QVector<int> stringOwners;
+    
+    for (int i = 0; i < entries.size(); ++i) {
+        uint vid = 0;
+        uint pid = 0;
+        if (!uevents[i].ok ||
+            !parseUsbUevent(uevents[i].data.constData(), &vid, &pid) ||
+            vid == 0x1d6b) { // Linux Foundation root hub
+            continue;
+        }
         
         DeviceInfo dev;
+        dev.vendorId = hexId(vid);
+        dev.productId = hexId(pid);
+        dev.sysPath = busPath + '/' + QString::fromLocal8Bit(entries[i]);
+        dev.hasUsb = true;
         
-        if (vidFile.open(QIODevice::ReadOnly)) {
-            dev.vendorId = QString::fromUtf8(vidFile.readAll()).trimmed();
-            vidFile.close();
+        quint32 key = (vid << 16) | pid;
+        auto known = firstByVidPid.constFind(key);
+        if (known != firstByVidPid.cend()) {
+            sameAs.append(known.value());
+        } else {
+            firstByVidPid.insert(key, devices.size());
+            sameAs.append(-1);
+            stringOwners.append(devices.size());
+            strings.append(BatchFileReader::Request{entries[i] + "/product", QByteArray(), false});
+            strings.append(BatchFileReader::Request{entries[i] + "/manufacturer", QByteArray(), false});
         }
+        devices.append(dev);
+    }
+    
+    uevents.clear();
+    
+    // Pass 2: string attributes, only for devices that will be shown
+    BatchFileReader::readAll(busFd, strings, 4096);
+    countBatch(strings);
+    ::closedir(dir);
+    
+    for (int j = 0; j < stringOwners.size(); ++j) {
+        DeviceInfo& dev = devices[stringOwners[j]];
+        if (strings[2 * j].ok) dev.name = QString::fromUtf8(strings[2 * j].data).trimmed();
+        if (strings[2 * j + 1].ok) dev.manufacturer = QString::fromUtf8(strings[2 * j + 1].data).trimmed();
+    }
+    
+    // Same model on another port: share the strings we already read
+    for (int i = 0; i < devices.size(); ++i) {
+        if (sameAs[i] < 0) continue;
+        devices[i].name = devices[sameAs[i]].name;
+        devices[i].manufacturer = devices[sameAs[i]].manufacturer;
+    }
+    
+    return devices;
+}
+
+QVector<DeviceInfo> DeviceScanner::scanViaUdevDatabase() {
+    QVector<DeviceInfo> devices;
+    const QString dataPath = m_udevDataPath;
+    
+    int dataFd = ::open(QFile::encodeName(dataPath).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dataFd < 0) return devices;
+    
+    DIR* dir = ::fdopendir(dataFd);
+    if (!dir) {
+        ::close(dataFd);
+        return devices;
+    }
+    
+    // USB device nodes are char major 189; everything else is skipped unread
+    QVector<QByteArray> entries;
+    while (dirent* ent = ::readdir(dir)) {
+        if (strncmp(ent->d_name, "c189:", 5) == 0) entries.append(QByteArray(ent->d_name));
+    }
+    std::sort(entries.begin(), entries.end());
+    
+    QByteArray buffer(8192, Qt::Uninitialized);  // reused for every entry
+    
+    for (const QByteArray& entry : entries) {
+        ++m_stats.devicesVisited;
         
-        if (pidFile.open(QIODevice::ReadOnly)) {
-            dev.productId = QString::fromUtf8(pidFile.readAll()).trimmed();
-            pidFile.close();
+        qsizetype n = readInto(dataFd, entry.constData(), buffer);
+        while (n == buffer.size() - 1) {
+            // Entry didn't fit; grow once and read it again
+            buffer.resize(buffer.size() * 2);
+            n = readInto(dataFd, entry.constData(), buffer);
         }
+        if (n <= 0) continue;
         
-        // Skip root hubs and empty IDs
+        DeviceInfo dev = parseUdevDbEntry(buffer.constData());
         if (dev.vendorId.isEmpty() || dev.productId.isEmpty()) continue;
         if (dev.vendorId == "1d6b") continue; // Linux Foundation root hub
         
-        // Read product name
-        QFile prodFile(path + "/product");
-        if (prodFile.open(QIODevice::ReadOnly)) {
-            dev.name = QString::fromUtf8(prodFile.readAll()).trimmed();
-            prodFile.close();
-        }
-        
-        // Read manufacturer
-        QFile mfgFile(path + "/manufacturer");
-        if (mfgFile.open(QIODevice::ReadOnly)) {
-            dev.manufacturer = QString::fromUtf8(mfgFile.readAll()).trimmed();
-            mfgFile.close();
-        }
-        
-        dev.sysPath = path;
+        dev.sysPath = m_sysfsRoot + "/dev/char/" + QString::fromLatin1(entry.mid(1));
         dev.hasUsb = true;
-        
         devices.append(dev);
     }
     
+    ::closedir(dir);
     return devices;
 }
 
@@ -114,30 +470,33 @@ QVector<DeviceInfo> DeviceScanner::scanViaUdevadm() {
     
     if (!isUdevadmAvailable()) return devices;
     
-    QString output = runCommand("udevadm", {"info", "--export-db"});
+    const QString output = runCommand("udevadm", {"info", "--export-db"});
     
     DeviceInfo current;
     bool inUsbDevice = false;
     
-    for (const QString& line : output.split('\n')) {
-        if (line.startsWith("P:")) {
+    // The export runs to megabytes; walk it as views instead of splitting
+    qsizetype pos = 0;
+    QStringView line;
+    while (TextScan::nextLine(output, pos, line)) {
+        if (line.startsWith(u"P:")) {
             // New device path
             if (inUsbDevice && !current.vendorId.isEmpty()) {
                 devices.append(current);
             }
             current = DeviceInfo();
-            inUsbDevice = line.contains("/usb");
-        } else if (line.startsWith("E:")) {
-            QString prop = line.mid(2).trimmed();
-            int eq = prop.indexOf('=');
+            inUsbDevice = line.contains(u"/usb");
+        } else if (line.startsWith(u"E:")) {
+            const QStringView prop = line.sliced(2).trimmed();
+            const qsizetype eq = TextScan::indexOf(prop, u'=');
             if (eq > 0) {
-                QString key = prop.left(eq);
-                QString val = prop.mid(eq + 1);
+                const QStringView key = prop.first(eq);
+                const QStringView val = prop.sliced(eq + 1);
                 
-                if (key == "ID_VENDOR_ID") current.vendorId = val;
-                else if (key == "ID_MODEL_ID") current.productId = val;
-                else if (key == "ID_MODEL") current.name = val.replace('_', ' ');
-                else if (key == "ID_VENDOR") current.manufacturer = val.replace('_', ' ');
+                if (key == u"ID_VENDOR_ID") current.vendorId = val.toString();
+                else if (key == u"ID_MODEL_ID") current.productId = val.toString();
+                else if (key == u"ID_MODEL") current.name = val.toString().replace('_', ' ');
+                else if (key == u"ID_VENDOR") current.manufacturer = val.toString().replace('_', ' ');
             }
         }
     }
@@ -149,51 +508,363 @@ QVector<DeviceInfo> DeviceScanner::scanViaUdevadm() {
     return devices;
 }
 
+QVector<DeviceScanner::HidrawNode> DeviceScanner::scanHidrawNodes() {
+    QVector<HidrawNode> nodes;
+    
+    const QByteArray classPath = QFile::encodeName(m_sysfsRoot + "/class/hidraw");
+    int classFd = ::open(classPath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (classFd < 0) return nodes;
+    
+    DIR* dir = ::fdopendir(classFd);
+    if (!dir) {
+        ::close(classFd);
+        return nodes;
+    }
+    
+    QByteArray buffer(4096, Qt::Uninitialized);
+    char link[PATH_MAX];
+    
+    while (dirent* ent = ::readdir(dir)) {
+        if (ent->d_name[0] == '.') continue;
+        
+        HidrawNode node;
+        node.node = QString::fromLocal8Bit(ent->d_name);
+        
+        // The class symlink target carries the full ancestry, so no parent walk
+        ssize_t len = ::readlinkat(classFd, ent->d_name, link, sizeof(link) - 1);
+        if (len > 0) node.devpath = QString::fromLocal8Bit(link, static_cast<int>(len));
+        
+        QByteArray ueventPath = QByteArray(ent->d_name) + "/device/uevent";
+        if (readInto(classFd, ueventPath.constData(), buffer) <= 0) continue;
+        if (!parseHidUevent(buffer.constData(), &node.bus, &node.vendorId,
+                            &node.productId, &node.name)) continue;
+        
+        nodes.append(node);
+    }
+    
+    ::closedir(dir);
+    
+    std::sort(nodes.begin(), nodes.end(), [](const HidrawNode& a, const HidrawNode& b) {
+        return a.node < b.node;
+    });
+    return nodes;
+}
+
+DeviceInfo DeviceScanner::deviceFromHidrawNode(const HidrawNode& node) const {
+    DeviceInfo dev;
+    dev.vendorId = hexId(node.vendorId);
+    dev.productId = hexId(node.productId);
+    dev.name = node.name;
+    dev.bus = hidBusName(node.bus);
+    dev.sysPath = m_sysfsRoot + "/class/hidraw/" + node.node;
+    dev.hidrawNodes.append("/dev/" + node.node);
+    dev.hasHidraw = true;
+    return dev;
+}
+
 void DeviceScanner::enrichWithHidrawInfo(QVector<DeviceInfo>& devices) {
-    // Scan /sys/class/hidraw to find which devices have hidraw
-    QDir hidrawDir("/sys/class/hidraw");
-    
-    if (!hidrawDir.exists()) return;
-    
-    for (const QString& entry : hidrawDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
-        QString devicePath = hidrawDir.filePath(entry + "/device");
-        QFileInfo linkInfo(devicePath);
-        
-        if (!linkInfo.isSymLink()) continue;
-        
-        QString realPath = linkInfo.symLinkTarget();
-        
-        // Walk up to find USB device info
-        QDir parent(realPath);
-        for (int i = 0; i < 10; ++i) {
-            parent.cdUp();
-            QString vidPath = parent.filePath("idVendor");
-            QString pidPath = parent.filePath("idProduct");
-            
-            if (QFile::exists(vidPath) && QFile::exists(pidPath)) {
-                QString vid, pid;
-                QFile vf(vidPath);
-                if (vf.open(QIODevice::ReadOnly)) {
-                    vid = QString::fromUtf8(vf.readAll()).trimmed();
-                    vf.close();
-                }
-                QFile pf(pidPath);
-                if (pf.open(QIODevice::ReadOnly)) {
-                    pid = QString::fromUtf8(pf.readAll()).trimmed();
-                    pf.close();
-                }
-                
-                // Mark matching device as having hidraw
-                for (auto& dev : devices) {
-                    if (dev.vendorId.compare(vid, Qt::CaseInsensitive) == 0 &&
-                        dev.productId.compare(pid, Qt::CaseInsensitive) == 0) {
-                        dev.hasHidraw = true;
-                    }
-                }
-                break;
+    // Index devices by (bus, vid:pid) so merging each hidraw node is O(1).
+    // The bus is part of the key because the same model can show up over
+    // USB and Bluetooth, and those need different rules.
+    auto indexKey = [](uint bus, quint32 vidPid) {
+        return (quint64(bus) << 32) | vidPid;
+    };
+    
+    QHash<quint64, int> index;
+    index.reserve(devices.size());
+    for (int i = 0; i < devices.size(); ++i) {
+        quint64 key = indexKey(hidBusNumber(devices[i].bus), devices[i].vidPidKey());
+        if (!index.contains(key)) index.insert(key, i);
+    }
+    
+    for (const HidrawNode& node : scanHidrawNodes()) {
+        quint64 key = indexKey(node.bus, (node.vendorId << 16) | node.productId);
+        
+        auto it = index.constFind(key);
+        if (it != index.cend()) {
+            devices[it.value()].hasHidraw = true;
+            devices[it.value()].hidrawNodes.append("/dev/" + node.node);
+            continue;
+        }
+        
+        // USB HID whose parent we skipped (e.g. a root hub) stays hidden
+        if (node.bus == HidBusUsb) continue;
+        
+        // Bluetooth/I2C HID devices have no USB idVendor ancestor
+        index.insert(key, devices.size());
+        devices.append(deviceFromHidrawNode(node));
+    }
+}
+
+// Hotplug monitor
+
+bool DeviceScanner::startMonitoring() {
+    if (isMonitoring()) return true;
+    
+    int fd = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                      NETLINK_KOBJECT_UEVENT);
+    if (fd < 0) {
+        emit scanError(QString("Cannot open uevent socket: %1")
+            .arg(QString::fromLocal8Bit(strerror(errno))));
+        return false;
+    }
+    
+    // Group 1 carries raw kernel uevents; they arrive before udev has run
+    // rules, but sysfs attributes already exist at that point.
+    sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        emit scanError(QString("Cannot bind uevent socket: %1")
+            .arg(QString::fromLocal8Bit(strerror(errno))));
+        ::close(fd);
+        return false;
+    }
+    
+    // Forcing past rmem_max needs CAP_NET_ADMIN; otherwise take what we get
+    int bufferSize = kUeventBufferSize;
+    if (::setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &bufferSize, sizeof(bufferSize)) < 0) {
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    }
+    
+    m_ueventFd = fd;
+    
+    // Populate after binding so no event between scan and listen is lost
+    populateLiveTable();
+    
+    m_coalesceTimer = new QTimer(this);
+    m_coalesceTimer->setSingleShot(true);
+    m_coalesceTimer->setInterval(kCoalesceIntervalMs);
+    connect(m_coalesceTimer, &QTimer::timeout, this, &DeviceScanner::flushPendingChanges);
+    
+    m_ueventNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(m_ueventNotifier, &QSocketNotifier::activated, this, &DeviceScanner::onUeventReadable);
+    
+    return true;
+}
+
+void DeviceScanner::stopMonitoring() {
+    if (!isMonitoring()) return;
+    
+    delete m_ueventNotifier;
+    m_ueventNotifier = nullptr;
+    delete m_coalesceTimer;
+    m_coalesceTimer = nullptr;
+    
+    ::close(m_ueventFd);
+    m_ueventFd = -1;
+    
+    m_liveDevices.clear();
+    m_hidrawOwners.clear();
+    m_batchBase.clear();
+}
+
+QVector<DeviceInfo> DeviceScanner::devices() const {
+    QStringList names = m_liveDevices.keys();
+    std::sort(names.begin(), names.end());
+    
+    QVector<DeviceInfo> list;
+    list.reserve(names.size());
+    for (const QString& name : names) {
+        list.append(m_liveDevices.value(name));
+    }
+    return uniqueByDeviceKey(list);
+}
+
+QVector<DeviceInfo> DeviceScanner::liveDevices() const {
+    return QVector<DeviceInfo>(m_liveDevices.cbegin(), m_liveDevices.cend());
+}
+
+void DeviceScanner::populateLiveTable() {
+    m_liveDevices.clear();
+    m_hidrawOwners.clear();
+    
+    // Keyed by USB kernel name ("1-2.3"), which uevents carry. Only the
+    // sysfs backends know it: the udev database has "189:N" and udevadm
+    // nothing, so those scan sysfs here too.
+    const QVector<DeviceInfo> usb = m_backend == Backend::Sysfs ? scanViaSys() : scanViaSysUevent();
+    for (DeviceInfo dev : usb) {
+        resolveNames(dev);
+        m_liveDevices.insert(QFileInfo(dev.sysPath).fileName(), dev);
+    }
+    
+    // Resolve hidraw nodes to the USB device they hang off; non-USB HID
+    // devices get their own entry keyed by the HID device kernel name
+    for (const HidrawNode& node : scanHidrawNodes()) {
+        QString owner;
+        if (node.bus == HidBusUsb) {
+            owner = findLiveOwner(node.devpath);
+            if (owner.isEmpty()) continue;
+            m_liveDevices[owner].hasHidraw = true;
+            m_liveDevices[owner].hidrawNodes.append("/dev/" + node.node);
+        } else {
+            owner = node.devpath.section('/', -3, -3);
+            m_liveDevices.insert(owner, deviceFromHidrawNode(node));
+        }
+        m_hidrawOwners.insert(node.node, owner);
+    }
+}
+
+QString DeviceScanner::findLiveOwner(const QString& devpath) const {
+    // The USB device is the closest ancestor path component we know about
+    const QStringList parts = devpath.split('/', Qt::SkipEmptyParts);
+    for (auto it = parts.crbegin(); it != parts.crend(); ++it) {
+        if (m_liveDevices.contains(*it)) return *it;
+    }
+    return QString();
+}
+
+void DeviceScanner::onUeventReadable() {
+    char buf[8192];
+    
+    for (;;) {
+        sockaddr_nl sender = {};
+        socklen_t senderLen = sizeof(sender);
+        ssize_t n = ::recvfrom(m_ueventFd, buf, sizeof(buf), 0,
+                               reinterpret_cast<sockaddr*>(&sender), &senderLen);
+        if (n < 0 && errno == ENOBUFS) {
+            // The kernel dropped events; only a rescan knows what changed
+            resyncLiveTable();
+            continue;
+        }
+        if (n <= 0) break;
+        
+        // Only trust messages sent by the kernel itself
+        if (sender.nl_pid != 0) continue;
+        
+        handleUevent(QByteArray(buf, static_cast<int>(n)));
+    }
+}
+
+void DeviceScanner::handleUevent(const QByteArray& message) {
+    // Kernel format: "action@devpath\0KEY=VALUE\0KEY=VALUE\0..."
+    const QList<QByteArray> fields = message.split('\0');
+    if (fields.isEmpty()) return;
+    
+    const QByteArray& header = fields.first();
+    int at = header.indexOf('@');
+    if (at <= 0) return;
+    
+    QByteArray action = header.left(at);
+    QString devpath = QString::fromUtf8(header.mid(at + 1));
+    QByteArray subsystem;
+    QByteArray devtype;
+    
+    for (int i = 1; i < fields.size(); ++i) {
+        const QByteArray& field = fields[i];
+        if (field.startsWith("SUBSYSTEM=")) subsystem = field.mid(10);
+        else if (field.startsWith("DEVTYPE=")) devtype = field.mid(8);
+    }
+    
+    if (action != "add" && action != "remove") return;
+    
+    bool isUsbDevice = (subsystem == "usb" && devtype == "usb_device");
+    bool isHidraw = (subsystem == "hidraw");
+    if (!isUsbDevice && !isHidraw) return;
+    
+    beginBatch();
+    
+    QString name = devpath.section('/', -1);
+    
+    if (isUsbDevice) {
+        if (action == "add") {
+            DeviceInfo dev = readUsbDevice(m_sysfsRoot + "/bus/usb/devices/" + name);
+            resolveNames(dev);
+            if (!dev.vendorId.isEmpty()) {
+                m_liveDevices.insert(name, dev);
+            }
+        } else {
+            m_liveDevices.remove(name);
+            for (auto it = m_hidrawOwners.begin(); it != m_hidrawOwners.end();) {
+                if (it.value() == name) it = m_hidrawOwners.erase(it);
+                else ++it;
             }
         }
+        return;
+    }
+    
+    // hidraw node appeared or vanished
+    if (action == "add") {
+        QString hidDevice = devpath.section('/', -3, -3);
+        uint bus = hidBusFromKernelName(hidDevice);
+        
+        if (bus == HidBusUsb) {
+            QString owner = findLiveOwner(devpath);
+            if (owner.isEmpty()) return;
+            m_hidrawOwners.insert(name, owner);
+            m_liveDevices[owner].hasHidraw = true;
+            m_liveDevices[owner].hidrawNodes.append("/dev/" + name);
+            return;
+        }
+        
+        // Bluetooth/I2C HID: identify it from the parent HID device's uevent
+        HidrawNode node;
+        node.node = name;
+        node.devpath = devpath;
+        QByteArray buffer(4096, Qt::Uninitialized);
+        QByteArray ueventPath = QFile::encodeName(m_sysfsRoot + devpath + "/device/uevent");
+        if (readInto(AT_FDCWD, ueventPath.constData(), buffer) <= 0) return;
+        if (!parseHidUevent(buffer.constData(), &node.bus, &node.vendorId,
+                            &node.productId, &node.name)) return;
+        
+        m_liveDevices.insert(hidDevice, deviceFromHidrawNode(node));
+        m_hidrawOwners.insert(name, hidDevice);
+    } else {
+        QString owner = m_hidrawOwners.take(name);
+        auto it = m_liveDevices.find(owner);
+        if (owner.isEmpty() || it == m_liveDevices.end()) return;
+        
+        if (!it.value().hasUsb) {
+            // Non-USB HID devices only exist through their hidraw node
+            m_liveDevices.erase(it);
+        } else {
+            it.value().hidrawNodes.removeAll("/dev/" + name);
+            it.value().hasHidraw = !it.value().hidrawNodes.isEmpty();
+        }
+    }
+}
+
+void DeviceScanner::beginBatch() {
+    // Start a new batch; everything until the timer fires is coalesced
+    if (!m_coalesceTimer->isActive()) {
+        m_batchBase = m_liveDevices;
+        m_coalesceTimer->start();
+    }
+}
+
+void DeviceScanner::resyncLiveTable() {
+    // The batch diff turns the rescan into the usual added/removed signals
+    beginBatch();
+    populateLiveTable();
+}
+
+void DeviceScanner::flushPendingChanges() {
+    QVector<DeviceInfo> added;
+    QVector<DeviceInfo> removed;
+    
+    for (auto it = m_batchBase.cbegin(); it != m_batchBase.cend(); ++it) {
+        auto current = m_liveDevices.constFind(it.key());
+        if (current == m_liveDevices.cend() || !(current.value() == it.value()) ||
+            current.value().hidrawNodes != it.value().hidrawNodes) {
+            removed.append(it.value());
+        }
+    }
+    
+    for (auto it = m_liveDevices.cbegin(); it != m_liveDevices.cend(); ++it) {
+        auto base = m_batchBase.constFind(it.key());
+        if (base == m_batchBase.cend() || !(base.value() == it.value()) ||
+            base.value().hidrawNodes != it.value().hidrawNodes) {
+            added.append(it.value());
+        }
     }
+    
+    m_batchBase.clear();
+    
+    if (added.isEmpty() && removed.isEmpty()) return;
+    
+    for (const auto& d : removed) emit deviceRemoved(d);
+    for (const auto& d : added) emit deviceAdded(d);
+    emit devicesChanged(added, removed);
 }
 
 } // namespace udevme
@@ -3,30 +3,129 @@
 
 #include <QObject>
 #include <QVector>
+#include <QHash>
 #include "Types.h"
+#include "BatchFileReader.h"
+
+class QSocketNotifier;
+class QTimer;
 
 namespace udevme {
 
 class DeviceScanner : public QObject {
     Q_OBJECT
 public:
+    enum class Backend {
+        Sysfs,          // One QFile per attribute (legacy path)
+        SysfsUevent,    // uevent per device, batched reads relative to the bus dirfd
+        UdevDatabase,   // /run/udev/data, includes hwdb vendor/model names
+        Udevadm         // `udevadm info --export-db` subprocess
+    };
+
+    // Per-scan I/O counters, used to compare backends
+    struct ScanStats {
+        int devicesVisited = 0;
+        int statCalls = 0;
+        int filesOpened = 0;
+        int readCalls = 0;
+    };
+
     explicit DeviceScanner(QObject* parent = nullptr);
-    
+    ~DeviceScanner() override;
+
+    void setBackend(Backend backend) { m_backend = backend; }
+    Backend backend() const { return m_backend; }
+    const ScanStats& lastScanStats() const { return m_stats; }
+
+    // Where sysfs and the udev runtime database live. Tests and benchmarks
+    // point these at fixture trees; the Udevadm backend always asks the
+    // running system.
+    void setSysfsRoot(const QString& root) { m_sysfsRoot = root; }
+    QString sysfsRoot() const { return m_sysfsRoot; }
+    void setUdevDataPath(const QString& path) { m_udevDataPath = path; }
+    QString udevDataPath() const { return m_udevDataPath; }
+
+    // Fill in missing USB product/vendor names from usb.ids (on by default)
+    void setNameResolution(bool enabled) { m_resolveNames = enabled; }
+
     QVector<DeviceInfo> scanDevices();
     bool isUdevadmAvailable() const;
     bool isLsusbAvailable() const;
 
+    // Hotplug monitor: listens for kernel uevents and keeps a live device
+    // table so callers don't need to rescan sysfs after every plug/unplug.
+    // The table always comes from sysfs, whatever the backend.
+    bool startMonitoring();
+    void stopMonitoring();
+    bool isMonitoring() const { return m_ueventFd >= 0; }
+
+    // Snapshot of the live device table (deduplicated by bus and vid:pid)
+    QVector<DeviceInfo> devices() const;
+    // Every connected device, one entry per physical device, unordered
+    QVector<DeviceInfo> liveDevices() const;
+
 signals:
     void scanProgress(const QString& message);
     void scanComplete(const QVector<DeviceInfo>& devices);
     void scanError(const QString& error);
 
+    // Emitted per device once a batch of hotplug events has settled. A
+    // device whose hidraw nodes changed is reported as removed (old state)
+    // and added (new state).
+    void deviceAdded(const DeviceInfo& device);
+    void deviceRemoved(const DeviceInfo& device);
+    void devicesChanged(const QVector<DeviceInfo>& added, const QVector<DeviceInfo>& removed);
+
+private slots:
+    void onUeventReadable();
+    void flushPendingChanges();
+
 private:
+    // A /sys/class/hidraw entry resolved through its parent HID device
+    struct HidrawNode {
+        QString node;       // e.g. "hidraw0"
+        QString devpath;    // class symlink target, ends in <hid device>/hidraw/<node>
+        QString name;       // HID_NAME
+        uint bus = 0;
+        uint vendorId = 0;
+        uint productId = 0;
+    };
+
+    QVector<DeviceInfo> scanUsbBus();
     QVector<DeviceInfo> scanViaSys();
+    QVector<DeviceInfo> scanViaSysUevent();
+    QVector<DeviceInfo> scanViaUdevDatabase();
     QVector<DeviceInfo> scanViaUdevadm();
     void enrichWithHidrawInfo(QVector<DeviceInfo>& devices);
+    QVector<HidrawNode> scanHidrawNodes();
+    DeviceInfo deviceFromHidrawNode(const HidrawNode& node) const;
     QString runCommand(const QString& cmd, const QStringList& args);
     bool commandExists(const QString& cmd) const;
+
+    DeviceInfo readUsbDevice(const QString& path);
+    qsizetype readInto(int dirFd, const char* name, QByteArray& buffer);
+    void countBatch(const QVector<BatchFileReader::Request>& requests);
+    void resolveNames(DeviceInfo& device) const;
+    void populateLiveTable();
+    // After the kernel dropped uevents (ENOBUFS): rescan and report the difference
+    void resyncLiveTable();
+    void beginBatch();
+    void handleUevent(const QByteArray& message);
+    QString findLiveOwner(const QString& devpath) const;
+
+    Backend m_backend = Backend::SysfsUevent;
+    ScanStats m_stats;
+    QString m_sysfsRoot = QStringLiteral("/sys");
+    QString m_udevDataPath = QStringLiteral("/run/udev/data");
+    bool m_resolveNames = true;
+
+    // Hotplug monitor state
+    int m_ueventFd = -1;
+    QSocketNotifier* m_ueventNotifier = nullptr;
+    QTimer* m_coalesceTimer = nullptr;
+    QHash<QString, DeviceInfo> m_liveDevices;   // usb or non-USB HID kernel name -> device
+    QHash<QString, QString> m_hidrawOwners;     // hidraw kernel name -> m_liveDevices key
+    QHash<QString, DeviceInfo> m_batchBase;     // live table when the current batch started
 };
 
 } // namespace udevme
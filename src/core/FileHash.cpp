@@ -0,0 +1,94 @@
+#include "FileHash.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+
+#include <atomic>
+#include <sys/stat.h>
+
+namespace udevme {
+
+namespace {
+
+struct Entry {
+    FileHash::Stat stat;
+    QString sha256;
+};
+
+struct Memo {
+    QMutex mutex;
+    QHash<QString, Entry> entries;
+    std::atomic<int> reads{0};
+};
+
+Memo& memo() {
+    static Memo m;
+    return m;
+}
+
+// The SHA-256 of the file's bytes as hex; empty if it can't be read.
+// Streamed, not mapped: the files are rewritten in place by cp and package
+// managers, and a mapping would fault (SIGBUS) if one shrank under us.
+QString digestFile(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return QString();
+    QCryptographicHash sha(QCryptographicHash::Sha256);
+    if (!sha.addData(&file)) return QString();
+    return QString::fromLatin1(sha.result().toHex());
+}
+
+} // namespace
+
+bool FileHash::stat(const QString& path, Stat& st) {
+    struct stat s;
+    if (::stat(QFile::encodeName(path).constData(), &s) != 0) return false;
+    st.device = quint64(s.st_dev);
+    st.inode = quint64(s.st_ino);
+    st.size = qint64(s.st_size);
+    st.mtimeNs = qint64(s.st_mtim.tv_sec) * 1000000000 + s.st_mtim.tv_nsec;
+    st.ctimeNs = qint64(s.st_ctim.tv_sec) * 1000000000 + s.st_ctim.tv_nsec;
+    return true;
+}
+
+bool FileHash::isRacy(const Stat& st) {
+    return QDateTime::currentMSecsSinceEpoch() * 1000000 - st.mtimeNs < RacyNs;
+}
+
+QString FileHash::sha256(const QString& path) {
+    Memo& m = memo();
+    Stat before;
+    if (!stat(path, before)) return QString();
+    {
+        QMutexLocker lock(&m.mutex);
+        auto it = m.entries.constFind(path);
+        if (it != m.entries.cend() && it->stat == before) return it->sha256;
+    }
+
+    Entry entry;
+    entry.stat = before;
+    entry.sha256 = digestFile(path);
+    if (entry.sha256.isEmpty()) return QString();
+    ++m.reads;
+
+    // Remembered only if the file held still while it was read
+    Stat after;
+    if (stat(path, after) && after == before && !isRacy(before)) {
+        QMutexLocker lock(&m.mutex);
+        m.entries.insert(path, entry);
+    }
+    return entry.sha256;
+}
+
+void FileHash::clear() {
+    Memo& m = memo();
+    QMutexLocker lock(&m.mutex);
+    m.entries.clear();
+}
+
+int FileHash::readCount() {
+    return memo().reads;
+}
+
+} // namespace udevme
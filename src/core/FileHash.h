@@ -0,0 +1,45 @@
+#ifndef FILEHASH_H
+#define FILEHASH_H
+
+#include <QString>
+
+namespace udevme {
+
+// Content hashes of files on disk, remembered per path for as long as
+// stat() says the file is the same one: device, inode, size and the
+// modification and change times in nanoseconds. Any other stat means
+// hashing the file again. Safe to call from several threads.
+class FileHash {
+public:
+    struct Stat {
+        quint64 device = 0;
+        quint64 inode = 0;
+        qint64 size = -1;
+        qint64 mtimeNs = 0;
+        qint64 ctimeNs = 0;
+
+        bool operator==(const Stat&) const = default;
+    };
+
+    // Files changed this recently can't be told apart by stat() alone:
+    // where timestamps are coarse (2 s on FAT), a second write in the same
+    // tick leaves it as it was
+    static constexpr qint64 RacyNs = 2000000000LL;
+    static bool isRacy(const Stat& st);
+
+    // False if the file doesn't exist
+    static bool stat(const QString& path, Stat& st);
+
+    // SHA-256 of the file's bytes as hex, the same as the hash of
+    // RuleParser::parseRulesStream(); empty if it can't be read
+    static QString sha256(const QString& path);
+
+    static void clear();
+
+    // Files read (and hashed) since start
+    static int readCount();
+};
+
+} // namespace udevme
+
+#endif // FILEHASH_H
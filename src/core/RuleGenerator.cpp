@@ -2,10 +2,59 @@
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QFile>
+#include <QtEndian>
+#include <QSet>
 #include <grp.h>
 
 namespace udevme {
 
+namespace {
+
+// udevd runs every rule on every event; let all but hidraw add/change
+// events leave after two comparisons
+const char GuardLines[] =
+    "SUBSYSTEM!=\"hidraw\", GOTO=\"udevme_end\"\n"
+    "ACTION==\"remove\", GOTO=\"udevme_end\"\n"
+    "\n";
+
+QString upperHex(uint value, int width) {
+    return QString("%1").arg(value, width, 16, QLatin1Char('0')).toUpper();
+}
+
+} // namespace
+
+void BlockChecksum::addText(QStringView text) {
+    // UTF-16LE whatever the host, so the sum is the same everywhere
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    m_hash.addData(QByteArrayView(reinterpret_cast<const char*>(text.utf16()),
+                                  text.size() * qsizetype(sizeof(char16_t))));
+#else
+    QByteArray bytes(text.size() * qsizetype(sizeof(char16_t)), Qt::Uninitialized);
+    qToLittleEndian<quint16>(text.utf16(), text.size(), bytes.data());
+    m_hash.addData(bytes);
+#endif
+}
+
+void BlockChecksum::addLine(QStringView line) {
+    addText(line);
+    addText(u"\n");
+}
+
+QString BlockChecksum::result() const {
+    // 64 bits is plenty to notice an edit; this isn't a signature
+    return QString::fromLatin1(m_hash.result().first(8).toHex());
+}
+
+QString BlockChecksum::of(QStringView metadata, QStringView body) {
+    BlockChecksum sum;
+    sum.addLine(metadata);
+    // As the parser sees the lines; hwdb property lines start with a space
+    for (QStringView line : body.tokenize(u'\n', Qt::SkipEmptyParts)) {
+        sum.addLine(line.trimmed());
+    }
+    return sum.result();
+}
+
 bool RuleGenerator::checkPlugdevGroup() {
     struct group* grp = getgrnam("plugdev");
     return grp != nullptr;
@@ -16,7 +65,10 @@ QString RuleGenerator::generateMetadataComment(const UdevRule& rule) {
     // Notes are stored separately in notes.json, not in the rules file
     QStringList deviceParts;
     for (const auto& d : rule.devices) {
-        deviceParts << QString("%1:%2").arg(d.vendorId, d.productId);
+        // Non-USB HID devices carry their bus, e.g. 046d:b01a@bluetooth
+        QString part = QString("%1:%2").arg(d.vendorId, d.productId);
+        if (!d.bus.isEmpty()) part += "@" + d.bus;
+        deviceParts << part;
     }
     
     QStringList appParts;
@@ -29,6 +81,8 @@ QString RuleGenerator::generateMetadataComment(const UdevRule& rule) {
     if (rule.ruleTypes.usb) typeParts << "usb";
     if (rule.ruleTypes.uaccess) typeParts << "uaccess";
     if (rule.ruleTypes.seat) typeParts << "seat";
+    // An empty value wouldn't parse back as a key=value pair
+    if (typeParts.isEmpty()) typeParts << "none";
     
     QString comment = QString("# udevme: id=%1 devices=%2 apps=%3 level=%4 types=%5 enabled=%6")
         .arg(rule.id.toString(QUuid::WithoutBraces))
@@ -41,67 +95,193 @@ QString RuleGenerator::generateMetadataComment(const UdevRule& rule) {
     return comment;
 }
 
-QString RuleGenerator::generatePermissionPart(const UdevRule& rule) {
+uint RuleGenerator::hidrawMode(const UdevRule& rule) {
     Q_UNUSED(rule);
     // MODE="0666" is needed for WebHID because browsers run sandboxed
     // and may not inherit uaccess ACL permissions.
     // WebHID has its own permission model (user must grant access in browser)
     // so this is safe in practice.
-    return "MODE=\"0666\"";
+    return 0666;
 }
 
-QString RuleGenerator::generateSingleRule(const UdevRule& rule) {
-    if (rule.devices.isEmpty()) {
-        return QString();
-    }
-    
-    QString output;
-    output += generateMetadataComment(rule) + "\n";
-    
+QString RuleGenerator::generatePermissionPart(const UdevRule& rule) {
+    return QString("MODE=\"%1\"").arg(hidrawMode(rule), 4, 8, QLatin1Char('0'));
+}
+
+QString RuleGenerator::hidDeviceName(const DeviceInfo& device) {
+    return QString("%1:%2:%3")
+        .arg(hidBusNumber(device.bus), 4, 16, QLatin1Char('0'))
+        .arg(device.vendorId.toUInt(nullptr, 16), 4, 16, QLatin1Char('0'))
+        .arg(device.productId.toUInt(nullptr, 16), 4, 16, QLatin1Char('0'))
+        .toUpper();
+}
+
+QString RuleGenerator::hwdbMatch(const DeviceInfo& device) {
+    // The kernel's HID modalias is hid:b<bus>g<group>v<vendor>p<product>
+    // in uppercase hex; the group doesn't matter here
+    return QLatin1String(HwdbPrefix) + "hid:b" + upperHex(hidBusNumber(device.bus), 4) +
+        "g*v" + upperHex(device.vendorId.toUInt(nullptr, 16), 8) +
+        "p" + upperHex(device.productId.toUInt(nullptr, 16), 8);
+}
+
+QString RuleGenerator::generateAttrsLines(const UdevRule& rule) {
+    QString body;
     for (const auto& device : rule.devices) {
+        QString deviceMatch;
+        uint bus = hidBusNumber(device.bus);
+        
+        if (bus == HidBusUsb) {
+            deviceMatch = QString("ATTRS{idVendor}==\"%1\", ATTRS{idProduct}==\"%2\"")
+                .arg(device.vendorId.toLower())
+                .arg(device.productId.toLower());
+        } else {
+            // Bluetooth/I2C HID devices have no idVendor attribute; match the
+            // parent HID device name (bus:vendor:product.instance) instead
+            deviceMatch = QString("KERNELS==\"%1.*\"").arg(hidDeviceName(device));
+        }
+        
         // Generate hidraw rule for WebHID
         QString hidrawRule = QString(
-            "KERNEL==\"hidraw*\", SUBSYSTEM==\"hidraw\", "
-            "ATTRS{idVendor}==\"%1\", ATTRS{idProduct}==\"%2\", %3")
-            .arg(device.vendorId.toLower())
-            .arg(device.productId.toLower())
+            "KERNEL==\"hidraw*\", SUBSYSTEM==\"hidraw\", %1, %2")
+            .arg(deviceMatch)
             .arg(generatePermissionPart(rule));
-        output += hidrawRule + "\n";
+        body += hidrawRule + "\n";
+    }
+    return body;
+}
+
+QString RuleGenerator::generateDevPathLines(const UdevRule& rule) {
+    // A hidraw node sits right below its HID device, so the event's own
+    // DEVPATH names bus, vendor and product; no ATTRS walk up the parents
+    // and no sysfs reads. Products of one vendor share a line.
+    QStringList vendors;
+    QVector<QStringList> patterns;
+    for (const auto& device : rule.devices) {
+        const QString name = hidDeviceName(device);
+        const QString vendor = name.left(9);
+        qsizetype i = vendors.indexOf(vendor);
+        if (i < 0) {
+            i = vendors.size();
+            vendors << vendor;
+            patterns.append(QStringList());
+        }
+        const QString pattern = "*/" + name + ".*";
+        if (!patterns[i].contains(pattern)) patterns[i] << pattern;
+    }
+    
+    QString body;
+    for (const QStringList& alternatives : patterns) {
+        body += QString("DEVPATH==\"%1\", %2\n").arg(alternatives.join('|'), generatePermissionPart(rule));
+    }
+    return body;
+}
+
+QString RuleGenerator::generateHwdbLines(const UdevRule& rule) {
+    // One hwdb record: a match line per device, then the property they
+    // all get. The record ends at the blank line after the block.
+    QString body;
+    QSet<QString> seen;
+    for (const auto& device : rule.devices) {
+        const QString match = hwdbMatch(device);
+        if (seen.contains(match)) continue;
+        seen.insert(match);
+        body += match + "\n";
+    }
+    body += QString(" %1=%2\n").arg(QLatin1String(HwdbModeProperty)).arg(hidrawMode(rule), 4, 8, QLatin1Char('0'));
+    return body;
+}
+
+QString RuleGenerator::generateSingleRule(const UdevRule& rule, RuleOutput output) {
+    if (rule.devices.isEmpty()) {
+        return QString();
+    }
+    
+    QString body;
+    switch (output) {
+        case RuleOutput::Compatible: body = generateAttrsLines(rule); break;
+        case RuleOutput::Optimized: body = generateDevPathLines(rule); break;
+        case RuleOutput::Hwdb: body = generateHwdbLines(rule); break;
     }
     
-    return output;
+    // The checksum goes last so the rest of the comment reads as before
+    const QString metadata = generateMetadataComment(rule);
+    return metadata + " sum=" + BlockChecksum::of(metadata, body) + "\n" + body;
 }
 
-QString RuleGenerator::generateRulesFile(const QVector<UdevRule>& rules) {
-    QString output;
+QString RuleGenerator::generateHeader(const QString& title) {
+    QString header;
+    header += "# udevme - " + title + "\n";
+    header += "# Generated by udevme\n";
+    header += "# Do not edit manually - changes will be overwritten\n";
+    header += "#\n";
+    header += "# File format version: 1\n";
+    header += "# schema_version=1\n";
+    header += "\n";
+    return header;
+}
+
+bool RuleGenerator::hasEnabledRules(const QVector<UdevRule>& rules) {
+    for (const auto& rule : rules) {
+        if (rule.enabled && !rule.devices.isEmpty()) return true;
+    }
+    return false;
+}
+
+QString RuleGenerator::generateRulesFile(const QVector<UdevRule>& rules, RuleOutput output,
+                                         const QString& hwdbFiles) {
+    const QString header = generateHeader("Auto-generated udev rules for WebHID / hidraw device access");
     
-    // File header
-    output += "# udevme - Auto-generated udev rules for WebHID / hidraw device access\n";
-    output += "# Generated by udevme\n";
-    output += "# Do not edit manually - changes will be overwritten\n";
-    output += "#\n";
-    output += "# File format version: 1\n";
-    output += "# schema_version=1\n";
-    output += "\n";
+    if (output == RuleOutput::Hwdb) {
+        if (!hasEnabledRules(rules)) {
+            return header + "# No enabled rules configured\n";
+        }
+        // The same statements however many devices there are: udevd finds
+        // the event's HID device in its compiled hwdb trie. The property is
+        // cleared first so a device taken off the list doesn't keep it
+        // from the udev database.
+        return header + GuardLines +
+            "# The allowed devices are listed in " + hwdbFiles + "\n"
+            "ENV{" + HwdbModeProperty + "}=\"\"\n"
+            "IMPORT{builtin}=\"hwdb --subsystem=hid --lookup-prefix=" + HwdbPrefix + "\"\n"
+            "ENV{" + HwdbModeProperty + "}==\"?*\", MODE=\"$env{" + HwdbModeProperty + "}\"\n" +
+            EndLabel + "\n";
+    }
     
     // Generate rules for enabled rules only
+    QString blocks;
     int count = 0;
     for (const auto& rule : rules) {
         if (!rule.enabled) continue;
         if (rule.devices.isEmpty()) continue;
         
-        QString ruleText = generateSingleRule(rule);
+        QString ruleText = generateSingleRule(rule, output);
         if (!ruleText.isEmpty()) {
-            output += ruleText + "\n";
+            blocks += ruleText + "\n";
             count++;
         }
     }
     
     if (count == 0) {
-        output += "# No enabled rules configured\n";
+        return header + "# No enabled rules configured\n";
+    }
+    if (output == RuleOutput::Compatible) {
+        return header + blocks;
     }
     
-    return output;
+    return header + GuardLines + blocks + EndLabel + "\n";
+}
+
+QString RuleGenerator::generateHwdbFile(const QVector<UdevRule>& rules) {
+    QString content = generateHeader("Auto-generated hwdb entries for WebHID / hidraw device access");
+    if (!hasEnabledRules(rules)) {
+        return content + "# No enabled rules configured\n";
+    }
+    for (const auto& rule : rules) {
+        if (!rule.enabled) continue;
+        if (rule.devices.isEmpty()) continue;
+        content += generateSingleRule(rule, RuleOutput::Hwdb) + "\n";
+    }
+    return content;
 }
 
 } // namespace udevme
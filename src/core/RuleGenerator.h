@@ -1,21 +1,73 @@
 #ifndef RULEGENERATOR_H
 #define RULEGENERATOR_H
 
+#include <QCryptographicHash>
 #include <QString>
+#include <QStringView>
 #include <QVector>
 #include "Types.h"
 
 namespace udevme {
 
+// Checksum of a rule block as written to the rules or hwdb file: the
+// metadata comment without its sum= field, then each rule line trimmed,
+// every line ending in a newline. Stored as sum= so the parser can tell
+// untouched blocks from hand-edited ones.
+class BlockChecksum {
+public:
+    void addText(QStringView text);
+    void addLine(QStringView line);
+    QString result() const;
+    void reset() { m_hash.reset(); }
+    
+    static QString of(QStringView metadata, QStringView body);
+    
+private:
+    QCryptographicHash m_hash{QCryptographicHash::Sha256};
+};
+
 class RuleGenerator {
 public:
-    static QString generateRulesFile(const QVector<UdevRule>& rules);
-    static QString generateSingleRule(const UdevRule& rule);
+    // With RuleOutput::Hwdb, the header points readers at hwdbFiles: the
+    // hwdb file, or the pattern of its shards
+    static QString generateRulesFile(const QVector<UdevRule>& rules,
+                                     RuleOutput output = RuleOutput::Compatible,
+                                     const QString& hwdbFiles = QStringLiteral("99-udevme.hwdb"));
+    static QString generateSingleRule(const UdevRule& rule,
+                                      RuleOutput output = RuleOutput::Compatible);
     static QString generateMetadataComment(const UdevRule& rule);
+    
+    // The device list for RuleOutput::Hwdb, for /etc/udev/hwdb.d; the
+    // rules file then only looks the event's HID device up in it
+    static QString generateHwdbFile(const QVector<UdevRule>& rules);
     static bool checkPlugdevGroup();
     
+    // Mode the generated rule gives the device's hidraw nodes
+    static uint hidrawMode(const UdevRule& rule);
+    
+    // Kernel name of the device's HID node without the instance, e.g.
+    // 0005:046D:B01A for 0005:046D:B01A.0003
+    static QString hidDeviceName(const DeviceInfo& device);
+    
+    // hwdb key matching the device's HID modalias, e.g.
+    // udevme:hid:b0005g*v0000046Dp0000B01A
+    static QString hwdbMatch(const DeviceInfo& device);
+    
+    // Where the optimized file's guards jump to; it ends the last block
+    static constexpr char EndLabel[] = "LABEL=\"udevme_end\"";
+    
+    // Namespaces our hwdb keys so the lookup finds no one else's entries
+    static constexpr char HwdbPrefix[] = "udevme:";
+    // Property our hwdb entries set to the hidraw mode
+    static constexpr char HwdbModeProperty[] = "UDEVME_MODE";
+    
 private:
     static QString generatePermissionPart(const UdevRule& rule);
+    static QString generateAttrsLines(const UdevRule& rule);
+    static QString generateDevPathLines(const UdevRule& rule);
+    static QString generateHwdbLines(const UdevRule& rule);
+    static QString generateHeader(const QString& title);
+    static bool hasEnabledRules(const QVector<UdevRule>& rules);
 };
 
 } // namespace udevme
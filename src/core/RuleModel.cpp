@@ -1,4 +1,11 @@
 #include "RuleModel.h"
+#include "RuleGenerator.h"
+#include "UsbIds.h"
+#include <QColor>
+#include <QFile>
+#include <QSet>
+
+#include <sys/stat.h>
 
 namespace udevme {
 
@@ -24,17 +31,27 @@ QVariant RuleModel::data(const QModelIndex& index, int role) const {
     if (role == Qt::DisplayRole) {
         switch (index.column()) {
             case ColEnabled: return QVariant();
+            case ColStatus: {
+                bool ok = false;
+                return statusText(rule, &ok);
+            }
             case ColDevices: return rule.devicesSummary();
             case ColApps: return rule.appsSummary();
             case ColNotes: return rule.notes;
         }
     } else if (role == Qt::CheckStateRole && index.column() == ColEnabled) {
         return rule.enabled ? Qt::Checked : Qt::Unchecked;
+    } else if (role == Qt::ForegroundRole && index.column() == ColStatus) {
+        bool ok = false;
+        statusText(rule, &ok);
+        if (!ok) return QColor(Qt::darkYellow);
     } else if (role == Qt::ToolTipRole) {
         switch (index.column()) {
+            case ColStatus: return statusToolTip(rule);
             case ColDevices: {
                 QStringList tips;
-                for (const auto& d : rule.devices) {
+                for (DeviceInfo d : rule.devices) {
+                    if (d.bus.isEmpty()) UsbIds::instance().resolve(d);
                     tips << QString("%1 (%2:%3)%4")
                         .arg(d.displayName(), d.vendorId, d.productId,
                              d.hasHidraw ? " [hidraw]" : "");
@@ -64,6 +81,7 @@ QVariant RuleModel::headerData(int section, Qt::Orientation orientation, int rol
 
     switch (section) {
         case ColEnabled: return "Enabled";
+        case ColStatus: return "Status";
         case ColDevices: return "Devices";
         case ColApps: return "For App";
         case ColNotes: return "Notes";
@@ -101,6 +119,7 @@ void RuleModel::addRule(const UdevRule& rule) {
     beginInsertRows(QModelIndex(), m_rules.size(), m_rules.size());
     m_rules.append(rule);
     endInsertRows();
+    indexRule(m_rules.size() - 1);
     setDirty(true);
     emit rulesChanged();
 }
@@ -111,6 +130,7 @@ void RuleModel::removeRule(int row) {
     beginRemoveRows(QModelIndex(), row, row);
     m_rules.removeAt(row);
     endRemoveRows();
+    rebuildDeviceIndex();
     setDirty(true);
     emit rulesChanged();
 }
@@ -129,6 +149,7 @@ void RuleModel::removeRules(const QVector<int>& rows) {
             endRemoveRows();
         }
     }
+    rebuildDeviceIndex();
     setDirty(true);
     emit rulesChanged();
 }
@@ -138,6 +159,7 @@ void RuleModel::updateRule(int row, const UdevRule& rule) {
     
     m_rules[row] = rule;
     m_rules[row].updatedAt = QDateTime::currentDateTime();
+    rebuildDeviceIndex();
     emit dataChanged(index(row, 0), index(row, ColCount - 1));
     setDirty(true);
     emit rulesChanged();
@@ -163,6 +185,7 @@ QVector<UdevRule> RuleModel::getEnabledRules() const {
 void RuleModel::setRules(const QVector<UdevRule>& rules) {
     beginResetModel();
     m_rules = rules;
+    rebuildDeviceIndex();
     endResetModel();
     emit rulesChanged();
 }
@@ -170,11 +193,147 @@ void RuleModel::setRules(const QVector<UdevRule>& rules) {
 void RuleModel::clear() {
     beginResetModel();
     m_rules.clear();
+    m_rowsByDevice.clear();
     endResetModel();
     setDirty(true);
     emit rulesChanged();
 }
 
+void RuleModel::setConnectedDevices(const QVector<DeviceInfo>& devices) {
+    m_deviceStates.clear();
+    for (const auto& dev : devices) {
+        DeviceState& state = m_deviceStates[dev.deviceKey()];
+        ++state.count;
+        state.hidrawNodes += dev.hidrawNodes;
+    }
+    for (auto& state : m_deviceStates) {
+        refreshMode(state);
+    }
+    
+    if (!m_rules.isEmpty()) {
+        emit dataChanged(index(0, ColStatus), index(m_rules.size() - 1, ColStatus));
+    }
+}
+
+void RuleModel::updateDevices(const QVector<DeviceInfo>& added, const QVector<DeviceInfo>& removed) {
+    QSet<quint64> changed;
+    
+    // Removed first: a device whose hidraw nodes changed is in both lists
+    for (const auto& dev : removed) {
+        const quint64 key = dev.deviceKey();
+        auto it = m_deviceStates.find(key);
+        if (it == m_deviceStates.end()) continue;
+        for (const QString& node : dev.hidrawNodes) {
+            it->hidrawNodes.removeOne(node);
+        }
+        if (--it->count <= 0) m_deviceStates.erase(it);
+        changed.insert(key);
+    }
+    
+    for (const auto& dev : added) {
+        const quint64 key = dev.deviceKey();
+        DeviceState& state = m_deviceStates[key];
+        ++state.count;
+        state.hidrawNodes += dev.hidrawNodes;
+        changed.insert(key);
+    }
+    
+    QVector<int> rows;
+    for (quint64 key : changed) {
+        auto it = m_deviceStates.find(key);
+        if (it != m_deviceStates.end()) refreshMode(*it);
+        rows += m_rowsByDevice.value(key);
+    }
+    emitStatusChanged(rows);
+}
+
+void RuleModel::rebuildDeviceIndex() {
+    m_rowsByDevice.clear();
+    for (int row = 0; row < m_rules.size(); ++row) {
+        indexRule(row);
+    }
+}
+
+void RuleModel::indexRule(int row) {
+    for (const auto& dev : m_rules[row].devices) {
+        QVector<int>& rows = m_rowsByDevice[dev.deviceKey()];
+        if (rows.isEmpty() || rows.last() != row) rows.append(row);
+    }
+}
+
+void RuleModel::refreshMode(DeviceState& state) {
+    // Only runs for devices that changed, never from data()
+    state.hidrawMode = -1;
+    for (const QString& node : state.hidrawNodes) {
+        struct stat st;
+        if (::stat(QFile::encodeName(node).constData(), &st) != 0) continue;
+        int mode = st.st_mode & 07777;
+        state.hidrawMode = state.hidrawMode < 0 ? mode : (state.hidrawMode & mode);
+    }
+}
+
+void RuleModel::emitStatusChanged(const QVector<int>& rows) {
+    QSet<int> seen;
+    for (int row : rows) {
+        if (row < 0 || row >= m_rules.size() || seen.contains(row)) continue;
+        seen.insert(row);
+        QModelIndex cell = index(row, ColStatus);
+        emit dataChanged(cell, cell, {Qt::DisplayRole, Qt::ToolTipRole, Qt::ForegroundRole});
+    }
+}
+
+QString RuleModel::statusText(const UdevRule& rule, bool* ok) const {
+    *ok = true;
+    if (rule.devices.isEmpty()) return QString();
+    
+    const uint expected = RuleGenerator::hidrawMode(rule);
+    int connected = 0;
+    int wrongMode = -1;
+    bool anyHidraw = false;
+    
+    for (const auto& dev : rule.devices) {
+        auto it = m_deviceStates.constFind(dev.deviceKey());
+        if (it == m_deviceStates.cend()) continue;
+        ++connected;
+        if (it->hidrawMode < 0) continue;
+        anyHidraw = true;
+        if ((uint(it->hidrawMode) & expected) != expected) wrongMode = it->hidrawMode;
+    }
+    
+    if (connected == 0) return "Not connected";
+    
+    QString text = connected == rule.devices.size()
+        ? QString("Connected")
+        : QString("%1/%2 connected").arg(connected).arg(rule.devices.size());
+    
+    if (wrongMode >= 0) {
+        // Expected for a disabled or not yet applied rule, worth flagging otherwise
+        *ok = !rule.enabled;
+        return text + QString(", hidraw %1").arg(wrongMode, 4, 8, QLatin1Char('0'));
+    }
+    if (anyHidraw) return text + ", accessible";
+    return text;
+}
+
+QString RuleModel::statusToolTip(const UdevRule& rule) const {
+    QStringList tips;
+    for (const auto& dev : rule.devices) {
+        auto it = m_deviceStates.constFind(dev.deviceKey());
+        if (it == m_deviceStates.cend()) {
+            tips << QString("%1: not connected").arg(dev.vidPid());
+        } else if (it->hidrawNodes.isEmpty()) {
+            tips << QString("%1: connected, no hidraw node").arg(dev.vidPid());
+        } else if (it->hidrawMode < 0) {
+            tips << QString("%1: %2 (mode unknown)").arg(dev.vidPid(), it->hidrawNodes.join(", "));
+        } else {
+            tips << QString("%1: %2 (mode %3)").arg(dev.vidPid(), it->hidrawNodes.join(", "))
+                .arg(it->hidrawMode, 4, 8, QLatin1Char('0'));
+        }
+    }
+    tips << QString("Rule sets MODE=\"%1\"").arg(RuleGenerator::hidrawMode(rule), 4, 8, QLatin1Char('0'));
+    return tips.join("\n");
+}
+
 void RuleModel::setDirty(bool dirty) {
     if (m_dirty != dirty) {
         m_dirty = dirty;
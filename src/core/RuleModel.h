@@ -3,6 +3,7 @@
 
 #include <QAbstractTableModel>
 #include <QVector>
+#include <QHash>
 #include "Types.h"
 
 namespace udevme {
@@ -12,6 +13,7 @@ class RuleModel : public QAbstractTableModel {
 public:
     enum Column {
         ColEnabled = 0,
+        ColStatus,
         ColDevices,
         ColApps,
         ColNotes,
@@ -39,6 +41,12 @@ public:
     void setRules(const QVector<UdevRule>& rules);
     void clear();
     
+    // Live device state for the status column. updateDevices() takes the
+    // deltas from DeviceScanner::devicesChanged and only touches rows that
+    // reference one of the changed devices.
+    void setConnectedDevices(const QVector<DeviceInfo>& devices);
+    void updateDevices(const QVector<DeviceInfo>& added, const QVector<DeviceInfo>& removed);
+    
     bool isDirty() const { return m_dirty; }
     void setDirty(bool dirty);
     void clearDirty() { setDirty(false); }
@@ -48,8 +56,25 @@ signals:
     void rulesChanged();
 
 private:
+    // Connected instances of one (bus, vid:pid) and their hidraw nodes
+    struct DeviceState {
+        int count = 0;
+        QStringList hidrawNodes;
+        int hidrawMode = -1;    // permission bits common to all nodes, -1 if none
+    };
+    
+    void rebuildDeviceIndex();
+    void indexRule(int row);
+    static void refreshMode(DeviceState& state);
+    void emitStatusChanged(const QVector<int>& rows);
+    QString statusText(const UdevRule& rule, bool* ok) const;
+    QString statusToolTip(const UdevRule& rule) const;
+    
     QVector<UdevRule> m_rules;
     bool m_dirty = false;
+    
+    QHash<quint64, DeviceState> m_deviceStates;     // DeviceInfo::deviceKey() -> state
+    QHash<quint64, QVector<int>> m_rowsByDevice;    // DeviceInfo::deviceKey() -> rule rows
 };
 
 } // namespace udevme
@@ -1,7 +1,7 @@
 #include "RuleParser.h"
+#include "RuleTokenizer.h"
+#include "RuleGenerator.h"
 #include <QFile>
-#include <QTextStream>
-#include <QRegularExpression>
 #include <QCryptographicHash>
 
 namespace udevme {
@@ -11,63 +11,87 @@ QString RuleParser::computeHash(const QString& content) {
     return QString::fromLatin1(hash.toHex());
 }
 
-bool RuleParser::isUdevmeComment(const QString& line) {
-    return line.trimmed().startsWith("# udevme:");
+namespace {
+
+inline bool isHexValue(QStringView value) {
+    if (value.isEmpty()) return false;
+    for (QChar c : value) {
+        const char16_t u = c.unicode();
+        if (!((u >= '0' && u <= '9') || (u >= 'a' && u <= 'f') || (u >= 'A' && u <= 'F'))) {
+            return false;
+        }
+    }
+    return true;
 }
 
-UdevRule RuleParser::parseMetadataComment(const QString& comment) {
+} // namespace
+
+bool RuleParser::isUdevmeComment(QStringView line) {
+    return line.trimmed().startsWith(u"# udevme:");
+}
+
+UdevRule RuleParser::parseMetadataComment(QStringView comment) {
     UdevRule rule;
     
     // Parse: # udevme: id=<uuid> devices=<vid:pid,...> apps=<...> level=<...> types=<...> enabled=<bool>
     // Notes are stored separately in notes.json, not in the rules file
-    QString line = comment.mid(comment.indexOf("udevme:") + 7).trimmed();
+    QStringView line = comment.sliced(comment.indexOf(u"udevme:") + 7).trimmed();
     
     // Extract key=value pairs
-    QRegularExpression kvRe("(\\w+)=([^\\s]+|\"[^\"]*\")");
-    QRegularExpressionMatchIterator it = kvRe.globalMatch(line);
+    RuleTokenizer tokenizer(line);
+    QStringView key;
+    QStringView value;
     
-    while (it.hasNext()) {
-        QRegularExpressionMatch match = it.next();
-        QString key = match.captured(1);
-        QString value = match.captured(2);
-        
+    while (tokenizer.nextPair(key, value)) {
         // Remove quotes if present
-        if (value.startsWith('"') && value.endsWith('"')) {
-            value = value.mid(1, value.length() - 2);
+        if (value.startsWith(u'"') && value.endsWith(u'"')) {
+            value = value.size() > 1 ? value.sliced(1, value.size() - 2) : QStringView();
         }
         
-        if (key == "id") {
+        if (key == u"id") {
             rule.id = QUuid::fromString(value);
             if (rule.id.isNull()) rule.id = QUuid::createUuid();
-        } else if (key == "devices") {
-            for (const QString& dev : value.split(',', Qt::SkipEmptyParts)) {
-                QStringList parts = dev.split(':');
-                if (parts.size() == 2) {
+        } else if (key == u"devices") {
+            for (QStringView dev : value.tokenize(u',', Qt::SkipEmptyParts)) {
+                // vid:pid, optionally suffixed with @bus for non-USB HID
+                const qsizetype at = dev.indexOf(u'@');
+                QStringView ids = at < 0 ? dev : dev.first(at);
+                const qsizetype colon = ids.indexOf(u':');
+                // The ids end up inside the generated rule lines, so anything
+                // but hex is dropped rather than written back out
+                if (colon >= 0 && ids.indexOf(u':', colon + 1) < 0 &&
+                    isHexValue(ids.first(colon)) && isHexValue(ids.sliced(colon + 1))) {
                     DeviceInfo di;
-                    di.vendorId = parts[0];
-                    di.productId = parts[1];
+                    di.vendorId = ids.first(colon).toString();
+                    di.productId = ids.sliced(colon + 1).toString();
+                    if (at >= 0) di.bus = dev.sliced(at + 1).toString();
                     rule.devices.append(di);
                 }
             }
-        } else if (key == "apps") {
-            if (value != "all") {
-                for (const QString& app : value.split(',', Qt::SkipEmptyParts)) {
+        } else if (key == u"apps") {
+            if (value != u"all") {
+                for (QStringView app : value.tokenize(u',', Qt::SkipEmptyParts)) {
                     AppInfo ai;
-                    ai.desktopId = app;
-                    ai.name = QString(app).replace(".desktop", "");
+                    ai.desktopId = app.toString();
+                    ai.name = QString(ai.desktopId).replace(".desktop", "");
                     rule.applications.append(ai);
                 }
             }
-        } else if (key == "level") {
-            rule.permissionLevel = permissionLevelFromString(value);
-        } else if (key == "types") {
-            QStringList types = value.split(',', Qt::SkipEmptyParts);
-            rule.ruleTypes.hidraw = types.contains("hidraw");
-            rule.ruleTypes.usb = types.contains("usb");
-            rule.ruleTypes.uaccess = types.contains("uaccess");
-            rule.ruleTypes.seat = types.contains("seat");
-        } else if (key == "enabled") {
-            rule.enabled = (value.toLower() == "true");
+        } else if (key == u"level") {
+            rule.permissionLevel = permissionLevelFromString(value.toString());
+        } else if (key == u"types") {
+            rule.ruleTypes.hidraw = false;
+            rule.ruleTypes.usb = false;
+            rule.ruleTypes.uaccess = false;
+            rule.ruleTypes.seat = false;
+            for (QStringView type : value.tokenize(u',', Qt::SkipEmptyParts)) {
+                if (type == u"hidraw") rule.ruleTypes.hidraw = true;
+                else if (type == u"usb") rule.ruleTypes.usb = true;
+                else if (type == u"uaccess") rule.ruleTypes.uaccess = true;
+                else if (type == u"seat") rule.ruleTypes.seat = true;
+            }
+        } else if (key == u"enabled") {
+            rule.enabled = value.compare(u"true", Qt::CaseInsensitive) == 0;
         }
         // Notes are loaded from notes.json by ConfigStore, not from rules file
     }
@@ -75,116 +99,384 @@ UdevRule RuleParser::parseMetadataComment(const QString& comment) {
     return rule;
 }
 
-DeviceInfo RuleParser::parseDeviceFromRule(const QString& line) {
+DeviceInfo RuleParser::parseDeviceFromRule(QStringView line) {
     DeviceInfo dev;
     
-    // Extract ATTRS{idVendor} or ATTR{idVendor}
-    QRegularExpression vidRe("ATTRS?\\{idVendor\\}==\"([0-9a-fA-F]+)\"");
-    QRegularExpressionMatch vidMatch = vidRe.match(line);
-    if (vidMatch.hasMatch()) {
-        dev.vendorId = vidMatch.captured(1);
-    }
-    
-    // Extract ATTRS{idProduct} or ATTR{idProduct}
-    QRegularExpression pidRe("ATTRS?\\{idProduct\\}==\"([0-9a-fA-F]+)\"");
-    QRegularExpressionMatch pidMatch = pidRe.match(line);
-    if (pidMatch.hasMatch()) {
-        dev.productId = pidMatch.captured(1);
+    RuleTokenizer tokenizer(line);
+    RuleTokenizer::Token token;
+    while (tokenizer.next(token)) {
+        if (token.op != u"==") continue;
+        
+        // ATTRS{idVendor} or ATTR{idVendor}, and the same for idProduct;
+        // the first hex match wins
+        if ((token.key == u"ATTRS" || token.key == u"ATTR") && isHexValue(token.value)) {
+            if (token.attr == u"idVendor" && dev.vendorId.isEmpty()) {
+                dev.vendorId = token.value.toString();
+            } else if (token.attr == u"idProduct" && dev.productId.isEmpty()) {
+                dev.productId = token.value.toString();
+            }
+        } else if (token.key == u"SUBSYSTEM" && token.value == u"usb") {
+            dev.hasUsb = true;
+        }
     }
     
     // Check subsystem
-    if (line.contains("hidraw")) {
+    if (line.contains(u"hidraw")) {
         dev.hasHidraw = true;
     }
-    if (line.contains("SUBSYSTEM==\"usb\"")) {
-        dev.hasUsb = true;
-    }
     
     return dev;
 }
 
-RuleParser::ParseResult RuleParser::parseRulesFile(const QString& content) {
-    ParseResult result;
-    result.success = true;
+class RuleParser::BlockParser {
+public:
+    BlockParser(const RuleCallback& onRule, BlockCache* cache, QStringList& warnings,
+                QVector<int>& editedLines, int& reused)
+        : m_onRule(onRule), m_cache(cache), m_warnings(warnings),
+          m_editedLines(editedLines), m_reused(reused) {}
     
-    QStringList lines = content.split('\n');
-    UdevRule currentRule;
-    bool hasCurrentRule = false;
+    // Lines come trimmed, one call per physical line so numbering holds
+    bool feedLine(QStringView line);
     
-    for (int i = 0; i < lines.size(); ++i) {
-        QString line = lines[i].trimmed();
-        
-        if (line.isEmpty()) continue;
-        
-        // Check for udevme metadata comment
-        if (isUdevmeComment(line)) {
-            // Save previous rule if exists
-            if (hasCurrentRule && !currentRule.devices.isEmpty()) {
-                result.rules.append(currentRule);
+    // Hands over the last block
+    bool finish() { return finishBlock(); }
+    
+    // Replaces the caller's cache with the blocks seen in this parse
+    void commitCache() {
+        if (m_cache) *m_cache = std::move(m_nextCache);
+    }
+    
+private:
+    void startBlock(QStringView line);
+    bool finishBlock();
+    void setRule(UdevRule&& rule);
+    void applyDeviceLine(QStringView line);
+    void applyDevPathLine(QStringView line);
+    void markHidraw(QMultiHash<QString, qsizetype>& index, QString (*key)(const DeviceInfo&),
+                    const QString& name);
+    DeviceInfo* findUsbDevice(const DeviceInfo& dev);
+    
+    // Rules usually list a few devices; past this many, rule lines look
+    // their device up in m_usbDevices so huge blocks stay linear
+    static constexpr qsizetype IndexThreshold = 16;
+    
+    const RuleCallback& m_onRule;
+    BlockCache* m_cache;
+    BlockCache m_nextCache;
+    QStringList& m_warnings;
+    QVector<int>& m_editedLines;
+    int& m_reused;
+    int m_lineNumber = 0;
+    
+    // Block being assembled
+    UdevRule m_rule;
+    bool m_hasRule = false;
+    QHash<QString, qsizetype> m_usbDevices;  // lowercase vid:pid -> index
+    qsizetype m_indexedDevices = 0;
+    QMultiHash<QString, qsizetype> m_hidNames;     // hidDeviceName() -> indexes
+    QMultiHash<QString, qsizetype> m_hwdbMatches;  // hwdbMatch() -> indexes
+    int m_blockLine = 0;
+    QString m_storedSum;
+    BlockChecksum m_checksum;
+    
+    // While a cached rule may be reused the block's lines are only kept,
+    // and parsed after all if its checksum turns out not to match
+    const UdevRule* m_cached = nullptr;
+    QString m_deferred;
+};
+
+void RuleParser::BlockParser::startBlock(QStringView line) {
+    m_hasRule = true;
+    m_blockLine = m_lineNumber;
+    m_storedSum.clear();
+    m_checksum.reset();
+    m_cached = nullptr;
+    
+    const qsizetype sumAt = line.lastIndexOf(u" sum=");
+    if (sumAt >= 0) {
+        const qsizetype valueStart = sumAt + 5;
+        qsizetype valueEnd = line.indexOf(u' ', valueStart);
+        if (valueEnd < 0) valueEnd = line.size();
+        m_storedSum = line.sliced(valueStart, valueEnd - valueStart).toString();
+        m_checksum.addText(line.first(sumAt));
+        m_checksum.addLine(line.sliced(valueEnd));
+    } else {
+        m_checksum.addLine(line);
+    }
+    
+    if (m_cache && !m_storedSum.isEmpty()) {
+        auto it = m_cache->constFind(m_storedSum);
+        if (it != m_cache->constEnd()) m_cached = &it.value();
+    }
+    if (m_cached) {
+        m_deferred.clear();
+        m_deferred += line;
+        m_deferred += u'\n';
+    } else {
+        setRule(parseMetadataComment(line));
+    }
+}
+
+bool RuleParser::BlockParser::finishBlock() {
+    if (!m_hasRule) return true;
+    m_hasRule = false;
+    
+    // Blocks from before checksums were written have nothing to verify
+    const bool signedBlock = !m_storedSum.isEmpty();
+    const bool verified = signedBlock && m_checksum.result() == m_storedSum;
+    if (signedBlock && !verified) {
+        m_editedLines.append(m_blockLine);
+        m_warnings << QString("Rule at line %1 was edited outside udevme").arg(m_blockLine);
+    }
+    
+    if (m_cached) {
+        if (verified) {
+            m_rule = *m_cached;
+            ++m_reused;
+        } else {
+            qsizetype pos = 0;
+            QStringView line;
+            RuleTokenizer::nextLine(m_deferred, pos, line);
+            setRule(parseMetadataComment(line));
+            while (pos < m_deferred.size() && RuleTokenizer::nextLine(m_deferred, pos, line)) {
+                applyDeviceLine(line);
             }
-            
-            // Start new rule from metadata
-            currentRule = parseMetadataComment(line);
-            hasCurrentRule = true;
-            continue;
         }
-        
-        // Skip other comments
-        if (line.startsWith('#')) continue;
-        
-        // Parse actual udev rule line to extract/verify device info
-        if (hasCurrentRule && (line.contains("idVendor") || line.contains("idProduct"))) {
-            DeviceInfo dev = parseDeviceFromRule(line);
-            
-            // Update existing device info or add if not found
-            bool found = false;
-            for (auto& d : currentRule.devices) {
-                if (d.vendorId == dev.vendorId && d.productId == dev.productId) {
-                    d.hasHidraw = d.hasHidraw || dev.hasHidraw;
-                    d.hasUsb = d.hasUsb || dev.hasUsb;
-                    found = true;
-                    break;
-                }
-            }
-            
-            if (!found && !dev.vendorId.isEmpty() && !dev.productId.isEmpty()) {
-                // If we have metadata but device wasn't listed (shouldn't happen), add it
-                bool alreadyInRule = false;
-                for (const auto& d : currentRule.devices) {
-                    if (d.vendorId == dev.vendorId && d.productId == dev.productId) {
-                        alreadyInRule = true;
-                        break;
-                    }
-                }
-                if (!alreadyInRule) {
-                    currentRule.devices.append(dev);
-                }
+    }
+    
+    if (m_rule.devices.isEmpty()) return true;
+    if (m_cache && verified) m_nextCache.insert(m_storedSum, m_rule);
+    return m_onRule(std::move(m_rule));
+}
+
+void RuleParser::BlockParser::setRule(UdevRule&& rule) {
+    m_rule = std::move(rule);
+    m_usbDevices.clear();
+    m_indexedDevices = 0;
+    m_hidNames.clear();
+    m_hwdbMatches.clear();
+}
+
+DeviceInfo* RuleParser::BlockParser::findUsbDevice(const DeviceInfo& dev) {
+    // Rule lines only name USB devices (others match on KERNELS), and the
+    // metadata keeps whatever case the ids were given in
+    auto& devices = m_rule.devices;
+    if (devices.size() < IndexThreshold) {
+        for (auto& d : devices) {
+            if (hidBusNumber(d.bus) == HidBusUsb &&
+                d.vendorId.compare(dev.vendorId, Qt::CaseInsensitive) == 0 &&
+                d.productId.compare(dev.productId, Qt::CaseInsensitive) == 0) {
+                return &d;
             }
         }
+        return nullptr;
     }
     
-    // Save last rule
-    if (hasCurrentRule && !currentRule.devices.isEmpty()) {
-        result.rules.append(currentRule);
+    auto key = [](const DeviceInfo& d) {
+        return d.vendorId.toLower() + u':' + d.productId.toLower();
+    };
+    // Devices appended since the last lookup are indexed on the way; the
+    // first of several equal ones wins, as in the linear search
+    for (; m_indexedDevices < devices.size(); ++m_indexedDevices) {
+        const DeviceInfo& d = devices[m_indexedDevices];
+        if (hidBusNumber(d.bus) != HidBusUsb) continue;
+        const QString k = key(d);
+        if (!m_usbDevices.contains(k)) m_usbDevices.insert(k, m_indexedDevices);
     }
+    const qsizetype i = m_usbDevices.value(key(dev), -1);
+    return i < 0 ? nullptr : &devices[i];
+}
+
+void RuleParser::BlockParser::markHidraw(QMultiHash<QString, qsizetype>& index,
+                                         QString (*key)(const DeviceInfo&), const QString& name) {
+    // Built on the block's first such line; equal devices all get marked
+    if (index.isEmpty()) {
+        for (qsizetype i = 0; i < m_rule.devices.size(); ++i) {
+            index.insert(key(m_rule.devices[i]), i);
+        }
+    }
+    for (auto it = index.constFind(name); it != index.constEnd() && it.key() == name; ++it) {
+        m_rule.devices[it.value()].hasHidraw = true;
+    }
+}
+
+void RuleParser::BlockParser::applyDevPathLine(QStringView line) {
+    // Optimized output: DEVPATH=="*/<hid name>.*|..." for devices the
+    // metadata already lists, so these only confirm hidraw coverage
+    RuleTokenizer tokenizer(line);
+    RuleTokenizer::Token token;
+    while (tokenizer.next(token)) {
+        if (token.key != u"DEVPATH" || token.op != u"==") continue;
+        for (QStringView pattern : token.value.tokenize(u'|')) {
+            if (pattern.size() < 4 || !pattern.startsWith(u"*/") || !pattern.endsWith(u".*")) continue;
+            markHidraw(m_hidNames, &RuleGenerator::hidDeviceName, pattern.sliced(2, pattern.size() - 4).toString());
+        }
+    }
+}
+
+void RuleParser::BlockParser::applyDeviceLine(QStringView line) {
+    if (line.startsWith(u"DEVPATH==")) {
+        applyDevPathLine(line);
+        return;
+    }
+    // hwdb output: one match line per device, the same story
+    if (line.startsWith(QLatin1String(RuleGenerator::HwdbPrefix))) {
+        markHidraw(m_hwdbMatches, &RuleGenerator::hwdbMatch, line.toString());
+        return;
+    }
+    
+    // Parse actual udev rule line to extract/verify device info
+    if (!line.contains(u"idVendor") && !line.contains(u"idProduct")) return;
+    DeviceInfo dev = parseDeviceFromRule(line);
+    
+    // Update existing device info or add if not found
+    if (DeviceInfo* d = findUsbDevice(dev)) {
+        d->hasHidraw = d->hasHidraw || dev.hasHidraw;
+        d->hasUsb = d->hasUsb || dev.hasUsb;
+        return;
+    }
+    
+    // If we have metadata but device wasn't listed (shouldn't happen), add it
+    if (!dev.vendorId.isEmpty() && !dev.productId.isEmpty()) {
+        m_rule.devices.append(dev);
+    }
+}
+
+bool RuleParser::BlockParser::feedLine(QStringView line) {
+    ++m_lineNumber;
+    if (line.isEmpty()) return true;
+    
+    // Check for udevme metadata comment
+    if (isUdevmeComment(line)) {
+        // Hand over the previous rule, then start a new one from metadata
+        const bool keepGoing = finishBlock();
+        startBlock(line);
+        return keepGoing;
+    }
+    
+    // The optimized file's end label isn't part of the last block
+    if (line == QLatin1String(RuleGenerator::EndLabel)) return finishBlock();
+    
+    // Skip other comments
+    if (line.startsWith(u'#') || !m_hasRule) return true;
+    
+    m_checksum.addLine(line);
+    if (m_cached) {
+        m_deferred += line;
+        m_deferred += u'\n';
+    } else {
+        applyDeviceLine(line);
+    }
+    return true;
+}
+
+RuleParser::ParseResult RuleParser::parseRulesFile(const QString& content, BlockCache* cache) {
+    ParseResult result;
+    result.success = true;
+    
+    const RuleCallback collect = [&result](UdevRule&& rule) {
+        result.rules.append(std::move(rule));
+        return true;
+    };
+    BlockParser parser(collect, cache, result.warnings, result.editedBlockLines, result.reusedBlocks);
+    
+    // One pass over the content; every line is a view, not a copy
+    qsizetype pos = 0;
+    QStringView line;
+    while (RuleTokenizer::nextLine(content, pos, line)) {
+        parser.feedLine(line);
+    }
+    parser.finish();
+    parser.commitCache();
     
     return result;
 }
 
 RuleParser::ParseResult RuleParser::parseRulesFromPath(const QString& path) {
     ParseResult result;
-    
+    StreamResult stream = parseRulesStream(path, [&result](UdevRule&& rule) {
+        result.rules.append(std::move(rule));
+        return true;
+    });
+    result.success = stream.success;
+    result.warnings = stream.warnings;
+    result.editedBlockLines = stream.editedBlockLines;
+    result.reusedBlocks = stream.reusedBlocks;
+    return result;
+}
+
+RuleParser::StreamResult RuleParser::parseRulesStream(const QString& path, const RuleCallback& onRule,
+                                                      BlockCache* cache) {
+    // Raw bytes, so the hash is FileHash's; lines are trimmed, which takes
+    // care of CRLF
     QFile file(path);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        result.success = false;
+    if (!file.open(QIODevice::ReadOnly)) {
+        StreamResult result;
         result.warnings << QString("Cannot open file: %1").arg(path);
         return result;
     }
+    return parseRulesStream(&file, onRule, cache);
+}
+
+RuleParser::StreamResult RuleParser::parseRulesStream(QIODevice* device, const RuleCallback& onRule,
+                                                      BlockCache* cache) {
+    StreamResult result;
+    const RuleCallback counted = [&](UdevRule&& rule) {
+        ++result.ruleCount;
+        return onRule(std::move(rule));
+    };
     
-    QString content = QString::fromUtf8(file.readAll());
-    file.close();
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    QByteArray buffer;
+    BlockParser parser(counted, cache, result.warnings, result.editedBlockLines, result.reusedBlocks);
+    bool keepGoing = true;
+    bool atEnd = false;
     
-    return parseRulesFile(content);
+    while (keepGoing && !atEnd) {
+        const qsizetype kept = buffer.size();
+        buffer.resize(kept + StreamChunkSize);
+        const qint64 n = device->read(buffer.data() + kept, StreamChunkSize);
+        if (n < 0) {
+            result.warnings << QString("Read error: %1").arg(device->errorString());
+            return result;
+        }
+        buffer.resize(kept + n);
+        atEnd = (n == 0);
+        
+        hash.addData(QByteArrayView(buffer.constData() + kept, n));
+        result.bytesRead += n;
+        result.peakBufferBytes = qMax(result.peakBufferBytes, buffer.size());
+        
+        // Decode whole lines only: UTF-8 sequences never span a newline, so
+        // this gives the same text as decoding the file in one go. A line
+        // longer than a chunk just waits for the next read.
+        // Only the bytes just read can hold a new newline; searching all of
+        // a long line again on every chunk would be quadratic.
+        qsizetype complete = buffer.size();
+        if (!atEnd) {
+            const qsizetype last = QByteArrayView(buffer).sliced(kept).lastIndexOf('\n');
+            complete = last < 0 ? 0 : kept + last + 1;
+        }
+        if (complete <= 0) continue;
+        
+        const QString text = QString::fromUtf8(buffer.constData(), complete);
+        buffer.remove(0, complete);
+        
+        // Text ends at a newline, so stop short of the empty piece after it
+        qsizetype pos = 0;
+        QStringView line;
+        while (keepGoing && pos < text.size() && RuleTokenizer::nextLine(text, pos, line)) {
+            keepGoing = parser.feedLine(line);
+        }
+    }
+    if (keepGoing) {
+        parser.finish();
+    }
+    parser.commitCache();
+    
+    result.hash = QString::fromLatin1(hash.result().toHex());
+    result.success = true;
+    return result;
 }
 
 } // namespace udevme
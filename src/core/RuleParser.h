@@ -1,10 +1,16 @@
 #ifndef RULEPARSER_H
 #define RULEPARSER_H
 
+#include <QHash>
 #include <QString>
+#include <QStringView>
 #include <QVector>
 #include "Types.h"
 
+#include <functional>
+
+class QIODevice;
+
 namespace udevme {
 
 class RuleParser {
@@ -12,17 +18,52 @@ public:
     struct ParseResult {
         QVector<UdevRule> rules;
         QStringList warnings;
+        QVector<int> editedBlockLines;  // blocks whose sum= no longer matches
+        int reusedBlocks = 0;           // taken from the BlockCache unparsed
         bool success = false;
     };
     
-    static ParseResult parseRulesFile(const QString& content);
+    // Rules of an earlier parse keyed by their block's sum=. Passed to a
+    // parse, blocks whose content still matches their sum are taken from
+    // here instead of being parsed again; afterwards it holds this file's
+    // blocks, ready for the next parse.
+    using BlockCache = QHash<QString, UdevRule>;
+    
+    // Called with each rule as soon as its block ends; return false to stop
+    using RuleCallback = std::function<bool(UdevRule&& rule)>;
+    
+    struct StreamResult {
+        QStringList warnings;
+        QString hash;                   // SHA-256 of the bytes read, as FileHash::sha256()
+        qint64 bytesRead = 0;
+        qsizetype peakBufferBytes = 0;  // most raw file data held at once
+        int ruleCount = 0;
+        QVector<int> editedBlockLines;
+        int reusedBlocks = 0;
+        bool success = false;
+    };
+    
+    static constexpr qsizetype StreamChunkSize = 64 * 1024;
+    
+    static ParseResult parseRulesFile(const QString& content, BlockCache* cache = nullptr);
     static ParseResult parseRulesFromPath(const QString& path);
     static QString computeHash(const QString& content);
     
+    // Reads the file in StreamChunkSize pieces and parses it as it goes, so
+    // memory stays bounded by a chunk plus the longest line whatever the
+    // file size. The hash covers the whole file unless onRule stopped early.
+    static StreamResult parseRulesStream(const QString& path, const RuleCallback& onRule,
+                                         BlockCache* cache = nullptr);
+    static StreamResult parseRulesStream(QIODevice* device, const RuleCallback& onRule,
+                                         BlockCache* cache = nullptr);
+    
 private:
-    static UdevRule parseMetadataComment(const QString& comment);
-    static bool isUdevmeComment(const QString& line);
-    static DeviceInfo parseDeviceFromRule(const QString& line);
+    // Assembles rule blocks line by line; defined in RuleParser.cpp
+    class BlockParser;
+
+    static UdevRule parseMetadataComment(QStringView comment);
+    static bool isUdevmeComment(QStringView line);
+    static DeviceInfo parseDeviceFromRule(QStringView line);
 };
 
 } // namespace udevme
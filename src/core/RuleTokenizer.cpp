@@ -0,0 +1,117 @@
+#include "RuleTokenizer.h"
+#include "TextScan.h"
+
+namespace udevme {
+
+namespace {
+
+// ASCII classes, as QRegularExpression's \w and \s use without UCP
+inline bool isWordChar(QChar c) {
+    const char16_t u = c.unicode();
+    return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') || u == '_';
+}
+
+inline bool isAsciiSpace(QChar c) {
+    const char16_t u = c.unicode();
+    return u == ' ' || (u >= '\t' && u <= '\r');
+}
+
+} // namespace
+
+bool RuleTokenizer::nextLine(QStringView content, qsizetype& pos, QStringView& line) {
+    return TextScan::nextLine(content, pos, line);
+}
+
+bool RuleTokenizer::next(Token& token) {
+    const qsizetype n = m_text.size();
+    auto skipSpace = [&] {
+        while (m_pos < n && m_text[m_pos].isSpace()) ++m_pos;
+    };
+
+    // Assignments are separated by commas and/or whitespace
+    while (m_pos < n && (m_text[m_pos] == u',' || m_text[m_pos].isSpace())) ++m_pos;
+    if (m_pos >= n) return false;
+
+    qsizetype start = m_pos;
+    while (m_pos < n && isWordChar(m_text[m_pos])) ++m_pos;
+    if (m_pos == start) {
+        m_error = true;
+        return false;
+    }
+    token.key = m_text.sliced(start, m_pos - start);
+    token.attr = QStringView();
+
+    if (m_pos < n && m_text[m_pos] == u'{') {
+        qsizetype close = m_text.indexOf(u'}', m_pos + 1);
+        if (close < 0) {
+            m_error = true;
+            return false;
+        }
+        token.attr = m_text.sliced(m_pos + 1, close - m_pos - 1);
+        m_pos = close + 1;
+    }
+
+    skipSpace();
+    start = m_pos;
+    if (m_pos + 1 < n && m_text[m_pos + 1] == u'=' &&
+        QStringView(u"=!+-:").contains(m_text[m_pos])) {
+        m_pos += 2;
+    } else if (m_pos < n && m_text[m_pos] == u'=') {
+        m_pos += 1;
+    } else {
+        m_error = true;
+        return false;
+    }
+    token.op = m_text.sliced(start, m_pos - start);
+
+    skipSpace();
+    token.escaped = m_pos + 1 < n && m_text[m_pos] == u'e' && m_text[m_pos + 1] == u'"';
+    if (token.escaped) ++m_pos;
+    if (m_pos >= n || m_text[m_pos] != u'"') {
+        m_error = true;
+        return false;
+    }
+    // \" doesn't end either kind of string; in e"..." a backslash escapes
+    // whatever follows it, elsewhere only the quote
+    qsizetype close = TextScan::indexOfAny(m_text, "\"\\", m_pos + 1);
+    while (close >= 0 && m_text[close] == u'\\') {
+        const bool skipNext = token.escaped || (close + 1 < n && m_text[close + 1] == u'"');
+        close = TextScan::indexOfAny(m_text, "\"\\", close + (skipNext ? 2 : 1));
+    }
+    if (close < 0) {
+        m_error = true;
+        return false;
+    }
+    token.value = m_text.sliced(m_pos + 1, close - m_pos - 1);
+    m_pos = close + 1;
+    return true;
+}
+
+bool RuleTokenizer::nextPair(QStringView& key, QStringView& value) {
+    const qsizetype n = m_text.size();
+
+    while (m_pos < n) {
+        if (!isWordChar(m_text[m_pos])) {
+            ++m_pos;
+            continue;
+        }
+
+        qsizetype start = m_pos;
+        while (m_pos < n && isWordChar(m_text[m_pos])) ++m_pos;
+
+        // A word not followed by '=' and a non-space can't start a pair,
+        // and neither can any suffix of it
+        if (m_pos + 1 >= n || m_text[m_pos] != u'=' || isAsciiSpace(m_text[m_pos + 1])) {
+            continue;
+        }
+        key = m_text.sliced(start, m_pos - start);
+
+        qsizetype valueStart = ++m_pos;
+        while (m_pos < n && !isAsciiSpace(m_text[m_pos])) ++m_pos;
+        value = m_text.sliced(valueStart, m_pos - valueStart);
+        return true;
+    }
+    return false;
+}
+
+} // namespace udevme
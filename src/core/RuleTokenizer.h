@@ -0,0 +1,46 @@
+#ifndef RULETOKENIZER_H
+#define RULETOKENIZER_H
+
+#include <QStringView>
+
+namespace udevme {
+
+// Single-pass tokenizer for udev rules text. Tokens are views into the
+// caller's buffer, which must outlive them; nothing is copied or allocated.
+class RuleTokenizer {
+public:
+    // One KEY{attr}<op>"value" assignment of a rule line
+    struct Token {
+        QStringView key;        // e.g. ATTRS
+        QStringView attr;       // text between the braces, empty if none
+        QStringView op;         // ==, !=, =, +=, -= or :=
+        QStringView value;      // without the quotes, escapes not decoded
+        bool escaped = false;   // e"..." string
+    };
+
+    explicit RuleTokenizer(QStringView text) : m_text(text) {}
+
+    // Yields the lines of content the way split('\n') + trimmed() would,
+    // including empty ones; pos starts at 0 and is advanced past the line
+    static bool nextLine(QStringView content, qsizetype& pos, QStringView& line);
+
+    // Next assignment of a rule line. Returns false at the end of the line
+    // or on malformed input, in which case hasError() is set.
+    bool next(Token& token);
+
+    // Next key=value pair of a "# udevme:" metadata comment body. Matches
+    // the old (\w+)=(\S+) scan: text that isn't a pair is skipped.
+    bool nextPair(QStringView& key, QStringView& value);
+
+    bool hasError() const { return m_error; }
+    qsizetype position() const { return m_pos; }
+
+private:
+    QStringView m_text;
+    qsizetype m_pos = 0;
+    bool m_error = false;
+};
+
+} // namespace udevme
+
+#endif // RULETOKENIZER_H
@@ -0,0 +1,390 @@
+#include "RulesAnalyzer.h"
+#include "RuleGenerator.h"
+#include "UdevRulesParser.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMap>
+#include <QtConcurrent>
+
+#include <fnmatch.h>
+#include <algorithm>
+
+namespace udevme {
+
+namespace {
+
+// A match on something that depends on the device
+struct Condition {
+    enum Kind { Vendor, Product, HidName, Subsystems };
+    Kind kind;
+    QString pattern;
+    bool negate;
+};
+
+// A statement that sets MODE and can apply to a hidraw node
+struct ModeStatement {
+    int file = 0;               // index into Report::files
+    int line = 0;
+    uint mode = 0;
+    bool final = false;         // MODE:=
+    bool conditional = false;   // has matches we can't evaluate
+    QVector<Condition> conditions;
+};
+
+struct ParsedFile {
+    QVector<ModeStatement> statements;
+    QStringList errors;
+};
+
+// No glob characters; '|' alternatives are fine
+inline bool isPlain(QStringView pattern) {
+    for (QChar c : pattern) {
+        if (c == u'*' || c == u'?' || c == u'[') return false;
+    }
+    return !pattern.isEmpty();
+}
+
+// "BBBB:VVVV:PPPP" of a KERNELS pattern naming a HID device, which the
+// kernel calls BBBB:VVVV:PPPP.NNNN
+QStringView hidNamePrefix(QStringView pattern) {
+    const qsizetype dot = pattern.indexOf(u'.');
+    QStringView prefix = dot < 0 ? pattern : pattern.first(dot);
+    return prefix.count(u':') == 2 ? prefix : QStringView();
+}
+
+// Evaluates what doesn't depend on the device and keeps the rest
+bool extractStatement(const RuleStatement& statement, ModeStatement& out) {
+    bool hasMode = false;
+    for (const RuleAssignment& a : statement) {
+        if (a.key == u"MODE" && !a.isMatch()) {
+            bool ok = false;
+            const uint mode = a.value.toUInt(&ok, 8);
+            if (!ok) return false;    // $env{} and friends
+            out.mode = mode;
+            out.final = a.op == RuleOperator::AssignFinal;
+            hasMode = true;
+            continue;
+        }
+        if (!a.isMatch()) continue;
+
+        const bool negate = a.op == RuleOperator::NoMatch;
+        auto holds = [&](QStringView text) {
+            return RulesAnalyzer::globMatch(a.value, text) != negate;
+        };
+
+        if (a.key == u"ACTION") {
+            if (!holds(u"add")) return false;
+        } else if (a.key == u"SUBSYSTEM") {
+            if (!holds(u"hidraw")) return false;
+        } else if (a.key == u"KERNEL") {
+            if (!holds(u"hidraw0")) return false;
+        } else if (a.key == u"SUBSYSTEMS") {
+            out.conditions.append({ Condition::Subsystems, a.value.toString(), negate });
+        } else if ((a.key == u"ATTRS" || a.key == u"ATTR") && a.attr == u"idVendor") {
+            out.conditions.append({ Condition::Vendor, a.value.toString(), negate });
+        } else if ((a.key == u"ATTRS" || a.key == u"ATTR") && a.attr == u"idProduct") {
+            out.conditions.append({ Condition::Product, a.value.toString(), negate });
+        } else if (a.key == u"ENV" && a.attr == u"ID_VENDOR_ID") {
+            out.conditions.append({ Condition::Vendor, a.value.toString(), negate });
+        } else if (a.key == u"ENV" && a.attr == u"ID_MODEL_ID") {
+            out.conditions.append({ Condition::Product, a.value.toString(), negate });
+        } else if (a.key == u"KERNELS" && !hidNamePrefix(a.value).isEmpty()) {
+            out.conditions.append({ Condition::HidName, hidNamePrefix(a.value).toString(), negate });
+        } else {
+            out.conditional = true;
+        }
+    }
+    return hasMode;
+}
+
+ParsedFile readModeStatements(const QString& path) {
+    ParsedFile parsed;
+    QString error;
+    const UdevRulesFile file = UdevRulesParser::parseFile(path, &error);
+    if (!error.isEmpty()) {
+        parsed.errors << error;
+        return parsed;
+    }
+
+    for (const RulesDiagnostic& d : file.diagnostics()) {
+        if (d.severity == RulesDiagnostic::Error) {
+            parsed.errors << QString("%1:%2: %3").arg(path).arg(d.line).arg(d.message);
+        }
+    }
+    for (const RuleStatement& statement : file) {
+        ModeStatement s;
+        if (!extractStatement(statement, s)) continue;
+        s.line = statement.line;
+        parsed.statements.append(std::move(s));
+    }
+    return parsed;
+}
+
+// The device as its hidraw node's parents describe it
+struct DeviceKey {
+    QString vendor;         // lowercase, as in sysfs
+    QString product;
+    QString hidName;        // BBBB:VVVV:PPPP
+    QStringList subsystems;
+    bool usb;
+};
+
+DeviceKey deviceKey(const DeviceInfo& device) {
+    DeviceKey key;
+    const uint bus = hidBusNumber(device.bus);
+    key.usb = bus == HidBusUsb;
+    key.vendor = device.vendorId.toLower();
+    key.product = device.productId.toLower();
+    key.hidName = QString("%1:%2:%3")
+        .arg(bus, 4, 16, QLatin1Char('0'))
+        .arg(device.vendorId.toUInt(nullptr, 16), 4, 16, QLatin1Char('0'))
+        .arg(device.productId.toUInt(nullptr, 16), 4, 16, QLatin1Char('0'))
+        .toUpper();
+    key.subsystems = { "hidraw", "hid", key.usb ? QString("usb") : device.bus };
+    return key;
+}
+
+bool matches(const ModeStatement& s, const DeviceKey& key) {
+    for (const Condition& c : s.conditions) {
+        bool hit = false;
+        switch (c.kind) {
+            case Condition::Vendor:
+                // Only USB parents have idVendor and ID_VENDOR_ID
+                hit = key.usb && RulesAnalyzer::globMatch(c.pattern, key.vendor);
+                break;
+            case Condition::Product:
+                hit = key.usb && RulesAnalyzer::globMatch(c.pattern, key.product);
+                break;
+            case Condition::HidName:
+                hit = RulesAnalyzer::globMatch(c.pattern, key.hidName);
+                break;
+            case Condition::Subsystems:
+                hit = std::any_of(key.subsystems.cbegin(), key.subsystems.cend(), [&](const QString& name) {
+                    return RulesAnalyzer::globMatch(c.pattern, name);
+                });
+                break;
+        }
+        if (hit == c.negate) return false;
+    }
+    return true;
+}
+
+// Where a statement can be found: by exact vid:pid, by vendor alone, or
+// only by trying it (wildcards, negations, statements for all hidraw)
+struct StatementIndex {
+    QHash<QString, QVector<int>> byVidPid;
+    QHash<QString, QVector<int>> byVendor;
+    QVector<int> others;
+
+    void add(const ModeStatement& s, int index) {
+        QStringList vendors;
+        QStringList products;
+        bool named = false;
+        for (const Condition& c : s.conditions) {
+            if (c.kind == Condition::Subsystems) continue;
+            named = true;
+            if (c.negate || !isPlain(c.pattern) ||
+                (c.kind == Condition::HidName && c.pattern.contains(u'|'))) {
+                others.append(index);
+                return;
+            }
+            const QStringList alternatives = c.pattern.split(u'|', Qt::SkipEmptyParts);
+            if (c.kind == Condition::Vendor) vendors += alternatives;
+            else if (c.kind == Condition::Product) products += alternatives;
+            else {
+                // BBBB:VVVV:PPPP names the device as well
+                const QStringList parts = c.pattern.split(u':');
+                vendors << parts[1];
+                products << parts[2];
+            }
+        }
+
+        if (!named) {
+            // Device-wide statements only count when nothing else limits them
+            if (!s.conditional) others.append(index);
+            return;
+        }
+        for (const QString& vendor : vendors) {
+            if (products.isEmpty()) {
+                byVendor[vendor.toLower()].append(index);
+            }
+            for (const QString& product : products) {
+                byVidPid[vendor.toLower() + u':' + product.toLower()].append(index);
+            }
+        }
+    }
+
+    QVector<int> candidates(const DeviceKey& key) const {
+        QVector<int> result = others;
+        result += byVidPid.value(key.vendor + u':' + key.product);
+        result += byVendor.value(key.vendor);
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+};
+
+} // namespace
+
+RulesAnalyzer::RulesAnalyzer(const QString& root) : m_root(root) {}
+
+QString RulesAnalyzer::Finding::message() const {
+    const QString where = QString("%1:%2").arg(file).arg(line);
+    const QString modeText = QString("%1").arg(mode, 4, 8, QLatin1Char('0'));
+    QString text;
+    switch (issue) {
+        case Issue::Shadowed:
+            text = QString("%1: MODE:=\"%2\" at %3 comes first; udev ignores the udevme rule's mode")
+                .arg(device, modeText, where);
+            break;
+        case Issue::Overridden:
+            text = QString("%1: MODE=\"%2\" at %3 replaces the udevme rule's %4")
+                .arg(device, modeText, where)
+                .arg(ruleMode, 4, 8, QLatin1Char('0'));
+            break;
+        case Issue::Redundant:
+            text = QString("%1: %2 already sets MODE=\"%3\"").arg(device, where, modeText);
+            break;
+    }
+    if (conditional) text += " (if its other conditions match)";
+    return text;
+}
+
+QStringList RulesAnalyzer::rulesDirectories() {
+    // udev's search path, highest priority first
+    return { "etc/udev/rules.d", "run/udev/rules.d", "usr/local/lib/udev/rules.d",
+             "usr/lib/udev/rules.d", "lib/udev/rules.d" };
+}
+
+bool RulesAnalyzer::isOwnFile(const QString& name) const {
+    // The sharded layout's 99-udevme-<id>.rules are ours as well
+    const QFileInfo own(m_rulesFileName);
+    return name == m_rulesFileName ||
+        (name.startsWith(own.completeBaseName() + u'-') && name.endsWith("." + own.suffix()));
+}
+
+QStringList RulesAnalyzer::ownFiles() const {
+    return m_ownFiles.isEmpty() ? QStringList{ m_rulesFileName } : m_ownFiles;
+}
+
+QStringList RulesAnalyzer::rulesFiles() const {
+    QMap<QString, QString> byName;
+    QStringList seenDirs;
+    for (const QString& dir : rulesDirectories()) {
+        // /lib is often a symlink to /usr/lib; don't read it twice
+        const QString path = QDir::cleanPath(m_root + u'/' + dir);
+        const QString canonical = QFileInfo(path).canonicalFilePath();
+        if (canonical.isEmpty() || seenDirs.contains(canonical)) continue;
+        seenDirs << canonical;
+
+        for (const QFileInfo& info : QDir(path).entryInfoList({ "*.rules" }, QDir::Files | QDir::System)) {
+            if (!byName.contains(info.fileName())) {
+                byName.insert(info.fileName(), info.filePath());
+            }
+        }
+    }
+
+    QStringList files;
+    for (auto it = byName.cbegin(); it != byName.cend(); ++it) {
+        // Symlinks to /dev/null mask a file without replacing it
+        if (isOwnFile(it.key()) || QFileInfo(it.value()).symLinkTarget() == "/dev/null") {
+            continue;
+        }
+        files << it.value();
+    }
+    return files;
+}
+
+RulesAnalyzer::Report RulesAnalyzer::analyze(const QVector<UdevRule>& rules) const {
+    Report report;
+    report.files = rulesFiles();
+
+    // Parsing dominates; each file is independent
+    const QList<ParsedFile> parsed = QtConcurrent::blockingMapped(report.files, &readModeStatements);
+
+    // Only udevme's names sort between two of its shards, so every other
+    // file comes either before all of them or after
+    const QStringList own = ownFiles();
+    const QString firstOwn = *std::min_element(own.cbegin(), own.cend());
+
+    QVector<ModeStatement> statements;
+    int ownPosition = -1;   // statements before this index come before udevme's files
+    for (int i = 0; i < parsed.size(); ++i) {
+        if (ownPosition < 0 && QFileInfo(report.files[i]).fileName() > firstOwn) {
+            ownPosition = statements.size();
+        }
+        report.errors += parsed[i].errors;
+        for (ModeStatement s : parsed[i].statements) {
+            s.file = i;
+            statements.append(std::move(s));
+        }
+    }
+    if (ownPosition < 0) ownPosition = statements.size();
+    report.statementCount = statements.size();
+
+    StatementIndex index;
+    for (int i = 0; i < statements.size(); ++i) {
+        index.add(statements[i], i);
+    }
+
+    for (const UdevRule& rule : rules) {
+        if (!rule.enabled) continue;
+        const uint ruleMode = RuleGenerator::hidrawMode(rule);
+
+        for (const DeviceInfo& device : rule.devices) {
+            const DeviceKey key = deviceKey(device);
+
+            // Replay the MODE assignments udev would make, ours included
+            int setter = -1;        // statement whose mode is current
+            bool final = false;
+            int before = -1;        // setter just before our rule
+            int blocker = -1;       // final setter that kept ours from applying
+            bool oursApplied = false;
+            bool oursDone = false;
+            auto applyOurs = [&] {
+                oursDone = true;
+                before = setter;
+                if (final) {
+                    blocker = setter;
+                    return;
+                }
+                oursApplied = true;
+                setter = -1;
+            };
+
+            for (int i : index.candidates(key)) {
+                if (!oursDone && i >= ownPosition) applyOurs();
+                const ModeStatement& s = statements[i];
+                if (final || !matches(s, key)) continue;
+                setter = i;
+                final = s.final;
+            }
+            if (!oursDone) applyOurs();
+
+            auto addFinding = [&](Issue issue, int statement) {
+                const ModeStatement& s = statements[statement];
+                report.findings.append({ issue, rule.id, device.vidPid(), report.files[s.file], s.line,
+                                         s.mode, ruleMode, s.conditional });
+            };
+            if (blocker >= 0) {
+                addFinding(Issue::Shadowed, blocker);
+            } else if (oursApplied && setter >= 0) {
+                addFinding(statements[setter].mode == ruleMode ? Issue::Redundant : Issue::Overridden, setter);
+            } else if (before >= 0 && statements[before].mode == ruleMode) {
+                addFinding(Issue::Redundant, before);
+            }
+        }
+    }
+    return report;
+}
+
+bool RulesAnalyzer::globMatch(QStringView pattern, QStringView text) {
+    const QByteArray subject = text.toUtf8();
+    for (QStringView alternative : pattern.tokenize(u'|')) {
+        if (fnmatch(alternative.toUtf8().constData(), subject.constData(), 0) == 0) return true;
+    }
+    return false;
+}
+
+} // namespace udevme
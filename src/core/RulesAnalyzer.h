@@ -0,0 +1,86 @@
+#ifndef RULESANALYZER_H
+#define RULESANALYZER_H
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QUuid>
+#include <QVector>
+#include "Types.h"
+
+namespace udevme {
+
+// Checks udevme's rules against every other rules file udev loads, for
+// statements that set MODE on the same hidraw nodes. Files are parsed in
+// parallel with UdevRulesParser and their MODE statements indexed by
+// vid:pid, so each device only looks at statements that can match it.
+//
+// Matching is static: ACTION, SUBSYSTEM(S), KERNEL(S), idVendor/idProduct
+// and their ENV{ID_*} forms are evaluated, anything else (e.g.
+// ENV{ID_INPUT_JOYSTICK}) makes a finding conditional. GOTO jumps are not
+// followed, so statements they would skip still count.
+class RulesAnalyzer {
+public:
+    enum class Issue {
+        Shadowed,       // an earlier MODE:= makes udev ignore ours
+        Overridden,     // a later statement sets a different mode
+        Redundant       // another statement sets the same mode anyway
+    };
+
+    struct Finding {
+        Issue issue;
+        QUuid ruleId;
+        QString device;         // vid:pid
+        QString file;           // the other statement's file
+        int line = 0;
+        uint mode = 0;          // what that statement sets
+        uint ruleMode = 0;      // what the udevme rule sets
+        bool conditional = false;
+
+        QString message() const;
+    };
+
+    struct Report {
+        QVector<Finding> findings;
+        QStringList files;      // in the order udev reads them
+        QStringList errors;     // unreadable files and syntax errors, "file:line: message"
+        int statementCount = 0; // MODE statements that can apply to hidraw nodes
+    };
+
+    explicit RulesAnalyzer(const QString& root = QStringLiteral("/"));
+
+    // Directory the rules directories are looked up under, for fixtures
+    void setRoot(const QString& root) { m_root = root; }
+    QString root() const { return m_root; }
+
+    // Name of udevme's own file; it takes this place in the order and is
+    // not parsed, the rules passed to analyze() stand in for it
+    void setRulesFileName(const QString& name) { m_rulesFileName = name; }
+    QString rulesFileName() const { return m_rulesFileName; }
+
+    // Names of the rules files udevme's rules end up in: the single file
+    // or the shards. Defaults to the rules file name.
+    void setOwnFiles(const QStringList& names) { m_ownFiles = names; }
+    QStringList ownFiles() const;
+
+    // Rules files by name, a file in an earlier directory hiding ones of
+    // the same name in later directories, as udev does
+    static QStringList rulesDirectories();
+    QStringList rulesFiles() const;
+
+    Report analyze(const QVector<UdevRule>& rules) const;
+
+    // udev's pattern matching: fnmatch() globs, '|' separating alternatives
+    static bool globMatch(QStringView pattern, QStringView text);
+
+private:
+    bool isOwnFile(const QString& name) const;
+
+    QString m_root;
+    QString m_rulesFileName = QStringLiteral("99-udevme.rules");
+    QStringList m_ownFiles;
+};
+
+} // namespace udevme
+
+#endif // RULESANALYZER_H
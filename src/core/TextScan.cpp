@@ -0,0 +1,209 @@
+#include "TextScan.h"
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define UDEVME_TEXTSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace udevme {
+
+namespace {
+
+constexpr int kMaxSet = 4;
+
+// Pads the set to four entries by repeating its first character, so the
+// vector loops always do four compares and never branch on the set size
+struct Needles {
+    char c[kMaxSet];
+
+    explicit Needles(const char* set) {
+        const size_t n = strlen(set);
+        Q_ASSERT(n >= 1 && n <= kMaxSet);
+        for (size_t i = 0; i < kMaxSet; ++i) c[i] = set[i < n ? i : 0];
+    }
+};
+
+template <typename Char>
+qsizetype scanScalar(const Char* p, qsizetype n, const Needles& set) {
+    for (qsizetype i = 0; i < n; ++i) {
+        const auto u = static_cast<std::make_unsigned_t<Char>>(p[i]);
+        if (u == uchar(set.c[0]) || u == uchar(set.c[1]) || u == uchar(set.c[2]) || u == uchar(set.c[3])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#ifdef UDEVME_TEXTSCAN_X86
+
+// Helpers carry the target attribute themselves so they inline into the
+// kernels below; a lambda wouldn't
+template <typename Char>
+__attribute__((target("sse2"))) inline __m128i splat128(char c) {
+    if constexpr (sizeof(Char) == 1) return _mm_set1_epi8(c);
+    else return _mm_set1_epi16(short(uchar(c)));
+}
+
+template <typename Char>
+__attribute__((target("sse2"))) inline __m128i equal128(__m128i a, __m128i b) {
+    if constexpr (sizeof(Char) == 1) return _mm_cmpeq_epi8(a, b);
+    else return _mm_cmpeq_epi16(a, b);
+}
+
+template <typename Char>
+__attribute__((target("avx2"))) inline __m256i splat256(char c) {
+    if constexpr (sizeof(Char) == 1) return _mm256_set1_epi8(c);
+    else return _mm256_set1_epi16(short(uchar(c)));
+}
+
+template <typename Char>
+__attribute__((target("avx2"))) inline __m256i equal256(__m256i a, __m256i b) {
+    if constexpr (sizeof(Char) == 1) return _mm256_cmpeq_epi8(a, b);
+    else return _mm256_cmpeq_epi16(a, b);
+}
+
+template <typename Char>
+__attribute__((target("sse2")))
+qsizetype scanSse2(const Char* p, qsizetype n, const Needles& set) {
+    constexpr qsizetype lanes = 16 / sizeof(Char);
+    const __m128i n0 = splat128<Char>(set.c[0]);
+    const __m128i n1 = splat128<Char>(set.c[1]);
+    const __m128i n2 = splat128<Char>(set.c[2]);
+    const __m128i n3 = splat128<Char>(set.c[3]);
+
+    qsizetype i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const __m128i hit = _mm_or_si128(_mm_or_si128(equal128<Char>(v, n0), equal128<Char>(v, n1)),
+                                         _mm_or_si128(equal128<Char>(v, n2), equal128<Char>(v, n3)));
+        const uint mask = uint(_mm_movemask_epi8(hit));
+        if (mask) return i + __builtin_ctz(mask) / qsizetype(sizeof(Char));
+    }
+    const qsizetype tail = scanScalar(p + i, n - i, set);
+    return tail < 0 ? -1 : i + tail;
+}
+
+template <typename Char>
+__attribute__((target("avx2")))
+qsizetype scanAvx2(const Char* p, qsizetype n, const Needles& set) {
+    constexpr qsizetype lanes = 32 / sizeof(Char);
+    const __m256i n0 = splat256<Char>(set.c[0]);
+    const __m256i n1 = splat256<Char>(set.c[1]);
+    const __m256i n2 = splat256<Char>(set.c[2]);
+    const __m256i n3 = splat256<Char>(set.c[3]);
+
+    qsizetype i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        const __m256i hit = _mm256_or_si256(_mm256_or_si256(equal256<Char>(v, n0), equal256<Char>(v, n1)),
+                                            _mm256_or_si256(equal256<Char>(v, n2), equal256<Char>(v, n3)));
+        const uint mask = uint(_mm256_movemask_epi8(hit));
+        if (mask) return i + __builtin_ctz(mask) / qsizetype(sizeof(Char));
+    }
+    // Short lines mostly end here; SSE2 handles the last 16..31 bytes
+    const qsizetype tail = scanSse2(p + i, n - i, set);
+    return tail < 0 ? -1 : i + tail;
+}
+
+#endif // UDEVME_TEXTSCAN_X86
+
+std::atomic<int> g_isa{-1};
+
+template <typename Char>
+qsizetype scan(const Char* p, qsizetype n, const Needles& set) {
+    switch (TextScan::isa()) {
+#ifdef UDEVME_TEXTSCAN_X86
+        case TextScan::Isa::Avx2: return scanAvx2(p, n, set);
+        case TextScan::Isa::Sse2: return scanSse2(p, n, set);
+#endif
+        default: return scanScalar(p, n, set);
+    }
+}
+
+template <typename Char>
+qsizetype scanFrom(const Char* p, qsizetype size, qsizetype from, const char* set) {
+    if (from < 0) from = 0;
+    if (from >= size) return -1;
+    const qsizetype found = scan(p + from, size - from, Needles(set));
+    return found < 0 ? -1 : from + found;
+}
+
+} // namespace
+
+TextScan::Isa TextScan::bestIsa() {
+#ifdef UDEVME_TEXTSCAN_X86
+    static const Isa best = __builtin_cpu_supports("avx2") ? Isa::Avx2
+                          : __builtin_cpu_supports("sse2") ? Isa::Sse2
+                          : Isa::Scalar;
+    return best;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+TextScan::Isa TextScan::isa() {
+    const int forced = g_isa.load(std::memory_order_relaxed);
+    return forced < 0 ? bestIsa() : Isa(forced);
+}
+
+void TextScan::setIsa(Isa isa) {
+    g_isa.store(int(isa <= bestIsa() ? isa : bestIsa()), std::memory_order_relaxed);
+}
+
+const char* TextScan::isaName(Isa isa) {
+    switch (isa) {
+        case Isa::Scalar: return "scalar";
+        case Isa::Sse2: return "sse2";
+        case Isa::Avx2: return "avx2";
+    }
+    return "";
+}
+
+qsizetype TextScan::indexOfAny(QByteArrayView text, const char* set, qsizetype from) {
+    return scanFrom(text.data(), text.size(), from, set);
+}
+
+qsizetype TextScan::indexOfAny(QStringView text, const char* set, qsizetype from) {
+    return scanFrom(text.utf16(), text.size(), from, set);
+}
+
+qsizetype TextScan::indexOf(QByteArrayView text, char c, qsizetype from) {
+    if (c == '\0') return text.indexOf(c, from);
+    const char set[] = { c, '\0' };
+    return scanFrom(text.data(), text.size(), from, set);
+}
+
+qsizetype TextScan::indexOf(QStringView text, char16_t c, qsizetype from) {
+    // Only ASCII goes through the vector path
+    if (c >= 0x80 || c == 0) return text.indexOf(QChar(c), from);
+    const char set[] = { char(c), '\0' };
+    return scanFrom(text.utf16(), text.size(), from, set);
+}
+
+bool TextScan::nextLine(QByteArrayView text, qsizetype& pos, QByteArrayView& line) {
+    if (pos > text.size()) return false;
+
+    qsizetype end = indexOf(text, '\n', pos);
+    if (end < 0) end = text.size();
+
+    line = text.sliced(pos, end - pos).trimmed();
+    pos = end + 1;
+    return true;
+}
+
+bool TextScan::nextLine(QStringView text, qsizetype& pos, QStringView& line) {
+    if (pos > text.size()) return false;
+
+    qsizetype end = indexOf(text, u'\n', pos);
+    if (end < 0) end = text.size();
+
+    line = text.sliced(pos, end - pos).trimmed();
+    pos = end + 1;
+    return true;
+}
+
+} // namespace udevme
@@ -0,0 +1,43 @@
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+#include <QByteArrayView>
+#include <QStringView>
+
+namespace udevme {
+
+// Delimiter search shared by the line-oriented parsers (rules files,
+// .desktop files, udevadm output). Looks for up to four ASCII characters
+// at once, 16 or 32 bytes per step with SSE2/AVX2, on UTF-8 bytes or
+// UTF-16 text. The implementation is picked once from what the CPU
+// supports; other architectures use the scalar loop.
+class TextScan {
+public:
+    enum class Isa { Scalar, Sse2, Avx2 };
+
+    // Implementation in use, and the best one this CPU can run
+    static Isa isa();
+    static Isa bestIsa();
+
+    // Forces an implementation, for tests and benchmarks. Anything the
+    // CPU can't run falls back to bestIsa().
+    static void setIsa(Isa isa);
+    static const char* isaName(Isa isa);
+
+    // Index of the first character at or after 'from' that is one of the
+    // (at most four) ASCII characters in 'set', or -1
+    static qsizetype indexOfAny(QByteArrayView text, const char* set, qsizetype from = 0);
+    static qsizetype indexOfAny(QStringView text, const char* set, qsizetype from = 0);
+
+    static qsizetype indexOf(QByteArrayView text, char c, qsizetype from = 0);
+    static qsizetype indexOf(QStringView text, char16_t c, qsizetype from = 0);
+
+    // Next line at 'pos', trimmed, the way split('\n') + trimmed() would
+    // give it; advances 'pos' past the newline. False once past the end.
+    static bool nextLine(QByteArrayView text, qsizetype& pos, QByteArrayView& line);
+    static bool nextLine(QStringView text, qsizetype& pos, QStringView& line);
+};
+
+} // namespace udevme
+
+#endif // TEXTSCAN_H
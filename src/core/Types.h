@@ -2,20 +2,47 @@
 #define TYPES_H
 
 #include <QString>
+#include <QStringList>
 #include <QVector>
 #include <QUuid>
 #include <QDateTime>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QMap>
 
 namespace udevme {
 
+// HID bus types as reported in a HID device's HID_ID (see linux/input.h).
+// USB is the default and is represented by an empty name.
+constexpr uint HidBusUsb = 0x03;
+
+inline QString hidBusName(uint bus) {
+    switch (bus) {
+        case HidBusUsb: return QString();
+        case 0x05: return "bluetooth";
+        case 0x06: return "virtual";
+        case 0x18: return "i2c";
+    }
+    return QString("bus%1").arg(bus, 2, 16, QLatin1Char('0'));
+}
+
+inline uint hidBusNumber(const QString& name) {
+    if (name.isEmpty()) return HidBusUsb;
+    if (name == "bluetooth") return 0x05;
+    if (name == "virtual") return 0x06;
+    if (name == "i2c") return 0x18;
+    if (name.startsWith("bus")) return name.mid(3).toUInt(nullptr, 16);
+    return HidBusUsb;
+}
+
 struct DeviceInfo {
     QString vendorId;
     QString productId;
     QString name;
     QString manufacturer;
     QString sysPath;
+    QString bus;            // empty for USB, otherwise hidBusName()
+    QStringList hidrawNodes;    // e.g. /dev/hidraw3; scan-time only, not saved
     bool hasHidraw = false;
     bool hasUsb = false;
 
@@ -29,12 +56,28 @@ struct DeviceInfo {
         return QString("%1:%2").arg(vendorId, productId);
     }
 
+    // vid:pid packed into one integer, for hash indexes
+    quint32 vidPidKey() const {
+        return (vendorId.toUInt(nullptr, 16) << 16) | (productId.toUInt(nullptr, 16) & 0xffff);
+    }
+
+    // Bus and vid:pid: the same model over USB and Bluetooth are different devices
+    quint64 deviceKey() const {
+        return (quint64(hidBusNumber(bus)) << 32) | vidPidKey();
+    }
+
+    // deviceKey() as text: lower-case vid:pid@bus
+    QString busKey() const {
+        return vidPid().toLower() + '@' + bus;
+    }
+
     QJsonObject toJson() const {
         QJsonObject obj;
         obj["vid"] = vendorId;
         obj["pid"] = productId;
         obj["name"] = name;
         obj["manufacturer"] = manufacturer;
+        if (!bus.isEmpty()) obj["bus"] = bus;
         obj["has_hidraw"] = hasHidraw;
         obj["has_usb"] = hasUsb;
         return obj;
@@ -46,6 +89,7 @@ struct DeviceInfo {
         d.productId = obj["pid"].toString();
         d.name = obj["name"].toString();
         d.manufacturer = obj["manufacturer"].toString();
+        d.bus = obj["bus"].toString();
         d.hasHidraw = obj["has_hidraw"].toBool();
         d.hasUsb = obj["has_usb"].toBool();
         return d;
@@ -161,6 +205,15 @@ struct UdevRule {
         return names.join("; ");
     }
 
+    // True if the rule lists this device on the same bus
+    bool hasDevice(const DeviceInfo& dev) const {
+        const QString key = dev.busKey();
+        for (const auto& d : devices) {
+            if (d.busKey() == key) return true;
+        }
+        return false;
+    }
+
     QString appsSummary() const {
         if (applications.isEmpty()) return "(all)";
         QStringList names;
@@ -215,11 +268,92 @@ struct UdevRule {
     }
 };
 
+// How RuleGenerator writes the rules file. Compatible is one ATTRS match
+// per device; Optimized skips every event but hidraw add/change up front
+// and matches devices by DEVPATH, one line per vendor. Hwdb lists the
+// devices in a hwdb file and leaves the rules file a single lookup.
+enum class RuleOutput {
+    Compatible,
+    Optimized,
+    Hwdb
+};
+
+inline QString ruleOutputToString(RuleOutput output) {
+    switch (output) {
+        case RuleOutput::Compatible: return "compatible";
+        case RuleOutput::Optimized: return "optimized";
+        case RuleOutput::Hwdb: return "hwdb";
+    }
+    return "compatible";
+}
+
+inline RuleOutput ruleOutputFromString(const QString& str) {
+    if (str == "optimized") return RuleOutput::Optimized;
+    if (str == "hwdb") return RuleOutput::Hwdb;
+    return RuleOutput::Compatible;
+}
+
+// How the generated rules are split into files. Single writes them all to
+// 99-udevme.rules (or .hwdb); Sharded writes a 99-udevme-<id> file per
+// rule, so Apply only replaces the rules that changed.
+enum class RuleLayout {
+    Single,
+    Sharded
+};
+
+inline QString ruleLayoutToString(RuleLayout layout) {
+    return layout == RuleLayout::Sharded ? "sharded" : "single";
+}
+
+inline RuleLayout ruleLayoutFromString(const QString& str) {
+    return str == "sharded" ? RuleLayout::Sharded : RuleLayout::Single;
+}
+
+// How the config is kept on disk. Json is udevme.json; Cbor is the
+// binary udevme.cbor (see ConfigCbor), which loads without a DOM.
+enum class ConfigFormat {
+    Json,
+    Cbor
+};
+
+inline QString configFormatToString(ConfigFormat format) {
+    return format == ConfigFormat::Cbor ? "cbor" : "json";
+}
+
+inline ConfigFormat configFormatFromString(const QString& str) {
+    return str == "cbor" ? ConfigFormat::Cbor : ConfigFormat::Json;
+}
+
+// User preferences, kept in settings.json next to udevme.json
+struct AppSettings {
+    RuleOutput ruleOutput = RuleOutput::Compatible;
+    RuleLayout ruleLayout = RuleLayout::Single;
+    ConfigFormat configFormat = ConfigFormat::Json;
+
+    QJsonObject toJson() const {
+        QJsonObject obj;
+        obj["rule_output"] = ruleOutputToString(ruleOutput);
+        obj["rule_layout"] = ruleLayoutToString(ruleLayout);
+        obj["config_format"] = configFormatToString(configFormat);
+        return obj;
+    }
+
+    static AppSettings fromJson(const QJsonObject& obj) {
+        AppSettings s;
+        s.ruleOutput = ruleOutputFromString(obj["rule_output"].toString());
+        s.ruleLayout = ruleLayoutFromString(obj["rule_layout"].toString());
+        s.configFormat = configFormatFromString(obj["config_format"].toString());
+        return s;
+    }
+};
+
 struct SyncInfo {
     QString rulesFileHashAtLoad;
     QDateTime lastSyncedFromRulesAt;
     QDateTime lastAppliedAt;
     QString rulesFileHashAfterApply;
+    QMap<QString, QString> fileHashes;  // system path -> hash, one per udevme file
+    QMap<QString, QString> fileStamps;  // system path -> "dev:inode:size:mtime:ctime", see ConfigStore::fileStamp()
 
     QJsonObject toJson() const {
         QJsonObject obj;
@@ -227,6 +361,16 @@ struct SyncInfo {
         obj["last_synced_from_rules_at"] = lastSyncedFromRulesAt.toString(Qt::ISODate);
         obj["last_applied_at"] = lastAppliedAt.toString(Qt::ISODate);
         obj["rules_file_hash_after_apply"] = rulesFileHashAfterApply;
+        QJsonObject files;
+        for (auto it = fileHashes.cbegin(); it != fileHashes.cend(); ++it) {
+            files[it.key()] = it.value();
+        }
+        obj["file_hashes"] = files;
+        QJsonObject stamps;
+        for (auto it = fileStamps.cbegin(); it != fileStamps.cend(); ++it) {
+            stamps[it.key()] = it.value();
+        }
+        obj["file_stamps"] = stamps;
         return obj;
     }
 
@@ -236,6 +380,14 @@ struct SyncInfo {
         s.lastSyncedFromRulesAt = QDateTime::fromString(obj["last_synced_from_rules_at"].toString(), Qt::ISODate);
         s.lastAppliedAt = QDateTime::fromString(obj["last_applied_at"].toString(), Qt::ISODate);
         s.rulesFileHashAfterApply = obj["rules_file_hash_after_apply"].toString();
+        const QJsonObject files = obj["file_hashes"].toObject();
+        for (auto it = files.begin(); it != files.end(); ++it) {
+            s.fileHashes.insert(it.key(), it.value().toString());
+        }
+        const QJsonObject stamps = obj["file_stamps"].toObject();
+        for (auto it = stamps.begin(); it != stamps.end(); ++it) {
+            s.fileStamps.insert(it.key(), it.value().toString());
+        }
         return s;
     }
 };
@@ -0,0 +1,311 @@
+#include "UdevRulesParser.h"
+#include "RuleTokenizer.h"
+#include <QFile>
+#include <QHash>
+#include <QVarLengthArray>
+#include <cstring>
+#include <utility>
+
+namespace udevme {
+
+namespace {
+
+enum OperatorClass : quint8 {
+    OpsMatch = 0x1,     // == !=
+    OpsSet = 0x2,       // = :=
+    OpsList = 0x4       // += -=
+};
+
+enum AttrUse : quint8 {
+    AttrNone,
+    AttrOptional,
+    AttrRequired
+};
+
+struct KeySpec {
+    QStringView name;
+    quint8 ops;
+    AttrUse attr;
+};
+
+// Keys from udev(7) and what they accept
+constexpr KeySpec kKeys[] = {
+    { u"ACTION", OpsMatch, AttrNone },
+    { u"DEVPATH", OpsMatch, AttrNone },
+    { u"KERNEL", OpsMatch, AttrNone },
+    { u"KERNELS", OpsMatch, AttrNone },
+    { u"SUBSYSTEM", OpsMatch, AttrNone },
+    { u"SUBSYSTEMS", OpsMatch, AttrNone },
+    { u"DRIVER", OpsMatch, AttrNone },
+    { u"DRIVERS", OpsMatch, AttrNone },
+    { u"TAGS", OpsMatch, AttrNone },
+    { u"RESULT", OpsMatch, AttrNone },
+    { u"PROGRAM", OpsMatch, AttrNone },
+    { u"TEST", OpsMatch, AttrOptional },
+    { u"CONST", OpsMatch, AttrRequired },
+    { u"ATTRS", OpsMatch, AttrRequired },
+    { u"NAME", OpsMatch | OpsSet, AttrNone },
+    { u"SYMLINK", OpsMatch | OpsSet | OpsList, AttrNone },
+    { u"TAG", OpsMatch | OpsSet | OpsList, AttrNone },
+    { u"ENV", OpsMatch | OpsSet | OpsList, AttrRequired },
+    { u"ATTR", OpsMatch | OpsSet, AttrRequired },
+    { u"SYSCTL", OpsMatch | OpsSet, AttrRequired },
+    { u"IMPORT", OpsMatch | OpsSet, AttrRequired },
+    { u"OWNER", OpsSet, AttrNone },
+    { u"GROUP", OpsSet, AttrNone },
+    { u"MODE", OpsSet, AttrNone },
+    { u"SECLABEL", OpsSet | OpsList, AttrRequired },
+    { u"RUN", OpsSet | OpsList, AttrOptional },
+    { u"OPTIONS", OpsSet | OpsList, AttrNone },
+    { u"LABEL", OpsSet, AttrNone },
+    { u"GOTO", OpsSet, AttrNone },
+};
+
+const KeySpec* findKey(QStringView key) {
+    for (const KeySpec& spec : kKeys) {
+        if (spec.name == key) return &spec;
+    }
+    return nullptr;
+}
+
+quint8 operatorClass(RuleOperator op) {
+    switch (op) {
+        case RuleOperator::Match:
+        case RuleOperator::NoMatch: return OpsMatch;
+        case RuleOperator::Assign:
+        case RuleOperator::AssignFinal: return OpsSet;
+        case RuleOperator::Add:
+        case RuleOperator::Remove: return OpsList;
+    }
+    return 0;
+}
+
+// The tokenizer only yields the six valid spellings
+RuleOperator operatorFromToken(QStringView op) {
+    if (op.size() == 1) return RuleOperator::Assign;
+    switch (op.front().unicode()) {
+        case u'=': return RuleOperator::Match;
+        case u'!': return RuleOperator::NoMatch;
+        case u'+': return RuleOperator::Add;
+        case u'-': return RuleOperator::Remove;
+        default: return RuleOperator::AssignFinal;
+    }
+}
+
+} // namespace
+
+QString ruleOperatorToString(RuleOperator op) {
+    switch (op) {
+        case RuleOperator::Match: return "==";
+        case RuleOperator::NoMatch: return "!=";
+        case RuleOperator::Assign: return "=";
+        case RuleOperator::Add: return "+=";
+        case RuleOperator::Remove: return "-=";
+        case RuleOperator::AssignFinal: return ":=";
+    }
+    return QString();
+}
+
+const RuleAssignment* RuleStatement::find(QStringView key) const {
+    for (const RuleAssignment& a : *this) {
+        if (a.key == key) return &a;
+    }
+    return nullptr;
+}
+
+QStringView RuleStatement::label() const {
+    const RuleAssignment* a = find(u"LABEL");
+    return a ? a->value : QStringView();
+}
+
+QStringView RuleStatement::gotoLabel() const {
+    const RuleAssignment* a = find(u"GOTO");
+    return a ? a->value : QStringView();
+}
+
+UdevRulesFile::UdevRulesFile(UdevRulesFile&& other) noexcept
+    : m_fileName(std::move(other.m_fileName)),
+      m_content(std::move(other.m_content)),
+      m_arena(std::move(other.m_arena)),
+      m_statements(std::exchange(other.m_statements, nullptr)),
+      m_count(std::exchange(other.m_count, 0)),
+      m_diagnostics(std::move(other.m_diagnostics)) {
+}
+
+UdevRulesFile& UdevRulesFile::operator=(UdevRulesFile&& other) noexcept {
+    if (this != &other) {
+        m_fileName = std::move(other.m_fileName);
+        m_content = std::move(other.m_content);
+        m_arena = std::move(other.m_arena);
+        m_statements = std::exchange(other.m_statements, nullptr);
+        m_count = std::exchange(other.m_count, 0);
+        m_diagnostics = std::move(other.m_diagnostics);
+    }
+    return *this;
+}
+
+int UdevRulesFile::findLabel(QStringView label, int from) const {
+    for (int i = from + 1; i < m_count; ++i) {
+        if (m_statements[i].label() == label) return i;
+    }
+    return -1;
+}
+
+bool UdevRulesFile::hasErrors() const {
+    for (const auto& d : m_diagnostics) {
+        if (d.severity == RulesDiagnostic::Error) return true;
+    }
+    return false;
+}
+
+UdevRulesFile UdevRulesParser::parse(const QString& content, const QString& fileName) {
+    UdevRulesFile file;
+    file.m_fileName = fileName;
+    file.m_content = content;
+    const QStringView text(file.m_content);
+
+    // Upper bounds: a statement per line, an assignment per '=' and, only
+    // if lines are continued, a joined copy of the text. Sizing the arena
+    // from them means a file normally lands in a single block.
+    qsizetype lines = 1;
+    qsizetype operators = 0;
+    for (QChar c : text) {
+        if (c == u'\n') ++lines;
+        else if (c == u'=') ++operators;
+    }
+    const bool continued = text.contains(u"\\\n") || text.contains(u"\\\r\n");
+    const qsizetype estimate = lines * qsizetype(sizeof(RuleStatement)) +
+                               operators * qsizetype(sizeof(RuleAssignment)) +
+                               (continued ? text.size() * qsizetype(sizeof(QChar)) : 0) + 64;
+    file.m_arena = Arena(qMax<qsizetype>(estimate, 1024));
+
+    file.m_statements = file.m_arena.allocateArray<RuleStatement>(lines);
+    RuleAssignment* assignments = file.m_arena.allocateArray<RuleAssignment>(qMax<qsizetype>(operators, 1));
+    qsizetype used = 0;
+
+    auto parseStatement = [&](QStringView statement, int line, int lineCount) {
+        RuleTokenizer tokenizer(statement);
+        RuleTokenizer::Token token;
+        RuleAssignment* first = assignments + used;
+        int count = 0;
+        while (tokenizer.next(token)) {
+            first[count++] = { token.key, token.attr, token.value, operatorFromToken(token.op), token.escaped };
+        }
+
+        if (tokenizer.hasError()) {
+            // udev skips the whole line; so do we
+            file.m_diagnostics.append({ line, RulesDiagnostic::Error,
+                QString("Invalid syntax at column %1, rule ignored").arg(tokenizer.position() + 1) });
+            return;
+        }
+        if (count == 0) return;
+
+        RuleStatement& s = file.m_statements[file.m_count++];
+        s = { first, count, line, lineCount };
+        used += count;
+        checkStatement(file, s);
+    };
+
+    // Physical lines of a statement continued with a trailing backslash
+    QVarLengthArray<QStringView, 4> pieces;
+    int startLine = 0;
+    auto flush = [&](int endLine) {
+        if (pieces.isEmpty()) return;
+        QStringView statement = pieces.front();
+        if (pieces.size() > 1) {
+            qsizetype total = 0;
+            for (QStringView p : pieces) total += p.size();
+            QChar* joined = file.m_arena.allocateArray<QChar>(total);
+            qsizetype offset = 0;
+            for (QStringView p : pieces) {
+                std::memcpy(joined + offset, p.data(), size_t(p.size()) * sizeof(QChar));
+                offset += p.size();
+            }
+            statement = QStringView(joined, total);
+        }
+        parseStatement(statement, startLine, endLine - startLine + 1);
+        pieces.clear();
+    };
+
+    qsizetype pos = 0;
+    int lineNumber = 0;
+    QStringView line;
+    while (RuleTokenizer::nextLine(text, pos, line)) {
+        ++lineNumber;
+
+        if (line.isEmpty()) {
+            flush(lineNumber - 1);
+            continue;
+        }
+        if (line.startsWith(u'#')) {
+            if (!pieces.isEmpty()) {
+                file.m_diagnostics.append({ lineNumber, RulesDiagnostic::Warning,
+                    "Comment inside a continued rule is ignored" });
+            }
+            continue;
+        }
+
+        if (pieces.isEmpty()) startLine = lineNumber;
+        if (line.endsWith(u'\\')) {
+            pieces.append(line.chopped(1));
+            continue;
+        }
+        pieces.append(line);
+        flush(lineNumber);
+    }
+    flush(lineNumber);
+
+    checkGotos(file);
+    return file;
+}
+
+UdevRulesFile UdevRulesParser::parseFile(const QString& path, QString* error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = QString("Cannot open file: %1").arg(path);
+        return UdevRulesFile();
+    }
+    return parse(QString::fromUtf8(file.readAll()), path);
+}
+
+void UdevRulesParser::checkStatement(UdevRulesFile& file, const RuleStatement& statement) {
+    auto warn = [&](const QString& message) {
+        file.m_diagnostics.append({ statement.line, RulesDiagnostic::Warning, message });
+    };
+
+    for (const RuleAssignment& a : statement) {
+        const KeySpec* spec = findKey(a.key);
+        if (!spec) {
+            warn(QString("Unknown key %1").arg(a.key));
+            continue;
+        }
+        if (!(spec->ops & operatorClass(a.op)) ||
+            ((a.key == u"LABEL" || a.key == u"GOTO") && a.op != RuleOperator::Assign)) {
+            warn(QString("Invalid operator %1 for %2").arg(ruleOperatorToString(a.op), a.key));
+        }
+        if (spec->attr == AttrRequired && a.attr.isEmpty()) {
+            warn(QString("%1 needs an attribute, e.g. %1{name}").arg(a.key));
+        } else if (spec->attr == AttrNone && !a.attr.isEmpty()) {
+            warn(QString("%1 doesn't take an attribute").arg(a.key));
+        }
+    }
+}
+
+void UdevRulesParser::checkGotos(UdevRulesFile& file) {
+    // A GOTO needs its LABEL later in the file, so comparing against each
+    // label's last statement saves a search per GOTO
+    QHash<QStringView, int> lastLabel;
+    for (int i = 0; i < file.m_count; ++i) {
+        const QStringView label = file.m_statements[i].label();
+        if (!label.isEmpty()) lastLabel.insert(label, i);
+    }
+    for (int i = 0; i < file.m_count; ++i) {
+        const QStringView target = file.m_statements[i].gotoLabel();
+        if (!target.isEmpty() && lastLabel.value(target, -1) <= i) {
+            file.m_diagnostics.append({ file.m_statements[i].line, RulesDiagnostic::Warning,
+                QString("GOTO=\"%1\" has no LABEL after it").arg(target) });
+        }
+    }
+}
+
+} // namespace udevme
@@ -0,0 +1,113 @@
+#ifndef UDEVRULESPARSER_H
+#define UDEVRULESPARSER_H
+
+#include <QString>
+#include <QStringView>
+#include <QVector>
+#include "Arena.h"
+
+namespace udevme {
+
+// General parser for the udev rules language (udev(7)), as opposed to
+// RuleParser which only reads back udevme's own rules file. The AST lives
+// in a per-file Arena; all strings are views into the file content or
+// the arena, so a parsed file is a handful of allocations however many
+// rules it has.
+
+enum class RuleOperator : quint8 {
+    Match,          // ==
+    NoMatch,        // !=
+    Assign,         // =
+    Add,            // +=
+    Remove,         // -=
+    AssignFinal     // :=
+};
+
+QString ruleOperatorToString(RuleOperator op);
+
+struct RuleAssignment {
+    QStringView key;        // e.g. ATTRS
+    QStringView attr;       // e.g. idVendor, empty if the key has none
+    QStringView value;      // as written, without quotes; escapes not decoded
+    RuleOperator op;
+    bool escaped;
+
+    bool isMatch() const { return op == RuleOperator::Match || op == RuleOperator::NoMatch; }
+};
+
+// One logical line: a comma-separated list of assignments
+struct RuleStatement {
+    const RuleAssignment* assignments;
+    int count;
+    int line;               // 1-based physical line the statement starts on
+    int lineCount;          // > 1 when continued with a trailing backslash
+
+    const RuleAssignment* begin() const { return assignments; }
+    const RuleAssignment* end() const { return assignments + count; }
+
+    // First assignment with the given key, or nullptr
+    const RuleAssignment* find(QStringView key) const;
+
+    QStringView label() const;      // LABEL="..." value, empty if none
+    QStringView gotoLabel() const;  // GOTO="..." value, empty if none
+};
+
+struct RulesDiagnostic {
+    enum Severity { Warning, Error };
+
+    int line;
+    Severity severity;
+    QString message;
+};
+
+class UdevRulesFile {
+public:
+    UdevRulesFile() = default;
+    UdevRulesFile(UdevRulesFile&& other) noexcept;
+    UdevRulesFile& operator=(UdevRulesFile&& other) noexcept;
+    UdevRulesFile(const UdevRulesFile&) = delete;
+    UdevRulesFile& operator=(const UdevRulesFile&) = delete;
+
+    const QString& fileName() const { return m_fileName; }
+
+    int size() const { return m_count; }
+    bool isEmpty() const { return m_count == 0; }
+    const RuleStatement& operator[](int index) const { return m_statements[index]; }
+    const RuleStatement* begin() const { return m_statements; }
+    const RuleStatement* end() const { return m_statements + m_count; }
+
+    // Index of the first statement after 'from' that defines the label,
+    // or -1. udev only jumps forward, so that's where GOTO lands.
+    int findLabel(QStringView label, int from = -1) const;
+
+    // Syntax errors (the statement was dropped, as udev does) and
+    // warnings about keys, operators and GOTO targets
+    const QVector<RulesDiagnostic>& diagnostics() const { return m_diagnostics; }
+    bool hasErrors() const;
+
+    const Arena& arena() const { return m_arena; }
+
+private:
+    friend class UdevRulesParser;
+
+    QString m_fileName;
+    QString m_content;      // the AST's views point into this and m_arena
+    Arena m_arena;
+    RuleStatement* m_statements = nullptr;
+    int m_count = 0;
+    QVector<RulesDiagnostic> m_diagnostics;
+};
+
+class UdevRulesParser {
+public:
+    static UdevRulesFile parse(const QString& content, const QString& fileName = QString());
+    static UdevRulesFile parseFile(const QString& path, QString* error = nullptr);
+
+private:
+    static void checkStatement(UdevRulesFile& file, const RuleStatement& statement);
+    static void checkGotos(UdevRulesFile& file);
+};
+
+} // namespace udevme
+
+#endif // UDEVRULESPARSER_H
@@ -0,0 +1,164 @@
+#include "UsbIds.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace udevme {
+
+namespace {
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses "xxxx  Name" at line; the ID must be exactly four hex digits
+// followed by whitespace
+bool parseIdLine(const char* line, const char* end, quint32* id, const char** name) {
+    if (end - line < 6) return false;
+
+    quint32 value = 0;
+    for (int i = 0; i < 4; ++i) {
+        int d = hexDigit(line[i]);
+        if (d < 0) return false;
+        value = (value << 4) | quint32(d);
+    }
+    if (line[4] != ' ' && line[4] != '\t') return false;
+
+    const char* p = line + 5;
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    if (p == end) return false;
+
+    *id = value;
+    *name = p;
+    return true;
+}
+
+} // namespace
+
+const UsbIds& UsbIds::instance() {
+    static const UsbIds ids([] {
+        for (const QString& path : defaultPaths()) {
+            if (QFile::exists(path)) return path;
+        }
+        return QString();
+    }());
+    return ids;
+}
+
+QStringList UsbIds::defaultPaths() {
+    return {
+        "/usr/share/hwdata/usb.ids",
+        "/usr/share/misc/usb.ids",
+        "/usr/share/usb.ids",
+        "/var/lib/usbutils/usb.ids"
+    };
+}
+
+UsbIds::UsbIds(const QString& path) : m_file(path) {
+    if (path.isEmpty() || !m_file.open(QIODevice::ReadOnly)) return;
+
+    m_size = m_file.size();
+    if (m_size <= 0 || m_size > std::numeric_limits<quint32>::max()) return;
+
+    m_data = reinterpret_cast<const char*>(m_file.map(0, m_size));
+    if (!m_data) return;
+
+    buildIndex();
+}
+
+UsbIds::~UsbIds() {
+    if (m_data) m_file.unmap(reinterpret_cast<uchar*>(const_cast<char*>(m_data)));
+}
+
+void UsbIds::buildIndex() {
+    const char* const begin = m_data;
+    const char* const fileEnd = m_data + m_size;
+
+    // Roughly 3k vendors and 20k products in current hwdata
+    m_vendors.reserve(4096);
+    m_products.reserve(m_size / 48);
+
+    bool inVendor = false;
+    quint32 vendorId = 0;
+
+    for (const char* line = begin; line < fileEnd;) {
+        const char* eol = static_cast<const char*>(memchr(line, '\n', fileEnd - line));
+        const char* end = eol ? eol : fileEnd;
+        const char* next = eol ? eol + 1 : fileEnd;
+
+        // Trim CR and trailing whitespace
+        while (end > line && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) --end;
+
+        if (line == end || *line == '#') {
+            line = next;
+            continue;
+        }
+
+        quint32 id = 0;
+        const char* name = nullptr;
+
+        if (*line != '\t') {
+            // Vendors come first; the first other top-level line ("C 00",
+            // "HID 00", ...) starts the class/HID tables we don't use
+            if (!parseIdLine(line, end, &id, &name)) break;
+            vendorId = id;
+            inVendor = true;
+            m_vendors.push_back({ id, quint32(name - begin), quint32(end - name) });
+        } else if (inVendor && line + 1 < end && line[1] != '\t') {
+            // Single tab: product. Double tab (interfaces) is skipped.
+            if (parseIdLine(line + 1, end, &id, &name)) {
+                m_products.push_back({ (vendorId << 16) | id, quint32(name - begin), quint32(end - name) });
+            }
+        }
+
+        line = next;
+    }
+
+    // The file is sorted already, but don't depend on it
+    auto byKey = [](const Entry& a, const Entry& b) { return a.key < b.key; };
+    std::stable_sort(m_vendors.begin(), m_vendors.end(), byKey);
+    std::stable_sort(m_products.begin(), m_products.end(), byKey);
+    m_vendors.shrink_to_fit();
+    m_products.shrink_to_fit();
+}
+
+QString UsbIds::lookup(const std::vector<Entry>& table, quint32 key) const {
+    auto it = std::lower_bound(table.begin(), table.end(), key,
+                               [](const Entry& e, quint32 k) { return e.key < k; });
+    if (it == table.end() || it->key != key) return QString();
+    return QString::fromUtf8(m_data + it->offset, it->length);
+}
+
+QString UsbIds::vendorName(uint vendorId) const {
+    return lookup(m_vendors, vendorId & 0xffff);
+}
+
+QString UsbIds::productName(uint vendorId, uint productId) const {
+    return lookup(m_products, ((vendorId & 0xffff) << 16) | (productId & 0xffff));
+}
+
+bool UsbIds::resolve(DeviceInfo& device) const {
+    if (!isLoaded() || (!device.name.isEmpty() && !device.manufacturer.isEmpty())) return false;
+
+    bool ok = false;
+    uint vid = device.vendorId.toUInt(&ok, 16);
+    if (!ok) return false;
+    uint pid = device.productId.toUInt(&ok, 16);
+    if (!ok) return false;
+
+    bool changed = false;
+    if (device.name.isEmpty()) {
+        device.name = productName(vid, pid);
+        changed = !device.name.isEmpty();
+    }
+    if (device.manufacturer.isEmpty()) {
+        device.manufacturer = vendorName(vid);
+        changed = changed || !device.manufacturer.isEmpty();
+    }
+    return changed;
+}
+
+} // namespace udevme
@@ -0,0 +1,60 @@
+#ifndef USBIDS_H
+#define USBIDS_H
+
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <vector>
+#include "Types.h"
+
+namespace udevme {
+
+// Vendor/product names from the hwdata usb.ids list, for devices that have
+// no string descriptors. The file is memory-mapped and indexed once; names
+// are only turned into QStrings when looked up. Immutable after
+// construction, so lookups are safe from any thread without locking.
+class UsbIds {
+public:
+    // Shared instance over the first usb.ids found in defaultPaths(),
+    // loaded on first use
+    static const UsbIds& instance();
+    static QStringList defaultPaths();
+
+    explicit UsbIds(const QString& path);
+    ~UsbIds();
+
+    UsbIds(const UsbIds&) = delete;
+    UsbIds& operator=(const UsbIds&) = delete;
+
+    bool isLoaded() const { return m_data != nullptr; }
+    int vendorCount() const { return static_cast<int>(m_vendors.size()); }
+    int productCount() const { return static_cast<int>(m_products.size()); }
+
+    // Empty when unknown
+    QString vendorName(uint vendorId) const;
+    QString productName(uint vendorId, uint productId) const;
+
+    // Fills an empty name/manufacturer; returns true if anything changed
+    bool resolve(DeviceInfo& device) const;
+
+private:
+    // Name location inside the mapped file
+    struct Entry {
+        quint32 key;        // vid for vendors, vid << 16 | pid for products
+        quint32 offset;
+        quint32 length;
+    };
+
+    void buildIndex();
+    QString lookup(const std::vector<Entry>& table, quint32 key) const;
+
+    QFile m_file;
+    const char* m_data = nullptr;
+    qsizetype m_size = 0;
+    std::vector<Entry> m_vendors;       // sorted by key
+    std::vector<Entry> m_products;      // sorted by key
+};
+
+} // namespace udevme
+
+#endif // USBIDS_H
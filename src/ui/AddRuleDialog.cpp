@@ -1,22 +1,48 @@
 #include "AddRuleDialog.h"
 #include "DeviceScanner.h"
 #include "AppScanner.h"
+#include "ConfigStore.h"
+#include "UsbIds.h"
 
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QGroupBox>
 #include <QApplication>
 #include <QStyle>
+#include <QSet>
+#include <QFutureWatcher>
 
 namespace udevme {
 
-AddRuleDialog::AddRuleDialog(QWidget* parent) : QDialog(parent) {
+namespace {
+
+// Unplugged devices seen within this window are offered too
+constexpr int kRecentDeviceDays = 90;
+
+}
+
+AddRuleDialog::AddRuleDialog(QWidget* parent)
+    : QDialog(parent), m_inventory(ConfigStore::getInventoryPath()) {
     setWindowTitle("Add udev Rule");
     setMinimumSize(700, 600);
     resize(850, 650);
     
+    m_scanner = new DeviceScanner(this);
+    // The inventory keeps what devices report; usb.ids names are added for display
+    m_scanner->setNameResolution(false);
+    connect(m_scanner, &DeviceScanner::devicesChanged, this, &AddRuleDialog::onDevicesChanged);
+    
     setupUi();
-    loadDevices();
+    m_inventory.load();
+    
+    // Keep the list live via hotplug events; fall back to a one-off scan
+    if (m_scanner->startMonitoring()) {
+        const QVector<DeviceInfo> live = m_scanner->devices();
+        setLiveDevices(live);
+        probeAccess(m_accessProbe.unprobedNodes(live));
+    } else {
+        loadDevices();
+    }
     loadApplications();
 }
 
@@ -88,6 +114,16 @@ void AddRuleDialog::setupUi() {
     );
     mainLayout->addWidget(m_warningLabel);
     
+    m_accessLabel = new QLabel(this);
+    m_accessLabel->setWordWrap(true);
+    m_accessLabel->setText(
+        "<b>Already accessible:</b> You can already read and write the selected device(s), so "
+        "the rule isn't needed right now and applying it won't change anything. Add it anyway "
+        "if you want access to stay independent of other rules."
+    );
+    m_accessLabel->setVisible(false);
+    mainLayout->addWidget(m_accessLabel);
+    
     // Buttons
     QHBoxLayout* buttonLayout = new QHBoxLayout();
     buttonLayout->addStretch();
@@ -121,19 +157,12 @@ void AddRuleDialog::setRule(const UdevRule& rule) {
     // Set notes
     m_notesEdit->setPlainText(rule.notes);
     
-    // Select devices that match the rule
+    // Select devices that match the rule, bus included
     for (int i = 0; i < m_deviceList->count(); ++i) {
         QListWidgetItem* item = m_deviceList->item(i);
         int idx = item->data(Qt::UserRole).toInt();
-        if (idx >= 0 && idx < m_allDevices.size()) {
-            const DeviceInfo& dev = m_allDevices[idx];
-            for (const auto& ruleDev : rule.devices) {
-                if (dev.vendorId.compare(ruleDev.vendorId, Qt::CaseInsensitive) == 0 &&
-                    dev.productId.compare(ruleDev.productId, Qt::CaseInsensitive) == 0) {
-                    item->setSelected(true);
-                    break;
-                }
-            }
+        if (idx >= 0 && idx < m_allDevices.size() && rule.hasDevice(m_allDevices[idx])) {
+            item->setSelected(true);
         }
     }
     
@@ -156,31 +185,110 @@ void AddRuleDialog::setRule(const UdevRule& rule) {
 }
 
 void AddRuleDialog::loadDevices() {
-    m_deviceList->clear();
-    m_allDevices.clear();
-    
     QApplication::setOverrideCursor(Qt::WaitCursor);
     
-    DeviceScanner scanner;
-    m_allDevices = scanner.scanDevices();
+    // A full rescan probes every node again
+    const QVector<DeviceInfo> live = m_scanner->scanDevices();
+    m_accessProbe.clear();
+    setLiveDevices(live);
+    probeAccess(m_accessProbe.unprobedNodes(live));
+    
+    QApplication::restoreOverrideCursor();
+}
+
+void AddRuleDialog::setLiveDevices(const QVector<DeviceInfo>& live) {
+    m_inventory.record(live);
     
-    for (const auto& dev : m_allDevices) {
+    m_allDevices = live;
+    m_liveDeviceCount = live.size();
+    
+    // Append recently seen devices that aren't plugged in right now
+    QSet<QString> connected;
+    for (const auto& dev : live) {
+        connected.insert(dev.busKey());
+    }
+    const QDateTime since = QDateTime::currentDateTimeUtc().addDays(-kRecentDeviceDays);
+    for (const auto& entry : m_inventory.seenSince(since)) {
+        if (!connected.contains(entry.device.busKey())) {
+            m_allDevices.append(entry.device);
+        }
+    }
+    
+    // usb.ids only covers USB-IF vendor IDs
+    const UsbIds& usbIds = UsbIds::instance();
+    for (DeviceInfo& dev : m_allDevices) {
+        if (dev.bus.isEmpty()) usbIds.resolve(dev);
+    }
+    
+    populateDeviceList();
+}
+
+void AddRuleDialog::populateDeviceList() {
+    // Preserve the current selection across list rebuilds
+    QSet<QString> selected;
+    for (QListWidgetItem* item : m_deviceList->selectedItems()) {
+        selected.insert(item->data(Qt::UserRole + 1).toString());
+    }
+    
+    m_deviceList->clear();
+    
+    for (int i = 0; i < m_allDevices.size(); ++i) {
+        const auto& dev = m_allDevices[i];
+        const bool connected = i < m_liveDeviceCount;
         QString text = QString("%1 (%2:%3)")
             .arg(dev.displayName(), dev.vendorId, dev.productId);
         
         if (dev.hasHidraw) {
             text += " [hidraw]";
         }
+        if (!dev.bus.isEmpty()) {
+            text += QString(" [%1]").arg(dev.bus);
+        }
+        const bool accessible = connected && m_accessProbe.isAccessible(dev);
+        if (!connected) {
+            text += " [not connected]";
+        } else if (accessible) {
+            text += " [already accessible]";
+        }
         
         QListWidgetItem* item = new QListWidgetItem(text);
-        item->setData(Qt::UserRole, QVariant::fromValue(m_deviceList->count()));
-        item->setToolTip(QString("Vendor: %1\nProduct: %2\nName: %3\nManufacturer: %4\nHidraw: %5")
+        item->setData(Qt::UserRole, QVariant::fromValue(i));
+        const QString key = dev.busKey();
+        item->setData(Qt::UserRole + 1, key);
+        QString tooltip = QString("Vendor: %1\nProduct: %2\nName: %3\nManufacturer: %4\nHidraw: %5")
             .arg(dev.vendorId, dev.productId, dev.name, dev.manufacturer,
-                 dev.hasHidraw ? "Yes" : "No"));
+                 dev.hasHidraw ? "Yes" : "No");
+        if (accessible) {
+            tooltip += "\nAccess: already readable and writable by you";
+        }
+        if (!connected) {
+            const DeviceInventory::Entry* entry = m_inventory.find(dev);
+            if (entry) {
+                tooltip += "\nLast seen: " + entry->lastSeen.toLocalTime().toString("yyyy-MM-dd hh:mm");
+            }
+            item->setForeground(palette().brush(QPalette::Disabled, QPalette::Text));
+        }
+        item->setToolTip(tooltip);
         m_deviceList->addItem(item);
+        item->setSelected(selected.contains(key));
     }
     
-    QApplication::restoreOverrideCursor();
+    filterDeviceList(m_deviceSearch->text());
+    updateAddButton();
+}
+
+void AddRuleDialog::probeAccess(const QStringList& nodes) {
+    if (nodes.isEmpty()) return;
+    
+    // Opening a busy node can block, so the list shows the devices first
+    // and gains the access markers once the probe is back
+    auto* watcher = new QFutureWatcher<AccessProbe::Result>(this);
+    connect(watcher, &QFutureWatcher<AccessProbe::Result>::finished, this, [this, watcher]() {
+        m_accessProbe.addResults(watcher->future().results());
+        watcher->deleteLater();
+        populateDeviceList();
+    });
+    watcher->setFuture(AccessProbe::probeNodes(nodes, true));
 }
 
 void AddRuleDialog::loadApplications() {
@@ -209,6 +317,14 @@ void AddRuleDialog::refreshDevices() {
     loadDevices();
 }
 
+void AddRuleDialog::onDevicesChanged(const QVector<DeviceInfo>& added, const QVector<DeviceInfo>& removed) {
+    // Hotplug batch settled; the scanner's live table is already current.
+    // Only the nodes that came or went change their probe results.
+    m_accessProbe.forget(removed);
+    setLiveDevices(m_scanner->devices());
+    probeAccess(m_accessProbe.unprobedNodes(added));
+}
+
 void AddRuleDialog::onDeviceSearchChanged(const QString& text) {
     filterDeviceList(text);
 }
@@ -242,6 +358,20 @@ void AddRuleDialog::onSelectionChanged() {
 void AddRuleDialog::updateAddButton() {
     bool hasDeviceSelected = !m_deviceList->selectedItems().isEmpty();
     m_addBtn->setEnabled(hasDeviceSelected);
+    m_accessLabel->setVisible(selectionAlreadyAccessible());
+}
+
+bool AddRuleDialog::selectionAlreadyAccessible() const {
+    const QList<QListWidgetItem*> items = m_deviceList->selectedItems();
+    if (items.isEmpty()) return false;
+    
+    for (QListWidgetItem* item : items) {
+        int idx = item->data(Qt::UserRole).toInt();
+        if (idx < 0 || idx >= m_liveDeviceCount || !m_accessProbe.isAccessible(m_allDevices[idx])) {
+            return false;
+        }
+    }
+    return true;
 }
 
 UdevRule AddRuleDialog::getRule() const {
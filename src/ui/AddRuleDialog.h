@@ -8,9 +8,13 @@
 #include <QPushButton>
 #include <QLabel>
 #include "Types.h"
+#include "DeviceInventory.h"
+#include "AccessProbe.h"
 
 namespace udevme {
 
+class DeviceScanner;
+
 class AddRuleDialog : public QDialog {
     Q_OBJECT
 public:
@@ -21,16 +25,24 @@ public:
     UdevRule getRule() const;
     
     bool isEditMode() const { return m_editMode; }
+    
+    // True if every selected device is connected and its hidraw nodes are
+    // already readable and writable by the current user
+    bool selectionAlreadyAccessible() const;
 
 private slots:
     void onDeviceSearchChanged(const QString& text);
     void onAppSearchChanged(const QString& text);
     void onSelectionChanged();
     void refreshDevices();
+    void onDevicesChanged(const QVector<DeviceInfo>& added, const QVector<DeviceInfo>& removed);
 
 private:
     void setupUi();
     void loadDevices();
+    void setLiveDevices(const QVector<DeviceInfo>& live);
+    void probeAccess(const QStringList& nodes);
+    void populateDeviceList();
     void loadApplications();
     void updateAddButton();
     void filterDeviceList(const QString& filter);
@@ -40,7 +52,11 @@ private:
     QLineEdit* m_deviceSearch;
     QListWidget* m_deviceList;
     QPushButton* m_refreshDevicesBtn;
-    QVector<DeviceInfo> m_allDevices;
+    QVector<DeviceInfo> m_allDevices;     // connected devices first, then recently seen
+    int m_liveDeviceCount = 0;
+    DeviceScanner* m_scanner;
+    DeviceInventory m_inventory;
+    AccessProbe m_accessProbe;            // per hidraw node, probed in the background
     
     // App list
     QLineEdit* m_appSearch;
@@ -56,6 +72,7 @@ private:
     
     // Info label
     QLabel* m_warningLabel;
+    QLabel* m_accessLabel;
     
     // Edit mode
     bool m_editMode = false;
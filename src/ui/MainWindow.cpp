@@ -1,8 +1,11 @@
 #include "MainWindow.h"
 #include "AddRuleDialog.h"
+#include "ConfigSession.h"
 #include "ConfigStore.h"
+#include "DeviceScanner.h"
 #include "RuleGenerator.h"
 #include "RuleParser.h"
+#include "RulesAnalyzer.h"
 
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -11,12 +14,17 @@
 #include <QMenuBar>
 #include <QMenu>
 #include <QAction>
+#include <QActionGroup>
 #include <QProcess>
+#include <QSet>
 #include <QSplitter>
 #include <QtConcurrent>
 #include <QFutureWatcher>
 #include <QApplication>
+#include <QDir>
 #include <QFile>
+#include <QFileDialog>
+#include <QFileInfo>
 
 namespace udevme {
 
@@ -25,9 +33,24 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) {
     setMinimumSize(800, 500);
     resize(1000, 600);
     
+    m_settings = ConfigStore::loadSettings();
+    m_session = new ConfigSession(this);
+    m_session->setFormat(m_settings.configFormat);
     setupMenuBar();
     setupUi();
+    connect(m_session, &ConfigSession::flushFailed, this, [this](const QString& error) {
+        m_logWidget->appendLog("WARNING: Failed to save config: " + error);
+    });
     loadRules();
+    
+    // Feed the status column from hotplug events instead of rescanning
+    m_deviceScanner = new DeviceScanner(this);
+    connect(m_deviceScanner, &DeviceScanner::devicesChanged, this, &MainWindow::onDevicesChanged);
+    if (m_deviceScanner->startMonitoring()) {
+        m_ruleModel->setConnectedDevices(m_deviceScanner->liveDevices());
+    } else {
+        m_ruleModel->setConnectedDevices(m_deviceScanner->scanDevices());
+    }
 }
 
 MainWindow::~MainWindow() {}
@@ -43,12 +66,59 @@ void MainWindow::setupMenuBar() {
     refreshAction->setShortcut(QKeySequence::Refresh);
     connect(refreshAction, &QAction::triggered, this, &MainWindow::loadRules);
     
+    QAction* exportAction = fileMenu->addAction("&Export Config as JSON...");
+    exportAction->setStatusTip("Save the config as udevme.json text, whichever format it is kept in");
+    connect(exportAction, &QAction::triggered, this, &MainWindow::onExportConfig);
+    
     fileMenu->addSeparator();
     
     QAction* quitAction = fileMenu->addAction("&Quit");
     quitAction->setShortcut(QKeySequence::Quit);
     connect(quitAction, &QAction::triggered, this, &QMainWindow::close);
     
+    // Tools menu
+    QMenu* toolsMenu = menuBar->addMenu("&Tools");
+    
+    m_conflictsAction = toolsMenu->addAction("Check for &Conflicts");
+    m_conflictsAction->setStatusTip("Find other udev rules that change the mode udevme sets");
+    connect(m_conflictsAction, &QAction::triggered, this, &MainWindow::onCheckConflicts);
+    
+    toolsMenu->addSeparator();
+    
+    QMenu* outputMenu = toolsMenu->addMenu("Rules &Output");
+    m_outputGroup = new QActionGroup(this);
+    const struct {
+        RuleOutput output;
+        const char* text;
+        const char* tip;
+    } outputs[] = {
+        { RuleOutput::Compatible, "&Compatible", "One rule line per device, matched by USB attributes" },
+        { RuleOutput::Optimized, "&Optimized", "Write rules udevd can skip for all but hidraw events, matched by device path" },
+        { RuleOutput::Hwdb, "&Hardware Database", "List devices in a udev hwdb file; best for hundreds of devices" },
+    };
+    for (const auto& o : outputs) {
+        QAction* action = outputMenu->addAction(o.text);
+        action->setCheckable(true);
+        action->setChecked(m_settings.ruleOutput == o.output);
+        action->setStatusTip(o.tip);
+        action->setData(int(o.output));
+        m_outputGroup->addAction(action);
+    }
+    connect(m_outputGroup, &QActionGroup::triggered, this, &MainWindow::onRuleOutputSelected);
+    
+    outputMenu->addSeparator();
+    QAction* shardedAction = outputMenu->addAction("One File per &Rule");
+    shardedAction->setCheckable(true);
+    shardedAction->setChecked(m_settings.ruleLayout == RuleLayout::Sharded);
+    shardedAction->setStatusTip("Write each rule to its own file, so Apply only replaces the rules that changed");
+    connect(shardedAction, &QAction::toggled, this, &MainWindow::onShardedLayoutToggled);
+    
+    QAction* binaryAction = toolsMenu->addAction("&Binary Config File");
+    binaryAction->setCheckable(true);
+    binaryAction->setChecked(m_settings.configFormat == ConfigFormat::Cbor);
+    binaryAction->setStatusTip("Keep the config in udevme.cbor, which loads faster with thousands of rules");
+    connect(binaryAction, &QAction::toggled, this, &MainWindow::onBinaryConfigToggled);
+    
     // Help menu
     QMenu* helpMenu = menuBar->addMenu("&Help");
     
@@ -81,6 +151,7 @@ void MainWindow::setupUi() {
     
     // Set reasonable column widths
     m_tableView->setColumnWidth(RuleModel::ColEnabled, 70);
+    m_tableView->setColumnWidth(RuleModel::ColStatus, 160);
     m_tableView->setColumnWidth(RuleModel::ColDevices, 350);
     m_tableView->setColumnWidth(RuleModel::ColApps, 200);
     
@@ -134,7 +205,7 @@ void MainWindow::setupUi() {
 void MainWindow::loadRules() {
     m_logWidget->appendLog("Loading rules...");
     
-    auto result = ConfigStore::load();
+    auto result = m_session->load();
     
     if (!result.success) {
         QMessageBox::critical(this, "Load Error", result.error);
@@ -152,7 +223,10 @@ void MainWindow::loadRules() {
     }
     
     QString status;
-    if (result.loadedFromSystem) {
+    if (result.fromCache) {
+        status = QString("Loaded %1 rule(s); system rules file unchanged")
+            .arg(result.rules.size());
+    } else if (result.loadedFromSystem) {
         status = QString("Loaded %1 rule(s) from system rules file")
             .arg(result.rules.size());
     } else {
@@ -223,6 +297,10 @@ void MainWindow::onAddRule() {
         m_ruleModel->addRule(rule);
         m_logWidget->appendLog(QString("Added rule for %1 device(s)")
             .arg(rule.devices.size()));
+        if (dialog.selectionAlreadyAccessible()) {
+            m_logWidget->appendLog("Note: these devices are already accessible; "
+                                   "applying isn't needed for them right now");
+        }
     }
 }
 
@@ -261,23 +339,66 @@ void MainWindow::onApply() {
 }
 
 void MainWindow::applyRulesAsync() {
-    // Generate rules content
     QVector<UdevRule> allRules = m_ruleModel->getAllRules();
-    QString rulesContent = RuleGenerator::generateRulesFile(allRules);
+    const ConfigStore::ApplyPlan plan = ConfigStore::planApply(allRules, m_settings);
+    
+    // Sharded rules that all match the system's need no root
+    if (plan.isEmpty()) {
+        SyncInfo syncInfo;
+        syncInfo.fileHashes = plan.expected;
+        syncInfo.fileStamps = ConfigStore::computeFileStamps(plan.expected.keys());
+        syncInfo.rulesFileHashAtLoad = ConfigStore::combineFileHashes(plan.expected);
+        syncInfo.rulesFileHashAfterApply = syncInfo.rulesFileHashAtLoad;
+        syncInfo.lastAppliedAt = QDateTime::currentDateTime();
+        syncInfo.lastSyncedFromRulesAt = QDateTime::currentDateTime();
+        m_session->save(allRules, syncInfo);
+        m_session->stampFilesLater();
+        m_ruleModel->clearDirty();
+        m_logWidget->appendLog("System rules are already up to date; nothing to apply");
+        updateStatus("Rules are up to date");
+        m_applyBtn->setEnabled(false);
+        m_addBtn->setEnabled(true);
+        onSelectionChanged(); // Re-enable edit/remove based on selection
+        return;
+    }
     
-    // Save staged file
-    if (!ConfigStore::saveStagedRules(rulesContent)) {
+    // Save staged files
+    QString stageError;
+    if (!ConfigStore::stageApply(plan, &stageError)) {
         QMessageBox::critical(this, "Error", "Failed to save staged rules file");
-        m_logWidget->appendLog("ERROR: Failed to save staged rules file");
+        m_logWidget->appendLog("ERROR: Failed to save staged rules file: " + stageError);
         m_applyBtn->setEnabled(true);
         m_addBtn->setEnabled(true);
         onSelectionChanged(); // Re-enable edit/remove based on selection
         return;
     }
     
-    m_logWidget->appendLog("Staged rules saved to: " + ConfigStore::getStagedRulesPath());
-    m_logWidget->appendLog("Rules content preview:\n" + rulesContent.left(500) + 
-        (rulesContent.length() > 500 ? "..." : ""));
+    // Copy what changed, remove what's gone; the hwdb is recompiled if a
+    // .hwdb file was among them
+    QString steps;
+    QSet<QString> dirs;
+    for (const ConfigStore::ApplyPlan::File& file : plan.write) {
+        const QString dir = QFileInfo(file.systemPath).path();
+        if (!dirs.contains(dir)) {
+            dirs.insert(dir);
+            steps += QString("mkdir -p '%1'\n").arg(dir);
+        }
+        steps += QString("cp '%1' '%2'\n").arg(file.stagedPath, file.systemPath);
+        m_logWidget->appendLog("Staged: " + file.stagedPath);
+    }
+    for (const QString& path : plan.remove) {
+        steps += QString("rm -f '%1'\n").arg(path);
+    }
+    if (plan.updateHwdb) {
+        steps += "systemd-hwdb update\n";
+    }
+    m_logWidget->appendLog(QString("Writing %1 file(s), removing %2")
+        .arg(plan.write.size()).arg(plan.remove.size()));
+    if (plan.write.size() == 1) {
+        const QString& content = plan.write.first().content;
+        m_logWidget->appendLog("Rules content preview:\n" + content.left(500) + 
+            (content.length() > 500 ? "..." : ""));
+    }
     
     // Find pkexec or sudo
     QString elevateCmd;
@@ -302,15 +423,16 @@ void MainWindow::applyRulesAsync() {
     QString script = QString(
         "#!/bin/bash\n"
         "set -e\n"
-        "cp '%1' '%2'\n"
+        "%1"
         "udevadm control --reload-rules\n"
         "udevadm trigger\n"
+        "udevadm settle --timeout=10 || true\n"
         "echo ''\n"
         "echo 'Rules applied successfully!'\n"
         "echo ''\n"
         "echo 'Current hidraw device permissions:'\n"
         "ls -l /dev/hidraw* 2>/dev/null || echo 'No hidraw devices found'\n"
-    ).arg(ConfigStore::getStagedRulesPath(), ConfigStore::getSystemRulesPath());
+    ).arg(steps);
     
     QString scriptPath = ConfigStore::getInstallDir() + "/apply_rules.sh";
     QFile scriptFile(scriptPath);
@@ -332,7 +454,7 @@ void MainWindow::applyRulesAsync() {
     QProcess* process = new QProcess(this);
     
     connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-            this, [this, process, rulesContent, allRules](int exitCode, QProcess::ExitStatus status) {
+            this, [this, process, plan, allRules](int exitCode, QProcess::ExitStatus status) {
         
         QString output = QString::fromUtf8(process->readAllStandardOutput());
         QString errorOutput = QString::fromUtf8(process->readAllStandardError());
@@ -345,21 +467,26 @@ void MainWindow::applyRulesAsync() {
         }
         
         if (exitCode == 0 && status == QProcess::NormalExit) {
-            // Verify the system rules match what we generated
-            QString systemContent = ConfigStore::readSystemRules();
-            QString systemHash = RuleParser::computeHash(systemContent);
-            QString expectedHash = RuleParser::computeHash(rulesContent);
+            // Verify the system files match what we generated, file by file
+            const QStringList mismatched = ConfigStore::verifyApply(plan);
             
-            if (systemHash == expectedHash) {
+            if (mismatched.isEmpty()) {
                 // Update sync info
                 SyncInfo syncInfo;
-                syncInfo.rulesFileHashAtLoad = systemHash;
-                syncInfo.rulesFileHashAfterApply = systemHash;
+                syncInfo.fileHashes = plan.expected;
+                syncInfo.fileStamps = ConfigStore::computeFileStamps(plan.expected.keys());
+                syncInfo.rulesFileHashAtLoad = ConfigStore::combineFileHashes(plan.expected);
+                syncInfo.rulesFileHashAfterApply = syncInfo.rulesFileHashAtLoad;
                 syncInfo.lastAppliedAt = QDateTime::currentDateTime();
                 syncInfo.lastSyncedFromRulesAt = QDateTime::currentDateTime();
                 
-                ConfigStore::saveConfig(allRules, syncInfo);
+                m_session->save(allRules, syncInfo);
+                m_session->stampFilesLater();
                 m_ruleModel->clearDirty();
+                if (m_deviceScanner->isMonitoring()) {
+                    // Modes changed without a hotplug event; re-stat the nodes
+                    m_ruleModel->setConnectedDevices(m_deviceScanner->liveDevices());
+                }
                 
                 m_logWidget->appendLog("Rules applied and verified successfully!");
                 updateStatus("Rules applied successfully. You may need to unplug/replug devices.");
@@ -368,7 +495,7 @@ void MainWindow::applyRulesAsync() {
                     "Rules applied successfully!\n\n"
                     "You may need to unplug and replug your devices for the new rules to take effect.");
             } else {
-                m_logWidget->appendLog("WARNING: System rules hash mismatch after apply");
+                m_logWidget->appendLog("WARNING: System rules hash mismatch after apply: " + mismatched.join(", "));
                 updateStatus("Applied but verification failed - please check manually");
             }
         } else {
@@ -391,6 +518,100 @@ void MainWindow::applyRulesAsync() {
     process->start(elevateCmd, {scriptPath});
 }
 
+void MainWindow::onDevicesChanged(const QVector<DeviceInfo>& added, const QVector<DeviceInfo>& removed) {
+    m_ruleModel->updateDevices(added, removed);
+}
+
+void MainWindow::onRuleOutputSelected(QAction* action) {
+    const RuleOutput output = RuleOutput(action->data().toInt());
+    if (output == m_settings.ruleOutput) return;
+    m_settings.ruleOutput = output;
+    if (!ConfigStore::saveSettings(m_settings)) {
+        m_logWidget->appendLog("WARNING: Failed to save settings to " + ConfigStore::getSettingsPath());
+    }
+    
+    // Only the file's layout changes, so it takes an Apply to rewrite it
+    m_logWidget->appendLog(QString("Rules output: %1 (takes effect on next Apply)")
+        .arg(ruleOutputToString(m_settings.ruleOutput)));
+    m_ruleModel->setDirty(true);
+}
+
+void MainWindow::onShardedLayoutToggled(bool sharded) {
+    m_settings.ruleLayout = sharded ? RuleLayout::Sharded : RuleLayout::Single;
+    if (!ConfigStore::saveSettings(m_settings)) {
+        m_logWidget->appendLog("WARNING: Failed to save settings to " + ConfigStore::getSettingsPath());
+    }
+    
+    m_logWidget->appendLog(QString("Rules layout: %1 (takes effect on next Apply)")
+        .arg(ruleLayoutToString(m_settings.ruleLayout)));
+    m_ruleModel->setDirty(true);
+}
+
+void MainWindow::onBinaryConfigToggled(bool binary) {
+    m_settings.configFormat = binary ? ConfigFormat::Cbor : ConfigFormat::Json;
+    if (!ConfigStore::saveSettings(m_settings)) {
+        m_logWidget->appendLog("WARNING: Failed to save settings to " + ConfigStore::getSettingsPath());
+    }
+    
+    // Only udevme's own copy changes; the system rules are untouched
+    m_session->setFormat(m_settings.configFormat);
+    m_logWidget->appendLog("Config file: " + ConfigStore::configPath(m_settings.configFormat));
+}
+
+void MainWindow::onExportConfig() {
+    const QString path = QFileDialog::getSaveFileName(this, "Export Config",
+        QDir::homePath() + "/udevme.json", "JSON files (*.json)");
+    if (path.isEmpty()) return;
+    
+    const QByteArray json = ConfigStore::serializeConfig(m_session->rules(), m_session->syncInfo(),
+                                                         ConfigFormat::Json);
+    if (!ConfigStore::writeFileIfChanged(path, json)) {
+        QMessageBox::warning(this, "Export Failed", "Cannot write " + path);
+        m_logWidget->appendLog("ERROR: Cannot write " + path);
+        return;
+    }
+    m_logWidget->appendLog("Exported config to " + path);
+}
+
+void MainWindow::onCheckConflicts() {
+    m_conflictsAction->setEnabled(false);
+    updateStatus("Checking system rules for conflicts...");
+    m_logWidget->appendLog("Checking system rules for conflicts...");
+    
+    RulesAnalyzer analyzer;
+    analyzer.setRulesFileName(QFileInfo(ConfigStore::getSystemRulesPath()).fileName());
+    const QVector<UdevRule> rules = m_ruleModel->getAllRules();
+    QStringList ownFiles;
+    for (const QString& path : ConfigStore::planApply(rules, m_settings).expected.keys()) {
+        if (path.endsWith(".rules")) ownFiles << QFileInfo(path).fileName();
+    }
+    analyzer.setOwnFiles(ownFiles);
+    
+    auto* watcher = new QFutureWatcher<RulesAnalyzer::Report>(this);
+    connect(watcher, &QFutureWatcher<RulesAnalyzer::Report>::finished, this, [this, watcher]() {
+        const RulesAnalyzer::Report report = watcher->result();
+        watcher->deleteLater();
+        m_conflictsAction->setEnabled(true);
+        
+        for (const QString& error : report.errors) {
+            m_logWidget->appendLog("WARNING: " + error);
+        }
+        for (const auto& finding : report.findings) {
+            m_logWidget->appendLog(finding.message());
+        }
+        
+        const QString summary = report.findings.isEmpty()
+            ? QString("No conflicts in %1 rules file(s)").arg(report.files.size())
+            : QString("%1 conflict(s) in %2 rules file(s), see the log")
+                .arg(report.findings.size()).arg(report.files.size());
+        updateStatus(summary);
+        m_logWidget->appendLog(summary);
+    });
+    watcher->setFuture(QtConcurrent::run([analyzer, rules]() {
+        return analyzer.analyze(rules);
+    }));
+}
+
 void MainWindow::onAbout() {
     QMessageBox::about(this, "About udevme",
         "<h3>udevme</h3>"
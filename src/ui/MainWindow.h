@@ -8,8 +8,14 @@
 #include "RuleModel.h"
 #include "LogWidget.h"
 
+class QAction;
+class QActionGroup;
+
 namespace udevme {
 
+class ConfigSession;
+class DeviceScanner;
+
 class MainWindow : public QMainWindow {
     Q_OBJECT
 public:
@@ -24,6 +30,12 @@ private slots:
     void onSelectionChanged();
     void onDoubleClicked(const QModelIndex& index);
     void onDirtyChanged(bool dirty);
+    void onDevicesChanged(const QVector<DeviceInfo>& added, const QVector<DeviceInfo>& removed);
+    void onCheckConflicts();
+    void onRuleOutputSelected(QAction* action);
+    void onShardedLayoutToggled(bool sharded);
+    void onBinaryConfigToggled(bool binary);
+    void onExportConfig();
     void onAbout();
 
 private:
@@ -36,16 +48,21 @@ private:
     
     QTableView* m_tableView;
     RuleModel* m_ruleModel;
+    DeviceScanner* m_deviceScanner;
+    ConfigSession* m_session;
     
     QPushButton* m_addBtn;
     QPushButton* m_editBtn;
     QPushButton* m_removeBtn;
     QPushButton* m_applyBtn;
     QLabel* m_statusLabel;
+    QAction* m_conflictsAction;
+    QActionGroup* m_outputGroup;
     
     LogWidget* m_logWidget;
     
     QString m_rulesHashAtLoad;
+    AppSettings m_settings;
 };
 
 } // namespace udevme
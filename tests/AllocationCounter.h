@@ -0,0 +1,41 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+// Include from exactly one translation unit per benchmark executable.
+
+#include <QtGlobal>
+#include <atomic>
+
+// Count heap allocations made anywhere in the process (including inside Qt)
+// by interposing malloc. Raw syscall counts can be cross-checked with
+// `strace -c -e trace=openat,read,close,newfstatat ./bench_<name>`.
+#ifdef __GLIBC__
+static std::atomic<qint64> g_allocations{0};
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) noexcept {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) noexcept {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+}
+
+static qint64 allocationCount() { return g_allocations.load(); }
+#else
+static qint64 allocationCount() { return -1; }
+#endif
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,229 @@
+#ifndef RULEPARSERREFERENCE_H
+#define RULEPARSERREFERENCE_H
+
+// The regex-based RuleParser as it was before the tokenizer, kept as the
+// reference the tokenizer must agree with, plus a generator for large
+// rules files. Shared by test_rules and bench_parser.
+
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include "RuleGenerator.h"
+#include "RuleParser.h"
+#include "Types.h"
+
+namespace udevme {
+namespace reference {
+
+inline UdevRule parseMetadataComment(const QString& comment) {
+    UdevRule rule;
+    QString line = comment.mid(comment.indexOf("udevme:") + 7).trimmed();
+
+    QRegularExpression kvRe("(\\w+)=([^\\s]+|\"[^\"]*\")");
+    QRegularExpressionMatchIterator it = kvRe.globalMatch(line);
+
+    while (it.hasNext()) {
+        QRegularExpressionMatch match = it.next();
+        QString key = match.captured(1);
+        QString value = match.captured(2);
+
+        if (value.startsWith('"') && value.endsWith('"')) {
+            value = value.mid(1, value.length() - 2);
+        }
+
+        if (key == "id") {
+            rule.id = QUuid::fromString(value);
+            if (rule.id.isNull()) rule.id = QUuid::createUuid();
+        } else if (key == "devices") {
+            for (const QString& dev : value.split(',', Qt::SkipEmptyParts)) {
+                QStringList parts = dev.section('@', 0, 0).split(':');
+                if (parts.size() == 2) {
+                    DeviceInfo di;
+                    di.vendorId = parts[0];
+                    di.productId = parts[1];
+                    di.bus = dev.section('@', 1);
+                    rule.devices.append(di);
+                }
+            }
+        } else if (key == "apps") {
+            if (value != "all") {
+                for (const QString& app : value.split(',', Qt::SkipEmptyParts)) {
+                    AppInfo ai;
+                    ai.desktopId = app;
+                    ai.name = QString(app).replace(".desktop", "");
+                    rule.applications.append(ai);
+                }
+            }
+        } else if (key == "level") {
+            rule.permissionLevel = permissionLevelFromString(value);
+        } else if (key == "types") {
+            QStringList types = value.split(',', Qt::SkipEmptyParts);
+            rule.ruleTypes.hidraw = types.contains("hidraw");
+            rule.ruleTypes.usb = types.contains("usb");
+            rule.ruleTypes.uaccess = types.contains("uaccess");
+            rule.ruleTypes.seat = types.contains("seat");
+        } else if (key == "enabled") {
+            rule.enabled = (value.toLower() == "true");
+        }
+    }
+
+    return rule;
+}
+
+inline DeviceInfo parseDeviceFromRule(const QString& line) {
+    DeviceInfo dev;
+
+    QRegularExpression vidRe("ATTRS?\\{idVendor\\}==\"([0-9a-fA-F]+)\"");
+    QRegularExpressionMatch vidMatch = vidRe.match(line);
+    if (vidMatch.hasMatch()) {
+        dev.vendorId = vidMatch.captured(1);
+    }
+
+    QRegularExpression pidRe("ATTRS?\\{idProduct\\}==\"([0-9a-fA-F]+)\"");
+    QRegularExpressionMatch pidMatch = pidRe.match(line);
+    if (pidMatch.hasMatch()) {
+        dev.productId = pidMatch.captured(1);
+    }
+
+    if (line.contains("hidraw")) {
+        dev.hasHidraw = true;
+    }
+    if (line.contains("SUBSYSTEM==\"usb\"")) {
+        dev.hasUsb = true;
+    }
+
+    return dev;
+}
+
+inline RuleParser::ParseResult parseRulesFile(const QString& content) {
+    RuleParser::ParseResult result;
+    result.success = true;
+
+    QStringList lines = content.split('\n');
+    UdevRule currentRule;
+    bool hasCurrentRule = false;
+
+    for (int i = 0; i < lines.size(); ++i) {
+        QString line = lines[i].trimmed();
+        if (line.isEmpty()) continue;
+
+        if (line.trimmed().startsWith("# udevme:")) {
+            if (hasCurrentRule && !currentRule.devices.isEmpty()) {
+                result.rules.append(currentRule);
+            }
+            currentRule = parseMetadataComment(line);
+            hasCurrentRule = true;
+            continue;
+        }
+
+        if (line.startsWith('#')) continue;
+
+        if (hasCurrentRule && (line.contains("idVendor") || line.contains("idProduct"))) {
+            DeviceInfo dev = parseDeviceFromRule(line);
+
+            bool found = false;
+            for (auto& d : currentRule.devices) {
+                if (d.vendorId == dev.vendorId && d.productId == dev.productId) {
+                    d.hasHidraw = d.hasHidraw || dev.hasHidraw;
+                    d.hasUsb = d.hasUsb || dev.hasUsb;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found && !dev.vendorId.isEmpty() && !dev.productId.isEmpty()) {
+                currentRule.devices.append(dev);
+            }
+        }
+    }
+
+    if (hasCurrentRule && !currentRule.devices.isEmpty()) {
+        result.rules.append(currentRule);
+    }
+
+    return result;
+}
+
+// Everything a ParseResult carries that comes from the file. Rules without
+// a valid id get a random one, so ids are only compared when both are
+// present in the content.
+inline QString describeDifference(const RuleParser::ParseResult& a, const RuleParser::ParseResult& b,
+                                  const QString& content) {
+    if (a.success != b.success) return "success";
+    if (a.warnings != b.warnings) return "warnings";
+    if (a.rules.size() != b.rules.size()) {
+        return QString("rule count %1 vs %2").arg(a.rules.size()).arg(b.rules.size());
+    }
+
+    for (int i = 0; i < a.rules.size(); ++i) {
+        const UdevRule& x = a.rules[i];
+        const UdevRule& y = b.rules[i];
+        const QString where = QString("rule %1: ").arg(i);
+
+        if (x.id != y.id && content.contains(x.id.toString(QUuid::WithoutBraces))) {
+            return where + "id";
+        }
+        if (x.permissionLevel != y.permissionLevel) return where + "level";
+        if (x.enabled != y.enabled) return where + "enabled";
+        if (x.ruleTypes.hidraw != y.ruleTypes.hidraw || x.ruleTypes.usb != y.ruleTypes.usb ||
+            x.ruleTypes.uaccess != y.ruleTypes.uaccess || x.ruleTypes.seat != y.ruleTypes.seat) {
+            return where + "types";
+        }
+        if (x.devices.size() != y.devices.size()) return where + "device count";
+        for (int d = 0; d < x.devices.size(); ++d) {
+            const DeviceInfo& p = x.devices[d];
+            const DeviceInfo& q = y.devices[d];
+            if (p.vendorId != q.vendorId || p.productId != q.productId || p.bus != q.bus ||
+                p.hasHidraw != q.hasHidraw || p.hasUsb != q.hasUsb) {
+                return where + QString("device %1 (%2 vs %3)").arg(d).arg(p.vidPid(), q.vidPid());
+            }
+        }
+        if (x.applications.size() != y.applications.size()) return where + "app count";
+        for (int j = 0; j < x.applications.size(); ++j) {
+            if (x.applications[j].desktopId != y.applications[j].desktopId ||
+                x.applications[j].name != y.applications[j].name) {
+                return where + QString("app %1").arg(j);
+            }
+        }
+    }
+    return QString();
+}
+
+// A rules file as RuleGenerator writes it, with a mix of USB and Bluetooth
+// devices, apps, levels and rule types
+inline QString generateRulesCorpus(int ruleCount, quint32 seed = 1) {
+    QRandomGenerator rng(seed);
+    QVector<UdevRule> rules;
+    rules.reserve(ruleCount);
+
+    static const char* const apps[] = { "brave-browser.desktop", "google-chrome.desktop",
+                                        "chromium.desktop", "org.kde.kdeconnect.app.desktop" };
+    for (int i = 0; i < ruleCount; ++i) {
+        UdevRule rule;
+        rule.id = QUuid::fromString(QString("%1-0000-4000-8000-%2")
+            .arg(i, 8, 16, QLatin1Char('0'))
+            .arg(rng.generate64() & 0xffffffffffffULL, 12, 16, QLatin1Char('0')));
+
+        const int deviceCount = 1 + rng.bounded(3);
+        for (int d = 0; d < deviceCount; ++d) {
+            DeviceInfo dev;
+            dev.vendorId = QString("%1").arg(rng.bounded(0x10000), 4, 16, QLatin1Char('0'));
+            dev.productId = QString("%1").arg(rng.bounded(0x10000), 4, 16, QLatin1Char('0'));
+            if (rng.bounded(8) == 0) dev.bus = "bluetooth";
+            rule.devices.append(dev);
+        }
+        for (int a = 0, n = rng.bounded(3); a < n; ++a) {
+            AppInfo app;
+            app.desktopId = apps[rng.bounded(4)];
+            rule.applications.append(app);
+        }
+        rule.permissionLevel = PermissionLevel(rng.bounded(3));
+        rule.ruleTypes.usb = rng.bounded(2);
+        rules.append(rule);
+    }
+
+    return RuleGenerator::generateRulesFile(rules);
+}
+
+} // namespace reference
+} // namespace udevme
+
+#endif // RULEPARSERREFERENCE_H
@@ -0,0 +1,38 @@
+#ifndef TESTHELPERS_H
+#define TESTHELPERS_H
+
+#include <QtTest/QtTest>
+#include "ConfigStore.h"
+
+namespace udevme {
+namespace test {
+
+// Stand-in for a /dev/hidraw node: only its permission bits matter.
+// Callers check QTest::currentTestFailed() before using the path.
+inline void createNode(const QString& path, QFile::Permissions permissions) {
+    QFile file(path);
+    QVERIFY2(file.open(QIODevice::WriteOnly), qPrintable(file.errorString()));
+    file.close();
+    QVERIFY(file.setPermissions(permissions));
+}
+
+// For initTestCase(): HOME and the /etc/udev root both live under `home`,
+// so load() sees neither the user's config nor rules installed on the host
+inline void isolateConfig(const QTemporaryDir& home) {
+    QVERIFY(home.isValid());
+    qputenv("HOME", home.path().toLocal8Bit());
+    ConfigStore::setSystemRoot(home.filePath("root"));
+}
+
+// For init(): each test starts without a config, notes or journal
+inline void removeConfigFiles() {
+    QFile::remove(ConfigStore::getConfigPath());
+    QFile::remove(ConfigStore::getBinaryConfigPath());
+    QFile::remove(ConfigStore::getNotesPath());
+    QFile::remove(ConfigStore::getJournalPath());
+}
+
+} // namespace test
+} // namespace udevme
+
+#endif // TESTHELPERS_H
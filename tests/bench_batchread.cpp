@@ -0,0 +1,125 @@
+#include <QtTest/QtTest>
+#include "BatchFileReader.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace udevme;
+
+// Wall time of BatchFileReader on a synthetic tree of small sysfs-like and
+// desktop-like files, io_uring vs synchronous, with a cold and a warm cache.
+class BenchBatchRead : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void coldScan_data();
+    void coldScan();
+    void warmScan_data();
+    void warmScan();
+
+private:
+    void evictPageCache();
+    QVector<BatchFileReader::Request> makeRequests() const;
+
+    QTemporaryDir m_tree;
+    QStringList m_files;
+    int m_dirFd = -1;
+};
+
+void BenchBatchRead::initTestCase() {
+    QVERIFY(m_tree.isValid());
+    QDir root(m_tree.path());
+    
+    // 4000 device directories with a uevent, like /sys/bus/usb/devices
+    for (int i = 0; i < 4000; ++i) {
+        QString dir = QString("dev%1").arg(i);
+        QVERIFY(root.mkpath(dir));
+        QFile f(root.filePath(dir + "/uevent"));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(QString("MAJOR=189\nMINOR=%1\nDEVTYPE=usb_device\nDRIVER=usb\n"
+                        "PRODUCT=%2/%3/100\nTYPE=0/0/0\nBUSNUM=001\nDEVNUM=%4\n")
+                .arg(i).arg(0x1000 + i, 0, 16).arg(i, 0, 16).arg(i % 128).toUtf8());
+        m_files << dir + "/uevent";
+    }
+    
+    // 2000 desktop files of a typical size
+    QVERIFY(root.mkpath("applications"));
+    QByteArray desktop = "[Desktop Entry]\nType=Application\nName=Example\nExec=example %U\n";
+    desktop += QByteArray("Name[xx]=Translated name\n").repeated(40);
+    for (int i = 0; i < 2000; ++i) {
+        QString name = QString("applications/app%1.desktop").arg(i);
+        QFile f(root.filePath(name));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(desktop);
+        m_files << name;
+    }
+    
+    m_dirFd = ::open(QFile::encodeName(m_tree.path()).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    QVERIFY(m_dirFd >= 0);
+    
+    qInfo("io_uring available: %s", BatchFileReader::isIoUringAvailable() ? "yes" : "no");
+}
+
+QVector<BatchFileReader::Request> BenchBatchRead::makeRequests() const {
+    QVector<BatchFileReader::Request> requests(m_files.size());
+    for (int i = 0; i < m_files.size(); ++i) {
+        requests[i].path = QFile::encodeName(m_files[i]);
+    }
+    return requests;
+}
+
+void BenchBatchRead::evictPageCache() {
+    // Dropping our own clean pages doesn't need root
+    for (const QString& file : m_files) {
+        int fd = ::openat(m_dirFd, QFile::encodeName(file).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+}
+
+void BenchBatchRead::coldScan_data() {
+    QTest::addColumn<int>("mode");
+    QTest::newRow("sync") << int(BatchFileReader::Mode::Sync);
+    QTest::newRow("auto") << int(BatchFileReader::Mode::Auto);
+}
+
+void BenchBatchRead::coldScan() {
+    QFETCH(int, mode);
+    
+    constexpr int runs = 5;
+    qint64 totalUs = 0;
+    for (int run = 0; run < runs; ++run) {
+        QVector<BatchFileReader::Request> requests = makeRequests();
+        evictPageCache();
+        
+        QElapsedTimer timer;
+        timer.start();
+        BatchFileReader::readAll(m_dirFd, requests, 4096, BatchFileReader::Mode(mode));
+        totalUs += timer.nsecsElapsed() / 1000;
+        
+        QVERIFY(std::all_of(requests.cbegin(), requests.cend(),
+                            [](const BatchFileReader::Request& r) { return r.ok; }));
+    }
+    qInfo("cold %s: %lld us per %lld files", QTest::currentDataTag(),
+          totalUs / runs, qint64(m_files.size()));
+}
+
+void BenchBatchRead::warmScan_data() {
+    coldScan_data();
+}
+
+void BenchBatchRead::warmScan() {
+    QFETCH(int, mode);
+    
+    QVector<BatchFileReader::Request> requests = makeRequests();
+    BatchFileReader::readAll(m_dirFd, requests, 4096, BatchFileReader::Mode(mode));
+    
+    QBENCHMARK {
+        BatchFileReader::readAll(m_dirFd, requests, 4096, BatchFileReader::Mode(mode));
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchBatchRead)
+#include "bench_batchread.moc"
@@ -0,0 +1,179 @@
+#include <QtTest/QtTest>
+#include "ConfigCbor.h"
+#include "Types.h"
+#include "AllocationCounter.h"
+
+using namespace udevme;
+
+// Saving and loading the config as udevme.json (QJsonDocument, the way
+// ConfigStore does it) and as udevme.cbor, at growing rule counts
+class BenchConfig : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void compareFormats();
+    void benchLoad_data();
+    void benchLoad();
+    void benchSave_data();
+    void benchSave();
+
+private:
+    enum Format { Json, Cbor };
+
+    static QVector<UdevRule> generate(int count);
+    static QByteArray save(Format format, const QVector<UdevRule>& rules, const SyncInfo& syncInfo);
+    static qsizetype load(Format format, const QString& path);
+    void addRows();
+
+    QMap<int, QVector<UdevRule>> m_rules;
+    SyncInfo m_syncInfo;
+    QTemporaryDir m_dir;
+};
+
+QVector<UdevRule> BenchConfig::generate(int count) {
+    QRandomGenerator rng(1);
+    QVector<UdevRule> rules;
+    rules.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        UdevRule rule;
+        for (int d = int(rng.bounded(1, 4)); d > 0; --d) {
+            DeviceInfo dev;
+            dev.vendorId = QString("%1").arg(rng.bounded(0x10000), 4, 16, QLatin1Char('0'));
+            dev.productId = QString("%1").arg(rng.bounded(0x10000), 4, 16, QLatin1Char('0'));
+            dev.name = QString("Device %1").arg(i);
+            dev.manufacturer = "Acme Peripherals";
+            dev.hasHidraw = true;
+            dev.hasUsb = d == 1;
+            rule.devices.append(dev);
+        }
+        if (i % 4 == 0) {
+            AppInfo app;
+            app.desktopId = "org.chromium.Chromium.desktop";
+            app.name = "Chromium";
+            app.exec = "chromium %U";
+            app.icon = "chromium";
+            rule.applications.append(app);
+        }
+        rule.permissionLevel = PermissionLevel(i % 3);
+        rules.append(rule);
+    }
+    return rules;
+}
+
+void BenchConfig::initTestCase() {
+    QVERIFY(m_dir.isValid());
+    m_syncInfo.rulesFileHashAtLoad = QString(64, u'a');
+    m_syncInfo.lastAppliedAt = QDateTime::currentDateTime();
+    m_syncInfo.fileHashes.insert("/etc/udev/rules.d/99-udevme.rules", m_syncInfo.rulesFileHashAtLoad);
+
+    for (int count : { 100, 10000, 100000 }) {
+        m_rules.insert(count, generate(count));
+        for (Format format : { Json, Cbor }) {
+            QFile file(m_dir.filePath(QString("%1.%2").arg(count).arg(format)));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write(save(format, m_rules[count], m_syncInfo));
+        }
+    }
+}
+
+QByteArray BenchConfig::save(Format format, const QVector<UdevRule>& rules, const SyncInfo& syncInfo) {
+    if (format == Cbor) return ConfigCbor::write(rules, syncInfo);
+
+    QJsonArray array;
+    for (const auto& rule : rules) {
+        QJsonObject obj = rule.toJson();
+        obj.remove("notes");
+        array.append(obj);
+    }
+    QJsonObject root;
+    root["schema_version"] = 1;
+    root["rules"] = array;
+    root["sync_info"] = syncInfo.toJson();
+    return QJsonDocument(root).toJson(QJsonDocument::Indented);
+}
+
+// Returns the device count so nothing gets optimized away
+qsizetype BenchConfig::load(Format format, const QString& path) {
+    QVector<UdevRule> rules;
+    SyncInfo syncInfo;
+    if (format == Cbor) {
+        ConfigCbor::readFile(path, rules, syncInfo);
+    } else {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) return -1;
+        const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+        for (const QJsonValue& v : root["rules"].toArray()) {
+            rules.append(UdevRule::fromJson(v.toObject()));
+        }
+        syncInfo = SyncInfo::fromJson(root["sync_info"].toObject());
+    }
+
+    qsizetype devices = 0;
+    for (const auto& rule : rules) devices += rule.devices.size();
+    return devices;
+}
+
+void BenchConfig::compareFormats() {
+    qInfo("%-6s %8s %10s %10s %10s %12s", "format", "rules", "bytes", "save usec", "load usec", "load allocs");
+    for (auto it = m_rules.cbegin(); it != m_rules.cend(); ++it) {
+        qsizetype expected = -1;
+        for (Format format : { Json, Cbor }) {
+            QElapsedTimer timer;
+            timer.start();
+            const QByteArray bytes = save(format, it.value(), m_syncInfo);
+            const qint64 saveNsec = timer.nsecsElapsed();
+
+            const QString path = m_dir.filePath(QString("%1.%2").arg(it.key()).arg(format));
+            timer.restart();
+            const qint64 before = allocationCount();
+            const qsizetype devices = load(format, path);
+            const qint64 allocs = allocationCount() - before;
+            const qint64 loadNsec = timer.nsecsElapsed();
+
+            qInfo("%-6s %8d %10lld %10lld %10lld %12lld", format == Cbor ? "cbor" : "json", it.key(),
+                  qint64(bytes.size()), saveNsec / 1000, loadNsec / 1000, allocs);
+
+            if (expected < 0) expected = devices;
+            QCOMPARE(devices, expected);
+        }
+    }
+}
+
+void BenchConfig::addRows() {
+    QTest::addColumn<int>("format");
+    QTest::addColumn<int>("rules");
+    for (auto it = m_rules.cbegin(); it != m_rules.cend(); ++it) {
+        QTest::addRow("json-%d", it.key()) << int(Json) << it.key();
+        QTest::addRow("cbor-%d", it.key()) << int(Cbor) << it.key();
+    }
+}
+
+void BenchConfig::benchLoad_data() {
+    addRows();
+}
+
+void BenchConfig::benchLoad() {
+    QFETCH(int, format);
+    QFETCH(int, rules);
+    const QString path = m_dir.filePath(QString("%1.%2").arg(rules).arg(format));
+    QBENCHMARK {
+        load(Format(format), path);
+    }
+}
+
+void BenchConfig::benchSave_data() {
+    addRows();
+}
+
+void BenchConfig::benchSave() {
+    QFETCH(int, format);
+    QFETCH(int, rules);
+    const QVector<UdevRule>& saved = m_rules[rules];
+    QBENCHMARK {
+        save(Format(format), saved, m_syncInfo);
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchConfig)
+#include "bench_config.moc"
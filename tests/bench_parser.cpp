@@ -0,0 +1,224 @@
+#include <QtTest/QtTest>
+#include "RuleParser.h"
+#include "RuleParserReference.h"
+#include "UdevRulesParser.h"
+#include "RulesAnalyzer.h"
+#include "Types.h"
+#include "AllocationCounter.h"
+
+using namespace udevme;
+
+class BenchParser : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void compareParsers();
+    void benchRegex_data();
+    void benchRegex();
+    void benchTokenizer_data();
+    void benchTokenizer();
+    void benchGrammar_data();
+    void benchGrammar();
+    void compareStreaming();
+    void benchStream_data();
+    void benchStream();
+    void benchAnalyzer_data();
+    void benchAnalyzer();
+
+private:
+    void addCorpusRows();
+
+    // Generated rules files by rule count, so runs are comparable across machines
+    QMap<int, QString> m_corpora;
+    QTemporaryDir m_dir;
+};
+
+void BenchParser::initTestCase() {
+    QVERIFY(m_dir.isValid());
+    for (int count : { 100, 10000, 50000 }) {
+        const QString content = reference::generateRulesCorpus(count);
+        m_corpora.insert(count, content);
+        
+        QFile file(m_dir.filePath(QString("%1.rules").arg(count)));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(content.toUtf8());
+    }
+}
+
+void BenchParser::addCorpusRows() {
+    QTest::addColumn<int>("rules");
+    for (auto it = m_corpora.cbegin(); it != m_corpora.cend(); ++it) {
+        QTest::addRow("%d-rules", it.key()) << it.key();
+    }
+}
+
+void BenchParser::compareParsers() {
+    using Parse = RuleParser::ParseResult (*)(const QString&);
+    struct Row {
+        const char* label;
+        Parse parse;
+    };
+    const Row rows[] = {
+        { "regex", &reference::parseRulesFile },
+        { "tokenizer", [](const QString& c) { return RuleParser::parseRulesFile(c); } },
+    };
+
+    qInfo("%-10s %8s %10s %12s %10s %8s", "parser", "rules", "bytes", "allocs", "usec", "MB/s");
+    for (auto it = m_corpora.cbegin(); it != m_corpora.cend(); ++it) {
+        const QString& content = it.value();
+        RuleParser::ParseResult expected;
+
+        for (const Row& row : rows) {
+            QElapsedTimer timer;
+            timer.start();
+            qint64 before = allocationCount();
+            RuleParser::ParseResult result = row.parse(content);
+            qint64 allocs = allocationCount() - before;
+            qint64 nsec = qMax<qint64>(timer.nsecsElapsed(), 1);
+
+            const qint64 bytes = content.size() * qint64(sizeof(QChar));
+            qInfo("%-10s %8d %10lld %12lld %10lld %8.1f", row.label, it.key(), bytes, allocs,
+                  nsec / 1000, bytes * 1000.0 / nsec);
+
+            QCOMPARE(result.rules.size(), it.key());
+            if (row.parse == &reference::parseRulesFile) {
+                expected = result;
+            } else {
+                const QString difference = reference::describeDifference(result, expected, content);
+                QVERIFY2(difference.isEmpty(), qPrintable(difference));
+            }
+        }
+
+        // The full grammar parser builds an AST of every line, not rules
+        QElapsedTimer timer;
+        timer.start();
+        qint64 before = allocationCount();
+        UdevRulesFile file = UdevRulesParser::parse(content);
+        qint64 allocs = allocationCount() - before;
+        qint64 nsec = qMax<qint64>(timer.nsecsElapsed(), 1);
+
+        const qint64 bytes = content.size() * qint64(sizeof(QChar));
+        qInfo("%-10s %8d %10lld %12lld %10lld %8.1f", "grammar", it.key(), bytes, allocs,
+              nsec / 1000, bytes * 1000.0 / nsec);
+        QVERIFY(!file.hasErrors());
+    }
+}
+
+void BenchParser::benchRegex_data() {
+    addCorpusRows();
+}
+
+void BenchParser::benchRegex() {
+    QFETCH(int, rules);
+    const QString& content = m_corpora[rules];
+    QBENCHMARK {
+        reference::parseRulesFile(content);
+    }
+}
+
+void BenchParser::benchTokenizer_data() {
+    addCorpusRows();
+}
+
+void BenchParser::benchTokenizer() {
+    QFETCH(int, rules);
+    const QString& content = m_corpora[rules];
+    QBENCHMARK {
+        RuleParser::parseRulesFile(content);
+    }
+}
+
+void BenchParser::benchGrammar_data() {
+    addCorpusRows();
+}
+
+void BenchParser::benchGrammar() {
+    QFETCH(int, rules);
+    const QString& content = m_corpora[rules];
+    QBENCHMARK {
+        UdevRulesParser::parse(content);
+    }
+}
+
+void BenchParser::compareStreaming() {
+    const QString path = m_dir.filePath(QString("%1.rules").arg(m_corpora.lastKey()));
+    const RuleParser::RuleCallback discard = [](UdevRule&&) { return true; };
+    
+    qInfo("%-10s %10s %12s %12s %10s", "mode", "bytes", "peak-bytes", "allocs", "usec");
+    
+    // What loading used to do: the whole file as UTF-8, then as UTF-16
+    QElapsedTimer timer;
+    timer.start();
+    qint64 before = allocationCount();
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadOnly | QIODevice::Text));
+        const QByteArray data = file.readAll();
+        const QString content = QString::fromUtf8(data);
+        RuleParser::parseRulesFile(content);
+        qInfo("%-10s %10lld %12lld %12lld %10lld", "whole", qint64(data.size()),
+              qint64(data.size() + content.size() * qsizetype(sizeof(QChar))),
+              allocationCount() - before, timer.nsecsElapsed() / 1000);
+    }
+    
+    // Peak is a raw chunk plus its UTF-16 copy
+    timer.restart();
+    before = allocationCount();
+    const RuleParser::StreamResult stream = RuleParser::parseRulesStream(path, discard);
+    qInfo("%-10s %10lld %12lld %12lld %10lld", "stream", stream.bytesRead,
+          qint64(stream.peakBufferBytes * 3), allocationCount() - before, timer.nsecsElapsed() / 1000);
+    QVERIFY(stream.success);
+}
+
+void BenchParser::benchStream_data() {
+    addCorpusRows();
+}
+
+void BenchParser::benchStream() {
+    QFETCH(int, rules);
+    const QString path = m_dir.filePath(QString("%1.rules").arg(rules));
+    const RuleParser::RuleCallback discard = [](UdevRule&&) { return true; };
+    QBENCHMARK {
+        RuleParser::parseRulesStream(path, discard);
+    }
+}
+
+void BenchParser::benchAnalyzer_data() {
+    QTest::addColumn<QString>("root");
+    
+    // About what a distro ships: 100 files of vendor and generic rules
+    const QString root = m_dir.filePath("analyzer");
+    const QString dir = root + "/usr/lib/udev/rules.d";
+    QVERIFY(QDir().mkpath(dir));
+    QRandomGenerator rng(1);
+    for (int f = 0; f < 100; ++f) {
+        QFile file(QString("%1/%2-generated.rules").arg(dir).arg(f, 2, 10, QLatin1Char('0')));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        for (int i = 0; i < 50; ++i) {
+            const QString vid = QString("%1").arg(rng.bounded(0x10000), 4, 16, QLatin1Char('0'));
+            const QString pid = QString("%1").arg(rng.bounded(0x10000), 4, 16, QLatin1Char('0'));
+            file.write(QString("SUBSYSTEM==\"hidraw\", ATTRS{idVendor}==\"%1\", ATTRS{idProduct}==\"%2\", "
+                               "MODE=\"0660\", TAG+=\"uaccess\"\n"
+                               "ACTION==\"add\", SUBSYSTEM==\"input\", ENV{ID_INPUT_JOYSTICK}==\"1\", "
+                               "RUN+=\"/bin/true\"\n").arg(vid, pid).toUtf8());
+        }
+    }
+    QTest::newRow("generated") << root;
+    if (!RulesAnalyzer().rulesFiles().isEmpty()) {
+        QTest::newRow("system") << QString("/");
+    }
+}
+
+void BenchParser::benchAnalyzer() {
+    QFETCH(QString, root);
+    // The 100-rule corpus stands in for udevme's own rules
+    const QVector<UdevRule> rules = RuleParser::parseRulesFile(m_corpora.first()).rules;
+    RulesAnalyzer analyzer(root);
+    QBENCHMARK {
+        analyzer.analyze(rules);
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchParser)
+#include "bench_parser.moc"
@@ -0,0 +1,163 @@
+#include <QtTest/QtTest>
+#include "DeviceScanner.h"
+#include "SysfsFixture.h"
+#include "Types.h"
+#include "AllocationCounter.h"
+
+using namespace udevme;
+
+class BenchScanner : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void compareBackends();
+    void benchSysfs_data();
+    void benchSysfs();
+    void benchSysfsUevent_data();
+    void benchSysfsUevent();
+    void benchUdevDatabase_data();
+    void benchUdevDatabase();
+    void benchUdevadm();
+
+private:
+    void addFixtureRows();
+    void runBackend(DeviceScanner::Backend backend);
+
+    // Synthetic trees by USB device count, so runs are comparable across machines
+    QTemporaryDir m_fixtures;
+    QMap<int, QString> m_fixtureRoots;
+};
+
+void BenchScanner::initTestCase() {
+    QVERIFY(m_fixtures.isValid());
+    for (int count : { 10, 100, 10000 }) {
+        SysfsFixture::Options options;
+        options.usbDevices = count;
+        options.hidrawNodes = count / 4;
+        options.bluetoothDevices = 2;
+        
+        const QString root = m_fixtures.filePath(QString::number(count));
+        QString error;
+        QVERIFY2(SysfsFixture::generate(root, options, &error), qPrintable(error));
+        m_fixtureRoots.insert(count, root);
+    }
+}
+
+void BenchScanner::addFixtureRows() {
+    QTest::addColumn<QString>("root");
+    QTest::newRow("live") << QString();
+    for (auto it = m_fixtureRoots.cbegin(); it != m_fixtureRoots.cend(); ++it) {
+        QTest::addRow("%d-devices", it.key()) << it.value();
+    }
+}
+
+void BenchScanner::compareBackends() {
+    if (!QDir("/sys/bus/usb/devices").exists()) {
+        QSKIP("No /sys/bus/usb/devices on this machine");
+    }
+    
+    struct Row {
+        const char* label;
+        DeviceScanner::Backend backend;
+    };
+    const Row rows[] = {
+        { "sysfs", DeviceScanner::Backend::Sysfs },
+        { "uevent", DeviceScanner::Backend::SysfsUevent },
+        { "udev-db", DeviceScanner::Backend::UdevDatabase },
+        { "udevadm", DeviceScanner::Backend::Udevadm },
+    };
+    
+    DeviceScanner scanner;
+    QVector<DeviceInfo> reference;
+    
+    qInfo("%-10s %8s %8s %8s %8s %8s %8s", "backend", "devices", "stat", "open", "read", "allocs", "usec");
+    for (const Row& row : rows) {
+        scanner.setBackend(row.backend);
+        
+        QElapsedTimer timer;
+        timer.start();
+        qint64 before = allocationCount();
+        QVector<DeviceInfo> devices = scanner.scanDevices();
+        qint64 allocs = allocationCount() - before;
+        qint64 usec = timer.nsecsElapsed() / 1000;
+        
+        const DeviceScanner::ScanStats& stats = scanner.lastScanStats();
+        qInfo("%-10s %8d %8d %8d %8d %8lld %8lld", row.label, stats.devicesVisited,
+              stats.statCalls, stats.filesOpened, stats.readCalls, allocs, usec);
+        
+        // The two sysfs backends must agree exactly
+        if (row.backend == DeviceScanner::Backend::Sysfs) {
+            reference = devices;
+        } else if (row.backend == DeviceScanner::Backend::SysfsUevent) {
+            QCOMPARE(devices.size(), reference.size());
+            for (int i = 0; i < reference.size(); ++i) {
+                QCOMPARE(devices[i].vidPid(), reference[i].vidPid());
+                QCOMPARE(devices[i].name, reference[i].name);
+                QCOMPARE(devices[i].manufacturer, reference[i].manufacturer);
+                QCOMPARE(devices[i].hasHidraw, reference[i].hasHidraw);
+            }
+        }
+    }
+}
+
+void BenchScanner::runBackend(DeviceScanner::Backend backend) {
+    QFETCH(QString, root);
+    
+    DeviceScanner scanner;
+    scanner.setBackend(backend);
+    if (!root.isEmpty()) {
+        scanner.setSysfsRoot(SysfsFixture::sysfsRoot(root));
+        scanner.setUdevDataPath(SysfsFixture::udevDataPath(root));
+    } else if (!QDir(scanner.sysfsRoot() + "/bus/usb/devices").exists()) {
+        QSKIP("No /sys/bus/usb/devices on this machine");
+    }
+    
+    QBENCHMARK {
+        scanner.scanDevices();
+    }
+}
+
+void BenchScanner::benchSysfs_data() {
+    addFixtureRows();
+}
+
+void BenchScanner::benchSysfs() {
+    runBackend(DeviceScanner::Backend::Sysfs);
+}
+
+void BenchScanner::benchSysfsUevent_data() {
+    addFixtureRows();
+}
+
+void BenchScanner::benchSysfsUevent() {
+    runBackend(DeviceScanner::Backend::SysfsUevent);
+}
+
+void BenchScanner::benchUdevDatabase_data() {
+    addFixtureRows();
+}
+
+void BenchScanner::benchUdevDatabase() {
+    QFETCH(QString, root);
+    if (root.isEmpty() && !QDir("/run/udev/data").exists()) {
+        QSKIP("No udev runtime database on this machine");
+    }
+    runBackend(DeviceScanner::Backend::UdevDatabase);
+}
+
+void BenchScanner::benchUdevadm() {
+    if (QStandardPaths::findExecutable("udevadm").isEmpty()) {
+        QSKIP("udevadm not installed");
+    }
+    
+    // Always the live system: udevadm can't be pointed at a fixture
+    DeviceScanner scanner;
+    scanner.setBackend(DeviceScanner::Backend::Udevadm);
+    QBENCHMARK {
+        scanner.scanDevices();
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchScanner)
+#include "bench_scanner.moc"
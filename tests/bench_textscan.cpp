@@ -0,0 +1,131 @@
+#include <QtTest/QtTest>
+#include "TextScan.h"
+
+using namespace udevme;
+
+// Line splitting plus a '=' lookup per line, the work the rules, .desktop
+// and udevadm parsers share, done the old way with QString::split() and
+// with TextScan at each instruction set
+class BenchTextScan : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanup();
+    void compareSplitting();
+    void benchSplit_data();
+    void benchSplit();
+
+private:
+    enum Method { QtSplit, QtView, ScanUtf16, ScanUtf8 };
+    static qsizetype run(Method method, const QByteArray& utf8, const QString& text);
+
+    // udevadm --export-db style text, about what a desktop machine produces
+    QByteArray m_utf8;
+    QString m_text;
+};
+
+void BenchTextScan::initTestCase() {
+    QRandomGenerator rng(1);
+    for (int device = 0; device < 2000; ++device) {
+        m_utf8 += QString("P: /devices/pci0000:00/0000:00:14.0/usb1/1-%1\n").arg(device).toUtf8();
+        for (int prop = 0; prop < 20; ++prop) {
+            m_utf8 += QString("E: PROPERTY_%1=%2\n")
+                .arg(prop)
+                .arg(QString(int(rng.bounded(4, 60)), QChar(u'a' + prop)))
+                .toUtf8();
+        }
+        m_utf8 += "\n";
+    }
+    m_text = QString::fromUtf8(m_utf8);
+}
+
+void BenchTextScan::cleanup() {
+    TextScan::setIsa(TextScan::bestIsa());
+}
+
+// Returns the sum of '=' offsets so nothing gets optimized away
+qsizetype BenchTextScan::run(Method method, const QByteArray& utf8, const QString& text) {
+    qsizetype sum = 0;
+    qsizetype pos = 0;
+    switch (method) {
+        case QtSplit:
+            for (const QString& raw : QString::fromUtf8(utf8).split('\n')) {
+                sum += raw.trimmed().indexOf('=');
+            }
+            break;
+        case QtView:
+            for (QStringView line : QStringView(text).tokenize(u'\n')) {
+                sum += line.trimmed().indexOf(u'=');
+            }
+            break;
+        case ScanUtf16: {
+            QStringView line;
+            while (TextScan::nextLine(text, pos, line)) sum += TextScan::indexOf(line, u'=');
+            break;
+        }
+        case ScanUtf8: {
+            QByteArrayView line;
+            while (TextScan::nextLine(utf8, pos, line)) sum += TextScan::indexOf(line, '=');
+            break;
+        }
+    }
+    return sum;
+}
+
+void BenchTextScan::compareSplitting() {
+    struct Row {
+        const char* label;
+        Method method;
+        TextScan::Isa isa;
+    };
+    QVector<Row> rows = { { "qt-split", QtSplit, TextScan::Isa::Scalar },
+                          { "qt-view", QtView, TextScan::Isa::Scalar } };
+    for (auto isa : { TextScan::Isa::Scalar, TextScan::Isa::Sse2, TextScan::Isa::Avx2 }) {
+        if (isa > TextScan::bestIsa()) continue;
+        rows.append({ TextScan::isaName(isa), ScanUtf16, isa });
+        rows.append({ TextScan::isaName(isa), ScanUtf8, isa });
+    }
+
+    qInfo("%-10s %-6s %10s %10s %8s", "method", "input", "bytes", "usec", "MB/s");
+    qsizetype expected = -1;
+    for (const Row& row : rows) {
+        TextScan::setIsa(row.isa);
+        const bool bytes = row.method == QtSplit || row.method == ScanUtf8;
+        const qint64 size = bytes ? m_utf8.size() : m_text.size() * qint64(sizeof(QChar));
+
+        QElapsedTimer timer;
+        timer.start();
+        const qsizetype sum = run(row.method, m_utf8, m_text);
+        const qint64 nsec = qMax<qint64>(timer.nsecsElapsed(), 1);
+        qInfo("%-10s %-6s %10lld %10lld %8.1f", row.label, bytes ? "utf-8" : "utf-16", size,
+              nsec / 1000, size * 1000.0 / nsec);
+
+        if (expected < 0) expected = sum;
+        QCOMPARE(sum, expected);
+    }
+}
+
+void BenchTextScan::benchSplit_data() {
+    QTest::addColumn<int>("method");
+    QTest::addColumn<int>("isa");
+    QTest::newRow("qt-split") << int(QtSplit) << int(TextScan::Isa::Scalar);
+    QTest::newRow("qt-view") << int(QtView) << int(TextScan::Isa::Scalar);
+    for (auto isa : { TextScan::Isa::Scalar, TextScan::Isa::Sse2, TextScan::Isa::Avx2 }) {
+        if (isa > TextScan::bestIsa()) continue;
+        QTest::addRow("%s-utf16", TextScan::isaName(isa)) << int(ScanUtf16) << int(isa);
+        QTest::addRow("%s-utf8", TextScan::isaName(isa)) << int(ScanUtf8) << int(isa);
+    }
+}
+
+void BenchTextScan::benchSplit() {
+    QFETCH(int, method);
+    QFETCH(int, isa);
+    TextScan::setIsa(TextScan::Isa(isa));
+    QBENCHMARK {
+        run(Method(method), m_utf8, m_text);
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchTextScan)
+#include "bench_textscan.moc"
@@ -0,0 +1,308 @@
+#include <QtTest/QtTest>
+#include "RuleGenerator.h"
+#include "RulesAnalyzer.h"
+#include "UdevRulesParser.h"
+#include "Types.h"
+
+using namespace udevme;
+
+// What udevd does with our rules file on each uevent, modelled on a
+// synthetic desktop's device tree: every device gets a "change" event, as
+// after the `udevadm trigger` that Apply runs. Counts the statements
+// udevd visits, the match keys it evaluates, the parent devices ATTRS and
+// friends walk and the sysfs attributes that makes it read, for each
+// rules output. hwdb lookups count as one match per HID device tried.
+class BenchUdevd : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void compareOutputs();
+    void benchEvents_data();
+    void benchEvents();
+
+private:
+    struct Device {
+        QString subsystem;
+        QString kernel;
+        QString devpath;
+        QHash<QString, QString> attrs;
+        int parent = -1;
+    };
+
+    struct Cost {
+        qint64 statements = 0;
+        qint64 matches = 0;
+        qint64 parentVisits = 0;
+        qint64 attrReads = 0;
+        qint64 modeSet = 0;
+    };
+
+    int addDevice(int parent, const QString& subsystem, const QString& kernel,
+                  const QHash<QString, QString>& attrs = {});
+    void addHidDevice(int parent, uint bus, uint vid, uint pid);
+    UdevRulesFile load(RuleOutput output);
+    void replay(const UdevRulesFile& file, Cost& cost) const;
+    void importHwdb(int device, QHash<QString, QString>& env, Cost& cost) const;
+    bool matchDevice(const RuleAssignment& a, const Device& dev,
+                     const QHash<QString, QString>& env = {}) const;
+    static bool isParentKey(QStringView key);
+
+    QVector<Device> m_devices;
+    QVector<UdevRule> m_rules;
+    QHash<QString, QString> m_hwdb;  // hwdb match -> mode, from generateHwdbFile()
+    int m_hidCount = 0;
+};
+
+int BenchUdevd::addDevice(int parent, const QString& subsystem, const QString& kernel,
+                          const QHash<QString, QString>& attrs) {
+    Device dev;
+    dev.subsystem = subsystem;
+    dev.kernel = kernel;
+    dev.devpath = (parent < 0 ? QString("/devices") : m_devices[parent].devpath) + "/" + kernel;
+    dev.attrs = attrs;
+    dev.parent = parent;
+    m_devices.append(dev);
+    return int(m_devices.size() - 1);
+}
+
+void BenchUdevd::addHidDevice(int parent, uint bus, uint vid, uint pid) {
+    const int n = m_hidCount++;
+    const QString name = QString("%1:%2:%3.%4")
+        .arg(bus, 4, 16, QLatin1Char('0'))
+        .arg(vid, 4, 16, QLatin1Char('0'))
+        .arg(pid, 4, 16, QLatin1Char('0'))
+        .arg(n + 1, 4, 16, QLatin1Char('0'))
+        .toUpper();
+    const QString modalias = QString("hid:b%1g0001v%2p%3")
+        .arg(QString("%1").arg(bus, 4, 16, QLatin1Char('0')).toUpper())
+        .arg(QString("%1").arg(vid, 8, 16, QLatin1Char('0')).toUpper())
+        .arg(QString("%1").arg(pid, 8, 16, QLatin1Char('0')).toUpper());
+    const int hid = addDevice(parent, "hid", name, { { "modalias", modalias } });
+    // The node sits in a hidraw/ directory, which isn't a device of its own
+    addDevice(hid, "hidraw", QString("hidraw%1").arg(n));
+    m_devices.last().devpath = m_devices[hid].devpath + QString("/hidraw/hidraw%1").arg(n);
+    const int input = addDevice(hid, "input", QString("input%1").arg(n));
+    addDevice(input, "input", QString("event%1").arg(n));
+}
+
+void BenchUdevd::initTestCase() {
+    // A desktop: PCI devices with storage, network, sound and graphics,
+    // two USB buses with a hub, a Bluetooth controller and virtual ttys
+    const int pci = addDevice(-1, QString(), "pci0000:00");
+    for (int i = 0; i < 20; ++i) {
+        addDevice(pci, "pci", QString("0000:00:%1.0").arg(i, 2, 16, QLatin1Char('0')));
+    }
+    const int nvme = addDevice(pci, "nvme", "nvme0");
+    const int disk = addDevice(nvme, "block", "nvme0n1");
+    for (int p = 1; p <= 3; ++p) addDevice(disk, "block", QString("nvme0n1p%1").arg(p));
+    addDevice(addDevice(pci, "pci", "0000:03:00.0"), "net", "enp3s0");
+    const int sound = addDevice(addDevice(pci, "pci", "0000:00:1f.3"), "sound", "card0");
+    for (const char* pcm : { "pcmC0D0p", "pcmC0D0c", "controlC0", "hwC0D0" }) addDevice(sound, "sound", pcm);
+    addDevice(addDevice(pci, "pci", "0000:01:00.0"), "drm", "card1");
+
+    QRandomGenerator rng(1);
+    const int xhci = addDevice(pci, "pci", "0000:00:14.0");
+    for (int busNo = 1; busNo <= 2; ++busNo) {
+        const int root = addDevice(xhci, "usb", QString("usb%1").arg(busNo),
+                                   { { "idVendor", "1d6b" }, { "idProduct", "0002" } });
+        const int hub = addDevice(root, "usb", QString("%1-1").arg(busNo),
+                                  { { "idVendor", "05e3" }, { "idProduct", "0610" } });
+        for (int port = 1; port <= 4; ++port) {
+            // Keyboards, mice, receivers, game controllers
+            const uint vid = port % 2 ? 0x046d : 0x1209 + rng.bounded(4);
+            const uint pid = 0xc500 + rng.bounded(0x80);
+            const QString kernel = QString("%1-1.%2").arg(busNo).arg(port);
+            const int usb = addDevice(hub, "usb", kernel,
+                                      { { "idVendor", QString("%1").arg(vid, 4, 16, QLatin1Char('0')) },
+                                        { "idProduct", QString("%1").arg(pid, 4, 16, QLatin1Char('0')) } });
+            for (int iface = 0; iface < 2; ++iface) {
+                const int intf = addDevice(usb, "usb", QString("%1:1.%2").arg(kernel).arg(iface));
+                addHidDevice(intf, HidBusUsb, vid, pid);
+            }
+        }
+    }
+    const int bt = addDevice(addDevice(xhci, "usb", "usb3"), "bluetooth", "hci0");
+    addHidDevice(bt, 0x05, 0x054c, 0x0ce6);
+    const int virt = addDevice(-1, QString(), "virtual");
+    for (int i = 0; i < 64; ++i) addDevice(virt, "tty", QString("tty%1").arg(i));
+
+    // Rules for the HID devices above plus as many for unplugged ones
+    for (const Device& dev : std::as_const(m_devices)) {
+        if (dev.subsystem != "hid") continue;
+        const QStringList ids = dev.kernel.section('.', 0, 0).split(':');
+        UdevRule rule;
+        DeviceInfo info;
+        info.bus = hidBusName(ids[0].toUInt(nullptr, 16));
+        info.vendorId = ids[1].toLower();
+        info.productId = ids[2].toLower();
+        rule.devices.append(info);
+        info.productId = QString("%1").arg(rng.bounded(0x10000), 4, 16, QLatin1Char('0'));
+        rule.devices.append(info);
+        m_rules.append(rule);
+    }
+}
+
+bool BenchUdevd::isParentKey(QStringView key) {
+    return key == u"KERNELS" || key == u"SUBSYSTEMS" || key == u"DRIVERS" || key == u"ATTRS" || key == u"TAGS";
+}
+
+bool BenchUdevd::matchDevice(const RuleAssignment& a, const Device& dev,
+                             const QHash<QString, QString>& env) const {
+    QString value;
+    if (a.key == u"ACTION") value = "change";
+    else if (a.key == u"ENV") value = env.value(a.attr.toString());
+    else if (a.key == u"SUBSYSTEM" || a.key == u"SUBSYSTEMS") value = dev.subsystem;
+    else if (a.key == u"KERNEL" || a.key == u"KERNELS") value = dev.kernel;
+    else if (a.key == u"DEVPATH") value = dev.devpath;
+    else if (a.key == u"ATTR" || a.key == u"ATTRS") value = dev.attrs.value(a.attr.toString());
+    const bool matched = RulesAnalyzer::globMatch(a.value, value);
+    return a.op == RuleOperator::Match ? matched : !matched;
+}
+
+UdevRulesFile BenchUdevd::load(RuleOutput output) {
+    m_hwdb.clear();
+    if (output == RuleOutput::Hwdb) {
+        // Match lines collect until the property line that applies to them
+        QStringList matches;
+        for (const QString& line : RuleGenerator::generateHwdbFile(m_rules).split('\n')) {
+            if (line.startsWith(QLatin1String(RuleGenerator::HwdbPrefix))) {
+                matches << line;
+            } else if (line.startsWith(u' ')) {
+                for (const QString& match : std::as_const(matches)) m_hwdb.insert(match, line.section('=', 1));
+            } else if (line.isEmpty()) {
+                matches.clear();
+            }
+        }
+    }
+    return UdevRulesParser::parse(RuleGenerator::generateRulesFile(m_rules, output));
+}
+
+void BenchUdevd::importHwdb(int device, QHash<QString, QString>& env, Cost& cost) const {
+    // --subsystem=hid: the HID devices from the event's up, first hit wins.
+    // The hash stands in for udevd's trie; both cost about the key length,
+    // not the number of entries.
+    for (int p = device; p >= 0; p = m_devices[p].parent) {
+        ++cost.parentVisits;
+        const Device& d = m_devices[p];
+        const QString modalias = d.attrs.value("modalias");
+        if (d.subsystem != "hid" || modalias.isEmpty()) continue;
+        ++cost.matches;
+        const QString key = RuleGenerator::HwdbPrefix + modalias.first(10) + "*" + modalias.sliced(14);
+        auto it = m_hwdb.constFind(key);
+        if (it != m_hwdb.constEnd()) {
+            env.insert(RuleGenerator::HwdbModeProperty, it.value());
+            return;
+        }
+    }
+}
+
+void BenchUdevd::replay(const UdevRulesFile& file, Cost& cost) const {
+    for (const Device& dev : m_devices) {
+        // udevd caches sysfs attributes per device for the event
+        QSet<QPair<int, QString>> read;
+        QHash<QString, QString> env;
+        bool modeSet = false;
+
+        for (int i = 0; i < file.size(); ++i) {
+            const RuleStatement& statement = file[i];
+            ++cost.statements;
+
+            bool matched = true;
+            bool hasParentKeys = false;
+            for (const RuleAssignment& a : statement) {
+                if (!a.isMatch()) continue;
+                if (isParentKey(a.key)) {
+                    hasParentKeys = true;
+                    continue;
+                }
+                ++cost.matches;
+                if (a.key == u"ATTR") read.insert({ int(&dev - m_devices.constData()), a.attr.toString() });
+                if (!matchDevice(a, dev, env)) {
+                    matched = false;
+                    break;
+                }
+            }
+
+            // All parent keys have to match on the same device, tried from
+            // the event's device up to the root
+            if (matched && hasParentKeys) {
+                matched = false;
+                for (int p = int(&dev - m_devices.constData()); p >= 0 && !matched; p = m_devices[p].parent) {
+                    ++cost.parentVisits;
+                    matched = true;
+                    for (const RuleAssignment& a : statement) {
+                        if (!a.isMatch() || !isParentKey(a.key)) continue;
+                        ++cost.matches;
+                        if (a.key == u"ATTRS") read.insert({ p, a.attr.toString() });
+                        if (!matchDevice(a, m_devices[p])) {
+                            matched = false;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (!matched) continue;
+
+            const RuleAssignment* import = statement.find(u"IMPORT");
+            if (import && import->attr == u"builtin" && import->value.startsWith(u"hwdb")) {
+                importHwdb(int(&dev - m_devices.constData()), env, cost);
+            }
+            if (statement.find(u"MODE")) modeSet = true;
+            const QStringView label = statement.gotoLabel();
+            if (!label.isEmpty()) {
+                const int target = file.findLabel(label, i);
+                if (target < 0) break;
+                i = target - 1;
+            }
+        }
+        cost.attrReads += read.size();
+        cost.modeSet += modeSet;
+    }
+}
+
+void BenchUdevd::compareOutputs() {
+    const qint64 events = m_devices.size();
+    qInfo("%lld devices, %lld rules", events, qint64(m_rules.size()));
+    qInfo("%-11s %11s %11s %11s %11s %8s %10s", "output", "stmts/ev", "matches/ev", "parents/ev",
+          "reads/ev", "nodes", "usec");
+
+    qint64 modes = -1;
+    for (RuleOutput output : { RuleOutput::Compatible, RuleOutput::Optimized, RuleOutput::Hwdb }) {
+        const UdevRulesFile file = load(output);
+        QVERIFY(!file.hasErrors());
+
+        Cost cost;
+        QElapsedTimer timer;
+        timer.start();
+        replay(file, cost);
+        qInfo("%-11s %11.1f %11.1f %11.1f %11.1f %8lld %10lld", qPrintable(ruleOutputToString(output)),
+              double(cost.statements) / events, double(cost.matches) / events,
+              double(cost.parentVisits) / events, double(cost.attrReads) / events, cost.modeSet,
+              timer.nsecsElapsed() / 1000);
+
+        // All set the mode of the same nodes
+        if (modes < 0) modes = cost.modeSet;
+        QCOMPARE(cost.modeSet, modes);
+    }
+    QVERIFY(modes > 0);
+}
+
+void BenchUdevd::benchEvents_data() {
+    QTest::addColumn<int>("output");
+    QTest::newRow("compatible") << int(RuleOutput::Compatible);
+    QTest::newRow("optimized") << int(RuleOutput::Optimized);
+    QTest::newRow("hwdb") << int(RuleOutput::Hwdb);
+}
+
+void BenchUdevd::benchEvents() {
+    QFETCH(int, output);
+    const UdevRulesFile file = load(RuleOutput(output));
+    QBENCHMARK {
+        Cost cost;
+        replay(file, cost);
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchUdevd)
+#include "bench_udevd.moc"
@@ -0,0 +1,69 @@
+#ifndef FUZZRULES_H
+#define FUZZRULES_H
+
+// Checks shared by the fuzz targets. Any input may parse to anything, but
+// what it parses to has to be written and read back unchanged, and the
+// streaming and cached parses have to agree with the plain one.
+
+#include <QBuffer>
+#include <QByteArray>
+#include <cstdlib>
+#include "RuleGenerator.h"
+#include "RuleParser.h"
+
+namespace udevme {
+namespace fuzz {
+
+inline void require(bool condition) {
+    if (!condition) abort();
+}
+
+inline void checkRulesFile(const QByteArray& bytes) {
+    const RuleParser::ParseResult parsed = RuleParser::parseRulesFile(QString::fromUtf8(bytes));
+    require(parsed.success);
+    const QString generated = RuleGenerator::generateRulesFile(parsed.rules);
+
+    // Rules without a valid id get a fresh one on every parse, so the
+    // streamed ones take the ids of the first parse before comparing
+    QBuffer buffer;
+    buffer.setData(bytes);
+    buffer.open(QIODevice::ReadOnly);
+    QVector<UdevRule> streamed;
+    const RuleParser::StreamResult stream = RuleParser::parseRulesStream(&buffer, [&](UdevRule&& rule) {
+        streamed.append(std::move(rule));
+        return true;
+    });
+    require(stream.success && stream.bytesRead == bytes.size());
+    require(streamed.size() == parsed.rules.size());
+    require(stream.editedBlockLines == parsed.editedBlockLines);
+    for (qsizetype i = 0; i < streamed.size(); ++i) streamed[i].id = parsed.rules[i].id;
+    require(RuleGenerator::generateRulesFile(streamed) == generated);
+
+    // What we write parses back to itself, with every checksum intact
+    RuleParser::BlockCache cache;
+    const RuleParser::ParseResult reparsed = RuleParser::parseRulesFile(generated, &cache);
+    require(reparsed.editedBlockLines.isEmpty());
+    require(RuleGenerator::generateRulesFile(reparsed.rules) == generated);
+
+    // The optimized layout too
+    const QString optimized = RuleGenerator::generateRulesFile(parsed.rules, RuleOutput::Optimized);
+    const RuleParser::ParseResult reparsedOptimized = RuleParser::parseRulesFile(optimized);
+    require(reparsedOptimized.editedBlockLines.isEmpty());
+    require(RuleGenerator::generateRulesFile(reparsedOptimized.rules, RuleOutput::Optimized) == optimized);
+
+    // and the hwdb file
+    const QString hwdb = RuleGenerator::generateHwdbFile(parsed.rules);
+    const RuleParser::ParseResult reparsedHwdb = RuleParser::parseRulesFile(hwdb);
+    require(reparsedHwdb.editedBlockLines.isEmpty());
+    require(RuleGenerator::generateHwdbFile(reparsedHwdb.rules) == hwdb);
+
+    // and reloading it takes every block from the cache
+    const RuleParser::ParseResult cached = RuleParser::parseRulesFile(generated, &cache);
+    require(cached.reusedBlocks == cached.rules.size());
+    require(RuleGenerator::generateRulesFile(cached.rules) == generated);
+}
+
+} // namespace fuzz
+} // namespace udevme
+
+#endif // FUZZRULES_H
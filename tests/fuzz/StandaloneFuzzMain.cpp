@@ -0,0 +1,53 @@
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <cstdio>
+
+// Runs a fuzz target over files instead of under libFuzzer: each argument
+// is a file or a directory of files, and no arguments reads stdin. This is
+// what replays the seed corpus in ctest, reproduces a crash file, and
+// serves as the harness for AFL-style fuzzers (`afl-fuzz ... -- target @@`).
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+namespace {
+
+bool runFile(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "Cannot open %s\n", qPrintable(path));
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(data.constData()), size_t(data.size()));
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        QFile in;
+        if (!in.open(stdin, QIODevice::ReadOnly)) return 1;
+        const QByteArray data = in.readAll();
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(data.constData()), size_t(data.size()));
+        return 0;
+    }
+
+    int runs = 0;
+    bool ok = true;
+    for (int i = 1; i < argc; ++i) {
+        const QString path = QFile::decodeName(argv[i]);
+        if (!QFileInfo(path).isDir()) {
+            ok = runFile(path) && ok;
+            ++runs;
+            continue;
+        }
+        QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            ok = runFile(it.next()) && ok;
+            ++runs;
+        }
+    }
+    printf("Ran %d inputs\n", runs);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,25 @@
+#include "FuzzRules.h"
+
+// The input is the rest of a "# udevme:" comment followed by a rule line
+// for each device it lists, so mutations go into the metadata rather than
+// into finding the comment in the first place
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    QByteArray metadata(reinterpret_cast<const char*>(data), qsizetype(size));
+    metadata.replace('\n', ' ');
+
+    QByteArray content = "# udevme: " + metadata + "\n";
+    const qsizetype devices = metadata.indexOf("devices=");
+    if (devices >= 0) {
+        qsizetype end = metadata.indexOf(' ', devices);
+        if (end < 0) end = metadata.size();
+        const QByteArray list = metadata.mid(devices + 8, end - devices - 8);
+        for (const QByteArray& device : list.split(',')) {
+            const QList<QByteArray> ids = device.split(':');
+            if (ids.size() != 2) continue;
+            content += "KERNEL==\"hidraw*\", SUBSYSTEM==\"hidraw\", ATTRS{idVendor}==\"" + ids[0] +
+                       "\", ATTRS{idProduct}==\"" + ids[1] + "\", MODE=\"0666\"\n";
+        }
+    }
+    udevme::fuzz::checkRulesFile(content);
+    return 0;
+}
@@ -0,0 +1,7 @@
+#include "FuzzRules.h"
+
+// Whole rules files, hand-edited or not
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    udevme::fuzz::checkRulesFile(QByteArray(reinterpret_cast<const char*>(data), qsizetype(size)));
+    return 0;
+}
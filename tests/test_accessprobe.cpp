@@ -0,0 +1,193 @@
+#include <QtTest/QtTest>
+#include <QtEndian>
+#include "AccessProbe.h"
+#include "Types.h"
+#include "TestHelpers.h"
+
+#include <unistd.h>
+
+using namespace udevme;
+
+class TestAccessProbe : public QObject {
+    Q_OBJECT
+
+private slots:
+    void init();
+    void testAclOwnerAndOther();
+    void testAclNamedUserMasked();
+    void testAclGroups();
+    void testAclMalformed();
+    void testModeBits();
+    void testProbeDevices();
+
+private:
+    struct AclEntry { quint16 tag; quint16 perm; quint32 id; };
+    static QByteArray acl(std::initializer_list<AclEntry> entries);
+
+    QTemporaryDir m_dir;
+};
+
+void TestAccessProbe::init() {
+    QVERIFY(m_dir.isValid());
+}
+
+// Same layout the kernel returns for system.posix_acl_access
+QByteArray TestAccessProbe::acl(std::initializer_list<AclEntry> entries) {
+    QByteArray blob(4 + int(entries.size()) * 8, '\0');
+    char* p = blob.data();
+    qToLittleEndian<quint32>(2, p);
+    p += 4;
+    for (const AclEntry& e : entries) {
+        qToLittleEndian<quint16>(e.tag, p);
+        qToLittleEndian<quint16>(e.perm, p + 2);
+        qToLittleEndian<quint32>(e.id, p + 4);
+        p += 8;
+    }
+    return blob;
+}
+
+void TestAccessProbe::testAclOwnerAndOther() {
+    const uid_t me = ::geteuid();
+    const gid_t otherGroup = gid_t(-2);
+    const QByteArray blob = acl({ {0x01, 6, 0}, {0x04, 0, 0}, {0x10, 7, 0}, {0x20, 4, 0} });
+
+    QCOMPARE(AccessProbe::aclPermissions(blob, me, otherGroup), 6u);
+    QCOMPARE(AccessProbe::aclPermissions(blob, me + 1, otherGroup), 4u);
+}
+
+void TestAccessProbe::testAclNamedUserMasked() {
+    const uid_t me = ::geteuid();
+    const gid_t otherGroup = gid_t(-2);
+
+    // What systemd-logind's uaccess writes: user:<me>:rw-
+    const QByteArray uaccess = acl({ {0x01, 6, 0}, {0x02, 6, me}, {0x04, 0, 0},
+                                     {0x10, 6, 0}, {0x20, 0, 0} });
+    QCOMPARE(AccessProbe::aclPermissions(uaccess, me + 1, otherGroup), 6u);
+
+    // A restrictive mask wins over the named entry
+    const QByteArray masked = acl({ {0x01, 6, 0}, {0x02, 6, me}, {0x04, 0, 0},
+                                    {0x10, 4, 0}, {0x20, 0, 0} });
+    QCOMPARE(AccessProbe::aclPermissions(masked, me + 1, otherGroup), 4u);
+
+    // Named entries for someone else don't apply
+    const QByteArray someoneElse = acl({ {0x01, 6, 0}, {0x02, 6, me + 1}, {0x04, 0, 0},
+                                         {0x10, 6, 0}, {0x20, 0, 0} });
+    QCOMPARE(AccessProbe::aclPermissions(someoneElse, me + 1, otherGroup), 0u);
+
+    // Well past a small fixed buffer: many named users before ours
+    QByteArray large = acl({ {0x01, 6, 0}, {0x04, 0, 0}, {0x10, 6, 0}, {0x20, 0, 0} });
+    for (quint32 i = 1; i <= 100; ++i) {
+        large += acl({ {0x02, 4, me + i} }).mid(4);
+    }
+    large += acl({ {0x02, 6, me} }).mid(4);
+    QVERIFY(large.size() > 512);
+    QCOMPARE(AccessProbe::aclPermissions(large, me + 1, otherGroup), 6u);
+}
+
+void TestAccessProbe::testAclGroups() {
+    const uid_t me = ::geteuid();
+    const gid_t myGroup = ::getegid();
+    const gid_t otherGroup = gid_t(-2);
+
+    const QByteArray blob = acl({ {0x01, 6, 0}, {0x04, 6, 0}, {0x10, 6, 0}, {0x20, 0, 0} });
+    QCOMPARE(AccessProbe::aclPermissions(blob, me + 1, myGroup), 6u);
+    QCOMPARE(AccessProbe::aclPermissions(blob, me + 1, otherGroup), 0u);
+
+    // Named group entries are matched against the process groups too
+    const QByteArray named = acl({ {0x01, 6, 0}, {0x04, 0, 0}, {0x08, 2, myGroup},
+                                   {0x10, 7, 0}, {0x20, 4, 0} });
+    QCOMPARE(AccessProbe::aclPermissions(named, me + 1, otherGroup), 2u);
+
+    // Read from one matching group and write from another is not read-write
+    const QByteArray split = acl({ {0x01, 6, 0}, {0x04, 4, 0}, {0x08, 2, myGroup},
+                                   {0x10, 7, 0}, {0x20, 0, 0} });
+    const uint perms = AccessProbe::aclPermissions(split, me + 1, myGroup);
+    QVERIFY((perms & 6u) != 6u);
+    QCOMPARE(AccessProbe::aclPermissions(split, me + 1, myGroup, 4), 4u);
+    QCOMPARE(AccessProbe::aclPermissions(split, me + 1, myGroup, 2), 2u);
+
+    // One entry granting both is enough, and the mask still applies to it
+    const QByteArray both = acl({ {0x01, 6, 0}, {0x04, 4, 0}, {0x08, 6, myGroup},
+                                  {0x10, 7, 0}, {0x20, 0, 0} });
+    QCOMPARE(AccessProbe::aclPermissions(both, me + 1, myGroup), 6u);
+    const QByteArray masked = acl({ {0x01, 6, 0}, {0x04, 4, 0}, {0x08, 6, myGroup},
+                                    {0x10, 4, 0}, {0x20, 0, 0} });
+    QCOMPARE(AccessProbe::aclPermissions(masked, me + 1, myGroup), 4u);
+}
+
+void TestAccessProbe::testAclMalformed() {
+    QCOMPARE(AccessProbe::aclPermissions(QByteArray(), 0, 0), 0u);
+    QCOMPARE(AccessProbe::aclPermissions(QByteArray("\x01\x00\x00\x00", 4), 0, 0), 0u);
+
+    // A truncated trailing entry is ignored rather than read past the end
+    QByteArray blob = acl({ {0x01, 6, 0}, {0x20, 6, 0} });
+    blob.chop(3);
+    QCOMPARE(AccessProbe::aclPermissions(blob, ::geteuid(), 0), 6u);
+}
+
+void TestAccessProbe::testModeBits() {
+    const QString open = m_dir.filePath("hidraw0");
+    const QString readOnly = m_dir.filePath("hidraw1");
+    test::createNode(open, QFile::ReadOwner | QFile::WriteOwner);
+    test::createNode(readOnly, QFile::ReadOwner);
+    if (QTest::currentTestFailed()) return;
+
+    AccessProbe::Result r = AccessProbe::probe(open, true);
+    QVERIFY(r.exists);
+    QCOMPARE(r.mode, 0600u);
+    QVERIFY(r.accessible());
+    QVERIFY(r.openChecked);
+    QVERIFY(r.openSucceeded);
+
+    QVERIFY(!AccessProbe::probe(m_dir.filePath("missing")).exists);
+
+    if (::geteuid() == 0) {
+        QSKIP("Running as root; mode bits don't restrict access");
+    }
+    r = AccessProbe::probe(readOnly, true);
+    QVERIFY(r.readable);
+    QVERIFY(!r.writable);
+    QVERIFY(!r.openChecked);
+    QVERIFY(!r.accessible());
+}
+
+void TestAccessProbe::testProbeDevices() {
+    const QString a = m_dir.filePath("hidraw2");
+    const QString b = m_dir.filePath("hidraw3");
+    test::createNode(a, QFile::ReadOwner | QFile::WriteOwner);
+    test::createNode(b, QFile::ReadOwner | QFile::WriteOwner);
+    if (QTest::currentTestFailed()) return;
+
+    DeviceInfo both;
+    both.vendorId = "1234";
+    both.productId = "5678";
+    both.hidrawNodes = { a, b };
+    DeviceInfo gone = both;
+    gone.hidrawNodes = { a, m_dir.filePath("hidraw9") };
+    DeviceInfo none = both;
+    none.hidrawNodes.clear();
+
+    AccessProbe probe;
+    QStringList nodes = probe.unprobedNodes({ both, gone, none });
+    QCOMPARE(nodes.size(), 3);
+    probe.addResults(AccessProbe::probeNodes(nodes).results());
+    QVERIFY(probe.result(a));
+    QVERIFY(probe.result(b));
+    QVERIFY(probe.isAccessible(both));
+    QVERIFY(!probe.isAccessible(gone));
+    QVERIFY(!probe.isAccessible(none));
+
+    // Known nodes aren't probed again; forgotten ones are
+    QVERIFY(probe.unprobedNodes({ both }).isEmpty());
+    probe.forget({ gone });
+    QVERIFY(!probe.result(a));
+    QVERIFY(probe.result(b));
+    QCOMPARE(probe.unprobedNodes({ both }), QStringList{ a });
+
+    probe.clear();
+    QVERIFY(!probe.result(b));
+    QVERIFY(!probe.isAccessible(both));
+}
+
+QTEST_GUILESS_MAIN(TestAccessProbe)
+#include "test_accessprobe.moc"
@@ -0,0 +1,215 @@
+#include <QtTest/QtTest>
+#include <QCborStreamWriter>
+#include "ConfigCbor.h"
+#include "Types.h"
+
+using namespace udevme;
+
+class TestConfigCbor : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testRoundTrip();
+    void testDeterministic();
+    void testMalformed();
+    void testUnknownKeysSkipped();
+    void testReadFile();
+
+private:
+    static QVector<UdevRule> rules();
+    static SyncInfo syncInfo();
+    // What udevme.json keeps of a rule
+    static QJsonObject stored(const UdevRule& rule);
+};
+
+QVector<UdevRule> TestConfigCbor::rules() {
+    const QDateTime created = QDateTime::fromSecsSinceEpoch(1700000000);
+
+    UdevRule keyboard;
+    keyboard.createdAt = created;
+    keyboard.updatedAt = created.addSecs(3600);
+    DeviceInfo usb;
+    usb.vendorId = "046d";
+    usb.productId = "c52b";
+    usb.name = "Unifying Receiver";
+    usb.manufacturer = "Logitech";
+    usb.hasHidraw = true;
+    usb.hasUsb = true;
+    keyboard.devices.append(usb);
+    DeviceInfo bt;
+    bt.vendorId = "05AC";       // not sysfs spelling, kept as text
+    bt.productId = "024f";
+    bt.name = "Magic Keyboard — ü";
+    bt.bus = "bluetooth";
+    bt.hasHidraw = true;
+    keyboard.devices.append(bt);
+    AppInfo app;
+    app.desktopId = "org.chromium.Chromium.desktop";
+    app.name = "Chromium";
+    app.exec = "chromium %U";
+    app.icon = "chromium";
+    keyboard.applications.append(app);
+
+    UdevRule open;
+    open.createdAt = created;
+    open.updatedAt = created;
+    open.permissionLevel = PermissionLevel::Open;
+    open.ruleTypes.hidraw = false;
+    open.ruleTypes.usb = true;
+    open.ruleTypes.uaccess = false;
+    open.ruleTypes.seat = true;
+    open.enabled = false;
+    DeviceInfo odd;
+    odd.vendorId = "1";
+    odd.productId = "";
+    open.devices.append(odd);
+
+    return { keyboard, open, UdevRule() };
+}
+
+SyncInfo TestConfigCbor::syncInfo() {
+    SyncInfo info;
+    info.rulesFileHashAtLoad = "3f2a";
+    info.rulesFileHashAfterApply = "3f2a";
+    info.lastAppliedAt = QDateTime::fromSecsSinceEpoch(1700000500);
+    info.fileHashes.insert("/etc/udev/rules.d/99-udevme.rules", "3f2a");
+    info.fileStamps.insert("/etc/udev/rules.d/99-udevme.rules", "1234:567:1700000500000000000");
+    return info;
+}
+
+QJsonObject TestConfigCbor::stored(const UdevRule& rule) {
+    QJsonObject obj = UdevRule::fromJson(rule.toJson()).toJson();
+    obj.remove("notes");
+    return obj;
+}
+
+void TestConfigCbor::testRoundTrip() {
+    const QVector<UdevRule> saved = rules();
+    const SyncInfo info = syncInfo();
+
+    QVector<UdevRule> loaded;
+    SyncInfo loadedInfo;
+    QString error;
+    QVERIFY2(ConfigCbor::read(ConfigCbor::write(saved, info), loaded, loadedInfo, &error), qPrintable(error));
+
+    // Everything udevme.json keeps, to the second
+    QCOMPARE(loaded.size(), saved.size());
+    for (int i = 0; i < saved.size(); ++i) {
+        QCOMPARE(loaded[i].id, saved[i].id);
+        QCOMPARE(stored(loaded[i]), stored(saved[i]));
+    }
+    QCOMPARE(loaded[0].devices[1].vendorId, QString("05AC"));
+    QCOMPARE(loaded[0].devices[1].name, QString("Magic Keyboard — ü"));
+    QCOMPARE(loadedInfo.toJson(), info.toJson());
+    QVERIFY(!loadedInfo.lastSyncedFromRulesAt.isValid());
+
+    // Smaller than the JSON it replaces
+    QJsonArray array;
+    for (const auto& rule : saved) array.append(stored(rule));
+    QVERIFY(ConfigCbor::write(saved, info).size() < QJsonDocument(array).toJson(QJsonDocument::Compact).size());
+}
+
+void TestConfigCbor::testDeterministic() {
+    const QVector<UdevRule> saved = rules();
+    const QByteArray bytes = ConfigCbor::write(saved, syncInfo());
+    QCOMPARE(ConfigCbor::write(saved, syncInfo()), bytes);
+
+    // A load and save without changes gives the same file back
+    QVector<UdevRule> loaded;
+    SyncInfo loadedInfo;
+    QVERIFY(ConfigCbor::read(bytes, loaded, loadedInfo));
+    QCOMPARE(ConfigCbor::write(loaded, loadedInfo), bytes);
+}
+
+void TestConfigCbor::testMalformed() {
+    QVector<UdevRule> loaded;
+    SyncInfo loadedInfo;
+    QString error;
+
+    QVERIFY(!ConfigCbor::read(QByteArray(), loaded, loadedInfo, &error));
+    QVERIFY(!error.isEmpty());
+    QVERIFY(!ConfigCbor::read("{\"rules\": []}", loaded, loadedInfo));
+
+    // Every truncation fails cleanly and leaves the output alone
+    const QByteArray bytes = ConfigCbor::write(rules(), syncInfo());
+    loaded = { UdevRule() };
+    for (qsizetype size = 0; size < bytes.size(); ++size) {
+        error.clear();
+        QVERIFY2(!ConfigCbor::read(bytes.first(size), loaded, loadedInfo, &error), qPrintable(QString::number(size)));
+        QVERIFY(!error.isEmpty());
+    }
+    QCOMPARE(loaded.size(), 1);
+
+    // A newer version is refused rather than half read
+    QByteArray newer;
+    {
+        QCborStreamWriter w(&newer);
+        w.append(QCborKnownTags::Signature);
+        w.startMap(1);
+        w.append(quint64(0));
+        w.append(quint64(ConfigCbor::Version + 1));
+        w.endMap();
+    }
+    QVERIFY(!ConfigCbor::read(newer, loaded, loadedInfo, &error));
+    QVERIFY(error.contains("newer"));
+}
+
+void TestConfigCbor::testUnknownKeysSkipped() {
+    // A rule with a key from some later version, holding a nested value
+    QByteArray bytes;
+    QCborStreamWriter w(&bytes);
+    w.append(QCborKnownTags::Signature);
+    w.startMap(2);
+    w.append(quint64(0));
+    w.append(quint64(ConfigCbor::Version));
+    w.append(quint64(1));
+    w.startArray(1);
+    w.startMap(2);
+    w.append(quint64(99));
+    w.startArray(2);
+    w.append("future");
+    w.startMap(0);
+    w.endMap();
+    w.endArray();
+    w.append(quint64(5));
+    w.append(false);
+    w.endMap();
+    w.endArray();
+    w.endMap();
+
+    QVector<UdevRule> loaded;
+    SyncInfo loadedInfo;
+    QString error;
+    QVERIFY2(ConfigCbor::read(bytes, loaded, loadedInfo, &error), qPrintable(error));
+    QCOMPARE(loaded.size(), 1);
+    QVERIFY(!loaded[0].enabled);
+    QVERIFY(!loaded[0].id.isNull());
+}
+
+void TestConfigCbor::testReadFile() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("udevme.cbor");
+    QVector<UdevRule> loaded;
+    SyncInfo loadedInfo;
+    QString error;
+    QVERIFY(!ConfigCbor::readFile(path, loaded, loadedInfo, &error));
+    QVERIFY(error.contains(path));
+
+    const QVector<UdevRule> saved = rules();
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(ConfigCbor::write(saved, syncInfo()));
+    file.close();
+
+    QVERIFY2(ConfigCbor::readFile(path, loaded, loadedInfo, &error), qPrintable(error));
+    QCOMPARE(loaded.size(), saved.size());
+    QCOMPARE(loaded[0].devices[0].name, QString("Unifying Receiver"));
+
+    // An empty file is a malformed one, not an empty config
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.close();
+    QVERIFY(!ConfigCbor::readFile(path, loaded, loadedInfo, &error));
+}
+
+QTEST_GUILESS_MAIN(TestConfigCbor)
+#include "test_configcbor.moc"
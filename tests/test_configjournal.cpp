@@ -0,0 +1,250 @@
+#include <QtTest/QtTest>
+#include "ConfigCbor.h"
+#include "ConfigJournal.h"
+#include "ConfigSession.h"
+#include "ConfigStore.h"
+#include "Types.h"
+#include "TestHelpers.h"
+
+using namespace udevme;
+
+class TestConfigJournal : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void testReplay();
+    void testTornTail();
+    void testStaleDigest();
+    void testCompaction();
+    void testSessionAppends();
+
+private:
+    static QVector<UdevRule> rules(int count);
+    static QByteArray encoded(const QVector<UdevRule>& rules);
+
+    QTemporaryDir m_home;
+};
+
+void TestConfigJournal::initTestCase() {
+    test::isolateConfig(m_home);
+}
+
+void TestConfigJournal::init() {
+    test::removeConfigFiles();
+}
+
+QVector<UdevRule> TestConfigJournal::rules(int count) {
+    QVector<UdevRule> rules;
+    for (int i = 0; i < count; ++i) {
+        UdevRule rule;
+        rule.createdAt = rule.updatedAt = QDateTime::fromSecsSinceEpoch(1700000000);
+        DeviceInfo dev;
+        dev.vendorId = "1234";
+        dev.productId = QString("%1").arg(i, 4, 16, QLatin1Char('0'));
+        dev.name = "Keyboard";
+        rule.devices.append(dev);
+        rules.append(rule);
+    }
+    return rules;
+}
+
+// Rules compare by what the config keeps of them
+QByteArray TestConfigJournal::encoded(const QVector<UdevRule>& rules) {
+    return ConfigCbor::write(rules, SyncInfo());
+}
+
+void TestConfigJournal::testReplay() {
+    const QString path = m_home.filePath("replay.journal");
+    const QByteArray digest = ConfigJournal::snapshotDigest("snapshot");
+    const QVector<UdevRule> base = rules(4);
+
+    // Update, remove, add, reorder and toggle, over two appends
+    QVector<UdevRule> step = base;
+    step[1].permissionLevel = PermissionLevel::Open;
+    step.remove(2);
+    step.append(rules(1));
+    QVector<UdevRule> last = step;
+    std::swap(last[0], last[3]);
+    last[1].enabled = false;
+    SyncInfo sync;
+    sync.rulesFileHashAtLoad = "abc";
+
+    ConfigJournal journal(path);
+    QVERIFY(journal.load(digest));
+    bool written = false;
+    QVERIFY(journal.append(base, SyncInfo(), step, SyncInfo(), &written));
+    QVERIFY(written);
+    QVERIFY(journal.append(step, SyncInfo(), last, sync, &written));
+    QVERIFY(written);
+
+    // Nothing changed, nothing appended
+    const qint64 size = QFileInfo(path).size();
+    QVERIFY(journal.append(last, sync, last, sync, &written));
+    QVERIFY(!written);
+    QCOMPARE(QFileInfo(path).size(), size);
+
+    QVector<UdevRule> replayed = base;
+    SyncInfo replayedSync;
+    ConfigJournal reader(path);
+    QVERIFY(reader.load(digest, &replayed, &replayedSync));
+    QCOMPARE(reader.recordCount(), journal.recordCount());
+    QCOMPARE(encoded(replayed), encoded(last));
+    QCOMPARE(replayedSync.rulesFileHashAtLoad, QString("abc"));
+}
+
+void TestConfigJournal::testTornTail() {
+    const QString path = m_home.filePath("torn.journal");
+    const QByteArray digest = ConfigJournal::snapshotDigest("snapshot");
+    const QVector<UdevRule> base = rules(2);
+    QVector<UdevRule> edited = base;
+    edited[0].enabled = false;
+
+    ConfigJournal journal(path);
+    QVERIFY(journal.load(digest));
+    QVERIFY(journal.append(base, SyncInfo(), edited, SyncInfo()));
+    const qint64 good = QFileInfo(path).size();
+
+    // A crash mid-append: the partial record is dropped, the rest replays
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::Append));
+        file.write(QByteArray("\x40\x00\x00\x00\x12", 5));
+    }
+    QVector<UdevRule> replayed = base;
+    ConfigJournal reader(path);
+    QVERIFY(reader.load(digest, &replayed));
+    QCOMPARE(reader.recordCount(), 1);
+    QCOMPARE(encoded(replayed), encoded(edited));
+
+    // The next append starts where the good records end
+    QVector<UdevRule> more = edited;
+    more.removeLast();
+    QVERIFY(reader.append(edited, SyncInfo(), more, SyncInfo()));
+    replayed = base;
+    QVERIFY(ConfigJournal(path).load(digest, &replayed));
+    QCOMPARE(encoded(replayed), encoded(more));
+    QVERIFY(QFileInfo(path).size() > good);
+
+    // A flipped byte ends the journal at that record
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.seek(good - 1));
+        char c = 0;
+        QVERIFY(file.getChar(&c));
+        QVERIFY(file.seek(good - 1));
+        QVERIFY(file.putChar(char(c ^ 0x01)));
+    }
+    replayed = base;
+    ConfigJournal corrupt(path);
+    QVERIFY(corrupt.load(digest, &replayed));
+    QCOMPARE(corrupt.recordCount(), 0);
+    QCOMPARE(encoded(replayed), encoded(base));
+
+    // Anything else isn't ours
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write(QByteArray(64, 'x'));
+    }
+    QVERIFY(!ConfigJournal(path).load(digest));
+}
+
+void TestConfigJournal::testStaleDigest() {
+    const QString path = m_home.filePath("stale.journal");
+    const QVector<UdevRule> base = rules(2);
+    QVector<UdevRule> edited = base;
+    edited.removeFirst();
+
+    ConfigJournal journal(path);
+    QVERIFY(journal.load(ConfigJournal::snapshotDigest("old")));
+    QVERIFY(journal.append(base, SyncInfo(), edited, SyncInfo()));
+
+    // Written against another snapshot: nothing applies
+    QVector<UdevRule> replayed = base;
+    ConfigJournal reader(path);
+    QVERIFY(reader.load(ConfigJournal::snapshotDigest("new"), &replayed));
+    QCOMPARE(reader.recordCount(), 0);
+    QCOMPARE(replayed.size(), 2);
+
+    // and the first append replaces it
+    QVERIFY(reader.append(base, SyncInfo(), edited, SyncInfo()));
+    QCOMPARE(reader.recordCount(), 1);
+    QVERIFY(ConfigJournal(path).load(ConfigJournal::snapshotDigest("new"), &replayed));
+    QCOMPARE(replayed.size(), 1);
+
+    QVERIFY(reader.reset(ConfigJournal::snapshotDigest("newer")));
+    QVERIFY(!QFile::exists(path));
+    QCOMPARE(reader.recordCount(), 0);
+}
+
+void TestConfigJournal::testCompaction() {
+    const QString path = m_home.filePath("compact.journal");
+    ConfigJournal journal(path);
+    QVERIFY(journal.load(ConfigJournal::snapshotDigest("snapshot")));
+
+    QVector<UdevRule> current = rules(1);
+    int appends = 0;
+    while (!journal.needsCompaction(current.size())) {
+        QVector<UdevRule> next = current;
+        next[0].enabled = !next[0].enabled;
+        QVERIFY(journal.append(current, SyncInfo(), next, SyncInfo()));
+        current = next;
+        QVERIFY(++appends < 1000);
+    }
+    QVERIFY(journal.recordCount() > current.size());
+}
+
+void TestConfigJournal::testSessionAppends() {
+    const QVector<UdevRule> saved = rules(3);
+    {
+        ConfigSession session;
+        session.save(saved, SyncInfo());
+    }
+    const QByteArray snapshotBytes = [] {
+        QFile file(ConfigStore::getConfigPath());
+        return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    }();
+    QVERIFY(!snapshotBytes.isEmpty());
+    QVERIFY(!QFile::exists(ConfigStore::getJournalPath()));
+
+    // Edits after a load go to the journal; the snapshot stays as it was
+    QVector<UdevRule> edited = saved;
+    {
+        ConfigSession session;
+        QVERIFY(session.load().success);
+        edited[1].enabled = false;
+        edited.removeLast();
+        session.setRules(edited);
+        QVERIFY(session.flush());
+        QVERIFY(QFile::exists(ConfigStore::getJournalPath()));
+    }
+    QFile file(ConfigStore::getConfigPath());
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), snapshotBytes);
+    file.close();
+
+    // Loading replays them
+    ConfigSession session;
+    ConfigStore::LoadResult result = session.load();
+    QVERIFY2(result.success, qPrintable(result.error));
+    QCOMPARE(encoded(result.rules), encoded(edited));
+    QVERIFY(!session.isDirty());
+
+    // Once the journal outgrows the rules it's folded into a new snapshot
+    for (int i = 0; i < 200 && QFile::exists(ConfigStore::getJournalPath()); ++i) {
+        edited[0].enabled = !edited[0].enabled;
+        session.setRules(edited);
+        QVERIFY(session.flush());
+    }
+    QVERIFY(!QFile::exists(ConfigStore::getJournalPath()));
+
+    result = ConfigSession().load();
+    QVERIFY(result.success);
+    QCOMPARE(encoded(result.rules), encoded(edited));
+}
+
+QTEST_GUILESS_MAIN(TestConfigJournal)
+#include "test_configjournal.moc"
@@ -0,0 +1,249 @@
+#include <QtTest/QtTest>
+#include "ConfigSession.h"
+#include "ConfigStore.h"
+#include "FileHash.h"
+#include "Types.h"
+#include "TestHelpers.h"
+
+using namespace udevme;
+
+class TestConfigSession : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void testWriteBehind();
+    void testIdenticalBytesSkipped();
+    void testIdleReloadWritesNothing();
+    void testDestructorFlushes();
+    void testFileStamp();
+    void testStampsAfterApply();
+    void testFormatSwitch();
+
+private:
+    static QVector<UdevRule> rules();
+
+    // HOME for the config files, and the root for /etc/udev
+    QTemporaryDir m_home;
+};
+
+void TestConfigSession::initTestCase() {
+    test::isolateConfig(m_home);
+    QCOMPARE(ConfigStore::getInstallDir(), m_home.path() + "/.local/bin/udevme");
+}
+
+void TestConfigSession::init() {
+    test::removeConfigFiles();
+}
+
+QVector<UdevRule> TestConfigSession::rules() {
+    QVector<UdevRule> rules;
+    for (int i = 0; i < 3; ++i) {
+        UdevRule rule;
+        DeviceInfo dev;
+        dev.vendorId = "1234";
+        dev.productId = QString("000%1").arg(i);
+        dev.name = "Keyboard";
+        dev.manufacturer = "Acme";
+        rule.devices.append(dev);
+        rule.notes = i == 1 ? "desk" : QString();
+        rules.append(rule);
+    }
+    return rules;
+}
+
+void TestConfigSession::testWriteBehind() {
+    ConfigSession session;
+    session.setFlushDelay(20);
+
+    // A burst of changes is one write per file, after the burst
+    const QVector<UdevRule> saved = rules();
+    SyncInfo info;
+    for (int i = 0; i < 5; ++i) {
+        info.rulesFileHashAtLoad = QString::number(i);
+        session.save(saved, info);
+    }
+    QVERIFY(session.isDirty());
+    QCOMPARE(session.writeCount(), 0);
+    QVERIFY(!QFile::exists(ConfigStore::getConfigPath()));
+
+    QTRY_VERIFY(!session.isDirty());
+    QCOMPARE(session.writeCount(), 2);
+    QVERIFY(QFile::exists(ConfigStore::getConfigPath()));
+    QVERIFY(QFile::exists(ConfigStore::getNotesPath()));
+}
+
+void TestConfigSession::testIdenticalBytesSkipped() {
+    const QVector<UdevRule> saved = rules();
+    SyncInfo info;
+    info.rulesFileHashAtLoad = "abc";
+
+    ConfigSession session;
+    session.save(saved, info);
+    QVERIFY(session.flush());
+    QCOMPARE(session.writeCount(), 2);
+
+    // Same content: nothing written
+    session.save(saved, info);
+    QVERIFY(session.isDirty());
+    QVERIFY(session.flush());
+    QCOMPARE(session.writeCount(), 2);
+
+    // A note lives in notes.json only; the config bytes don't change
+    QVector<UdevRule> edited = saved;
+    edited[0].notes = "shelf";
+    session.setRules(edited);
+    QVERIFY(session.flush());
+    QCOMPARE(session.writeCount(), 3);
+
+    session.setSyncInfo(info);
+    QVERIFY(session.flush());
+    QCOMPARE(session.writeCount(), 3);
+}
+
+void TestConfigSession::testIdleReloadWritesNothing() {
+    const QVector<UdevRule> saved = rules();
+    {
+        ConfigSession session;
+        session.save(saved, SyncInfo());
+    }
+    const QFileInfo before(ConfigStore::getConfigPath());
+    QVERIFY(before.exists());
+
+    ConfigSession session;
+    const ConfigStore::LoadResult result = session.load();
+    QVERIFY(result.success);
+    QVERIFY(!result.loadedFromSystem);
+    QCOMPARE(session.rules().size(), saved.size());
+    QCOMPARE(session.rules()[1].notes, QString("desk"));
+    QCOMPARE(session.rules()[0].id, saved[0].id);
+    QVERIFY(!session.isDirty());
+
+    // Saving back what was loaded is still no write
+    session.save(session.rules(), session.syncInfo());
+    QVERIFY(session.flush());
+    QCOMPARE(session.writeCount(), 0);
+    QCOMPARE(QFileInfo(ConfigStore::getConfigPath()).lastModified(), before.lastModified());
+}
+
+void TestConfigSession::testDestructorFlushes() {
+    {
+        ConfigSession session;
+        session.save(rules(), SyncInfo());
+        QVERIFY(session.isDirty());
+    }
+    QFile file(ConfigStore::getConfigPath());
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    QCOMPARE(root["rules"].toArray().size(), 3);
+}
+
+void TestConfigSession::testFileStamp() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("99-udevme.rules");
+    QVERIFY(ConfigStore::fileStamp(path).isEmpty());
+    const QDateTime past = QDateTime::currentDateTime().addSecs(-60).addMSecs(-123);
+
+    // Just written: not trusted until it's old enough to be told apart
+    QVERIFY(ConfigStore::writeFileIfChanged(path, "SUBSYSTEM==\"usb\"\n"));
+    QVERIFY(ConfigStore::fileStamp(path).isEmpty());
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.setFileTime(past, QFileDevice::FileModificationTime));
+    }
+    const QString stamp = ConfigStore::fileStamp(path);
+    QVERIFY(!stamp.isEmpty());
+    QCOMPARE(ConfigStore::fileStamp(path), stamp);
+
+    // Same bytes: the file isn't touched, so the stamp holds
+    QVERIFY(ConfigStore::writeFileIfChanged(path, "SUBSYSTEM==\"usb\"\n"));
+    QCOMPARE(ConfigStore::fileStamp(path), stamp);
+
+    // Edited in place, same size, mtime put back as cp -p would: the
+    // change time still tells
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.write("SUBSYSTEM==\"hid\"\n") > 0);
+        QVERIFY(file.flush());
+        QVERIFY(file.setFileTime(past, QFileDevice::FileModificationTime));
+    }
+    QVERIFY(!ConfigStore::fileStamp(path).isEmpty());
+    QVERIFY(ConfigStore::fileStamp(path) != stamp);
+
+    // Stamps survive the config round trip
+    SyncInfo info;
+    info.fileStamps = ConfigStore::computeFileStamps({ path });
+    QCOMPARE(SyncInfo::fromJson(info.toJson()).fileStamps, info.fileStamps);
+}
+
+void TestConfigSession::testStampsAfterApply() {
+    QTemporaryDir dir;
+    const QString kept = dir.filePath("99-udevme.rules");
+    const QString edited = dir.filePath("99-udevme.hwdb");
+    QVERIFY(ConfigStore::writeFileIfChanged(kept, "SUBSYSTEM==\"usb\"\n"));
+    QVERIFY(ConfigStore::writeFileIfChanged(edited, "usb:v1234p0001*\n"));
+
+    // As an Apply records them: hashed, but too recent to stamp
+    SyncInfo info;
+    info.fileHashes.insert(kept, FileHash::sha256(kept));
+    info.fileHashes.insert(edited, FileHash::sha256(edited));
+    info.fileStamps = ConfigStore::computeFileStamps(info.fileHashes.keys());
+    QVERIFY(info.fileStamps.value(kept).isEmpty());
+
+    ConfigSession session;
+    session.setStampDelay(20);
+    session.save(rules(), info);
+    session.stampFilesLater();
+
+    // Both age past the window; one no longer holds the bytes it was hashed with
+    QVERIFY(ConfigStore::writeFileIfChanged(edited, "usb:v1234p0002*\n"));
+    const QDateTime past = QDateTime::currentDateTime().addSecs(-60);
+    for (const QString& path : { kept, edited }) {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.setFileTime(past, QFileDevice::FileModificationTime));
+    }
+
+    QTRY_VERIFY(!session.syncInfo().fileStamps.value(kept).isEmpty());
+    QCOMPARE(session.syncInfo().fileStamps.value(kept), ConfigStore::fileStamp(kept));
+    QVERIFY(session.syncInfo().fileStamps.value(edited).isEmpty());
+    QCOMPARE(session.syncInfo().fileHashes, info.fileHashes);
+    QVERIFY(session.isDirty());
+}
+
+void TestConfigSession::testFormatSwitch() {
+    const QVector<UdevRule> saved = rules();
+    ConfigSession session;
+    session.save(saved, SyncInfo());
+    QVERIFY(session.flush());
+
+    // Converting writes udevme.cbor and drops udevme.json
+    session.setFormat(ConfigFormat::Cbor);
+    QVERIFY(session.isDirty());
+    QVERIFY(session.flush());
+    QVERIFY(QFile::exists(ConfigStore::getBinaryConfigPath()));
+    QVERIFY(!QFile::exists(ConfigStore::getConfigPath()));
+
+    ConfigSession binary;
+    binary.setFormat(ConfigFormat::Cbor);
+    const ConfigStore::LoadResult result = binary.load();
+    QVERIFY2(result.success, qPrintable(result.error));
+    QCOMPARE(result.rules.size(), saved.size());
+    QCOMPARE(result.rules[2].id, saved[2].id);
+    QCOMPARE(result.rules[1].notes, QString("desk"));
+    QVERIFY(!binary.isDirty());
+
+    // A session still on JSON converts back on load
+    ConfigSession json;
+    QVERIFY(json.load().success);
+    QVERIFY(json.isDirty());
+    QVERIFY(json.flush());
+    QVERIFY(QFile::exists(ConfigStore::getConfigPath()));
+    QVERIFY(!QFile::exists(ConfigStore::getBinaryConfigPath()));
+}
+
+QTEST_GUILESS_MAIN(TestConfigSession)
+#include "test_configsession.moc"
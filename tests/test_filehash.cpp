@@ -0,0 +1,107 @@
+#include <QtTest/QtTest>
+#include "FileHash.h"
+
+using namespace udevme;
+
+class TestFileHash : public QObject {
+    Q_OBJECT
+
+private slots:
+    void init();
+    void testSha256();
+    void testMemoized();
+    void testChangedContent();
+    void testSameContentNewStat();
+    void testRecentFilesNotRemembered();
+
+private:
+    // Writes the file and backdates it past the racy window
+    static void write(const QString& path, const QByteArray& content, int ageSecs = 60);
+    static QString sha256Of(const QByteArray& content);
+
+    QTemporaryDir m_dir;
+};
+
+void TestFileHash::init() {
+    QVERIFY(m_dir.isValid());
+    FileHash::clear();
+}
+
+void TestFileHash::write(const QString& path, const QByteArray& content, int ageSecs) {
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QCOMPARE(file.write(content), content.size());
+    QVERIFY(file.setFileTime(QDateTime::currentDateTime().addSecs(-ageSecs), QFileDevice::FileModificationTime));
+}
+
+QString TestFileHash::sha256Of(const QByteArray& content) {
+    return QString::fromLatin1(QCryptographicHash::hash(content, QCryptographicHash::Sha256).toHex());
+}
+
+void TestFileHash::testSha256() {
+    const QString path = m_dir.filePath("sha.rules");
+    const QByteArray content = "# udevme\nSUBSYSTEM==\"hidraw\", MODE=\"0660\"\n";
+    write(path, content);
+    QCOMPARE(FileHash::sha256(path), sha256Of(content));
+
+    write(path, QByteArray());
+    QCOMPARE(FileHash::sha256(path), sha256Of(QByteArray()));
+
+    QVERIFY(FileHash::sha256(m_dir.filePath("missing.rules")).isEmpty());
+}
+
+void TestFileHash::testMemoized() {
+    const QString path = m_dir.filePath("memo.rules");
+    write(path, "SUBSYSTEM==\"usb\"\n");
+
+    const int reads = FileHash::readCount();
+    const QString hash = FileHash::sha256(path);
+    QCOMPARE(FileHash::readCount(), reads + 1);
+
+    // Unchanged stat: not read again
+    for (int i = 0; i < 3; ++i) QCOMPARE(FileHash::sha256(path), hash);
+    QCOMPARE(FileHash::readCount(), reads + 1);
+
+    FileHash::clear();
+    QCOMPARE(FileHash::sha256(path), hash);
+    QCOMPARE(FileHash::readCount(), reads + 2);
+}
+
+void TestFileHash::testChangedContent() {
+    const QString path = m_dir.filePath("changed.rules");
+    write(path, "SUBSYSTEM==\"usb\"\n");
+    const QString before = FileHash::sha256(path);
+
+    // Same size, same age: the change time still moves
+    write(path, "SUBSYSTEM==\"hid\"\n");
+    QCOMPARE(FileHash::sha256(path), sha256Of("SUBSYSTEM==\"hid\"\n"));
+    QVERIFY(FileHash::sha256(path) != before);
+}
+
+void TestFileHash::testSameContentNewStat() {
+    const QString path = m_dir.filePath("touched.rules");
+    const QByteArray content = "KERNEL==\"hidraw*\", TAG+=\"uaccess\"\n";
+    write(path, content);
+    const QString hash = FileHash::sha256(path);
+
+    // Rewritten with the same bytes: a new stat is hashed again
+    write(path, content, 30);
+    const int reads = FileHash::readCount();
+    QCOMPARE(FileHash::sha256(path), hash);
+    QCOMPARE(FileHash::readCount(), reads + 1);
+    QCOMPARE(FileHash::sha256(path), hash);
+    QCOMPARE(FileHash::readCount(), reads + 1);
+}
+
+void TestFileHash::testRecentFilesNotRemembered() {
+    const QString path = m_dir.filePath("fresh.rules");
+    write(path, "SUBSYSTEM==\"usb\"\n", 0);
+
+    const int reads = FileHash::readCount();
+    FileHash::sha256(path);
+    FileHash::sha256(path);
+    QCOMPARE(FileHash::readCount(), reads + 2);
+}
+
+QTEST_GUILESS_MAIN(TestFileHash)
+#include "test_filehash.moc"
@@ -0,0 +1,207 @@
+#include <QtTest/QtTest>
+#include "DeviceInventory.h"
+#include "Types.h"
+
+using namespace udevme;
+
+class TestInventory : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testRecordAndReload();
+    void testUnchangedDevicesNotRewritten();
+    void testKeepsNamesFromStringlessScans();
+    void testTornRecordDropped();
+    void testForeignFileSetAside();
+    void testCompaction();
+    void testSeenSince();
+
+private:
+    static DeviceInfo device(const QString& vid, const QString& pid, const QString& name,
+                             const QString& bus = QString());
+};
+
+DeviceInfo TestInventory::device(const QString& vid, const QString& pid, const QString& name,
+                                 const QString& bus) {
+    DeviceInfo dev;
+    dev.vendorId = vid;
+    dev.productId = pid;
+    dev.name = name;
+    dev.manufacturer = "Acme";
+    dev.bus = bus;
+    dev.hasUsb = bus.isEmpty();
+    dev.hasHidraw = true;
+    dev.sysPath = "/sys/bus/usb/devices/1-1";
+    return dev;
+}
+
+void TestInventory::testRecordAndReload() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("devices.inv");
+    const QDateTime seen = QDateTime::fromSecsSinceEpoch(1700000000, Qt::UTC);
+
+    DeviceInventory inventory(path);
+    QVERIFY(inventory.load());
+    QCOMPARE(inventory.size(), 0);
+    QVERIFY(inventory.record({ device("1234", "5678", "Keyboard"),
+                               device("1234", "5678", "BT Keyboard", "bluetooth") }, seen));
+
+    DeviceInventory reloaded(path);
+    QVERIFY(reloaded.load());
+    QCOMPARE(reloaded.size(), 2);
+
+    // Same vid:pid on another bus is a separate device
+    const DeviceInventory::Entry* usb = reloaded.find(device("1234", "5678", QString()));
+    const DeviceInventory::Entry* bt = reloaded.find(device("1234", "5678", QString(), "bluetooth"));
+    QVERIFY(usb);
+    QVERIFY(bt);
+    QCOMPARE(usb->device.name, QString("Keyboard"));
+    QCOMPARE(usb->device.manufacturer, QString("Acme"));
+    QVERIFY(usb->device.hasUsb);
+    QVERIFY(usb->device.hasHidraw);
+    QVERIFY(usb->device.sysPath.isEmpty());
+    QCOMPARE(usb->lastSeen, seen);
+    QCOMPARE(bt->device.name, QString("BT Keyboard"));
+    QCOMPARE(bt->device.bus, QString("bluetooth"));
+
+    QVERIFY(!reloaded.find(device("dead", "beef", QString())));
+}
+
+void TestInventory::testUnchangedDevicesNotRewritten() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("devices.inv");
+    const QDateTime seen = QDateTime::fromSecsSinceEpoch(1700000000, Qt::UTC);
+
+    DeviceInventory inventory(path);
+    QVERIFY(inventory.load());
+    QVERIFY(inventory.record({ device("1234", "5678", "Keyboard") }, seen));
+    const qint64 size = QFileInfo(path).size();
+
+    // Seen again shortly after: nothing to append
+    QVERIFY(inventory.record({ device("1234", "5678", "Keyboard") }, seen.addSecs(60)));
+    QCOMPARE(QFileInfo(path).size(), size);
+    QCOMPARE(inventory.recordCount(), 1);
+
+    // Renamed, or seen again much later: one new record each
+    QVERIFY(inventory.record({ device("1234", "5678", "Keyboard v2") }, seen.addSecs(120)));
+    QVERIFY(inventory.record({ device("1234", "5678", "Keyboard v2") }, seen.addDays(2)));
+    QCOMPARE(inventory.recordCount(), 3);
+
+    DeviceInventory reloaded(path);
+    QVERIFY(reloaded.load());
+    QCOMPARE(reloaded.recordCount(), 3);
+    QCOMPARE(reloaded.find(device("1234", "5678", QString()))->device.name, QString("Keyboard v2"));
+    QCOMPARE(reloaded.find(device("1234", "5678", QString()))->lastSeen, seen.addDays(2));
+}
+
+void TestInventory::testKeepsNamesFromStringlessScans() {
+    QTemporaryDir dir;
+    DeviceInventory inventory(dir.filePath("devices.inv"));
+    QVERIFY(inventory.load());
+
+    const QDateTime seen = QDateTime::fromSecsSinceEpoch(1700000000, Qt::UTC);
+    QVERIFY(inventory.record({ device("1234", "5678", "Keyboard") }, seen));
+
+    DeviceInfo bare = device("1234", "5678", QString());
+    bare.manufacturer.clear();
+    QVERIFY(inventory.record({ bare }, seen.addDays(1)));
+
+    const DeviceInventory::Entry* entry = inventory.find(bare);
+    QVERIFY(entry);
+    QCOMPARE(entry->device.name, QString("Keyboard"));
+    QCOMPARE(entry->device.manufacturer, QString("Acme"));
+    QCOMPARE(entry->lastSeen, seen.addDays(1));
+}
+
+void TestInventory::testTornRecordDropped() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("devices.inv");
+    const QDateTime seen = QDateTime::fromSecsSinceEpoch(1700000000, Qt::UTC);
+
+    DeviceInventory inventory(path);
+    QVERIFY(inventory.load());
+    QVERIFY(inventory.record({ device("1234", "5678", "Keyboard") }, seen));
+    const qint64 goodSize = QFileInfo(path).size();
+    QVERIFY(inventory.record({ device("abcd", "ef01", "Mouse") }, seen));
+
+    // Simulate a crash halfway through the second append
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.resize(goodSize + 5));
+    file.close();
+
+    DeviceInventory reloaded(path);
+    QVERIFY(reloaded.load());
+    QCOMPARE(reloaded.size(), 1);
+    QCOMPARE(QFileInfo(path).size(), goodSize);
+
+    // Appends after recovery are readable again
+    QVERIFY(reloaded.record({ device("abcd", "ef01", "Mouse") }, seen));
+    DeviceInventory again(path);
+    QVERIFY(again.load());
+    QCOMPARE(again.size(), 2);
+}
+
+void TestInventory::testForeignFileSetAside() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("devices.inv");
+    const QDateTime seen = QDateTime::fromSecsSinceEpoch(1700000000, Qt::UTC);
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("UDMINV99 not a log we can read");
+    }
+
+    // Moved out of the way, so appends don't land after it
+    DeviceInventory inventory(path);
+    QVERIFY(inventory.load());
+    QCOMPARE(inventory.size(), 0);
+    QVERIFY(!QFile::exists(path));
+    QVERIFY(QFile::exists(path + ".bad"));
+
+    QVERIFY(inventory.record({ device("1234", "5678", "Keyboard") }, seen));
+    DeviceInventory reloaded(path);
+    QVERIFY(reloaded.load());
+    QCOMPARE(reloaded.size(), 1);
+}
+
+void TestInventory::testCompaction() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("devices.inv");
+    QDateTime seen = QDateTime::fromSecsSinceEpoch(1700000000, Qt::UTC);
+
+    DeviceInventory inventory(path);
+    QVERIFY(inventory.load());
+    for (int i = 0; i < 200; ++i) {
+        seen = seen.addDays(1);
+        QVERIFY(inventory.record({ device("1234", "5678", "Keyboard") }, seen));
+    }
+
+    // The log never grows far past the live set
+    QCOMPARE(inventory.size(), 1);
+    QVERIFY(inventory.recordCount() < 100);
+
+    DeviceInventory reloaded(path);
+    QVERIFY(reloaded.load());
+    QCOMPARE(reloaded.recordCount(), inventory.recordCount());
+    QCOMPARE(reloaded.find(device("1234", "5678", QString()))->lastSeen, seen);
+}
+
+void TestInventory::testSeenSince() {
+    QTemporaryDir dir;
+    DeviceInventory inventory(dir.filePath("devices.inv"));
+    QVERIFY(inventory.load());
+
+    const QDateTime base = QDateTime::fromSecsSinceEpoch(1700000000, Qt::UTC);
+    QVERIFY(inventory.record({ device("0001", "0001", "Old") }, base));
+    QVERIFY(inventory.record({ device("0002", "0002", "Newer") }, base.addDays(10)));
+    QVERIFY(inventory.record({ device("0003", "0003", "Newest") }, base.addDays(20)));
+
+    const auto recent = inventory.seenSince(base.addDays(5));
+    QCOMPARE(recent.size(), 2);
+    QCOMPARE(recent[0].device.name, QString("Newest"));
+    QCOMPARE(recent[1].device.name, QString("Newer"));
+}
+
+QTEST_GUILESS_MAIN(TestInventory)
+#include "test_inventory.moc"
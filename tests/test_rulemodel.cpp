@@ -0,0 +1,145 @@
+#include <QtTest/QtTest>
+#include "RuleModel.h"
+#include "Types.h"
+#include "TestHelpers.h"
+
+using namespace udevme;
+
+class TestRuleModel : public QObject {
+    Q_OBJECT
+
+private slots:
+    void init();
+    void testStatusFollowsDevices();
+    void testOnlyAffectedRowsUpdated();
+    void testHidrawMode();
+    void testIndexFollowsRuleEdits();
+
+private:
+    static UdevRule rule(std::initializer_list<const char*> vidPids);
+    static DeviceInfo device(const char* vidPid, const QStringList& nodes = QStringList());
+    static QString status(const RuleModel& model, int row);
+
+    QTemporaryDir m_dir;
+};
+
+void TestRuleModel::init() {
+    QVERIFY(m_dir.isValid());
+}
+
+UdevRule TestRuleModel::rule(std::initializer_list<const char*> vidPids) {
+    UdevRule r;
+    for (const char* vp : vidPids) {
+        r.devices.append(device(vp));
+    }
+    return r;
+}
+
+DeviceInfo TestRuleModel::device(const char* vidPid, const QStringList& nodes) {
+    DeviceInfo dev;
+    dev.vendorId = QString(vidPid).section(':', 0, 0);
+    dev.productId = QString(vidPid).section(':', 1, 1);
+    dev.hidrawNodes = nodes;
+    dev.hasHidraw = !nodes.isEmpty();
+    dev.hasUsb = true;
+    return dev;
+}
+
+QString TestRuleModel::status(const RuleModel& model, int row) {
+    return model.data(model.index(row, RuleModel::ColStatus)).toString();
+}
+
+
+void TestRuleModel::testStatusFollowsDevices() {
+    RuleModel model;
+    model.setRules({ rule({"1234:5678"}), rule({"1234:5678", "abcd:ef01"}) });
+    model.setConnectedDevices({});
+
+    QCOMPARE(status(model, 0), QString("Not connected"));
+    QCOMPARE(status(model, 1), QString("Not connected"));
+
+    model.updateDevices({ device("1234:5678") }, {});
+    QCOMPARE(status(model, 0), QString("Connected"));
+    QCOMPARE(status(model, 1), QString("1/2 connected"));
+
+    // Two of the same model plugged in; unplugging one keeps it connected
+    model.updateDevices({ device("1234:5678") }, {});
+    model.updateDevices({}, { device("1234:5678") });
+    QCOMPARE(status(model, 0), QString("Connected"));
+
+    model.updateDevices({}, { device("1234:5678") });
+    QCOMPARE(status(model, 0), QString("Not connected"));
+}
+
+void TestRuleModel::testOnlyAffectedRowsUpdated() {
+    RuleModel model;
+    QVector<UdevRule> rules;
+    for (int i = 0; i < 500; ++i) {
+        rules.append(rule({ qPrintable(QString("%1:0001").arg(i + 1, 4, 16, QLatin1Char('0'))) }));
+    }
+    rules[250].devices.append(device("beef:0002"));
+    model.setRules(rules);
+    model.setConnectedDevices({});
+
+    QSignalSpy spy(&model, &QAbstractItemModel::dataChanged);
+    model.updateDevices({ device("0010:0001"), device("beef:0002") }, {});
+
+    QCOMPARE(spy.count(), 2);
+    QSet<int> rows;
+    for (const auto& args : spy) {
+        QModelIndex from = args[0].toModelIndex();
+        QModelIndex to = args[1].toModelIndex();
+        QCOMPARE(from, to);
+        QCOMPARE(from.column(), int(RuleModel::ColStatus));
+        rows.insert(from.row());
+    }
+    QCOMPARE(rows, QSet<int>({ 15, 250 }));
+
+    // Devices no rule references don't touch the view at all
+    spy.clear();
+    model.updateDevices({ device("dead:0001") }, {});
+    QCOMPARE(spy.count(), 0);
+}
+
+void TestRuleModel::testHidrawMode() {
+    const QString open = m_dir.filePath("hidraw0");
+    const QString restricted = m_dir.filePath("hidraw1");
+    test::createNode(open, QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup |
+                           QFile::WriteGroup | QFile::ReadOther | QFile::WriteOther);
+    test::createNode(restricted, QFile::ReadOwner | QFile::WriteOwner);
+    if (QTest::currentTestFailed()) return;
+
+    RuleModel model;
+    model.setRules({ rule({"1234:5678"}) });
+    model.setConnectedDevices({ device("1234:5678", { open }) });
+    QCOMPARE(status(model, 0), QString("Connected, accessible"));
+    QVERIFY(!model.data(model.index(0, RuleModel::ColStatus), Qt::ForegroundRole).isValid());
+
+    // Node changed: reported as removed (old) + added (new)
+    model.updateDevices({ device("1234:5678", { restricted }) }, { device("1234:5678", { open }) });
+    QCOMPARE(status(model, 0), QString("Connected, hidraw 0600"));
+    QVERIFY(model.data(model.index(0, RuleModel::ColStatus), Qt::ForegroundRole).isValid());
+    QVERIFY(model.data(model.index(0, RuleModel::ColStatus), Qt::ToolTipRole).toString().contains(restricted));
+}
+
+void TestRuleModel::testIndexFollowsRuleEdits() {
+    RuleModel model;
+    model.setRules({ rule({"1111:0001"}), rule({"2222:0002"}) });
+    model.setConnectedDevices({});
+
+    model.removeRule(0);
+    model.addRule(rule({"3333:0003"}));
+    model.updateRule(0, rule({"4444:0004"}));
+
+    QSignalSpy spy(&model, &QAbstractItemModel::dataChanged);
+    model.updateDevices({ device("2222:0002"), device("3333:0003") }, {});
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy[0][0].toModelIndex().row(), 1);
+
+    model.updateDevices({ device("4444:0004") }, {});
+    QCOMPARE(status(model, 0), QString("Connected"));
+    QCOMPARE(status(model, 1), QString("Connected"));
+}
+
+QTEST_GUILESS_MAIN(TestRuleModel)
+#include "test_rulemodel.moc"
@@ -1,7 +1,10 @@
 #include <QtTest/QtTest>
 #include "RuleGenerator.h"
 #include "RuleParser.h"
+#include "RuleParserReference.h"
+#include "RuleTokenizer.h"
 #include "Types.h"
+#include "UdevRulesParser.h"
 
 using namespace udevme;
 
@@ -15,8 +18,181 @@ private slots:
     void testMetadataComment();
     void testPermissionLevelConversion();
     void testHashComputation();
+    void testNonUsbDeviceRoundTrip();
+    void testTokenizer();
+    void testMetadataPairsMatchRegex_data();
+    void testMetadataPairsMatchRegex();
+    void testParserMatchesReference_data();
+    void testParserMatchesReference();
+    void testStreamMatchesWholeFile_data();
+    void testStreamMatchesWholeFile();
+    void testStreamStopsEarly();
+    void testStreamMissingFile();
+    void testBlockChecksum();
+    void testEditedBlocks();
+    void testIncrementalReparse();
+    void testOptimizedOutput();
+    void testHwdbOutput();
+    void testRoundTripProperty_data();
+    void testRoundTripProperty();
+    void testPathologicalInputs_data();
+    void testPathologicalInputs();
+
+private:
+    QTemporaryDir m_dir;
+    QString writeFile(const QString& name, const QByteArray& data);
 };
 
+namespace {
+
+// A random rule of the kind the UI can produce: hex ids in either case, any
+// bus, any apps, level and set of types (none included), enabled or not
+UdevRule randomRule(QRandomGenerator& rng) {
+    static const char* const buses[] = { "", "", "", "bluetooth", "i2c", "virtual", "bus1f" };
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFXYZ0123456789.-_";
+    auto hexId = [&rng] {
+        QString id = QString("%1").arg(rng.bounded(0x10000), 4, 16, QLatin1Char('0'));
+        for (QChar& c : id) {
+            if (rng.bounded(2)) c = c.toUpper();
+        }
+        return id;
+    };
+    
+    UdevRule rule;
+    rule.id = QUuid(rng.generate(), quint16(rng.generate()), quint16(rng.generate()),
+                    uchar(rng.generate()), uchar(rng.generate()), uchar(rng.generate()), uchar(rng.generate()),
+                    uchar(rng.generate()), uchar(rng.generate()), uchar(rng.generate()), uchar(rng.generate()));
+    
+    // A USB device listed twice is the same device, so each appears once
+    QSet<QString> usbIds;
+    for (int i = 0, n = rng.bounded(7); i < n; ++i) {
+        DeviceInfo dev;
+        dev.vendorId = hexId();
+        dev.productId = hexId();
+        dev.bus = buses[rng.bounded(7)];
+        if (hidBusNumber(dev.bus) == HidBusUsb) {
+            const QString key = dev.vidPid().toLower();
+            if (usbIds.contains(key)) continue;
+            usbIds.insert(key);
+        }
+        rule.devices.append(dev);
+    }
+    for (int i = 0, n = rng.bounded(4); i < n; ++i) {
+        AppInfo app;
+        for (int j = 0, len = 1 + rng.bounded(20); j < len; ++j) {
+            app.desktopId += QChar(alphabet[rng.bounded(int(sizeof(alphabet)) - 1)]);
+        }
+        app.desktopId += ".desktop";
+        rule.applications.append(app);
+    }
+    rule.permissionLevel = PermissionLevel(rng.bounded(3));
+    rule.ruleTypes.hidraw = rng.bounded(2);
+    rule.ruleTypes.usb = rng.bounded(2);
+    rule.ruleTypes.uaccess = rng.bounded(2);
+    rule.ruleTypes.seat = rng.bounded(2);
+    rule.enabled = rng.bounded(5) != 0;
+    return rule;
+}
+
+// The file that holds the rule blocks for the output
+QString generateBlocks(const QVector<UdevRule>& rules, RuleOutput output) {
+    return output == RuleOutput::Hwdb ? RuleGenerator::generateHwdbFile(rules)
+                                      : RuleGenerator::generateRulesFile(rules, output);
+}
+
+// Empty if generating the rules and parsing them back gives every enabled
+// rule with devices, field for field, and generates the same file again
+QString roundTripFailure(const QVector<UdevRule>& rules, RuleOutput output) {
+    const QString generated = generateBlocks(rules, output);
+    const RuleParser::ParseResult parsed = RuleParser::parseRulesFile(generated);
+    if (!parsed.warnings.isEmpty()) return "warning: " + parsed.warnings.first();
+    
+    QVector<UdevRule> expected;
+    for (const UdevRule& rule : rules) {
+        if (rule.enabled && !rule.devices.isEmpty()) expected.append(rule);
+    }
+    if (parsed.rules.size() != expected.size()) {
+        return QString("%1 rules, expected %2").arg(parsed.rules.size()).arg(expected.size());
+    }
+    
+    for (int i = 0; i < expected.size(); ++i) {
+        const UdevRule& x = parsed.rules[i];
+        const UdevRule& y = expected[i];
+        const QString where = QString("rule %1: ").arg(i);
+        if (x.id != y.id) return where + "id";
+        if (x.permissionLevel != y.permissionLevel) return where + "level";
+        if (!x.enabled) return where + "enabled";
+        if (x.ruleTypes.hidraw != y.ruleTypes.hidraw || x.ruleTypes.usb != y.ruleTypes.usb ||
+            x.ruleTypes.uaccess != y.ruleTypes.uaccess || x.ruleTypes.seat != y.ruleTypes.seat) {
+            return where + "types";
+        }
+        if (x.devices.size() != y.devices.size()) {
+            return where + QString("%1 devices, expected %2").arg(x.devices.size()).arg(y.devices.size());
+        }
+        for (int d = 0; d < x.devices.size(); ++d) {
+            const DeviceInfo& p = x.devices[d];
+            const DeviceInfo& q = y.devices[d];
+            // Compatible output only has an ATTRS line to find hidraw in for
+            // USB devices; the others name every device's hidraw
+            const bool hidraw = output != RuleOutput::Compatible || hidBusNumber(q.bus) == HidBusUsb;
+            if (p.vendorId != q.vendorId || p.productId != q.productId || p.bus != q.bus ||
+                p.hasHidraw != hidraw || p.hasUsb) {
+                return where + QString("device %1 (%2@%3)").arg(d).arg(q.vidPid(), q.bus);
+            }
+        }
+        if (x.applications.size() != y.applications.size()) return where + "app count";
+        for (int a = 0; a < x.applications.size(); ++a) {
+            if (x.applications[a].desktopId != y.applications[a].desktopId) {
+                return where + QString("app %1").arg(a);
+            }
+        }
+    }
+    
+    if (generateBlocks(parsed.rules, output) != generated) return "regenerated file differs";
+    return QString();
+}
+
+// Drops rules, devices and apps from a failing set for as long as it
+// keeps failing, so a report shows only what matters
+QVector<UdevRule> shrinkRoundTrip(QVector<UdevRule> rules, RuleOutput output) {
+    auto keepIfFailing = [&rules, output](const QVector<UdevRule>& candidate) {
+        if (roundTripFailure(candidate, output).isEmpty()) return false;
+        rules = candidate;
+        return true;
+    };
+    
+    for (bool shrunk = true; shrunk;) {
+        shrunk = false;
+        for (qsizetype i = 0; i < rules.size() && !shrunk; ++i) {
+            QVector<UdevRule> candidate = rules;
+            candidate.removeAt(i);
+            shrunk = keepIfFailing(candidate);
+            for (qsizetype d = 0; d < rules[i].devices.size() && !shrunk; ++d) {
+                candidate = rules;
+                candidate[i].devices.removeAt(d);
+                shrunk = keepIfFailing(candidate);
+            }
+            for (qsizetype a = 0; a < rules[i].applications.size() && !shrunk; ++a) {
+                candidate = rules;
+                candidate[i].applications.removeAt(a);
+                shrunk = keepIfFailing(candidate);
+            }
+        }
+    }
+    return rules;
+}
+
+} // namespace
+
+QString TestRules::writeFile(const QString& name, const QByteArray& data) {
+    const QString path = m_dir.filePath(name);
+    QFile file(path);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(data);
+    }
+    return path;
+}
+
 void TestRules::testRuleGeneration() {
     UdevRule rule;
     rule.id = QUuid::fromString("12345678-1234-1234-1234-123456789abc");
@@ -179,5 +355,588 @@ void TestRules::testHashComputation() {
     QCOMPARE(hash1.length(), 64); // SHA256 hex = 64 chars
 }
 
+void TestRules::testNonUsbDeviceRoundTrip() {
+    UdevRule rule;
+    rule.id = QUuid::fromString("0badc0de-0000-4000-8000-000000000001");
+    
+    DeviceInfo usb;
+    usb.vendorId = "046d";
+    usb.productId = "c52b";
+    rule.devices.append(usb);
+    
+    DeviceInfo bt;
+    bt.vendorId = "046d";
+    bt.productId = "b01a";
+    bt.bus = "bluetooth";
+    rule.devices.append(bt);
+    
+    QString generated = RuleGenerator::generateRulesFile({rule});
+    
+    QVERIFY(generated.contains("devices=046d:c52b,046d:b01a@bluetooth"));
+    QVERIFY(generated.contains("ATTRS{idVendor}==\"046d\", ATTRS{idProduct}==\"c52b\""));
+    QVERIFY(generated.contains("KERNELS==\"0005:046D:B01A.*\""));
+    
+    auto parseResult = RuleParser::parseRulesFile(generated);
+    QCOMPARE(parseResult.rules.size(), 1);
+    QCOMPARE(parseResult.rules[0].devices.size(), 2);
+    QCOMPARE(parseResult.rules[0].devices[0].bus, QString());
+    QCOMPARE(parseResult.rules[0].devices[1].bus, QString("bluetooth"));
+    
+    QCOMPARE(RuleGenerator::generateRulesFile(parseResult.rules), generated);
+
+    // The same vid:pid on the other bus isn't part of the rule
+    DeviceInfo btKeyboard = usb;
+    btKeyboard.bus = "bluetooth";
+    DeviceInfo usbMouse = bt;
+    usbMouse.bus.clear();
+    usbMouse.vendorId = "046D";
+    const UdevRule& parsed = parseResult.rules[0];
+    QVERIFY(parsed.hasDevice(usb));
+    QVERIFY(parsed.hasDevice(bt));
+    QVERIFY(!parsed.hasDevice(btKeyboard));
+    QVERIFY(!parsed.hasDevice(usbMouse));
+    DeviceInfo upper = usb;
+    upper.productId = "C52B";
+    QVERIFY(parsed.hasDevice(upper));
+    QCOMPARE(bt.busKey(), QString("046d:b01a@bluetooth"));
+}
+
+void TestRules::testTokenizer() {
+    const QString text = "  KERNEL==\"hidraw*\", SUBSYSTEM==\"hidraw\",ATTRS{idVendor}==\"046d\" MODE:=\"0666\", TAG+=\"\"";
+    RuleTokenizer tokenizer(text);
+    RuleTokenizer::Token token;
+    
+    QVERIFY(tokenizer.next(token));
+    QCOMPARE(token.key.toString(), QString("KERNEL"));
+    QVERIFY(token.attr.isEmpty());
+    QCOMPARE(token.op.toString(), QString("=="));
+    QCOMPARE(token.value.toString(), QString("hidraw*"));
+    
+    QVERIFY(tokenizer.next(token));
+    QCOMPARE(token.key.toString(), QString("SUBSYSTEM"));
+    QVERIFY(tokenizer.next(token));
+    QCOMPARE(token.key.toString(), QString("ATTRS"));
+    QCOMPARE(token.attr.toString(), QString("idVendor"));
+    QCOMPARE(token.value.toString(), QString("046d"));
+    QVERIFY(tokenizer.next(token));
+    QCOMPARE(token.op.toString(), QString(":="));
+    QVERIFY(tokenizer.next(token));
+    QCOMPARE(token.op.toString(), QString("+="));
+    QVERIFY(token.value.isEmpty());
+    
+    QVERIFY(!tokenizer.next(token));
+    QVERIFY(!tokenizer.hasError());
+    
+    // Tokens point into the caller's buffer
+    QVERIFY(token.value.data() >= text.constData() && token.value.data() <= text.constData() + text.size());
+    
+    RuleTokenizer broken(u"ATTRS{idVendor==\"046d\"");
+    QVERIFY(!broken.next(token));
+    QVERIFY(broken.hasError());
+    
+    // Lines come out like split('\n') + trimmed(), trailing empty one included
+    const QString content = "a\r\n\n  b  \n";
+    QStringList lines;
+    qsizetype pos = 0;
+    QStringView line;
+    while (RuleTokenizer::nextLine(content, pos, line)) {
+        lines << line.toString();
+    }
+    QCOMPARE(lines, QStringList({ "a", "", "b", "" }));
+}
+
+void TestRules::testMetadataPairsMatchRegex_data() {
+    QTest::addColumn<QString>("body");
+    QTest::newRow("generated") << "id=deadbeef-dead-beef-dead-beefdeadbeef devices=cafe:babe apps=all level=Safe types=hidraw,uaccess enabled=true";
+    QTest::newRow("quoted") << "apps=\"a b\" level=\"Open\"";
+    QTest::newRow("lone-quote") << "apps=\" level=Open";
+    QTest::newRow("no-value") << "id= devices=1:2";
+    QTest::newRow("double-equals") << "a==b c=d=e";
+    QTest::newRow("punctuation-key") << "x-y=z ab.cd=ef";
+    QTest::newRow("junk") << "=x == free text, k=v\tj=w";
+    QTest::newRow("unicode") << "n\u00e4me=v key=\u00fcber";
+    QTest::newRow("empty") << "";
+}
+
+void TestRules::testMetadataPairsMatchRegex() {
+    QFETCH(QString, body);
+    
+    QStringList expected;
+    QRegularExpression kvRe("(\\w+)=([^\\s]+|\"[^\"]*\")");
+    for (auto it = kvRe.globalMatch(body); it.hasNext(); ) {
+        QRegularExpressionMatch match = it.next();
+        expected << match.captured(1) + '|' + match.captured(2);
+    }
+    
+    QStringList actual;
+    RuleTokenizer tokenizer(body);
+    QStringView key;
+    QStringView value;
+    while (tokenizer.nextPair(key, value)) {
+        actual << key.toString() + '|' + value.toString();
+    }
+    
+    QCOMPARE(actual, expected);
+}
+
+void TestRules::testParserMatchesReference_data() {
+    QTest::addColumn<QString>("content");
+    
+    QTest::newRow("generated-1000") << reference::generateRulesCorpus(1000);
+    QTest::newRow("hand-edited") << QString(
+        "# header\r\n"
+        "   # udevme: id=11111111-2222-3333-4444-555555555555 devices=1111:2222,3333:4444@bluetooth apps=x.desktop level=Open types=usb enabled=TRUE\r\n"
+        "SUBSYSTEM==\"usb\", ATTRS{idVendor}==\"1111\", ATTRS{idProduct}==\"2222\", MODE=\"0666\"\r\n"
+        "KERNEL==\"hidraw*\", ATTR{idVendor}==\"1111\", ATTR{idProduct}==\"2222\"\n"
+        "KERNEL==\"hidraw*\", ATTRS{idVendor}==\"9999\", ATTRS{idProduct}==\"8888\"\n"
+        "\n"
+        "# udevme: devices=aaaa:bbbb:cccc,dddd:eeee apps=\"all\" level=Balanced types=seat enabled=no\n"
+        "ATTRS{idVendor}==\"zz\", ATTRS{idVendor}==\"dddd\", ATTRS{idProduct}==\"eeee\"\n"
+        "# udevme: id=not-a-uuid devices= apps=\"\n"
+        "ATTRS{idVendor}==\"0001\", ATTRS{idProduct}==\"0002\"\n"
+        "# udevme: level=Open\n"
+        "# udevme: devices=ABCD:EF01 types=\n"
+        "\tKERNEL==\"hidraw*\", ATTRS{idVendor}==\"ABCD\", ATTRS{idProduct}==\"EF01\"   \n"
+        "ATTRS{idVendor}==\"abcd\"\n");
+    QTest::newRow("rules-before-metadata") << QString(
+        "ATTRS{idVendor}==\"1111\", ATTRS{idProduct}==\"2222\"\n"
+        "# udevme: devices=1111:2222\n");
+    QTest::newRow("empty") << QString();
+}
+
+void TestRules::testParserMatchesReference() {
+    QFETCH(QString, content);
+    
+    const RuleParser::ParseResult expected = reference::parseRulesFile(content);
+    const RuleParser::ParseResult actual = RuleParser::parseRulesFile(content);
+    const QString difference = reference::describeDifference(actual, expected, content);
+    QVERIFY2(difference.isEmpty(), qPrintable(difference));
+}
+
+void TestRules::testStreamMatchesWholeFile_data() {
+    QTest::addColumn<QByteArray>("data");
+    
+    const QByteArray corpus = reference::generateRulesCorpus(3000).toUtf8();
+    QVERIFY(corpus.size() > 4 * RuleParser::StreamChunkSize);
+    QTest::newRow("generated") << corpus;
+    QTest::newRow("crlf") << QByteArray(corpus).replace("\n", "\r\n");
+    QTest::newRow("no-trailing-newline") << corpus.chopped(1);
+    
+    // Multi-byte characters on every possible chunk offset
+    QByteArray utf8;
+    for (int i = 0; utf8.size() < 3 * RuleParser::StreamChunkSize; ++i) {
+        utf8 += "# udevme: devices=1111:2222 apps=" + QByteArray(i % 7, 'x') +
+                "\xc3\xbc\xe2\x82\xac.desktop\nATTRS{idVendor}==\"1111\", ATTRS{idProduct}==\"2222\"\n";
+    }
+    QTest::newRow("utf8") << utf8;
+    
+    // One line far longer than a chunk
+    QTest::newRow("long-line") << "# udevme: devices=1111:2222 apps=" +
+        QByteArray(3 * RuleParser::StreamChunkSize, 'a') + "\n" + corpus;
+    QTest::newRow("empty") << QByteArray();
+}
+
+void TestRules::testStreamMatchesWholeFile() {
+    QFETCH(QByteArray, data);
+    QVERIFY(m_dir.isValid());
+    const QString path = writeFile("stream.rules", data);
+    
+    // Lines are trimmed, so CRLF parses like LF
+    const QString content = QString::fromUtf8(QByteArray(data).replace('\r', QByteArray()));
+    const RuleParser::ParseResult expected = RuleParser::parseRulesFile(content);
+    
+    RuleParser::ParseResult actual;
+    actual.success = true;
+    const RuleParser::StreamResult stream = RuleParser::parseRulesStream(path, [&actual](UdevRule&& rule) {
+        actual.rules.append(std::move(rule));
+        return true;
+    });
+    
+    QVERIFY(stream.success);
+    QCOMPARE(stream.ruleCount, expected.rules.size());
+    const QString difference = reference::describeDifference(actual, expected, content);
+    QVERIFY2(difference.isEmpty(), qPrintable(difference));
+    
+    // The file's bytes as they are, '\r' included, so the hash is the one
+    // FileHash gives for the same file
+    QCOMPARE(stream.hash, QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex()));
+    if (!data.contains('\r')) QCOMPARE(stream.hash, RuleParser::computeHash(content));
+    
+    // Bounded by the chunk size plus the longest line, not the file
+    qsizetype longestLine = 0;
+    for (const QByteArray& line : data.split('\n')) {
+        longestLine = qMax(longestLine, line.size());
+    }
+    QVERIFY(stream.peakBufferBytes <= RuleParser::StreamChunkSize + longestLine + 1);
+}
+
+void TestRules::testStreamStopsEarly() {
+    QVERIFY(m_dir.isValid());
+    const QByteArray corpus = reference::generateRulesCorpus(3000).toUtf8();
+    const QString path = writeFile("early.rules", corpus);
+    
+    int seen = 0;
+    const RuleParser::StreamResult stream = RuleParser::parseRulesStream(path, [&seen](UdevRule&&) {
+        return ++seen < 5;
+    });
+    QVERIFY(stream.success);
+    QCOMPARE(seen, 5);
+    QCOMPARE(stream.ruleCount, 5);
+    QVERIFY(stream.bytesRead < corpus.size());
+}
+
+void TestRules::testStreamMissingFile() {
+    QVERIFY(m_dir.isValid());
+    const QString path = m_dir.filePath("missing.rules");
+    
+    bool called = false;
+    const RuleParser::StreamResult stream = RuleParser::parseRulesStream(path, [&called](UdevRule&&) {
+        called = true;
+        return true;
+    });
+    QVERIFY(!stream.success);
+    QVERIFY(!called);
+    QCOMPARE(stream.warnings.size(), 1);
+    
+    const RuleParser::ParseResult result = RuleParser::parseRulesFromPath(path);
+    QVERIFY(!result.success);
+    QCOMPARE(result.warnings, stream.warnings);
+}
+
+void TestRules::testBlockChecksum() {
+    UdevRule rule;
+    rule.id = QUuid::fromString("12345678-1234-1234-1234-123456789abc");
+    DeviceInfo dev;
+    dev.vendorId = "1234";
+    dev.productId = "5678";
+    rule.devices.append(dev);
+    
+    const QString block = RuleGenerator::generateSingleRule(rule);
+    const QString metadata = RuleGenerator::generateMetadataComment(rule);
+    const QStringList lines = block.split('\n');
+    
+    // sum= comes last and covers the comment before it and the rule lines
+    QVERIFY(lines[0].startsWith(metadata + " sum="));
+    const QString sum = lines[0].sliced(metadata.size() + 5);
+    QCOMPARE(sum.size(), 16);
+    QCOMPARE(sum, BlockChecksum::of(metadata, block.sliced(lines[0].size() + 1)));
+    
+    BlockChecksum incremental;
+    incremental.addLine(metadata);
+    incremental.addLine(lines[1]);
+    QCOMPARE(incremental.result(), sum);
+    
+    // Any change to the block changes it
+    rule.enabled = false;
+    QVERIFY(!RuleGenerator::generateSingleRule(rule).contains(sum));
+}
+
+void TestRules::testEditedBlocks() {
+    const QString content = reference::generateRulesCorpus(20);
+    const RuleParser::ParseResult clean = RuleParser::parseRulesFile(content);
+    QVERIFY(clean.warnings.isEmpty());
+    QVERIFY(clean.editedBlockLines.isEmpty());
+    
+    // Hand-edit the device line of the 6th block and the comment of the 12th
+    QStringList lines = content.split('\n');
+    QVector<int> blockLines;
+    for (int i = 0; i < lines.size(); ++i) {
+        if (lines[i].startsWith("# udevme:")) blockLines << i + 1;
+    }
+    QCOMPARE(blockLines.size(), 20);
+    lines[blockLines[5]].replace("MODE=\"0666\"", "MODE=\"0660\"");
+    lines[blockLines[11] - 1].replace("enabled=true", "enabled=false");
+    
+    // Whitespace udev ignores doesn't count as an edit
+    lines[blockLines[15]] += "   ";
+    
+    const RuleParser::ParseResult edited = RuleParser::parseRulesFile(lines.join('\n'));
+    QCOMPARE(edited.editedBlockLines, QVector<int>({ blockLines[5], blockLines[11] }));
+    QCOMPARE(edited.warnings.size(), 2);
+    QVERIFY(edited.warnings[0].contains(QString::number(blockLines[5])));
+    QCOMPARE(edited.rules.size(), 20);
+    QVERIFY(!edited.rules[11].enabled);
+    
+    // Files written before checksums have nothing to check
+    const QString withoutSums = QString(content).remove(QRegularExpression(" sum=[0-9a-f]+"));
+    const RuleParser::ParseResult old = RuleParser::parseRulesFile(withoutSums);
+    QVERIFY(old.editedBlockLines.isEmpty());
+    const QString difference = reference::describeDifference(old, clean, content);
+    QVERIFY2(difference.isEmpty(), qPrintable(difference));
+}
+
+void TestRules::testIncrementalReparse() {
+    const QString content = reference::generateRulesCorpus(200);
+    const RuleParser::ParseResult expected = RuleParser::parseRulesFile(content);
+    
+    RuleParser::BlockCache cache;
+    RuleParser::ParseResult first = RuleParser::parseRulesFile(content, &cache);
+    QCOMPARE(first.reusedBlocks, 0);
+    QCOMPARE(cache.size(), 200);
+    
+    RuleParser::ParseResult second = RuleParser::parseRulesFile(content, &cache);
+    QCOMPARE(second.reusedBlocks, 200);
+    QString difference = reference::describeDifference(second, expected, content);
+    QVERIFY2(difference.isEmpty(), qPrintable(difference));
+    
+    // Regenerate one rule: only that block is parsed again
+    QVector<UdevRule> rules = expected.rules;
+    rules[42].permissionLevel = PermissionLevel::Open;
+    rules[42].devices.removeLast();
+    if (rules[42].devices.isEmpty()) {
+        DeviceInfo dev;
+        dev.vendorId = "beef";
+        dev.productId = "cafe";
+        rules[42].devices.append(dev);
+    }
+    const QString changed = RuleGenerator::generateRulesFile(rules);
+    const RuleParser::ParseResult third = RuleParser::parseRulesFile(changed, &cache);
+    QCOMPARE(third.reusedBlocks, 199);
+    difference = reference::describeDifference(third, RuleParser::parseRulesFile(changed), changed);
+    QVERIFY2(difference.isEmpty(), qPrintable(difference));
+    
+    // A block edited by hand keeps its old sum, which is still cached; its
+    // content must be parsed, not the cached rule returned
+    QStringList lines = changed.split('\n');
+    const int block = lines.indexOf(RuleGenerator::generateSingleRule(rules[7]).section('\n', 0, 0));
+    QVERIFY(block >= 0);
+    lines[block].replace("devices=" + rules[7].devices[0].vendorId, "devices=dead");
+    const RuleParser::ParseResult fourth = RuleParser::parseRulesFile(lines.join('\n'), &cache);
+    QCOMPARE(fourth.reusedBlocks, 199);
+    QCOMPARE(fourth.editedBlockLines.size(), 1);
+    QCOMPARE(fourth.rules[7].devices[0].vendorId, QString("dead"));
+    
+    // Streaming shares the cache
+    QVERIFY(m_dir.isValid());
+    const QString path = writeFile("cached.rules", changed.toUtf8());
+    int count = 0;
+    const RuleParser::StreamResult stream = RuleParser::parseRulesStream(path, [&count](UdevRule&&) {
+        ++count;
+        return true;
+    }, &cache);
+    QVERIFY(stream.success);
+    QCOMPARE(count, 200);
+    QCOMPARE(stream.reusedBlocks, 199);
+    QVERIFY(stream.editedBlockLines.isEmpty());
+}
+
+void TestRules::testOptimizedOutput() {
+    UdevRule rule;
+    rule.id = QUuid::fromString("0badc0de-0000-4000-8000-000000000002");
+    for (const char* ids : { "046d:c52b", "046D:C539", "1209:0001", "046d:c52b", "054c:0ce6@bluetooth" }) {
+        const QStringList parts = QString(ids).split(QRegularExpression("[:@]"));
+        DeviceInfo dev;
+        dev.vendorId = parts[0];
+        dev.productId = parts[1];
+        if (parts.size() > 2) dev.bus = parts[2];
+        rule.devices.append(dev);
+    }
+    UdevRule disabled = rule;
+    disabled.id = QUuid::createUuid();
+    disabled.enabled = false;
+    
+    const QString generated = RuleGenerator::generateRulesFile({ rule, disabled }, RuleOutput::Optimized);
+    const QStringList lines = generated.split('\n', Qt::SkipEmptyParts);
+    
+    // Guards before the first rule, the label after the last; one DEVPATH
+    // line per vendor with each product once, and no parent matches
+    QVERIFY(lines.contains("SUBSYSTEM!=\"hidraw\", GOTO=\"udevme_end\""));
+    QVERIFY(lines.contains("ACTION==\"remove\", GOTO=\"udevme_end\""));
+    QCOMPARE(lines.last(), QString(RuleGenerator::EndLabel));
+    QVERIFY(lines.contains("DEVPATH==\"*/0003:046D:C52B.*|*/0003:046D:C539.*\", MODE=\"0666\""));
+    QVERIFY(lines.contains("DEVPATH==\"*/0003:1209:0001.*\", MODE=\"0666\""));
+    QVERIFY(lines.contains("DEVPATH==\"*/0005:054C:0CE6.*\", MODE=\"0666\""));
+    QVERIFY(!generated.contains("ATTRS") && !generated.contains("KERNELS"));
+    QCOMPARE(generated.count("DEVPATH"), 3);
+    
+    // udev reads it without complaint, and every GOTO lands
+    const UdevRulesFile file = UdevRulesParser::parse(generated);
+    QVERIFY(file.diagnostics().isEmpty());
+    QCOMPARE(file.findLabel(u"udevme_end"), file.size() - 1);
+    
+    // Parses back to the same rule, checksums intact, label outside the block
+    const RuleParser::ParseResult parsed = RuleParser::parseRulesFile(generated);
+    QVERIFY(parsed.warnings.isEmpty());
+    QCOMPARE(parsed.rules.size(), 1);
+    QCOMPARE(parsed.rules[0].devices.size(), 5);
+    for (const DeviceInfo& dev : parsed.rules[0].devices) {
+        QVERIFY(dev.hasHidraw);
+    }
+    QCOMPARE(RuleGenerator::generateRulesFile(parsed.rules, RuleOutput::Optimized), generated);
+    
+    // The same rules either way; only the lines udev sees differ
+    const RuleParser::ParseResult compatible =
+        RuleParser::parseRulesFile(RuleGenerator::generateRulesFile({ rule }, RuleOutput::Compatible));
+    QCOMPARE(compatible.rules.size(), 1);
+    QCOMPARE(compatible.rules[0].id, parsed.rules[0].id);
+    QCOMPARE(compatible.rules[0].devices.size(), 5);
+    
+    // Nothing to guard when there are no rules
+    QCOMPARE(RuleGenerator::generateRulesFile({ disabled }, RuleOutput::Optimized),
+             RuleGenerator::generateRulesFile({ disabled }));
+}
+
+void TestRules::testHwdbOutput() {
+    UdevRule rule;
+    rule.id = QUuid::fromString("0badc0de-0000-4000-8000-000000000003");
+    for (const char* ids : { "046d:c52b", "046D:C539", "046d:c52b", "054c:0ce6@bluetooth" }) {
+        const QStringList parts = QString(ids).split(QRegularExpression("[:@]"));
+        DeviceInfo dev;
+        dev.vendorId = parts[0];
+        dev.productId = parts[1];
+        if (parts.size() > 2) dev.bus = parts[2];
+        rule.devices.append(dev);
+    }
+    UdevRule disabled = rule;
+    disabled.id = QUuid::createUuid();
+    disabled.enabled = false;
+    
+    // One hwdb record per rule: each device's HID modalias once, then the
+    // mode, then the blank line that ends the record
+    const QString hwdb = RuleGenerator::generateHwdbFile({ rule, disabled });
+    const QStringList lines = hwdb.split('\n');
+    QVERIFY(lines.contains("udevme:hid:b0003g*v0000046Dp0000C52B"));
+    QVERIFY(lines.contains("udevme:hid:b0003g*v0000046Dp0000C539"));
+    QVERIFY(lines.contains("udevme:hid:b0005g*v0000054Cp00000CE6"));
+    QCOMPARE(hwdb.count("udevme:hid:"), 3);
+    QCOMPARE(hwdb.count(" UDEVME_MODE=0666\n\n"), 1);
+    
+    // The rules file names no device, so it doesn't grow with the list
+    const QString rules = RuleGenerator::generateRulesFile({ rule, disabled }, RuleOutput::Hwdb);
+    QVERIFY(!rules.contains("046D", Qt::CaseInsensitive) && !rules.contains("udevme:hid:"));
+    QVERIFY(rules.contains("IMPORT{builtin}=\"hwdb --subsystem=hid --lookup-prefix=udevme:\""));
+    QVERIFY(rules.contains("# The allowed devices are listed in 99-udevme.hwdb\n"));
+    QVERIFY(RuleGenerator::generateRulesFile({ rule }, RuleOutput::Hwdb, "99-udevme-*.hwdb")
+                .contains("# The allowed devices are listed in 99-udevme-*.hwdb\n"));
+    UdevRule many = rule;
+    for (int i = 0; i < 1000; ++i) {
+        DeviceInfo dev;
+        dev.vendorId = "1209";
+        dev.productId = QString("%1").arg(i, 4, 16, QLatin1Char('0'));
+        many.devices.append(dev);
+    }
+    QCOMPARE(RuleGenerator::generateRulesFile({ many }, RuleOutput::Hwdb), rules);
+    
+    const UdevRulesFile file = UdevRulesParser::parse(rules);
+    QVERIFY(file.diagnostics().isEmpty());
+    QCOMPARE(file.findLabel(u"udevme_end"), file.size() - 1);
+    QVERIFY(RuleParser::parseRulesFile(rules).rules.isEmpty());
+    
+    // The hwdb file is what parses back to the rules, checksums intact
+    const RuleParser::ParseResult parsed = RuleParser::parseRulesFile(hwdb);
+    QVERIFY(parsed.warnings.isEmpty());
+    QCOMPARE(parsed.rules.size(), 1);
+    QCOMPARE(parsed.rules[0].id, rule.id);
+    QCOMPARE(parsed.rules[0].devices.size(), 4);
+    for (const DeviceInfo& dev : parsed.rules[0].devices) {
+        QVERIFY(dev.hasHidraw);
+    }
+    QCOMPARE(RuleGenerator::generateHwdbFile(parsed.rules), hwdb);
+    
+    // Dropping an entry by hand shows as an edit
+    QString edited = hwdb;
+    edited.remove("udevme:hid:b0003g*v0000046Dp0000C539\n");
+    QCOMPARE(RuleParser::parseRulesFile(edited).editedBlockLines.size(), 1);
+    
+    // No rules, nothing to look up
+    QCOMPARE(RuleGenerator::generateRulesFile({ disabled }, RuleOutput::Hwdb),
+             RuleGenerator::generateRulesFile({ disabled }));
+    QVERIFY(RuleGenerator::generateHwdbFile({ disabled }).contains("# No enabled rules configured"));
+}
+
+void TestRules::testRoundTripProperty_data() {
+    QTest::addColumn<int>("output");
+    QTest::addColumn<quint32>("seed");
+    for (RuleOutput output : { RuleOutput::Compatible, RuleOutput::Optimized, RuleOutput::Hwdb }) {
+        for (quint32 seed = 1; seed <= 50; ++seed) {
+            QTest::addRow("%s-%u", qPrintable(ruleOutputToString(output)), seed) << int(output) << seed;
+        }
+    }
+}
+
+void TestRules::testRoundTripProperty() {
+    QFETCH(int, output);
+    QFETCH(quint32, seed);
+    const RuleOutput mode = RuleOutput(output);
+    QRandomGenerator rng(seed);
+    
+    for (int round = 0; round < 20; ++round) {
+        QVector<UdevRule> rules;
+        for (int i = 0, n = rng.bounded(12); i < n; ++i) {
+            rules.append(randomRule(rng));
+        }
+        if (roundTripFailure(rules, mode).isEmpty()) continue;
+        
+        rules = shrinkRoundTrip(rules, mode);
+        QFAIL(qPrintable(QString("round %1: %2\n%3")
+            .arg(round)
+            .arg(roundTripFailure(rules, mode), generateBlocks(rules, mode))));
+    }
+}
+
+void TestRules::testPathologicalInputs_data() {
+    QTest::addColumn<QByteArray>("content");
+    QTest::addColumn<int>("devices");
+    
+    const QByteArray huge(8 * 1024 * 1024, 'a');
+    QTest::newRow("long-rule-line") << "# udevme: devices=1111:2222\nATTRS{idVendor}==\"1111\", " + huge + "\n" << 1;
+    QTest::newRow("long-comment") << "# udevme: devices=1111:2222\n# " + huge << 1;
+    QTest::newRow("long-metadata") << "# udevme: devices=1111:2222 apps=" + huge << 1;
+    QTest::newRow("unterminated-value") << "# udevme: devices=1111:2222\nATTRS{idVendor}==\"" + huge << 1;
+    QTest::newRow("escaped-value") << "# udevme: devices=1111:2222\nATTRS{idVendor}==e\"" + QByteArray(huge).replace('a', '\\') << 1;
+    QTest::newRow("blank-lines") << "# udevme: devices=1111:2222\n" + QByteArray(huge.size(), '\n') << 1;
+    
+    // One rule for 100,000 devices, their rule lines in reverse order
+    const int count = 100000;
+    QByteArrayList ids;
+    QByteArrayList lines;
+    for (int i = 0; i < count; ++i) {
+        const QByteArray vid = QByteArray::number(0xa000 + i / 0x1000, 16);
+        const QByteArray pid = QByteArray::number(0xb000 + i % 0x1000, 16);
+        ids << vid.toUpper() + ":" + pid;
+        lines << "KERNEL==\"hidraw*\", SUBSYSTEM==\"hidraw\", ATTRS{idVendor}==\"" + vid +
+                 "\", ATTRS{idProduct}==\"" + pid + "\", MODE=\"0666\"";
+    }
+    std::reverse(lines.begin(), lines.end());
+    QTest::newRow("many-devices") << "# udevme: devices=" + ids.join(',') + "\n" + lines.join('\n') << count;
+}
+
+void TestRules::testPathologicalInputs() {
+    QFETCH(QByteArray, content);
+    QFETCH(int, devices);
+    
+    // Generous enough for a debug build; anything quadratic in the line
+    // length or device count takes minutes
+    constexpr qint64 budgetMs = 5000;
+    
+    QElapsedTimer timer;
+    timer.start();
+    const RuleParser::ParseResult parsed = RuleParser::parseRulesFile(QString::fromUtf8(content));
+    const qint64 parseMs = timer.restart();
+    QCOMPARE(parsed.rules.size(), 1);
+    QCOMPARE(parsed.rules[0].devices.size(), devices);
+    
+    QBuffer buffer(&content);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+    int streamed = 0;
+    const RuleParser::StreamResult stream = RuleParser::parseRulesStream(&buffer, [&streamed](UdevRule&&) {
+        ++streamed;
+        return true;
+    });
+    const qint64 streamMs = timer.elapsed();
+    QVERIFY(stream.success);
+    QCOMPARE(streamed, 1);
+    
+    qInfo("%lld bytes: parsed in %lld ms, streamed in %lld ms", qint64(content.size()), parseMs, streamMs);
+    QVERIFY2(parseMs < budgetMs, qPrintable(QString("parse took %1 ms").arg(parseMs)));
+    QVERIFY2(streamMs < budgetMs, qPrintable(QString("stream took %1 ms").arg(streamMs)));
+    
+    if (devices > 1) {
+        for (const DeviceInfo& dev : parsed.rules[0].devices) {
+            QVERIFY(dev.hasHidraw);
+        }
+    }
+}
+
 QTEST_MAIN(TestRules)
 #include "test_rules.moc"
@@ -0,0 +1,230 @@
+#include <QtTest/QtTest>
+#include "RulesAnalyzer.h"
+#include "Types.h"
+
+using namespace udevme;
+
+class TestRulesAnalyzer : public QObject {
+    Q_OBJECT
+
+private slots:
+    void init();
+    void testGlobMatch();
+    void testRulesFiles();
+    void testFindings();
+    void testUnrelatedStatements();
+    void testDisabledRules();
+    void testShardPosition();
+    void testSystemRules();
+
+private:
+    void writeRules(const QString& dir, const QString& name, const QByteArray& content);
+    static UdevRule rule(std::initializer_list<DeviceInfo> devices);
+    static DeviceInfo device(const QString& vid, const QString& pid, const QString& bus = QString());
+    static const RulesAnalyzer::Finding* find(const RulesAnalyzer::Report& report, const QString& device);
+
+    QScopedPointer<QTemporaryDir> m_root;
+};
+
+void TestRulesAnalyzer::init() {
+    m_root.reset(new QTemporaryDir);
+    QVERIFY(m_root->isValid());
+}
+
+void TestRulesAnalyzer::writeRules(const QString& dir, const QString& name, const QByteArray& content) {
+    const QString path = m_root->filePath(dir);
+    QDir().mkpath(path);
+    QFile file(path + "/" + name);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(content);
+}
+
+UdevRule TestRulesAnalyzer::rule(std::initializer_list<DeviceInfo> devices) {
+    UdevRule r;
+    r.id = QUuid::createUuid();
+    for (const DeviceInfo& d : devices) r.devices.append(d);
+    return r;
+}
+
+DeviceInfo TestRulesAnalyzer::device(const QString& vid, const QString& pid, const QString& bus) {
+    DeviceInfo d;
+    d.vendorId = vid;
+    d.productId = pid;
+    d.bus = bus;
+    return d;
+}
+
+const RulesAnalyzer::Finding* TestRulesAnalyzer::find(const RulesAnalyzer::Report& report, const QString& device) {
+    for (const auto& f : report.findings) {
+        if (f.device == device) return &f;
+    }
+    return nullptr;
+}
+
+void TestRulesAnalyzer::testGlobMatch() {
+    QVERIFY(RulesAnalyzer::globMatch(u"hidraw*", u"hidraw3"));
+    QVERIFY(RulesAnalyzer::globMatch(u"usb|hidraw", u"hidraw"));
+    QVERIFY(RulesAnalyzer::globMatch(u"046[cd]", u"046d"));
+    QVERIFY(RulesAnalyzer::globMatch(u"0003:046D:C52B", u"0003:046D:C52B"));
+    QVERIFY(!RulesAnalyzer::globMatch(u"usb|input", u"hidraw"));
+    QVERIFY(!RulesAnalyzer::globMatch(u"046D", u"046d"));
+}
+
+void TestRulesAnalyzer::testRulesFiles() {
+    writeRules("usr/lib/udev/rules.d", "50-udev-default.rules", "");
+    writeRules("usr/lib/udev/rules.d", "70-uaccess.rules", "");
+    writeRules("usr/lib/udev/rules.d", "60-sensor.rules", "SUBSYSTEM==\"hidraw\", MODE:=\"0600\"\n");
+    writeRules("etc/udev/rules.d", "60-sensor.rules", "");
+    writeRules("run/udev/rules.d", "10-early.rules", "");
+    writeRules("etc/udev/rules.d", "99-udevme.rules", "");
+    writeRules("etc/udev/rules.d", "99-udevme-0badc0de-0000-4000-8000-000000000001.rules", "");
+    writeRules("usr/lib/udev/rules.d", "not-rules.txt", "");
+    QVERIFY(QFile::link("/dev/null", m_root->filePath("etc/udev/rules.d/70-uaccess.rules")));
+
+    RulesAnalyzer analyzer(m_root->path());
+    const QString root = m_root->path();
+    QCOMPARE(analyzer.rulesFiles(), QStringList({
+        root + "/run/udev/rules.d/10-early.rules",
+        root + "/usr/lib/udev/rules.d/50-udev-default.rules",
+        root + "/etc/udev/rules.d/60-sensor.rules",
+    }));
+
+    // Our own file and its shards take no part; any other name does
+    analyzer.setRulesFileName("60-sensor.rules");
+    const QStringList files = analyzer.rulesFiles();
+    QCOMPARE(files.size(), 4);
+    QCOMPARE(files.last(), root + "/etc/udev/rules.d/99-udevme.rules");
+    QCOMPARE(files[2], root + "/etc/udev/rules.d/99-udevme-0badc0de-0000-4000-8000-000000000001.rules");
+}
+
+void TestRulesAnalyzer::testFindings() {
+    writeRules("usr/lib/udev/rules.d", "50-udev-default.rules",
+               "SUBSYSTEM==\"hidraw\", MODE=\"0600\"\n");
+    writeRules("usr/lib/udev/rules.d", "60-vendor.rules",
+               "# Logitech receivers\n"
+               "SUBSYSTEM==\"hidraw\", ATTRS{idVendor}==\"046d\", MODE:=\"0660\"\n"
+               "SUBSYSTEM==\"hidraw\", ATTRS{idVendor}==\"1209\", ATTRS{idProduct}==\"0001|0002\", MODE=\"0666\"\n"
+               "ENV{ID_INPUT_JOYSTICK}==\"1\", ATTRS{idVendor}==\"2e8a\", MODE:=\"0600\"\n");
+    writeRules("etc/udev/rules.d", "99-zz-local.rules",
+               "KERNEL==\"hidraw*\", KERNELS==\"0005:054C:0CE6.*\", MODE=\"0600\"\n"
+               "KERNEL==\"hidraw*\", ATTRS{idVendor}==\"cafe\", MODE=\"0666\"\n");
+
+    RulesAnalyzer analyzer(m_root->path());
+    const UdevRule logitech = rule({ device("046d", "c52b") });
+    const QVector<UdevRule> rules = {
+        logitech,
+        rule({ device("1209", "0001"), device("054c", "0ce6", "bluetooth") }),
+        rule({ device("2e8a", "000a"), device("cafe", "0001"), device("abcd", "0001") }),
+    };
+    const RulesAnalyzer::Report report = analyzer.analyze(rules);
+    QVERIFY(report.errors.isEmpty());
+    QCOMPARE(report.files.size(), 3);
+    QCOMPARE(report.statementCount, 6);
+    QCOMPARE(report.findings.size(), 5);
+
+    const RulesAnalyzer::Finding* f = find(report, "046d:c52b");
+    QVERIFY(f);
+    QCOMPARE(f->issue, RulesAnalyzer::Issue::Shadowed);
+    QCOMPARE(f->ruleId, logitech.id);
+    QCOMPARE(f->file, report.files[1]);
+    QCOMPARE(f->line, 2);
+    QCOMPARE(f->mode, 0660u);
+    QCOMPARE(f->ruleMode, 0666u);
+    QVERIFY(!f->conditional);
+    QVERIFY(f->message().contains("MODE:=\"0660\""));
+
+    f = find(report, "1209:0001");
+    QVERIFY(f);
+    QCOMPARE(f->issue, RulesAnalyzer::Issue::Redundant);
+    QCOMPARE(f->line, 3);
+
+    // Bluetooth devices are only reachable through their HID name
+    f = find(report, "054c:0ce6");
+    QVERIFY(f);
+    QCOMPARE(f->issue, RulesAnalyzer::Issue::Overridden);
+    QCOMPARE(f->file, report.files[2]);
+    QCOMPARE(f->mode, 0600u);
+
+    f = find(report, "2e8a:000a");
+    QVERIFY(f);
+    QCOMPARE(f->issue, RulesAnalyzer::Issue::Shadowed);
+    QVERIFY(f->conditional);
+
+    // A later statement setting the same mode makes ours the redundant one
+    f = find(report, "cafe:0001");
+    QVERIFY(f);
+    QCOMPARE(f->issue, RulesAnalyzer::Issue::Redundant);
+    QCOMPARE(f->line, 2);
+
+    // Only the generic 0600 default applies, and ours replaces it
+    QVERIFY(!find(report, "abcd:0001"));
+}
+
+void TestRulesAnalyzer::testUnrelatedStatements() {
+    writeRules("usr/lib/udev/rules.d", "60-other.rules",
+               // Other subsystems and actions
+               "SUBSYSTEM==\"usb\", ATTRS{idVendor}==\"046d\", MODE:=\"0600\"\n"
+               "ACTION==\"remove\", ATTRS{idVendor}==\"046d\", MODE:=\"0600\"\n"
+               "KERNEL==\"event*\", ATTRS{idVendor}==\"046d\", MODE:=\"0600\"\n"
+               "SUBSYSTEMS==\"bluetooth\", ATTRS{idVendor}==\"046d\", MODE:=\"0600\"\n"
+               // Not this device, and not a literal mode
+               "ATTRS{idVendor}==\"046d\", ATTRS{idProduct}!=\"c52b\", MODE:=\"0600\"\n"
+               "ATTRS{idVendor}==\"046e\", MODE:=\"0600\"\n"
+               "ATTRS{idVendor}==\"046d\", MODE:=\"$env{MODE}\"\n"
+               // Device-wide, but only under conditions we can't see
+               "ENV{ID_INPUT_JOYSTICK}==\"1\", MODE:=\"0600\"\n"
+               // Broken
+               "ATTRS{idVendor}==\"046d\", MODE:=\"0600\n");
+    writeRules("etc/udev/rules.d", "99-zz-local.rules",
+               "KERNELS==\"0005:046D:C52B.*\", MODE=\"0600\"\n");
+
+    RulesAnalyzer analyzer(m_root->path());
+    const RulesAnalyzer::Report report = analyzer.analyze({ rule({ device("046d", "c52b") }) });
+    QVERIFY(report.findings.isEmpty());
+    QCOMPARE(report.errors.size(), 1);
+    QVERIFY(report.errors[0].contains("60-other.rules:9"));
+}
+
+void TestRulesAnalyzer::testDisabledRules() {
+    writeRules("etc/udev/rules.d", "99-zz-local.rules",
+               "ATTRS{idVendor}==\"046d\", MODE=\"0600\"\n");
+
+    UdevRule disabled = rule({ device("046d", "c52b") });
+    disabled.enabled = false;
+    RulesAnalyzer analyzer(m_root->path());
+    QVERIFY(analyzer.analyze({ disabled }).findings.isEmpty());
+}
+
+void TestRulesAnalyzer::testShardPosition() {
+    // Sorts after the shards but before 99-udevme.rules
+    writeRules("etc/udev/rules.d", "99-udevme.local.rules",
+               "ATTRS{idVendor}==\"046d\", MODE=\"0600\"\n");
+
+    const UdevRule logitech = rule({ device("046d", "c52b") });
+    RulesAnalyzer analyzer(m_root->path());
+    QVERIFY(analyzer.analyze({ logitech }).findings.isEmpty());
+
+    analyzer.setOwnFiles({ "99-udevme-" + logitech.id.toString(QUuid::WithoutBraces) + ".rules" });
+    const RulesAnalyzer::Report report = analyzer.analyze({ logitech });
+    QCOMPARE(report.findings.size(), 1);
+    QCOMPARE(report.findings[0].issue, RulesAnalyzer::Issue::Overridden);
+    QCOMPARE(report.findings[0].file, report.files[0]);
+}
+
+void TestRulesAnalyzer::testSystemRules() {
+    RulesAnalyzer analyzer;
+    if (analyzer.rulesFiles().isEmpty()) {
+        QSKIP("No system udev rules installed");
+    }
+
+    // Just has to get through whatever the distro ships
+    QElapsedTimer timer;
+    timer.start();
+    const RulesAnalyzer::Report report = analyzer.analyze({ rule({ device("046d", "c52b") }) });
+    qInfo("%lld files, %d MODE statements, %lld ms", qint64(report.files.size()),
+          report.statementCount, timer.elapsed());
+    QVERIFY(!report.files.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestRulesAnalyzer)
+#include "test_rulesanalyzer.moc"
@@ -0,0 +1,161 @@
+#include <QtTest/QtTest>
+#include "DeviceScanner.h"
+#include "SysfsFixture.h"
+#include "Types.h"
+
+using namespace udevme;
+
+Q_DECLARE_METATYPE(udevme::DeviceScanner::Backend)
+
+class TestScanner : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testBackendsMatchFixture_data();
+    void testBackendsMatchFixture();
+    void testSysPathsStayInFixture();
+    void testCaptureReplay();
+    void testSameVidPidOnTwoBuses();
+
+private:
+    static QVector<DeviceInfo> scan(const QString& root, DeviceScanner::Backend backend);
+    static void compareDevices(QVector<DeviceInfo> actual, const QVector<DeviceInfo>& expected);
+};
+
+QVector<DeviceInfo> TestScanner::scan(const QString& root, DeviceScanner::Backend backend) {
+    DeviceScanner scanner;
+    scanner.setSysfsRoot(SysfsFixture::sysfsRoot(root));
+    scanner.setUdevDataPath(SysfsFixture::udevDataPath(root));
+    scanner.setBackend(backend);
+    // Fixture IDs are random; keep the host's usb.ids out of the comparison
+    scanner.setNameResolution(false);
+    return scanner.scanDevices();
+}
+
+void TestScanner::compareDevices(QVector<DeviceInfo> actual, const QVector<DeviceInfo>& expected) {
+    std::sort(actual.begin(), actual.end(), [](const DeviceInfo& a, const DeviceInfo& b) {
+        return std::tie(a.vendorId, a.productId, a.bus) < std::tie(b.vendorId, b.productId, b.bus);
+    });
+
+    QCOMPARE(actual.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+        QCOMPARE(actual[i].vidPid(), expected[i].vidPid());
+        QCOMPARE(actual[i].name, expected[i].name);
+        QCOMPARE(actual[i].manufacturer, expected[i].manufacturer);
+        QCOMPARE(actual[i].bus, expected[i].bus);
+        QCOMPARE(actual[i].hasUsb, expected[i].hasUsb);
+        QCOMPARE(actual[i].hasHidraw, expected[i].hasHidraw);
+    }
+}
+
+void TestScanner::testBackendsMatchFixture_data() {
+    QTest::addColumn<DeviceScanner::Backend>("backend");
+    QTest::addColumn<int>("usbDevices");
+    QTest::addColumn<int>("hidrawNodes");
+
+    const struct {
+        const char* label;
+        DeviceScanner::Backend backend;
+    } backends[] = {
+        { "sysfs", DeviceScanner::Backend::Sysfs },
+        { "uevent", DeviceScanner::Backend::SysfsUevent },
+        { "udev-db", DeviceScanner::Backend::UdevDatabase },
+    };
+
+    for (const auto& b : backends) {
+        QTest::addRow("%s/empty", b.label) << b.backend << 0 << 0;
+        QTest::addRow("%s/small", b.label) << b.backend << 10 << 4;
+        // More than one bus, duplicates and string-less devices included
+        QTest::addRow("%s/multibus", b.label) << b.backend << 250 << 40;
+    }
+}
+
+void TestScanner::testBackendsMatchFixture() {
+    QFETCH(DeviceScanner::Backend, backend);
+    QFETCH(int, usbDevices);
+    QFETCH(int, hidrawNodes);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    SysfsFixture::Options options;
+    options.usbDevices = usbDevices;
+    options.hidrawNodes = hidrawNodes;
+    options.bluetoothDevices = 2;
+
+    QString error;
+    QVERIFY2(SysfsFixture::generate(dir.path(), options, &error), qPrintable(error));
+
+    compareDevices(scan(dir.path(), backend), SysfsFixture::expectedDevices(options));
+}
+
+void TestScanner::testSysPathsStayInFixture() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    SysfsFixture::Options options;
+    QVERIFY(SysfsFixture::generate(dir.path(), options));
+
+    for (auto backend : { DeviceScanner::Backend::Sysfs, DeviceScanner::Backend::SysfsUevent,
+                          DeviceScanner::Backend::UdevDatabase }) {
+        for (const DeviceInfo& dev : scan(dir.path(), backend)) {
+            QVERIFY2(dev.sysPath.startsWith(dir.path() + "/sys/"), qPrintable(dev.sysPath));
+        }
+    }
+}
+
+void TestScanner::testCaptureReplay() {
+    if (QStandardPaths::findExecutable("tar").isEmpty()) {
+        QSKIP("tar not installed");
+    }
+
+    QTemporaryDir source;
+    QTemporaryDir replay;
+    QVERIFY(source.isValid());
+    QVERIFY(replay.isValid());
+
+    SysfsFixture::Options options;
+    options.usbDevices = 30;
+    options.hidrawNodes = 8;
+    QVERIFY(SysfsFixture::generate(source.path(), options));
+
+    // Capture the generated tree as if it were a live system, then replay it
+    const QString archive = replay.filePath("capture.tar.gz");
+    QString error;
+    QVERIFY2(SysfsFixture::capture(SysfsFixture::sysfsRoot(source.path()),
+                                   SysfsFixture::udevDataPath(source.path()), archive, &error),
+             qPrintable(error));
+    QVERIFY2(SysfsFixture::extract(archive, replay.filePath("root"), &error), qPrintable(error));
+
+    const QVector<DeviceInfo> expected = SysfsFixture::expectedDevices(options);
+    compareDevices(scan(replay.filePath("root"), DeviceScanner::Backend::SysfsUevent), expected);
+    compareDevices(scan(replay.filePath("root"), DeviceScanner::Backend::UdevDatabase), expected);
+}
+
+void TestScanner::testSameVidPidOnTwoBuses() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    SysfsFixture::Options options;
+    options.usbDevices = 5;
+    options.hidrawNodes = 3;
+    options.bluetoothDevices = 0;
+    options.dualBusDevices = 2;
+    QVERIFY(SysfsFixture::generate(dir.path(), options));
+
+    const QVector<DeviceInfo> expected = SysfsFixture::expectedDevices(options);
+    for (auto backend : { DeviceScanner::Backend::Sysfs, DeviceScanner::Backend::SysfsUevent,
+                          DeviceScanner::Backend::UdevDatabase }) {
+        const QVector<DeviceInfo> devices = scan(dir.path(), backend);
+        compareDevices(devices, expected);
+
+        // Both the USB and the Bluetooth entry of a shared vid:pid are listed
+        QHash<QString, int> perVidPid;
+        for (const DeviceInfo& dev : devices) ++perVidPid[dev.vidPid()];
+        QCOMPARE(perVidPid.size(), 5);
+        QCOMPARE(devices.size(), 5 + 2);
+    }
+}
+
+QTEST_GUILESS_MAIN(TestScanner)
+#include "test_scanner.moc"
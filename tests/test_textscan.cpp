@@ -0,0 +1,132 @@
+#include <QtTest/QtTest>
+#include "TextScan.h"
+
+using namespace udevme;
+
+class TestTextScan : public QObject {
+    Q_OBJECT
+
+private slots:
+    void cleanup();
+    void testIndexOfAny_data();
+    void testIndexOfAny();
+    void testIndexOfNonAscii();
+    void testNextLine_data();
+    void testNextLine();
+    void testIsaFallback();
+
+private:
+    static void addIsaRows();
+};
+
+void TestTextScan::cleanup() {
+    TextScan::setIsa(TextScan::bestIsa());
+}
+
+void TestTextScan::addIsaRows() {
+    QTest::addColumn<int>("isa");
+    for (auto isa : { TextScan::Isa::Scalar, TextScan::Isa::Sse2, TextScan::Isa::Avx2 }) {
+        if (isa <= TextScan::bestIsa()) {
+            QTest::newRow(TextScan::isaName(isa)) << int(isa);
+        }
+    }
+}
+
+void TestTextScan::testIndexOfAny_data() {
+    addIsaRows();
+}
+
+void TestTextScan::testIndexOfAny() {
+    QFETCH(int, isa);
+    TextScan::setIsa(TextScan::Isa(isa));
+    QCOMPARE(TextScan::isa(), TextScan::Isa(isa));
+
+    // Every length and offset around the 16/32 byte steps, with the match
+    // anywhere or nowhere, against a plain loop
+    QRandomGenerator rng(7);
+    const char* const sets[] = { "\n", "=\n", "\n=\"#", "#" };
+    for (int round = 0; round < 4000; ++round) {
+        const int size = int(rng.bounded(100));
+        QByteArray bytes(size, 'a');
+        for (char& c : bytes) {
+            const int r = int(rng.bounded(60));
+            c = r < 4 ? "\n=\"#"[r] : r == 4 ? char(0xc3) : char('a' + r % 26);
+        }
+        const QString text = QString::fromLatin1(bytes);
+        const char* set = sets[rng.bounded(4)];
+        const qsizetype from = rng.bounded(size + 2);
+
+        qsizetype expected = -1;
+        for (qsizetype i = from; i < size && expected < 0; ++i) {
+            if (strchr(set, bytes[i])) expected = i;
+        }
+        QCOMPARE(TextScan::indexOfAny(bytes, set, from), expected);
+        QCOMPARE(TextScan::indexOfAny(text, set, from), expected);
+        if (set[1] == '\0') {
+            QCOMPARE(TextScan::indexOf(bytes, set[0], from), expected);
+            QCOMPARE(TextScan::indexOf(text, char16_t(set[0]), from), expected);
+        }
+    }
+}
+
+void TestTextScan::testIndexOfNonAscii() {
+    // UTF-16 units sharing a low byte with a delimiter must not match
+    const QString text = QString(40, QChar(0x0a3d)) + u'=' + QChar(0x0a0a);
+    QCOMPARE(TextScan::indexOfAny(text, "=\n"), 40);
+    QCOMPARE(TextScan::indexOf(text, u'\n'), -1);
+    QCOMPARE(TextScan::indexOf(text, char16_t(0x0a0a)), 41);
+
+    // UTF-8 lead and continuation bytes are searchable too
+    const QByteArray utf8 = QString("abcdefghijklmnopqrstuvwxyz=ü").toUtf8();
+    QCOMPARE(TextScan::indexOf(utf8, char(0xc3)), 27);
+    QCOMPARE(TextScan::indexOf(utf8, '\0'), -1);
+    QCOMPARE(TextScan::indexOf(QByteArrayView(), '\n'), -1);
+}
+
+void TestTextScan::testNextLine_data() {
+    QTest::addColumn<QString>("content");
+    QTest::newRow("empty") << QString();
+    QTest::newRow("single") << QString("line");
+    QTest::newRow("trailing-newline") << QString("a\nb\n");
+    QTest::newRow("blank-lines") << QString("\n\n  \n\tx\t\n");
+    QTest::newRow("crlf") << QString("key=value\r\n[Desktop Entry]\r\nName=é\r\n");
+    QTest::newRow("long") << QString(200, u'x') + "\n " + QString(70, u'y') + " \n";
+}
+
+void TestTextScan::testNextLine() {
+    QFETCH(QString, content);
+
+    QStringList expected;
+    for (const QString& line : content.split('\n')) {
+        expected << line.trimmed();
+    }
+
+    for (auto isa : { TextScan::Isa::Scalar, TextScan::bestIsa() }) {
+        TextScan::setIsa(isa);
+
+        QStringList lines;
+        qsizetype pos = 0;
+        QStringView line;
+        while (TextScan::nextLine(content, pos, line)) lines << line.toString();
+        QCOMPARE(lines, expected);
+
+        // The byte version matches for ASCII whitespace
+        const QByteArray bytes = content.toUtf8();
+        QStringList byteLines;
+        pos = 0;
+        QByteArrayView byteLine;
+        while (TextScan::nextLine(bytes, pos, byteLine)) byteLines << QString::fromUtf8(byteLine);
+        QCOMPARE(byteLines, expected);
+    }
+}
+
+void TestTextScan::testIsaFallback() {
+    // Asking for more than the CPU has gets the best it has
+    TextScan::setIsa(TextScan::Isa::Avx2);
+    QVERIFY(TextScan::isa() <= TextScan::bestIsa());
+    TextScan::setIsa(TextScan::Isa::Scalar);
+    QCOMPARE(TextScan::isa(), TextScan::Isa::Scalar);
+}
+
+QTEST_GUILESS_MAIN(TestTextScan)
+#include "test_textscan.moc"
@@ -0,0 +1,260 @@
+#include <QtTest/QtTest>
+#include "UdevRulesParser.h"
+#include "Arena.h"
+
+using namespace udevme;
+
+class TestUdevRules : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testArena();
+    void testAssignments();
+    void testContinuations();
+    void testGotoAndLabel();
+    void testSyntaxErrors();
+    void testKeyWarnings();
+    void testBulkAllocation();
+    void testSurvivesMove();
+    void testSystemRules();
+
+private:
+    static QString text(QStringView view) { return view.toString(); }
+};
+
+void TestUdevRules::testArena() {
+    Arena arena(256);
+    QCOMPARE(arena.blockCount(), 0);
+
+    auto* a = arena.allocateArray<quint64>(4);
+    QVERIFY(reinterpret_cast<quintptr>(a) % alignof(quint64) == 0);
+    auto* b = arena.allocateArray<char>(3);
+    auto* c = arena.allocateArray<quint32>(1);
+    QVERIFY(reinterpret_cast<quintptr>(c) % alignof(quint32) == 0);
+    QVERIFY(b >= reinterpret_cast<char*>(a + 4));
+    QCOMPARE(arena.blockCount(), 1);
+
+    // Larger than a block: gets its own
+    arena.allocateArray<char>(4096);
+    QCOMPARE(arena.blockCount(), 2);
+
+    const QString source = "copied";
+    QStringView copy = arena.copy(source);
+    QCOMPARE(copy.toString(), source);
+    QVERIFY(copy.data() != source.constData());
+
+    Arena moved(std::move(arena));
+    QCOMPARE(moved.blockCount(), 2);
+    QCOMPARE(arena.blockCount(), 0);
+    QCOMPARE(copy.toString(), source);
+
+    moved.clear();
+    QCOMPARE(moved.blockCount(), 0);
+    QCOMPARE(moved.bytesUsed(), 0);
+}
+
+void TestUdevRules::testAssignments() {
+    UdevRulesFile file = UdevRulesParser::parse(
+        "# comment\n"
+        "\n"
+        "SUBSYSTEM==\"hidraw\", ATTRS{idVendor}!=\"046d\", MODE=\"0660\", TAG+=\"uaccess\", "
+        "SYMLINK-=\"old\", OWNER:=\"root\", ENV{ID_X}=e\"a\\\"b\",\n"
+        "  KERNEL == \"hidraw*\" ,RUN{program}+=\"/bin/true\"  \n");
+
+    QVERIFY(file.diagnostics().isEmpty());
+    QCOMPARE(file.size(), 2);
+
+    const RuleStatement& first = file[0];
+    QCOMPARE(first.line, 3);
+    QCOMPARE(first.lineCount, 1);
+    QCOMPARE(first.count, 7);
+
+    const RuleAssignment* a = first.assignments;
+    QCOMPARE(text(a[0].key), QString("SUBSYSTEM"));
+    QCOMPARE(a[0].op, RuleOperator::Match);
+    QCOMPARE(text(a[0].value), QString("hidraw"));
+    QVERIFY(a[0].isMatch());
+
+    QCOMPARE(text(a[1].key), QString("ATTRS"));
+    QCOMPARE(text(a[1].attr), QString("idVendor"));
+    QCOMPARE(a[1].op, RuleOperator::NoMatch);
+
+    QCOMPARE(a[2].op, RuleOperator::Assign);
+    QVERIFY(!a[2].isMatch());
+    QCOMPARE(a[3].op, RuleOperator::Add);
+    QCOMPARE(a[4].op, RuleOperator::Remove);
+    QCOMPARE(a[5].op, RuleOperator::AssignFinal);
+
+    QVERIFY(a[6].escaped);
+    QCOMPARE(text(a[6].value), QString("a\\\"b"));
+
+    QCOMPARE(text(first.find(u"MODE")->value), QString("0660"));
+    QVERIFY(!first.find(u"GROUP"));
+
+    const RuleStatement& second = file[1];
+    QCOMPARE(second.line, 4);
+    QCOMPARE(text(second.assignments[0].key), QString("KERNEL"));
+    QCOMPARE(text(second.assignments[1].attr), QString("program"));
+
+    QCOMPARE(ruleOperatorToString(RuleOperator::AssignFinal), QString(":="));
+
+    // Plain strings skip \" too; any other backslash is just a character
+    UdevRulesFile plain = UdevRulesParser::parse(
+        "PROGRAM==\"/bin/sh -c \\\"x\\\"\", RESULT==\"a\\b\", MODE=\"0660\"\n");
+    QVERIFY(plain.diagnostics().isEmpty());
+    QCOMPARE(plain.size(), 1);
+    QCOMPARE(plain[0].count, 3);
+    QVERIFY(!plain[0].assignments[0].escaped);
+    QCOMPARE(text(plain[0].assignments[0].value), QString("/bin/sh -c \\\"x\\\""));
+    QCOMPARE(text(plain[0].assignments[1].value), QString("a\\b"));
+}
+
+void TestUdevRules::testContinuations() {
+    UdevRulesFile file = UdevRulesParser::parse(
+        "SUBSYSTEM==\"usb\", \\\n"
+        "   ATTR{idVendor}==\"1209\", \\\r\n"
+        "# dropped\n"
+        "   MODE=\"0666\"\n"
+        "KERNEL==\"hidraw*\", \\\n"
+        "\n"
+        "TAG+=\"x\" \\");
+
+    QCOMPARE(file.size(), 3);
+    QCOMPARE(file[0].line, 1);
+    QCOMPARE(file[0].lineCount, 4);
+    QCOMPARE(file[0].count, 3);
+    QCOMPARE(text(file[0].find(u"MODE")->value), QString("0666"));
+
+    // An empty line ends the statement, as does the end of the file
+    QCOMPARE(file[1].line, 5);
+    QCOMPARE(file[1].count, 1);
+    QCOMPARE(file[2].line, 7);
+    QCOMPARE(text(file[2].assignments[0].key), QString("TAG"));
+
+    QCOMPARE(file.diagnostics().size(), 1);
+    QCOMPARE(file.diagnostics()[0].line, 3);
+    QCOMPARE(file.diagnostics()[0].severity, RulesDiagnostic::Warning);
+}
+
+void TestUdevRules::testGotoAndLabel() {
+    UdevRulesFile file = UdevRulesParser::parse(
+        "ACTION!=\"add\", GOTO=\"end\"\n"
+        "SUBSYSTEM!=\"hidraw\", GOTO=\"missing\"\n"
+        "MODE=\"0666\"\n"
+        "LABEL=\"end\"\n");
+
+    QCOMPARE(file.size(), 4);
+    QCOMPARE(text(file[0].gotoLabel()), QString("end"));
+    QCOMPARE(text(file[3].label()), QString("end"));
+    QCOMPARE(file.findLabel(u"end"), 3);
+    QCOMPARE(file.findLabel(u"end", 3), -1);
+
+    QCOMPARE(file.diagnostics().size(), 1);
+    QCOMPARE(file.diagnostics()[0].line, 2);
+    QVERIFY(file.diagnostics()[0].message.contains("missing"));
+    QVERIFY(!file.hasErrors());
+
+    // udev only jumps forward; a label repeated further on still counts
+    file = UdevRulesParser::parse(
+        "LABEL=\"back\"\n"
+        "LABEL=\"twice\"\n"
+        "GOTO=\"back\"\n"
+        "GOTO=\"twice\"\n"
+        "LABEL=\"twice\"\n");
+    QCOMPARE(file.diagnostics().size(), 1);
+    QCOMPARE(file.diagnostics()[0].line, 3);
+}
+
+void TestUdevRules::testSyntaxErrors() {
+    UdevRulesFile file = UdevRulesParser::parse(
+        "KERNEL==\"hidraw*\", MODE=\"0666\n"
+        "ATTRS{idVendor==\"046d\"\n"
+        "KERNEL=>\"x\"\n"
+        "KERNEL==hidraw\n"
+        "MODE=\"0600\"\n");
+
+    // Broken lines are dropped, the rest of the file still parses
+    QCOMPARE(file.size(), 1);
+    QCOMPARE(file[0].line, 5);
+    QVERIFY(file.hasErrors());
+
+    QVector<int> lines;
+    for (const auto& d : file.diagnostics()) {
+        QCOMPARE(d.severity, RulesDiagnostic::Error);
+        lines << d.line;
+    }
+    QCOMPARE(lines, QVector<int>({ 1, 2, 3, 4 }));
+}
+
+void TestUdevRules::testKeyWarnings() {
+    UdevRulesFile file = UdevRulesParser::parse(
+        "BOGUS==\"x\", MODE==\"0666\", ATTRS==\"y\", KERNEL{x}==\"z\", GOTO+=\"a\"\n"
+        "LABEL=\"a\"\n");
+
+    QCOMPARE(file.size(), 2);
+    QStringList messages;
+    for (const auto& d : file.diagnostics()) {
+        QCOMPARE(d.severity, RulesDiagnostic::Warning);
+        messages << d.message;
+    }
+    QCOMPARE(messages.size(), 5);
+    QVERIFY(messages[0].contains("BOGUS"));
+    QVERIFY(messages[1].contains("MODE"));
+    QVERIFY(messages[2].contains("ATTRS{name}"));
+    QVERIFY(messages[3].contains("KERNEL"));
+    QVERIFY(messages[4].contains("GOTO"));
+}
+
+void TestUdevRules::testBulkAllocation() {
+    QString content;
+    for (int i = 0; i < 10000; ++i) {
+        content += QString("KERNEL==\"hidraw*\", SUBSYSTEM==\"hidraw\", ATTRS{idVendor}==\"%1\", "
+                           "ATTRS{idProduct}==\"%2\", MODE=\"0666\"\n")
+            .arg(i, 4, 16, QLatin1Char('0')).arg(i * 7 % 0x10000, 4, 16, QLatin1Char('0'));
+    }
+
+    UdevRulesFile file = UdevRulesParser::parse(content);
+    QCOMPARE(file.size(), 10000);
+    QVERIFY(file.diagnostics().isEmpty());
+    QCOMPARE(file.arena().blockCount(), 1);
+    QCOMPARE(text(file[9999].find(u"ATTRS")->value), QString("270f"));
+}
+
+void TestUdevRules::testSurvivesMove() {
+    UdevRulesFile moved;
+    {
+        UdevRulesFile file = UdevRulesParser::parse("KERNEL==\"a\", \\\nMODE=\"0600\"\n", "x.rules");
+        moved = std::move(file);
+        QCOMPARE(file.size(), 0);
+    }
+    QCOMPARE(moved.fileName(), QString("x.rules"));
+    QCOMPARE(moved.size(), 1);
+    QCOMPARE(text(moved[0].find(u"MODE")->value), QString("0600"));
+}
+
+void TestUdevRules::testSystemRules() {
+    QStringList files;
+    for (const QString& dir : { QString("/usr/lib/udev/rules.d"), QString("/lib/udev/rules.d") }) {
+        for (const QFileInfo& info : QDir(dir).entryInfoList({ "*.rules" }, QDir::Files)) {
+            files << info.filePath();
+        }
+        if (!files.isEmpty()) break;
+    }
+    if (files.isEmpty()) {
+        QSKIP("No system udev rules installed");
+    }
+
+    // Whatever udev accepts must parse without syntax errors
+    for (const QString& path : files) {
+        QString error;
+        UdevRulesFile file = UdevRulesParser::parseFile(path, &error);
+        QVERIFY2(error.isEmpty(), qPrintable(error));
+        for (const auto& d : file.diagnostics()) {
+            QVERIFY2(d.severity != RulesDiagnostic::Error,
+                     qPrintable(QString("%1:%2: %3").arg(path).arg(d.line).arg(d.message)));
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(TestUdevRules)
+#include "test_udevrules.moc"
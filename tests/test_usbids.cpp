@@ -0,0 +1,133 @@
+#include <QtTest/QtTest>
+#include "UsbIds.h"
+#include "Types.h"
+
+using namespace udevme;
+
+class TestUsbIds : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void testLookups();
+    void testSkipsInterfacesAndTrailingTables();
+    void testResolveFillsOnlyMissing();
+    void testMissingFile();
+    void testSystemFile();
+
+private:
+    QTemporaryDir m_dir;
+    QString m_path;
+};
+
+void TestUsbIds::initTestCase() {
+    QVERIFY(m_dir.isValid());
+    m_path = m_dir.filePath("usb.ids");
+
+    // Trimmed-down copy of the real layout, including the tables after the
+    // vendor list whose lines look a lot like IDs
+    QFile file(m_path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(
+        "#\n"
+        "#\tList of USB ID's\n"
+        "#\n"
+        "# Syntax:\n"
+        "# vendor  vendor_name\n"
+        "#\tdevice  device_name\t\t\t\t<-- single tab\n"
+        "\n"
+        "046d  Logitech, Inc.\n"
+        "\tc52b  Unifying Receiver\n"
+        "\t\t0000  Interface that must not become a product\n"
+        "\tc534  Unifying Receiver \n"
+        "1209  Generic\r\n"
+        "\tbeef  Zürich Board\r\n"
+        "abcd  Vendor Without Products\n"
+        "\n"
+        "# List of known device classes, subclasses and protocols\n"
+        "C 00  (Defined at Interface level)\n"
+        "\t00  Unused\n"
+        "C 03  Human Interface Device\n"
+        "HID 0000  Undefined\n"
+        "AT 0000  Undefined\n"
+        "0001  Not a vendor\n");
+    file.close();
+}
+
+void TestUsbIds::testLookups() {
+    UsbIds ids(m_path);
+    QVERIFY(ids.isLoaded());
+    QCOMPARE(ids.vendorCount(), 3);
+    QCOMPARE(ids.productCount(), 3);
+
+    QCOMPARE(ids.vendorName(0x046d), QString("Logitech, Inc."));
+    QCOMPARE(ids.productName(0x046d, 0xc52b), QString("Unifying Receiver"));
+    QCOMPARE(ids.productName(0x046d, 0xc534), QString("Unifying Receiver"));
+    QCOMPARE(ids.vendorName(0x1209), QString("Generic"));
+    QCOMPARE(ids.productName(0x1209, 0xbeef), QString::fromUtf8("Zürich Board"));
+    QCOMPARE(ids.vendorName(0xabcd), QString("Vendor Without Products"));
+
+    QVERIFY(ids.vendorName(0x1234).isEmpty());
+    QVERIFY(ids.productName(0x046d, 0x1234).isEmpty());
+    QVERIFY(ids.productName(0xabcd, 0xc52b).isEmpty());
+}
+
+void TestUsbIds::testSkipsInterfacesAndTrailingTables() {
+    UsbIds ids(m_path);
+    QVERIFY(ids.productName(0x046d, 0x0000).isEmpty());
+    QVERIFY(ids.vendorName(0x0001).isEmpty());
+    QVERIFY(ids.vendorName(0x0c00).isEmpty());
+}
+
+void TestUsbIds::testResolveFillsOnlyMissing() {
+    UsbIds ids(m_path);
+
+    DeviceInfo bare;
+    bare.vendorId = "046d";
+    bare.productId = "c52b";
+    QVERIFY(ids.resolve(bare));
+    QCOMPARE(bare.name, QString("Unifying Receiver"));
+    QCOMPARE(bare.manufacturer, QString("Logitech, Inc."));
+    QCOMPARE(bare.displayName(), QString("Unifying Receiver"));
+
+    DeviceInfo named;
+    named.vendorId = "046D";
+    named.productId = "C52B";
+    named.name = "My Receiver";
+    QVERIFY(ids.resolve(named));
+    QCOMPARE(named.name, QString("My Receiver"));
+    QCOMPARE(named.manufacturer, QString("Logitech, Inc."));
+
+    DeviceInfo unknown;
+    unknown.vendorId = "dead";
+    unknown.productId = "beef";
+    QVERIFY(!ids.resolve(unknown));
+    QVERIFY(unknown.name.isEmpty());
+    QCOMPARE(unknown.displayName(), QString("dead:beef"));
+}
+
+void TestUsbIds::testMissingFile() {
+    UsbIds ids(m_dir.filePath("does-not-exist"));
+    QVERIFY(!ids.isLoaded());
+    QVERIFY(ids.vendorName(0x046d).isEmpty());
+
+    DeviceInfo dev;
+    dev.vendorId = "046d";
+    dev.productId = "c52b";
+    QVERIFY(!ids.resolve(dev));
+}
+
+void TestUsbIds::testSystemFile() {
+    const UsbIds& ids = UsbIds::instance();
+    if (!ids.isLoaded()) {
+        QSKIP("No usb.ids installed");
+    }
+
+    // The Linux Foundation root hub IDs have been in usb.ids forever
+    QVERIFY(!ids.vendorName(0x1d6b).isEmpty());
+    QVERIFY(!ids.productName(0x1d6b, 0x0002).isEmpty());
+    QVERIFY(ids.vendorCount() > 1000);
+}
+
+QTEST_GUILESS_MAIN(TestUsbIds)
+#include "test_usbids.moc"
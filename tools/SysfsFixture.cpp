@@ -0,0 +1,495 @@
+#include "SysfsFixture.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QSet>
+#include <QTemporaryDir>
+
+#include <unistd.h>
+#include <cctype>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include <tuple>
+
+namespace udevme {
+
+namespace {
+
+// Devices per synthetic bus; keeps devnum below the 128 per-bus limit
+constexpr int kDevicesPerBus = 120;
+constexpr int kHidrawMajor = 241;
+
+struct Model {
+    uint vendorId = 0;
+    uint productId = 0;
+    QString name;
+    QString manufacturer;
+    bool hasStrings = true;
+};
+
+struct UsbSlot {
+    int busnum = 0;
+    int devnum = 0;
+    int port = 0;
+    int model = 0;
+    bool hasHidraw = false;
+};
+
+struct Layout {
+    QVector<Model> models;
+    QVector<UsbSlot> usb;
+    QVector<Model> bluetooth;
+    int buses = 0;
+};
+
+// Deterministic for a given Options so expectedDevices() needs no tree.
+// Every 10th device repeats the previous model (same device on two ports)
+// and every 7th model has no string descriptors.
+Layout buildLayout(const SysfsFixture::Options& options) {
+    static const char* const kProducts[] = {
+        "Keyboard", "Mouse", "Gamepad", "Headset", "Flash Drive",
+        "Webcam", "Serial Adapter", "Macro Pad", "Drawing Tablet", "Hub Controller"
+    };
+    static const char* const kVendors[] = {
+        "Acme", "Globex", "Initech", "Umbrella", "Hooli", "Zürich Labs"
+    };
+
+    Layout layout;
+    QRandomGenerator rng(options.seed);
+    QSet<quint32> used;
+
+    auto uniqueId = [&](uint vidBase, uint vidRange) {
+        for (;;) {
+            uint vid = vidBase + rng.bounded(vidRange);
+            uint pid = rng.bounded(1u, 0x10000u);
+            quint32 key = (vid << 16) | pid;
+            if (vid == 0x1d6b || used.contains(key)) continue; // root hub vendor
+            used.insert(key);
+            return key;
+        }
+    };
+
+    const int usbCount = qMax(0, options.usbDevices);
+    const int hidrawCount = qBound(0, options.hidrawNodes, usbCount);
+
+    for (int i = 0; i < usbCount; ++i) {
+        if (i % 10 == 9) {
+            layout.models.append(layout.models.last());
+        } else {
+            quint32 key = uniqueId(0x0400, 0x2c00);
+            Model m;
+            m.vendorId = key >> 16;
+            m.productId = key & 0xffff;
+            m.hasStrings = (i % 7 != 6);
+            if (m.hasStrings) {
+                m.name = QString("%1 %2").arg(QString::fromLatin1(kProducts[rng.bounded(10)])).arg(i + 1);
+                m.manufacturer = QString::fromUtf8(kVendors[rng.bounded(6)]);
+            }
+            layout.models.append(m);
+        }
+
+        UsbSlot slot;
+        slot.busnum = i / kDevicesPerBus + 1;
+        slot.port = i % kDevicesPerBus + 1;
+        slot.devnum = slot.port + 1;    // devnum 1 is the root hub
+        slot.model = i;
+        slot.hasHidraw = i < hidrawCount;
+        layout.usb.append(slot);
+    }
+    layout.buses = qMax(1, (usbCount + kDevicesPerBus - 1) / kDevicesPerBus);
+
+    // Separate vendor range so Bluetooth devices never collide with USB ones
+    for (int i = 0; i < qMax(0, options.bluetoothDevices); ++i) {
+        quint32 key = uniqueId(0x3000, 0x1000);
+        Model m;
+        m.vendorId = key >> 16;
+        m.productId = key & 0xffff;
+        m.name = QString("BT %1 %2").arg(QString::fromLatin1(kProducts[rng.bounded(10)])).arg(i + 1);
+        layout.bluetooth.append(m);
+    }
+
+    // The same model used over its dongle and over Bluetooth
+    for (int i = 0; i < qBound(0, options.dualBusDevices, int(layout.models.size())); ++i) {
+        Model m = layout.models[i];
+        m.name = QString("BT Dual %1").arg(i + 1);
+        m.manufacturer.clear();
+        layout.bluetooth.append(m);
+    }
+
+    return layout;
+}
+
+QString hex4(uint id) {
+    return QString("%1").arg(id, 4, 16, QLatin1Char('0'));
+}
+
+QString hex4Upper(uint id) {
+    return hex4(id).toUpper();
+}
+
+// udev's *_ENC escaping: anything outside a small safe set becomes \xHH
+QString udevEncode(const QString& value) {
+    QByteArray out;
+    for (char c : value.toUtf8()) {
+        uchar u = static_cast<uchar>(c);
+        if (u >= 0x80 || isalnum(u) || strchr("#+-.:=@_", c)) {
+            out += c;
+        } else {
+            out += "\\x" + QByteArray::number(u, 16).rightJustified(2, '0');
+        }
+    }
+    return QString::fromUtf8(out);
+}
+
+// Kernel HID device names end in a 4-digit uppercase hex sequence number
+QString hidSequenceName(int sequence) {
+    return QString("%1").arg(sequence, 4, 16, QLatin1Char('0')).toUpper();
+}
+
+class TreeWriter {
+public:
+    explicit TreeWriter(const QString& root) : m_root(root) {}
+
+    bool write(const QString& path, const QString& content) {
+        return write(path, content.toUtf8());
+    }
+
+    bool write(const QString& path, const QByteArray& content) {
+        const QString full = m_root + '/' + path;
+        if (!QDir().mkpath(QFileInfo(full).path())) return fail("Cannot create directory for " + full);
+        QFile file(full);
+        if (!file.open(QIODevice::WriteOnly) || file.write(content) != content.size()) {
+            return fail("Cannot write " + full);
+        }
+        return true;
+    }
+
+    // Symlink with a target relative to the link, like the kernel creates
+    bool link(const QString& path, const QString& target) {
+        const QString full = m_root + '/' + path;
+        if (!QDir().mkpath(QFileInfo(full).path())) return fail("Cannot create directory for " + full);
+        if (::symlink(QFile::encodeName(target).constData(), QFile::encodeName(full).constData()) != 0) {
+            return fail("Cannot create symlink " + full);
+        }
+        return true;
+    }
+
+    bool ok() const { return m_error.isEmpty(); }
+    QString error() const { return m_error; }
+
+private:
+    bool fail(const QString& message) {
+        if (m_error.isEmpty()) m_error = message;
+        return false;
+    }
+
+    QString m_root;
+    QString m_error;
+};
+
+QString usbUevent(int busnum, int devnum, uint vid, uint pid, const char* driver) {
+    return QString("MAJOR=189\nMINOR=%1\nDEVNAME=bus/usb/%2/%3\nDEVTYPE=usb_device\n"
+                   "DRIVER=%4\nPRODUCT=%5/%6/100\nTYPE=0/0/0\nBUSNUM=%2\nDEVNUM=%3\n")
+        .arg((busnum - 1) * 128 + devnum - 1)
+        .arg(busnum, 3, 10, QLatin1Char('0'))
+        .arg(devnum, 3, 10, QLatin1Char('0'))
+        .arg(QLatin1String(driver))
+        .arg(vid, 0, 16)
+        .arg(pid, 0, 16);
+}
+
+QString udevEntry(int busnum, int devnum, const Model& m) {
+    // usb_id falls back to the hex IDs when there are no string descriptors
+    const QString vendor = m.hasStrings ? m.manufacturer : hex4(m.vendorId);
+    const QString model = m.hasStrings ? m.name : hex4(m.productId);
+    return QString("S:bus/usb/%1/%2\nI:1000000\n"
+                   "E:ID_VENDOR=%3\nE:ID_VENDOR_ENC=%4\nE:ID_VENDOR_ID=%5\n"
+                   "E:ID_MODEL=%6\nE:ID_MODEL_ENC=%7\nE:ID_MODEL_ID=%8\n"
+                   "E:ID_REVISION=0100\nE:ID_BUS=usb\nE:ID_USB_INTERFACES=:030101:\n"
+                   "G:uaccess\nQ:uaccess\nV:1\n")
+        .arg(busnum, 3, 10, QLatin1Char('0'))
+        .arg(devnum, 3, 10, QLatin1Char('0'))
+        .arg(QString(vendor).replace(' ', '_'), udevEncode(vendor), hex4(m.vendorId))
+        .arg(QString(model).replace(' ', '_'), udevEncode(model), hex4(m.productId));
+}
+
+// Writes <hidDevice>/uevent, its hidraw node and the class symlink.
+// hidDevice is relative to sys/.
+void writeHidDevice(TreeWriter& w, const QString& hidDevice, uint bus,
+                    uint vid, uint pid, const QString& name, int hidraw) {
+    const QString hidName = hidDevice.section('/', -1);
+    w.write("sys/" + hidDevice + "/uevent",
+            QString("DRIVER=hid-generic\nHID_ID=%1:0000%2:0000%3\nHID_NAME=%4\n"
+                    "MODALIAS=hid:b%1g0001v0000%2p0000%3\n")
+                .arg(hex4Upper(bus), hex4Upper(vid), hex4Upper(pid), name));
+
+    const QString node = QString("hidraw%1").arg(hidraw);
+    const QString nodeDir = hidDevice + "/hidraw/" + node;
+    w.write("sys/" + nodeDir + "/uevent",
+            QString("MAJOR=%1\nMINOR=%2\nDEVNAME=%3\n").arg(kHidrawMajor).arg(hidraw).arg(node));
+    w.write("sys/" + nodeDir + "/dev", QString("%1:%2\n").arg(kHidrawMajor).arg(hidraw));
+    w.link("sys/" + nodeDir + "/device", "../../../" + hidName);
+    w.link("sys/class/hidraw/" + node, "../../" + nodeDir);
+}
+
+QByteArray readSmall(const QString& path, bool* ok) {
+    QFile file(path);
+    *ok = file.open(QIODevice::ReadOnly);
+    return *ok ? file.read(64 * 1024) : QByteArray();
+}
+
+QString readLink(const QString& path) {
+    char buf[PATH_MAX];
+    ssize_t len = ::readlink(QFile::encodeName(path).constData(), buf, sizeof(buf) - 1);
+    return len > 0 ? QFile::decodeName(QByteArray(buf, static_cast<int>(len))) : QString();
+}
+
+// Keeps only lines whose prefix is in the allow list
+QByteArray filterLines(const QByteArray& data, std::initializer_list<const char*> allowed) {
+    QByteArray out;
+    for (const QByteArray& line : data.split('\n')) {
+        for (const char* prefix : allowed) {
+            if (line.startsWith(prefix)) {
+                out += line + '\n';
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+bool runTar(const QStringList& args, QString* error) {
+    QProcess tar;
+    tar.start("tar", args);
+    if (!tar.waitForFinished(60000) || tar.exitStatus() != QProcess::NormalExit || tar.exitCode() != 0) {
+        if (error) *error = "tar failed: " + QString::fromLocal8Bit(tar.readAllStandardError()).trimmed();
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool SysfsFixture::generate(const QString& root, const Options& options, QString* error) {
+    QDir rootDir(root);
+    if (rootDir.exists() && !rootDir.isEmpty()) {
+        if (error) *error = "Fixture root is not empty: " + root;
+        return false;
+    }
+
+    const Layout layout = buildLayout(options);
+    TreeWriter w(root);
+    int hidSequence = 1;
+    int hidraw = 0;
+
+    // Root hubs: enumerated like any device but skipped by the scanner
+    for (int b = 1; b <= layout.buses; ++b) {
+        const QString hub = QString("devices/pci0000:00/0000:00:%1.0/usb%2")
+            .arg(0x13 + b, 2, 16, QLatin1Char('0')).arg(b);
+        const QString hubName = QString("usb%1").arg(b);
+        const QString hubIface = QString("%1-0:1.0").arg(b);
+
+        w.write("sys/" + hub + "/uevent", usbUevent(b, 1, 0x1d6b, 0x0002, "usb"));
+        w.write("sys/" + hub + "/idVendor", QString("1d6b\n"));
+        w.write("sys/" + hub + "/idProduct", QString("0002\n"));
+        w.write("sys/" + hub + "/product", QString("xHCI Host Controller\n"));
+        w.write("sys/" + hub + "/manufacturer", QString("Linux xhci-hcd\n"));
+        w.write("sys/" + hub + '/' + hubIface + "/uevent",
+                QString("DEVTYPE=usb_interface\nDRIVER=hub\nPRODUCT=1d6b/2/606\nTYPE=9/0/1\nINTERFACE=9/0/0\n"));
+        w.link("sys/bus/usb/devices/" + hubName, "../../../" + hub);
+        w.link("sys/bus/usb/devices/" + hubIface, "../../../" + hub + '/' + hubIface);
+
+        Model hubModel;
+        hubModel.vendorId = 0x1d6b;
+        hubModel.productId = 0x0002;
+        hubModel.name = "xHCI Host Controller";
+        hubModel.manufacturer = "Linux xhci-hcd";
+        w.write(QString("run/udev/data/c189:%1").arg((b - 1) * 128), udevEntry(b, 1, hubModel));
+    }
+
+    for (const UsbSlot& slot : layout.usb) {
+        const Model& m = layout.models[slot.model];
+        const QString name = QString("%1-%2").arg(slot.busnum).arg(slot.port);
+        const QString dev = QString("devices/pci0000:00/0000:00:%1.0/usb%2/%3")
+            .arg(0x13 + slot.busnum, 2, 16, QLatin1Char('0')).arg(slot.busnum).arg(name);
+        const QString iface = name + ":1.0";
+        const int minor = (slot.busnum - 1) * 128 + slot.devnum - 1;
+
+        w.write("sys/" + dev + "/uevent", usbUevent(slot.busnum, slot.devnum, m.vendorId, m.productId, "usb"));
+        w.write("sys/" + dev + "/idVendor", hex4(m.vendorId) + '\n');
+        w.write("sys/" + dev + "/idProduct", hex4(m.productId) + '\n');
+        w.write("sys/" + dev + "/busnum", QString("%1\n").arg(slot.busnum));
+        w.write("sys/" + dev + "/devnum", QString("%1\n").arg(slot.devnum));
+        w.write("sys/" + dev + "/dev", QString("189:%1\n").arg(minor));
+        if (m.hasStrings) {
+            w.write("sys/" + dev + "/product", m.name + '\n');
+            w.write("sys/" + dev + "/manufacturer", m.manufacturer + '\n');
+        }
+        w.write("sys/" + dev + '/' + iface + "/uevent",
+                QString("DEVTYPE=usb_interface\nDRIVER=usbhid\nPRODUCT=%1/%2/100\nTYPE=0/0/0\nINTERFACE=3/1/1\n")
+                    .arg(m.vendorId, 0, 16).arg(m.productId, 0, 16));
+        w.link("sys/bus/usb/devices/" + name, "../../../" + dev);
+        w.link("sys/bus/usb/devices/" + iface, "../../../" + dev + '/' + iface);
+        w.write(QString("run/udev/data/c189:%1").arg(minor), udevEntry(slot.busnum, slot.devnum, m));
+
+        if (slot.hasHidraw) {
+            const QString hidDevice = QString("%1/%2/%3:%4:%5.%6")
+                .arg(dev, iface, hex4Upper(HidBusUsb), hex4Upper(m.vendorId), hex4Upper(m.productId),
+                     hidSequenceName(hidSequence++));
+            writeHidDevice(w, hidDevice, HidBusUsb, m.vendorId, m.productId,
+                           (m.manufacturer + ' ' + m.name).trimmed(), hidraw++);
+        }
+    }
+
+    // Bluetooth LE HID goes through uhid and has no USB ancestor
+    for (const Model& m : layout.bluetooth) {
+        const QString hidDevice = QString("devices/virtual/misc/uhid/%1:%2:%3.%4")
+            .arg(hex4Upper(0x05), hex4Upper(m.vendorId), hex4Upper(m.productId),
+                 hidSequenceName(hidSequence++));
+        writeHidDevice(w, hidDevice, 0x05, m.vendorId, m.productId, m.name, hidraw++);
+    }
+
+    // Entries the udev database backend has to skip
+    w.write(QString("run/udev/data/c13:64"), QString("E:ID_INPUT=1\nE:ID_VENDOR_ID=dead\nE:ID_MODEL_ID=beef\n"));
+    w.write(QString("run/udev/data/+usb:1-1:1.0"), QString("E:ID_VENDOR_ID=dead\n"));
+    w.write(QString("run/udev/data/n2"), QString("E:ID_NET_NAME=eth0\n"));
+
+    if (!w.ok()) {
+        if (error) *error = w.error();
+        return false;
+    }
+    return true;
+}
+
+QVector<DeviceInfo> SysfsFixture::expectedDevices(const Options& options) {
+    const Layout layout = buildLayout(options);
+    QVector<DeviceInfo> devices;
+    QHash<quint32, int> index;
+
+    for (const UsbSlot& slot : layout.usb) {
+        const Model& m = layout.models[slot.model];
+        quint32 key = (m.vendorId << 16) | m.productId;
+        auto it = index.constFind(key);
+        if (it != index.cend()) {
+            devices[it.value()].hasHidraw |= slot.hasHidraw;
+            continue;
+        }
+
+        DeviceInfo dev;
+        dev.vendorId = hex4(m.vendorId);
+        dev.productId = hex4(m.productId);
+        dev.name = m.name;
+        dev.manufacturer = m.manufacturer;
+        dev.hasUsb = true;
+        dev.hasHidraw = slot.hasHidraw;
+        index.insert(key, devices.size());
+        devices.append(dev);
+    }
+
+    for (const Model& m : layout.bluetooth) {
+        DeviceInfo dev;
+        dev.vendorId = hex4(m.vendorId);
+        dev.productId = hex4(m.productId);
+        dev.name = m.name;
+        dev.bus = hidBusName(0x05);
+        dev.hasHidraw = true;
+        devices.append(dev);
+    }
+
+    std::sort(devices.begin(), devices.end(), [](const DeviceInfo& a, const DeviceInfo& b) {
+        return std::tie(a.vendorId, a.productId, a.bus) < std::tie(b.vendorId, b.productId, b.bus);
+    });
+    return devices;
+}
+
+bool SysfsFixture::capture(const QString& sysRoot, const QString& udevData,
+                           const QString& archive, QString* error) {
+    QTemporaryDir staging;
+    if (!staging.isValid()) {
+        if (error) *error = "Cannot create staging directory";
+        return false;
+    }
+
+    const QString canonicalSys = QFileInfo(sysRoot).canonicalFilePath();
+    TreeWriter w(staging.path());
+
+    // Copies the listed attributes of a real device directory into the
+    // staging tree at the same position under sys/
+    auto copyAttributes = [&](const QString& realDir, std::initializer_list<const char*> names) {
+        const QString rel = realDir.mid(canonicalSys.size() + 1);
+        for (const char* name : names) {
+            bool ok = false;
+            QByteArray data = readSmall(realDir + '/' + name, &ok);
+            if (ok) w.write("sys/" + rel + '/' + name, data);
+        }
+        return rel;
+    };
+
+    const QString busDir = sysRoot + "/bus/usb/devices";
+    for (const QString& entry : QDir(busDir).entryList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::System)) {
+        const QString link = readLink(busDir + '/' + entry);
+        const QString real = QFileInfo(busDir + '/' + entry).canonicalFilePath();
+        if (link.isEmpty() || !real.startsWith(canonicalSys + '/')) continue;
+
+        // No serial: it identifies the user's hardware and the scanner never reads it
+        copyAttributes(real, {"uevent", "idVendor", "idProduct", "product", "manufacturer",
+                              "busnum", "devnum", "dev"});
+        w.link("sys/bus/usb/devices/" + entry, link);
+    }
+
+    const QString classDir = sysRoot + "/class/hidraw";
+    for (const QString& entry : QDir(classDir).entryList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::System)) {
+        const QString link = readLink(classDir + '/' + entry);
+        const QString real = QFileInfo(classDir + '/' + entry).canonicalFilePath();
+        if (link.isEmpty() || !real.startsWith(canonicalSys + '/')) continue;
+
+        const QString rel = copyAttributes(real, {"uevent", "dev"});
+        w.link("sys/class/hidraw/" + entry, link);
+
+        const QString deviceLink = readLink(real + "/device");
+        const QString hidDevice = QFileInfo(real + "/device").canonicalFilePath();
+        if (deviceLink.isEmpty() || !hidDevice.startsWith(canonicalSys + '/')) continue;
+        w.link("sys/" + rel + "/device", deviceLink);
+
+        // HID_UNIQ and HID_PHYS carry serials and Bluetooth addresses
+        bool ok = false;
+        QByteArray uevent = readSmall(hidDevice + "/uevent", &ok);
+        if (ok) {
+            w.write("sys/" + hidDevice.mid(canonicalSys.size() + 1) + "/uevent",
+                    filterLines(uevent, {"DRIVER=", "HID_ID=", "HID_NAME=", "MODALIAS="}));
+        }
+    }
+
+    for (const QString& entry : QDir(udevData).entryList({"c189:*"}, QDir::Files)) {
+        bool ok = false;
+        QByteArray data = readSmall(udevData + '/' + entry, &ok);
+        if (!ok) continue;
+        w.write("run/udev/data/" + entry,
+                filterLines(data, {"E:ID_VENDOR_ID=", "E:ID_MODEL_ID=", "E:ID_VENDOR=", "E:ID_MODEL=",
+                                   "E:ID_VENDOR_ENC=", "E:ID_MODEL_ENC=",
+                                   "E:ID_VENDOR_FROM_DATABASE=", "E:ID_MODEL_FROM_DATABASE="}));
+    }
+
+    if (!w.ok()) {
+        if (error) *error = w.error();
+        return false;
+    }
+
+    QDir().mkpath(staging.path() + "/sys");
+    QDir().mkpath(staging.path() + "/run/udev/data");
+    return runTar({"-czf", QFileInfo(archive).absoluteFilePath(), "-C", staging.path(), "sys", "run"}, error);
+}
+
+bool SysfsFixture::extract(const QString& archive, const QString& root, QString* error) {
+    if (!QDir().mkpath(root)) {
+        if (error) *error = "Cannot create " + root;
+        return false;
+    }
+    return runTar({"-xzf", QFileInfo(archive).absoluteFilePath(), "-C", root}, error);
+}
+
+} // namespace udevme
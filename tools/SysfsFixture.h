@@ -0,0 +1,51 @@
+#ifndef SYSFSFIXTURE_H
+#define SYSFSFIXTURE_H
+
+#include <QString>
+#include <QVector>
+#include "Types.h"
+
+namespace udevme {
+
+// Builds and captures the slice of sysfs and /run/udev/data that
+// DeviceScanner reads, so scans can be tested and benchmarked offline.
+//
+// A fixture root has the same layout as the real system:
+//   <root>/sys/devices/...             device directories
+//   <root>/sys/bus/usb/devices/*       relative symlinks into devices/
+//   <root>/sys/class/hidraw/*          relative symlinks into devices/
+//   <root>/run/udev/data/c189:*        udev database entries
+// Point the scanner at it with sysfsRoot() and udevDataPath().
+class SysfsFixture {
+public:
+    struct Options {
+        int usbDevices = 10;        // excluding root hubs
+        int hidrawNodes = 4;        // attached to the first USB devices
+        int bluetoothDevices = 1;   // uhid devices with only a hidraw node
+        int dualBusDevices = 0;     // Bluetooth devices sharing the vid:pid of a USB one
+        quint32 seed = 1;
+    };
+
+    static QString sysfsRoot(const QString& root) { return root + "/sys"; }
+    static QString udevDataPath(const QString& root) { return root + "/run/udev/data"; }
+
+    // Writes a synthetic tree under root, which must be empty or missing
+    static bool generate(const QString& root, const Options& options, QString* error = nullptr);
+
+    // What a scan of generate(root, options) must return, sorted by vid:pid
+    // and then bus
+    static QVector<DeviceInfo> expectedDevices(const Options& options);
+
+    // Copies the scanner-relevant files of a live system into a .tar.gz.
+    // Serial numbers, HID_UNIQ/HID_PHYS and unrelated udev properties are
+    // left out so the archive can be attached to a bug report.
+    static bool capture(const QString& sysRoot, const QString& udevData,
+                        const QString& archive, QString* error = nullptr);
+
+    // Unpacks a captured archive into root
+    static bool extract(const QString& archive, const QString& root, QString* error = nullptr);
+};
+
+} // namespace udevme
+
+#endif // SYSFSFIXTURE_H
@@ -0,0 +1,110 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include "DeviceScanner.h"
+#include "SysfsFixture.h"
+
+using namespace udevme;
+
+// udevme-fixture generate <dir> [--usb N] [--hidraw M] [--bluetooth K] [--seed S]
+// udevme-fixture capture <archive.tar.gz> [--sys /sys] [--udev-data /run/udev/data]
+// udevme-fixture scan <dir|archive.tar.gz> [--backend sysfs|uevent|udev-db]
+
+namespace {
+
+QTextStream& err() {
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+int generate(const QCommandLineParser& parser, const QString& root) {
+    SysfsFixture::Options options;
+    options.usbDevices = parser.value("usb").toInt();
+    options.hidrawNodes = parser.value("hidraw").toInt();
+    options.bluetoothDevices = parser.value("bluetooth").toInt();
+    options.seed = parser.value("seed").toUInt();
+
+    QString error;
+    if (!SysfsFixture::generate(root, options, &error)) {
+        err() << error << Qt::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int capture(const QCommandLineParser& parser, const QString& archive) {
+    QString error;
+    if (!SysfsFixture::capture(parser.value("sys"), parser.value("udev-data"), archive, &error)) {
+        err() << error << Qt::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int scan(const QCommandLineParser& parser, const QString& input) {
+    QTemporaryDir extracted;
+    QString root = input;
+    if (QFileInfo(input).isFile()) {
+        QString error;
+        if (!extracted.isValid() || !SysfsFixture::extract(input, extracted.path(), &error)) {
+            err() << "Cannot extract " << input << ": " << error << Qt::endl;
+            return 1;
+        }
+        root = extracted.path();
+    }
+
+    const QString backend = parser.value("backend");
+    DeviceScanner scanner;
+    scanner.setSysfsRoot(SysfsFixture::sysfsRoot(root));
+    scanner.setUdevDataPath(SysfsFixture::udevDataPath(root));
+    if (backend == "sysfs") scanner.setBackend(DeviceScanner::Backend::Sysfs);
+    else if (backend == "uevent") scanner.setBackend(DeviceScanner::Backend::SysfsUevent);
+    else if (backend == "udev-db") scanner.setBackend(DeviceScanner::Backend::UdevDatabase);
+    else {
+        err() << "Unknown backend: " << backend << Qt::endl;
+        return 1;
+    }
+
+    QJsonArray list;
+    for (const DeviceInfo& dev : scanner.scanDevices()) {
+        list.append(dev.toJson());
+    }
+    QTextStream(stdout) << QJsonDocument(list).toJson();
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("udevme-fixture");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generate, capture and replay sysfs trees for the device scanner");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "generate, capture or scan");
+    parser.addPositionalArgument("path", "Fixture directory or archive");
+    parser.addOptions({
+        {"usb", "USB devices to generate (excluding root hubs)", "n", "10"},
+        {"hidraw", "hidraw nodes on the generated USB devices", "n", "4"},
+        {"bluetooth", "Bluetooth HID devices to generate", "n", "1"},
+        {"seed", "Seed for generated IDs and names", "n", "1"},
+        {"sys", "sysfs root to capture", "path", "/sys"},
+        {"udev-data", "udev database to capture", "path", "/run/udev/data"},
+        {"backend", "Scanner backend: sysfs, uevent or udev-db", "name", "uevent"},
+    });
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 2) parser.showHelp(1);
+
+    const QString& command = args[0];
+    if (command == "generate") return generate(parser, args[1]);
+    if (command == "capture") return capture(parser, args[1]);
+    if (command == "scan") return scan(parser, args[1]);
+    parser.showHelp(1);
+}